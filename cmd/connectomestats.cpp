@@ -263,14 +263,8 @@ void run()
   // For compatibility with existing statistics code, symmetric matrix data is adjusted
   //   into vector form - one row per edge in the symmetric connectome. This has already
   //   been performed when the CohortDataImport class is initialised.
-  matrix_type data (importer.size(), num_edges);
-  {
-    ProgressBar progress ("Agglomerating input connectome data", importer.size());
-    for (size_t subject = 0; subject < importer.size(); subject++) {
-      (*importer[subject]) (data.row (subject));
-      ++progress;
-    }
-  }
+  Math::Stats::Measurements data (importer.size(), num_edges, get_options ("float32").size());
+  data.load (importer, "Agglomerating input connectome data");
   const bool nans_in_data = !data.allFinite();
 
   // Only add contrast matrix row number to image outputs if there's more than one hypothesis
@@ -366,7 +360,7 @@ void run()
       for (size_t i = 0; i != num_hypotheses; ++i)
         save_vector (null_distribution.col(i), output_prefix + "null_dist" + postfix(i) + ".txt");
     }
-    const matrix_type pvalue_output = MR::Math::Stats::fwe_pvalue (null_distribution, default_enhanced);
+    const matrix_type pvalue_output = MR::Math::Stats::fwe_pvalue (null_distribution, default_enhanced, get_options ("fwe_tail").size());
     for (size_t i = 0; i != num_hypotheses; ++i) {
       save_matrix (mat2vec.V2M (pvalue_output.col(i)),       output_prefix + "fwe_1mpvalue" + postfix(i) + ".csv");
       save_matrix (mat2vec.V2M (uncorrected_pvalues.col(i)), output_prefix + "uncorrected_1mpvalue" + postfix(i) + ".csv");
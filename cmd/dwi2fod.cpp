@@ -56,7 +56,15 @@ OptionGroup CommonOptions = OptionGroup ("Options common to more than one algori
 
     + Option ("mask",
               "only perform computation within the specified binary brain mask image.")
-      + Argument ("image").type_image_in();
+      + Argument ("image").type_image_in()
+
+    + Option ("block",
+              "process the image one row of voxels at a time, computing the projections of "
+              "the data for all voxels in the row as matrix-matrix products, and initialising "
+              "the constrained fit in each voxel from the active constraints of the preceding "
+              "voxel. This is typically considerably faster; minor differences in output may "
+              "arise due to the different initialisation, for the csd algorithm in particular, "
+              "and for the msmt_csd algorithm in voxels where the constrained fit is degenerate.");
 
 void usage ()
 {
@@ -147,7 +155,7 @@ class CSD_Processor { MEMALIGN(CSD_Processor)
     }
 
 
-  private:
+  protected:
     DWI::SDeconv::CSD sdeconv;
     Eigen::VectorXd data;
     Image<bool> mask;
@@ -178,6 +186,73 @@ class CSD_Processor { MEMALIGN(CSD_Processor)
 
 
 
+// Processes one row of voxels along the inner loop axis per invocation:
+//   the data projections required by CSD are computed for all voxels in the
+//   row at once, and the solution in each voxel is initialised from the set
+//   of negative amplitudes found for the preceding voxel in the row
+class CSD_BlockProcessor : public CSD_Processor { MEMALIGN(CSD_BlockProcessor)
+  public:
+    CSD_BlockProcessor (const DWI::SDeconv::CSD::Shared& shared, Image<bool>& mask,
+                        Image<float>& dwi, Image<float>& fod,
+                        const vector<size_t>& outer_axes, const size_t axis) :
+      CSD_Processor (shared, mask),
+      dwi (dwi),
+      fod (fod),
+      outer_axes (outer_axes),
+      axis (axis),
+      block (shared.dwis.size(), dwi.size (axis)),
+      valid (dwi.size (axis)) { }
+
+
+    void operator() (const Iterator& pos) {
+      assign_pos_of (pos, outer_axes).to (dwi, fod);
+
+      ssize_t count = 0;
+      for (auto l = Loop (axis) (dwi); l; ++l) {
+        valid[dwi.index (axis)] = load_data (dwi);
+        if (valid[dwi.index (axis)])
+          block.col (count++) = data;
+      }
+
+      init.noalias() = sdeconv.shared.rconv * block.leftCols (count);
+      Mt_b.noalias() = sdeconv.shared.M.transpose() * block.leftCols (count);
+
+      ssize_t i = 0;
+      for (auto l = Loop (axis) (fod); l; ++l) {
+        if (!valid[fod.index (axis)]) {
+          for (auto v = Loop (3) (fod); v; ++v)
+            fod.value() = 0.0;
+          continue;
+        }
+
+        sdeconv.set (init.col (i), Mt_b.col (i), i > 0);
+        ++i;
+
+        size_t n;
+        for (n = 0; n < sdeconv.shared.niter; n++)
+          if (sdeconv.iterate())
+            break;
+
+        if (sdeconv.shared.niter && n >= sdeconv.shared.niter)
+          INFO ("voxel [ " + str (fod.index(0)) + " " + str (fod.index(1)) + " " + str (fod.index(2)) +
+              " ] did not reach full convergence");
+
+        fod.row(3) = sdeconv.FOD();
+      }
+    }
+
+
+  private:
+    Image<float> dwi, fod;
+    const vector<size_t> outer_axes;
+    const size_t axis;
+    Eigen::MatrixXd block, init, Mt_b;
+    vector<bool> valid;
+};
+
+
+
+
 class MSMT_Processor { MEMALIGN (MSMT_Processor)
   public:
     MSMT_Processor (const DWI::SDeconv::MSMT_CSD::Shared& shared, Image<bool>& mask_image,
@@ -221,7 +296,7 @@ class MSMT_Processor { MEMALIGN (MSMT_Processor)
     }
 
 
-  private:
+  protected:
     DWI::SDeconv::MSMT_CSD sdeconv;
     Image<bool> mask_image;
     vector< Image<float> > odf_images;
@@ -233,6 +308,76 @@ class MSMT_Processor { MEMALIGN (MSMT_Processor)
 
 
 
+// Processes one row of voxels along the inner loop axis per invocation:
+//   the unconstrained solutions are computed for all voxels in the row at
+//   once, and the solver in each voxel is initialised from the active
+//   constraints of the preceding voxel in the row
+class MSMT_BlockProcessor : public MSMT_Processor { MEMALIGN (MSMT_BlockProcessor)
+  public:
+    MSMT_BlockProcessor (const DWI::SDeconv::MSMT_CSD::Shared& shared, Image<bool>& mask_image,
+      vector< Image<float> > odf_images, Image<float> dwi_modelled,
+      Image<float>& dwi_image, const vector<size_t>& outer_axes, const size_t axis) :
+        MSMT_Processor (shared, mask_image, odf_images, dwi_modelled),
+        dwi_image (dwi_image),
+        outer_axes (outer_axes),
+        axis (axis),
+        block (shared.grad.rows(), dwi_image.size (axis)) { }
+
+
+    void operator() (const Iterator& pos)
+    {
+      assign_pos_of (pos, outer_axes).to (dwi_image);
+
+      voxels.clear();
+      for (auto l = Loop (axis) (dwi_image); l; ++l) {
+        if (mask_image.valid()) {
+          assign_pos_of (dwi_image, 0, 3).to (mask_image);
+          if (!mask_image.value())
+            continue;
+        }
+        block.col (voxels.size()) = dwi_image.row(3);
+        voxels.push_back (dwi_image.index (axis));
+      }
+      if (voxels.empty())
+        return;
+
+      sdeconv (block.leftCols (voxels.size()), output_block, niters);
+
+      for (size_t v = 0; v != voxels.size(); ++v) {
+        dwi_image.index (axis) = voxels[v];
+        if (niters[v] >= sdeconv.shared.problem.max_niter) {
+          INFO ("voxel [ " + str (dwi_image.index(0)) + " " + str (dwi_image.index(1)) + " " + str (dwi_image.index(2)) +
+              " ] did not reach full convergence");
+        }
+
+        size_t j = 0;
+        for (size_t i = 0; i < odf_images.size(); ++i) {
+          assign_pos_of (dwi_image, 0, 3).to (odf_images[i]);
+          for (auto l = Loop(3)(odf_images[i]); l; ++l)
+            odf_images[i].value() = output_block (j++, v);
+        }
+
+        if (modelled_image.valid()) {
+          assign_pos_of (dwi_image, 0, 3).to (modelled_image);
+          dwi_data = sdeconv.shared.problem.H * output_block.col (v);
+          modelled_image.row(3) = dwi_data;
+        }
+      }
+    }
+
+
+  private:
+    Image<float> dwi_image;
+    const vector<size_t> outer_axes;
+    const size_t axis;
+    Eigen::MatrixXd block, output_block;
+    vector<size_t> niters;
+    vector<ssize_t> voxels;
+};
+
+
+
+
 
 
 
@@ -275,10 +420,14 @@ void run ()
     header_out.size(3) = shared.nSH();
     auto fod = Image<float>::create (argument[3], header_out);
 
-    CSD_Processor processor (shared, mask);
     auto dwi = header_in.get_image<float>().with_direct_io (3);
-    ThreadedLoop ("performing constrained spherical deconvolution", dwi, 0, 3)
-        .run (processor, dwi, fod);
+    auto loop = ThreadedLoop ("performing constrained spherical deconvolution", dwi, 0, 3);
+    if (get_options ("block").size()) {
+      loop.run_outer (CSD_BlockProcessor (shared, mask, dwi, fod, loop.outer_loop.axes, loop.inner_axes[0]));
+    } else {
+      CSD_Processor processor (shared, mask);
+      loop.run (processor, dwi, fod);
+    }
 
   } else if (algorithm == 1) {
 
@@ -317,13 +466,17 @@ void run ()
     if (opt.size())
       dwi_modelled = Image<float>::create (opt[0][0], header_in);
 
-    MSMT_Processor processor (shared, mask, odfs, dwi_modelled);
     auto dwi = header_in.get_image<float>().with_direct_io (3);
-    ThreadedLoop ("performing MSMT CSD ("
-                  + str(shared.num_shells()) + " shell" + (shared.num_shells() > 1 ? "s" : "") + ", "
-                  + str(num_tissues) + " tissue" + (num_tissues > 1 ? "s" : "") + ")",
-                  dwi, 0, 3)
-        .run (processor, dwi);
+    auto loop = ThreadedLoop ("performing MSMT CSD ("
+                              + str(shared.num_shells()) + " shell" + (shared.num_shells() > 1 ? "s" : "") + ", "
+                              + str(num_tissues) + " tissue" + (num_tissues > 1 ? "s" : "") + ")",
+                              dwi, 0, 3);
+    if (get_options ("block").size()) {
+      loop.run_outer (MSMT_BlockProcessor (shared, mask, odfs, dwi_modelled, dwi, loop.outer_loop.axes, loop.inner_axes[0]));
+    } else {
+      MSMT_Processor processor (shared, mask, odfs, dwi_modelled);
+      loop.run (processor, dwi);
+    }
 
   } else {
     assert (0);
@@ -26,6 +26,7 @@
 #include "fixel/loop.h"
 #include "fixel/types.h"
 #include "fixel/filter/smooth.h"
+#include "formats/list.h"
 #include "math/stats/fwe.h"
 #include "math/stats/glm.h"
 #include "math/stats/import.h"
@@ -95,7 +96,8 @@ void usage ()
   + Argument ("in_fixel_directory", "the fixel directory containing the data files for each subject (after obtaining fixel correspondence").type_directory_in()
 
   + Argument ("subjects", "a text file listing the subject identifiers (one per line). This should correspond with the filenames "
-                          "in the fixel directory (including the file extension), and be listed in the same order as the rows of the design matrix.").type_image_in ()
+                          "in the fixel directory (including the file extension), and be listed in the same order as the rows of the design matrix. "
+                          "Alternatively, a packed fixel data store generated by the fixelpack command.").type_image_in ()
 
   + Argument ("design", "the design matrix").type_file_in ()
 
@@ -131,6 +133,11 @@ void usage ()
 
   + Option ("cfe_legacy", "use the legacy (non-normalised) form of the cfe equation")
 
+  + Option ("cfe_quantise", "store fixel-fixel connectivity values in memory as 16-bit integers "
+                            "rather than 32-bit floating-point, reducing the RAM required at the "
+                            "expense of a small loss of precision "
+                            "(this is done automatically if the matrix would otherwise exceed the -memory_limit)")
+
   + Math::Stats::GLM::glm_options ("fixel");
 
 }
@@ -152,14 +159,15 @@ void write_fixel_output (const std::string& filename,
 
 // Define data importer class that will obtain fixel data for a
 //   specific subject based on the string path to the image file for
-//   that subject
+//   that subject, or from one column of a packed fixel data store
 class SubjectFixelImport : public Math::Stats::SubjectDataImportBase
 { MEMALIGN(SubjectFixelImport)
   public:
     SubjectFixelImport (const std::string& path) :
         Math::Stats::SubjectDataImportBase (path),
         H (Header::open (path)),
-        data (H.get_image<float>())
+        data (H.get_image<float>()),
+        column (0)
     {
       for (size_t axis = 1; axis < data.ndim(); ++axis) {
         if (data.size(axis) > 1)
@@ -167,9 +175,24 @@ class SubjectFixelImport : public Math::Stats::SubjectDataImportBase
       }
     }
 
+    SubjectFixelImport (const Image<float>& store, const size_t column, const std::string& name) :
+        Math::Stats::SubjectDataImportBase (name),
+        H (store),
+        data (store),
+        column (column)
+    {
+      assert (column < size_t(store.size(1)));
+      H.size(1) = 1;
+      H.stride(0) = 1;
+      H.stride(1) = 2;
+      H.stride(2) = 3;
+      H.keyval().erase (Fixel::packed_subjects_key);
+    }
+
     void operator() (matrix_type::RowXpr row) const override
     {
       Image<float> temp (data); // For thread-safety
+      temp.index(1) = column;
       for (temp.index(0) = 0; temp.index(0) != temp.size(0); ++temp.index(0))
         row [temp.index(0)] = temp.value();
     }
@@ -178,6 +201,7 @@ class SubjectFixelImport : public Math::Stats::SubjectDataImportBase
     {
       Image<float> temp (data); // For thread-safety
       temp.index(0) = index;
+      temp.index(1) = column;
       assert (!is_out_of_bounds (temp));
       return default_type(temp.value());
     }
@@ -191,11 +215,34 @@ class SubjectFixelImport : public Math::Stats::SubjectDataImportBase
   private:
     Header H;
     Image<float> data; // May be mapped input file, or scratch smoothed data
+    const size_t column;
 
 };
 
 
 
+// Open the subjects input as a packed fixel data store if it is one;
+//   otherwise it is expected to be a text file listing fixel data files
+Image<float> open_packed_store (const std::string& path)
+{
+  // A list of subject data files is a text file, and so will not possess an image file extension
+  bool is_image = false;
+  for (auto p = Formats::known_extensions; *p; ++p) {
+    if (Path::has_suffix (path, std::string (*p))) {
+      is_image = true;
+      break;
+    }
+  }
+  if (!is_image)
+    return Image<float>();
+  Header H = Header::open (path);
+  if (!Fixel::is_packed_store (H))
+    throw Exception ("Image \"" + path + "\" is not a packed fixel data store (as generated by the fixelpack command)");
+  return H.get_image<float>();
+}
+
+
+
 
 void run()
 {
@@ -210,6 +257,7 @@ void run()
   const value_type cfe_e = get_option_value ("cfe_e", DEFAULT_CFE_E);
   const value_type cfe_c = get_option_value ("cfe_c", DEFAULT_CFE_C);
   const bool cfe_legacy = get_options ("cfe_legacy").size();
+  const bool cfe_quantise = get_options ("cfe_quantise").size();
 
   const bool do_nonstationarity_adjustment = get_options ("nonstationarity").size();
   const default_type empirical_skew = get_option_value ("skew_nonstationarity", DEFAULT_EMPIRICAL_SKEW);
@@ -246,7 +294,14 @@ void run()
   // Read file names and check files exist
   // Preference for finding files relative to input template fixel directory
   Math::Stats::CohortDataImport importer;
-  importer.initialise<SubjectFixelImport> (argument[1], input_fixel_directory);
+  Image<float> packed_data = open_packed_store (argument[1]);
+  if (packed_data.valid()) {
+    const vector<std::string> subjects = Fixel::packed_store_subjects (packed_data);
+    for (size_t i = 0; i != subjects.size(); ++i)
+      importer.add (std::make_shared<SubjectFixelImport> (packed_data, i, subjects[i]));
+  } else {
+    importer.initialise<SubjectFixelImport> (argument[1], input_fixel_directory);
+  }
   for (size_t i = 0; i != importer.size(); ++i) {
     if (!Fixel::fixels_match (index_header, dynamic_cast<SubjectFixelImport*>(importer[i].get())->header()))
       throw Exception ("Fixel data file \"" + importer[i]->name() + "\" does not match template fixel image");
@@ -343,22 +398,19 @@ void run()
   output_header.keyval()["cfe_c"] = str(cfe_c);
   output_header.keyval()["cfe_legacy"] = str(cfe_legacy);
 
-  matrix_type data = matrix_type::Zero (importer.size(), num_fixels);
-  {
-    ProgressBar progress (std::string ("Loading fixel data (no smoothing)"), importer.size());
-    for (size_t subject = 0; subject != importer.size(); subject++) {
-      (*importer[subject]) (data.row (subject));
-      progress++;
-    }
-  }
+  Math::Stats::Measurements data (importer.size(), num_fixels, get_options ("float32").size());
+  if (packed_data.valid())
+    data.load (packed_data, "Loading fixel data from packed store (no smoothing)");
+  else
+    data.load (importer, "Loading fixel data (no smoothing)");
   // Detect non-finite values in mask fixels only; NaN-fill other fixels
   bool nans_in_data = false;
   for (auto l = Loop(0) (mask); l; ++l) {
     if (mask.value()) {
-      if (!data.col (mask.index(0)).allFinite())
+      if (!data.allFinite (mask.index(0)))
         nans_in_data = true;
     } else {
-      data.col (mask.index (0)).fill (NaN);
+      data.fill (mask.index (0), NaN);
     }
   }
   if (nans_in_data) {
@@ -427,7 +479,7 @@ void run()
   }
 
   // Construct the class for performing fixel-based statistical enhancement
-  std::shared_ptr<Stats::EnhancerBase> cfe_integrator (new Stats::CFE (matrix, cfe_dh, cfe_e, cfe_h, cfe_c, !cfe_legacy));
+  std::shared_ptr<Stats::EnhancerBase> cfe_integrator (new Stats::CFE (matrix, cfe_dh, cfe_e, cfe_h, cfe_c, !cfe_legacy, cfe_quantise));
 
   // If performing non-stationarity adjustment we need to pre-compute the empirical CFE statistic
   matrix_type empirical_cfe_statistic;
@@ -474,7 +526,7 @@ void run()
       }
     }
 
-    const matrix_type pvalue_output = MR::Math::Stats::fwe_pvalue (null_distribution, default_enhanced);
+    const matrix_type pvalue_output = MR::Math::Stats::fwe_pvalue (null_distribution, default_enhanced, get_options ("fwe_tail").size());
     ++progress;
     for (size_t i = 0; i != num_hypotheses; ++i) {
       write_fixel_output (Path::join (output_fixel_directory, "fwe_1mpvalue" + postfix(i) + ".mif"), pvalue_output.col(i), mask, output_header);
@@ -57,7 +57,12 @@ void usage ()
     + Argument ("value").type_float (0.0, 90.0)
 
   + Option ("mask", "provide a fixel data file containing a mask of those fixels to be computed; fixels outside the mask will be empty in the output matrix")
-    + Argument ("file").type_image_in();
+    + Argument ("file").type_image_in()
+
+  + Option ("passes", "generate the matrix in multiple passes, each computing the connectivity of a subset of fixels; "
+                      "the fixels traversed by each streamline are stored in a temporary file, which is re-read in each pass. "
+                      "This reduces the peak memory usage by approximately a factor of the number of passes (default: 1)")
+    + Argument ("number").type_integer (1);
 
 }
 
@@ -93,14 +98,13 @@ void run()
       fixel_mask.value() = true;
   }
 
-  auto connectivity_matrix = Fixel::Matrix::generate (argument[1],
-                                                      index_image,
-                                                      fixel_mask,
-                                                      angular_threshold);
-
-  Fixel::Matrix::normalise_and_write (connectivity_matrix,
-                                      connectivity_threshold,
-                                      argument[2]);
+  Fixel::Matrix::generate_and_write (argument[1],
+                                     index_image,
+                                     fixel_mask,
+                                     angular_threshold,
+                                     connectivity_threshold,
+                                     argument[2],
+                                     get_option_value ("passes", 1));
 
 }
 
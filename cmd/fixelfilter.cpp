@@ -171,6 +171,30 @@ void run()
     auto output_image = Image<float>::create (argument[2], single_file);
     CONSOLE (std::string ("Applying \"") + filters[argument[1]] + "\" operation to fixel data file \"" + single_file.name() + "\"");
     (*filter) (single_file, output_image);
+  } else if (int(argument[1]) == 1) {
+    // Smooth all fixel data files together, so that the smoothing kernel
+    //   only needs to be computed and traversed once
+    Fixel::copy_index_and_directions_file (argument[0], argument[2]);
+    Fixel::Filter::Smooth::data_matrix_type data (multiple_files[0].size(0), multiple_files.size());
+    {
+      ProgressBar progress ("Loading " + str(multiple_files.size()) + " fixel data files", multiple_files.size());
+      for (size_t i = 0; i != multiple_files.size(); ++i) {
+        auto input_image = multiple_files[i].get_image<float>();
+        for (auto l = Loop(0) (input_image); l; ++l)
+          data(ssize_t(input_image.index(0)), i) = input_image.value();
+        ++progress;
+      }
+    }
+    Fixel::Filter::Smooth::data_matrix_type smoothed;
+    CONSOLE ("Applying \"smooth\" operation to " + str(multiple_files.size()) + " fixel data files");
+    (*dynamic_cast<Fixel::Filter::Smooth*> (filter.get())) (data, smoothed);
+    ProgressBar progress ("Writing " + str(multiple_files.size()) + " smoothed fixel data files", multiple_files.size());
+    for (size_t i = 0; i != multiple_files.size(); ++i) {
+      auto output_image = Image<float>::create (Path::join (argument[2], Path::basename (multiple_files[i].name())), multiple_files[i]);
+      for (auto l = Loop(0) (output_image); l; ++l)
+        output_image.value() = smoothed(ssize_t(output_image.index(0)), i);
+      ++progress;
+    }
   } else {
     Fixel::copy_index_and_directions_file (argument[0], argument[2]);
     ProgressBar progress (std::string ("Applying \"") + filters[argument[1]] + "\" operation to " + str(multiple_files.size()) + " fixel data files",
@@ -0,0 +1,98 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include "command.h"
+#include "header.h"
+#include "image.h"
+#include "progressbar.h"
+#include "algo/loop.h"
+#include "file/path.h"
+
+#include "fixel/helpers.h"
+#include "fixel/keys.h"
+
+using namespace MR;
+using namespace App;
+
+
+void usage ()
+{
+  AUTHOR = "Robert E. Smith (robert.smith@florey.edu.au)";
+
+  SYNOPSIS = "Pack the fixel data files of many subjects into a single packed fixel data store";
+
+  DESCRIPTION
+  + "The packed store is a single image of size (fixels x subjects x 1), in which the data of all "
+    "subjects for each fixel are stored contiguously; the name of the data file from which each "
+    "column was derived is recorded in the image header. Provided that the output is an uncompressed "
+    ".mif file, it can be memory-mapped, and any contiguous range of fixels read for all subjects at "
+    "once, without opening a separate file for each subject."
+
+  + "The packed store can be provided to fixelcfestats in place of the subject list text file; "
+    "the fixelunpack command performs the reverse operation."
+
+  + "The subject list text file is interpreted in the same way as for fixelcfestats, with file "
+    "names provided relative to the input fixel directory. The output file should not be "
+    "placed within a fixel directory, as it is not itself a valid fixel data file.";
+
+  ARGUMENTS
+  + Argument ("in_fixel_directory", "the fixel directory containing the data files for each subject").type_directory_in()
+  + Argument ("subjects", "a text file listing the subject data files (one per line), relative to the fixel directory").type_file_in()
+  + Argument ("output", "the output packed fixel data store").type_image_out();
+}
+
+
+
+void run ()
+{
+  const std::string fixel_directory = argument[0];
+  Header index_header = Fixel::find_index_header (fixel_directory);
+
+  vector<std::string> subjects;
+  {
+    std::ifstream ifs (std::string(argument[1]).c_str());
+    if (!ifs)
+      throw Exception ("Unable to open subject file list \"" + std::string(argument[1]) + "\"");
+    std::string line;
+    while (getline (ifs, line)) {
+      line = strip (line);
+      if (line.size())
+        subjects.push_back (line);
+    }
+  }
+  if (subjects.empty())
+    throw Exception ("No subjects listed in file \"" + std::string(argument[1]) + "\"");
+
+  vector<Header> headers;
+  for (const auto& subject : subjects) {
+    headers.push_back (Header::open (Path::join (fixel_directory, subject)));
+    Fixel::check_data_file (headers.back());
+    if (headers.back().size(1) != 1)
+      throw Exception ("Fixel data file \"" + headers.back().name() + "\" contains more than one value per fixel");
+    if (!Fixel::fixels_match (index_header, headers.back()))
+      throw Exception ("Fixel data file \"" + headers.back().name() + "\" does not match fixel directory");
+  }
+
+  auto output = Image<float>::create (argument[2], Fixel::packed_store_header (headers[0], subjects));
+  ProgressBar progress ("Packing data from " + str(subjects.size()) + " fixel data files", subjects.size());
+  for (size_t i = 0; i != headers.size(); ++i) {
+    auto input = headers[i].get_image<float>();
+    output.index(1) = i;
+    for (auto l = Loop (0) (input, output); l; ++l)
+      output.value() = input.value();
+    ++progress;
+  }
+}
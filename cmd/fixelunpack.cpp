@@ -0,0 +1,92 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include "command.h"
+#include "header.h"
+#include "image.h"
+#include "progressbar.h"
+#include "algo/loop.h"
+#include "file/path.h"
+
+#include "fixel/helpers.h"
+#include "fixel/keys.h"
+
+using namespace MR;
+using namespace App;
+
+
+void usage ()
+{
+  AUTHOR = "Robert E. Smith (robert.smith@florey.edu.au)";
+
+  SYNOPSIS = "Unpack a packed fixel data store into individual fixel data files";
+
+  DESCRIPTION
+  + "This command reverses the operation of the fixelpack command: one fixel data file is "
+    "written for each column of the packed store, using the file name from which that column "
+    "was originally derived."
+
+  + "The fixel index and directions images are copied from the input fixel directory into the "
+    "output fixel directory. If the input and output directories are the same, the data files "
+    "are written into the existing directory (providing the -force option is supplied).";
+
+  ARGUMENTS
+  + Argument ("input", "the input packed fixel data store").type_image_in()
+  + Argument ("in_fixel_directory", "the fixel directory containing the fixel index and directions images "
+                                    "to which the packed data correspond").type_directory_in()
+  + Argument ("out_fixel_directory", "the fixel directory into which the data files will be written").type_directory_out();
+}
+
+
+
+void run ()
+{
+  auto input = Image<float>::open (argument[0]);
+  const vector<std::string> subjects = Fixel::packed_store_subjects (input);
+
+  const std::string input_fixel_directory = argument[1];
+  Fixel::check_fixel_directory (input_fixel_directory);
+  Header index_header = Fixel::find_index_header (input_fixel_directory);
+  if (!Fixel::fixels_match (index_header, input))
+    throw Exception ("Packed fixel data store \"" + input.name() + "\" does not match fixel directory \"" + input_fixel_directory + "\"");
+
+  std::set<std::string> output_names;
+  for (const auto& subject : subjects) {
+    if (!output_names.insert (Path::basename (subject)).second)
+      throw Exception ("Packed fixel data store contains more than one subject with file name \"" + Path::basename (subject) + "\"");
+  }
+
+  Header output_header (input);
+  output_header.size(1) = 1;
+  output_header.stride(0) = 1;
+  output_header.stride(1) = 2;
+  output_header.stride(2) = 3;
+  output_header.keyval().erase (Fixel::packed_subjects_key);
+
+  const std::string output_fixel_directory = argument[2];
+  Fixel::copy_index_and_directions_file (input_fixel_directory, output_fixel_directory);
+
+  ProgressBar progress ("Unpacking " + str(subjects.size()) + " fixel data files", subjects.size());
+  for (size_t i = 0; i != subjects.size(); ++i) {
+    auto output = Image<float>::create (Path::join (output_fixel_directory, Path::basename (subjects[i])), output_header);
+    input.index(1) = i;
+    for (auto l = Loop (0) (output); l; ++l) {
+      input.index(0) = output.index(0);
+      output.value() = input.value();
+    }
+    ++progress;
+  }
+}
@@ -251,15 +251,8 @@ void run() {
                      + (extra_columns.size() ? " (taking into account the " + str(extra_columns.size()) + " uses of -column)" : ""));
   CONSOLE ("Number of hypotheses: " + str(num_hypotheses));
 
-  matrix_type data (importer.size(), num_voxels);
-  {
-    // Load images
-    ProgressBar progress ("loading input images", importer.size());
-    for (size_t subject = 0; subject < importer.size(); subject++) {
-      (*importer[subject]) (data.row (subject));
-      progress++;
-    }
-  }
+  Math::Stats::Measurements data (importer.size(), num_voxels, get_options ("float32").size());
+  data.load (importer, "loading input images");
   const bool nans_in_data = !data.allFinite();
   if (nans_in_data) {
     INFO ("Non-finite values present in data; rows will be removed from voxel-wise design matrices accordingly");
@@ -391,7 +384,7 @@ void run() {
       }
     }
 
-    const matrix_type fwe_pvalue_output = MR::Math::Stats::fwe_pvalue (null_distribution, default_enhanced);
+    const matrix_type fwe_pvalue_output = MR::Math::Stats::fwe_pvalue (null_distribution, default_enhanced, get_options ("fwe_tail").size());
     ++progress;
     for (size_t i = 0; i != num_hypotheses; ++i) {
       write_output (fwe_pvalue_output.col(i), *v2v, prefix + "fwe_1mpvalue" + postfix(i) + ".mif", output_header);
@@ -171,6 +171,17 @@ void usage ()
         "Use -from 1 to warp from image1 or -from 2 to warp from image2")
     +   Argument ("image").type_integer (1,2)
 
+    + Option ("batch",
+        "apply the same non-linear transformation to an additional input image, writing the result to the "
+        "specified output image. This option can be specified multiple times. All images are then resampled "
+        "in a single multi-threaded pass, such that the deformation field (and its Jacobian, where required) "
+        "is evaluated only once per output voxel. Each image is treated according to its own number of volumes: "
+        "FOD reorientation, if requested, is applied to each image whose number of volumes corresponds to a SH series, "
+        "and the -reorient_fod option must be specified if any image has such a number of volumes. "
+        "Only valid with the -warp or -warp_full options.").allow_multiple()
+    +   Argument ("input").type_image_in ()
+    +   Argument ("output").type_image_out ()
+
     + OptionGroup ("Fibre orientation distribution handling options")
 
     + Option ("modulate",
@@ -207,6 +218,13 @@ void usage ()
     + Option ("no_reorientation", "deprecated, use -reorient_fod instead");
 }
 
+
+bool is_possible_fod (const Header& header)
+{
+  return header.ndim() == 4 && header.size(3) >= 6 &&
+      header.size(3) == (int) Math::SH::NforL (Math::SH::LforN (header.size(3)));
+}
+
 void apply_warp (Image<float>& input, Image<float>& output, Image<default_type>& warp,
   const int interp, const float out_of_bounds_value, const vector<uint32_t>& oversample, const bool jacobian_modulate = false) {
   switch (interp) {
@@ -228,6 +246,125 @@ void apply_warp (Image<float>& input, Image<float>& output, Image<default_type>&
   }
 }
 
+// Resample several images through the same deformation field (provided on
+// the output grid) in a single pass, evaluating the deformation and its
+// Jacobian only once per output voxel
+template <template <class ImageType> class Interpolator>
+class BatchWarpKernel { MEMALIGN(BatchWarpKernel<Interpolator>)
+  public:
+    using InterpType = Interpolator<Image<float>>;
+    using ReorientType = Registration::Transform::NonLinearKernel<Image<float>, Image<default_type>>;
+
+    BatchWarpKernel (vector<Image<float>>& inputs, vector<Image<float>>& outputs, Image<default_type>& deform,
+                     const float out_of_bounds_value, const bool jacobian_modulate,
+                     const vector<bool>& reorient, const Eigen::MatrixXd& directions, const bool modulate_fod) :
+        outputs (outputs),
+        deform (deform),
+        jacobian (deform, true),
+        out_of_bounds_value (out_of_bounds_value),
+        jacobian_modulate (jacobian_modulate)
+    {
+      for (size_t n = 0; n != inputs.size(); ++n) {
+        interps.emplace_back (new InterpType (inputs[n], out_of_bounds_value));
+        reorient_kernels.emplace_back (reorient[n] ? new ReorientType (inputs[n].size(3), deform, directions, modulate_fod) : nullptr);
+      }
+    }
+
+    BatchWarpKernel (const BatchWarpKernel& that) :
+        outputs (that.outputs),
+        deform (that.deform),
+        jacobian (that.jacobian),
+        out_of_bounds_value (that.out_of_bounds_value),
+        jacobian_modulate (that.jacobian_modulate)
+    {
+      for (size_t n = 0; n != that.interps.size(); ++n) {
+        interps.emplace_back (new InterpType (*that.interps[n]));
+        reorient_kernels.emplace_back (that.reorient_kernels[n] ? new ReorientType (*that.reorient_kernels[n]) : nullptr);
+      }
+    }
+
+    void operator() (const Iterator& pos) {
+      assign_pos_of (pos, 0, 3).to (deform);
+      const Eigen::Vector3d position = deform.row(3);
+      const bool valid_position = !(std::isnan (position[0]) || std::isnan (position[1]) || std::isnan (position[2]));
+      default_type scale = 1.0;
+      if (jacobian_modulate && valid_position) {
+        assign_pos_of (pos, 0, 3).to (jacobian);
+        scale = jacobian.value().template cast<default_type>().determinant();
+      }
+
+      for (size_t n = 0; n != outputs.size(); ++n) {
+        auto& output (outputs[n]);
+        auto& interp (*interps[n]);
+        assign_pos_of (pos, 0, 3).to (output);
+        if (valid_position)
+          interp.scanner (position);
+        const ssize_t nvols = output.ndim() > 3 ? output.size(3) : 1;
+        for (ssize_t volume = 0; volume != nvols; ++volume) {
+          if (output.ndim() > 3)
+            interp.index(3) = output.index(3) = volume;
+          default_type value = out_of_bounds_value;
+          if (valid_position) {
+            value = interp.value();
+            if (jacobian_modulate && value != 0.0)
+              value *= scale;
+          }
+          output.value() = value;
+        }
+        if (reorient_kernels[n])
+          (*reorient_kernels[n]) (output);
+      }
+    }
+
+  private:
+    vector<Image<float>> outputs;
+    Image<default_type> deform;
+    Adapter::Jacobian<Image<default_type>> jacobian;
+    const float out_of_bounds_value;
+    const bool jacobian_modulate;
+    vector<std::unique_ptr<InterpType>> interps;
+    vector<std::unique_ptr<ReorientType>> reorient_kernels;
+};
+
+
+
+void apply_warp_batch (vector<Image<float>>& inputs, vector<Image<float>>& outputs, Image<default_type>& warp,
+  const int interp, const float out_of_bounds_value, const vector<uint32_t>& oversample, const bool jacobian_modulate,
+  const vector<bool>& reorient, const Eigen::MatrixXd& directions, const bool modulate_fod) {
+
+  // reslice warp onto output grid
+  Image<default_type> deform (warp);
+  if (warp.transform().matrix() != outputs[0].transform().matrix() ||
+      !dimensions_match (warp, outputs[0], 0, 3) ||
+      !spacings_match (warp, outputs[0], 0, 3)) {
+    Header header (outputs[0]);
+    header.ndim() = 4;
+    header.size(3) = 3;
+    Stride::set (header, Stride::contiguous_along_axis (3, header));
+    deform = Image<default_type>::scratch (header);
+    Filter::reslice<Interp::Cubic> (warp, deform, Adapter::NoTransform, oversample);
+  }
+
+  const std::string message = "warping " + str(inputs.size()) + " images";
+  switch (interp) {
+  case 0:
+    ThreadedLoop (message, outputs[0], 0, 3).run (BatchWarpKernel<Interp::Nearest> (inputs, outputs, deform, out_of_bounds_value, jacobian_modulate, reorient, directions, modulate_fod));
+    break;
+  case 1:
+    ThreadedLoop (message, outputs[0], 0, 3).run (BatchWarpKernel<Interp::Linear> (inputs, outputs, deform, out_of_bounds_value, jacobian_modulate, reorient, directions, modulate_fod));
+    break;
+  case 2:
+    ThreadedLoop (message, outputs[0], 0, 3).run (BatchWarpKernel<Interp::Cubic> (inputs, outputs, deform, out_of_bounds_value, jacobian_modulate, reorient, directions, modulate_fod));
+    break;
+  case 3:
+    ThreadedLoop (message, outputs[0], 0, 3).run (BatchWarpKernel<Interp::Sinc> (inputs, outputs, deform, out_of_bounds_value, jacobian_modulate, reorient, directions, modulate_fod));
+    break;
+  default:
+    assert (0);
+    break;
+  }
+}
+
 void apply_linear_jacobian (Image<float> & image, transform_type trafo) {
   const float det = trafo.linear().topLeftCorner<3,3>().determinant();
   INFO("global intensity modulation with scale factor " + str(det));
@@ -331,6 +468,10 @@ void run ()
       throw Exception ("the input -warp file must have 3 volumes in the 4th dimension (x,y,z positions)");
   }
 
+  const auto batch = get_options ("batch");
+  if (batch.size() && !warp.valid())
+    throw Exception ("the -batch option can only be used in combination with the -warp or -warp_full options");
+
   // Inverse
   const bool inverse = get_options ("inverse").size();
   if (inverse) {
@@ -382,23 +523,39 @@ void run ()
   Stride::List stride = Stride::get (input_header);
 
   // Detect FOD image
-  bool is_possible_fod_image = input_header.ndim() == 4 && input_header.size(3) >= 6 &&
-   input_header.size(3) == (int) Math::SH::NforL (Math::SH::LforN (input_header.size(3)));
+  bool is_possible_fod_image = is_possible_fod (input_header);
 
 
   // reorientation
   if (get_options ("no_reorientation").size())
     throw Exception ("The -no_reorientation option is deprecated. Use -reorient_fod no instead.");
   opt = get_options ("reorient_fod");
-  bool fod_reorientation = opt.size() && bool(opt[0][0]);
+  const bool reorient_fod_requested = opt.size() && bool(opt[0][0]);
+
+  // Each -batch image is judged from its own header, by the same rules as the input image
+  vector<Header> batch_headers;
+  vector<bool> batch_fod;
+  for (const auto& entry : batch) {
+    batch_headers.push_back (Header::open (entry[0]));
+    const Header& H (batch_headers.back());
+    if (H.ndim() > 4)
+      throw Exception ("-batch input image \"" + H.name() + "\" has more than 4 dimensions");
+    if (is_possible_fod (H) && !opt.size())
+      throw Exception ("-reorient_fod yes/no needs to be explicitly specified for images with " +
+        str(H.size(3)) + " volumes (-batch input image \"" + H.name() + "\")");
+    batch_fod.push_back (reorient_fod_requested && is_possible_fod (H));
+  }
+  const bool any_batch_fod = std::find (batch_fod.begin(), batch_fod.end(), true) != batch_fod.end();
+
+  bool fod_reorientation = reorient_fod_requested && is_possible_fod_image;
   if (is_possible_fod_image && !opt.size())
     throw Exception("-reorient_fod yes/no needs to be explicitly specified for images with " +
       str(input_header.size(3)) + " volumes");
-  else if (!is_possible_fod_image && fod_reorientation)
+  else if (!is_possible_fod_image && reorient_fod_requested && !any_batch_fod)
     throw Exception("Apodised PSF reorientation requires SH series images");
 
   Eigen::MatrixXd directions_cartesian;
-  if (fod_reorientation && (linear || warp.valid() || template_header.valid()) && is_possible_fod_image) {
+  if ((fod_reorientation || any_batch_fod) && (linear || warp.valid() || template_header.valid())) {
     CONSOLE ("performing apodised PSF reorientation");
 
     Eigen::MatrixXd directions_az_el;
@@ -410,7 +567,8 @@ void run ()
     Math::Sphere::spherical2cartesian (directions_az_el, directions_cartesian);
 
     // load with SH coeffients contiguous in RAM
-    stride = Stride::contiguous_along_axis (3, input_header);
+    if (fod_reorientation)
+      stride = Stride::contiguous_along_axis (3, input_header);
   }
 
   // Intensity / FOD modulation
@@ -419,20 +577,20 @@ void run ()
   bool modulate_jac = opt.size() && (int) opt[0][0] == 1;
 
   const std::string reorient_msg = str("reorienting") + str((modulate_fod ? " with FOD modulation" : ""));
-  if (modulate_fod)
+  if (modulate_fod && fod_reorientation)
     add_line (output_header.keyval()["comments"], std::string ("FOD modulation applied"));
   if (modulate_jac)
     add_line (output_header.keyval()["comments"], std::string ("Jacobian determinant modulation applied"));
 
   if (modulate_fod) {
-    if (!is_possible_fod_image)
+    if (!is_possible_fod_image && !any_batch_fod)
       throw Exception ("FOD modulation can only be performed with SH series image");
-    if (!fod_reorientation)
+    if (!reorient_fod_requested)
       throw Exception ("FOD modulation can only be performed with FOD reorientation");
   }
 
   if (modulate_jac) {
-    if (fod_reorientation) {
+    if (fod_reorientation || any_batch_fod) {
       WARN ("Input image being interpreted as FOD data (user requested FOD reorientation); "
           "FOD-based modulation would be more appropriate for such data than the requested Jacobian modulation.");
     } else if (is_possible_fod_image) {
@@ -632,9 +790,8 @@ void run ()
 
     auto output = Image<float>::create(argument[1], output_header).with_direct_io();
 
+    Image<default_type> warp_deform;
     if (warp.ndim() == 5) {
-      Image<default_type> warp_deform;
-
       // Warp to the midway space defined by the warp grid
       if (get_options ("midway_space").size()) {
         warp_deform = Registration::Warp::compute_midway_deformation (warp, from);
@@ -642,26 +799,49 @@ void run ()
       } else {
         warp_deform = Registration::Warp::compute_full_deformation (warp, template_header, from);
       }
-      apply_warp (input, output, warp_deform, interp, out_of_bounds_value, oversample, modulate_jac);
-      if (fod_reorientation)
-        Registration::Transform::reorient_warp (reorient_msg.c_str(),
-          output, warp_deform, directions_cartesian.transpose(), modulate_fod);
 
-    // Compose and apply input linear and 4D deformation field
+    // Compose input linear and 4D deformation field
     } else if (warp.ndim() == 4 && linear) {
-      auto warp_composed = Image<default_type>::scratch (warp);
-      Registration::Warp::compose_linear_deformation (linear_transform, warp, warp_composed);
-      apply_warp (input, output, warp_composed, interp, out_of_bounds_value, oversample, modulate_jac);
-      if (fod_reorientation)
-        Registration::Transform::reorient_warp (reorient_msg.c_str(),
-          output, warp_composed, directions_cartesian.transpose(), modulate_fod);
+      warp_deform = Image<default_type>::scratch (warp);
+      Registration::Warp::compose_linear_deformation (linear_transform, warp, warp_deform);
 
     // Apply 4D deformation field only
     } else {
-      apply_warp (input, output, warp, interp, out_of_bounds_value, oversample, modulate_jac);
+      warp_deform = warp;
+    }
+
+    if (batch.size()) {
+      vector<Image<float>> inputs (1, input), outputs (1, output);
+      vector<bool> reorient (1, fod_reorientation);
+      for (size_t n = 0; n != batch.size(); ++n) {
+        Header& batch_header (batch_headers[n]);
+        Header batch_output_header (batch_header);
+        batch_output_header.datatype() = DataType::from_command_line (DataType::from<float> ());
+        Stride::set_from_command_line (batch_output_header);
+        for (size_t i = 0; i < 3; ++i) {
+          batch_output_header.size(i) = output_header.size(i);
+          batch_output_header.spacing(i) = output_header.spacing(i);
+        }
+        batch_output_header.transform() = output_header.transform();
+        if (!template_header)
+          add_line (batch_output_header.keyval()["comments"], std::string ("resliced using warp image \"" + warp.name() + "\""));
+        if (modulate_fod && batch_fod[n])
+          add_line (batch_output_header.keyval()["comments"], std::string ("FOD modulation applied"));
+        if (modulate_jac)
+          add_line (batch_output_header.keyval()["comments"], std::string ("Jacobian determinant modulation applied"));
+
+        inputs.push_back (batch_header.get_image<float>().with_direct_io (batch_fod[n] ?
+              Stride::contiguous_along_axis (3, batch_header) : Stride::get (batch_header)));
+        outputs.push_back (Image<float>::create (batch[n][1], batch_output_header).with_direct_io());
+        reorient.push_back (batch_fod[n]);
+      }
+      apply_warp_batch (inputs, outputs, warp_deform, interp, out_of_bounds_value, oversample, modulate_jac,
+                        reorient, directions_cartesian.transpose(), modulate_fod);
+    } else {
+      apply_warp (input, output, warp_deform, interp, out_of_bounds_value, oversample, modulate_jac);
       if (fod_reorientation)
         Registration::Transform::reorient_warp (reorient_msg.c_str(),
-          output, warp, directions_cartesian.transpose(), modulate_fod);
+          output, warp_deform, directions_cartesian.transpose(), modulate_fod);
     }
 
     DWI::export_grad_commandline (output);
@@ -18,6 +18,7 @@
 
 #include "command.h"
 #include "image.h"
+#include "ordered_thread_queue.h"
 #include "thread_queue.h"
 #include "types.h"
 
@@ -25,6 +26,8 @@
 #include "dwi/tractography/properties.h"
 #include "dwi/tractography/weights.h"
 #include "dwi/tractography/mapping/loader.h"
+#include "dwi/tractography/connectome/accumulator.h"
+#include "dwi/tractography/connectome/assignments.h"
 #include "dwi/tractography/connectome/connectome.h"
 #include "dwi/tractography/connectome/metric.h"
 #include "dwi/tractography/connectome/mapper.h"
@@ -81,7 +84,15 @@ void usage ()
              "seeded from the (effectively) same location, and as such, only the endpoint of each "
              "streamline (not their starting point) is assigned based on the provided parcellation "
              "image. Accordingly, the output file contains only a vector of connectivity values "
-             "rather than a matrix, since each streamline is assigned to only one node rather than two.");
+             "rather than a matrix, since each streamline is assigned to only one node rather than two.")
+
+  + Example ("Generate multiple connectomes in a single pass through the streamline data",
+             "tck2connectome tracks.tck nodes.mif connectome.csv -extra_output nodes.mif length,mean distances.csv -extra_output nodes_fine.mif count connectome_fine.csv",
+             "Each use of the -extra_output option yields an additional connectome, based on any "
+             "parcellation image and any combination of metric & edge statistic. Since the "
+             "streamline data are only read once, and the node assignments of each streamline "
+             "are only computed once per parcellation image, this is considerably faster than "
+             "running the command multiple times.");
 
 
   ARGUMENTS
@@ -109,7 +120,18 @@ void usage ()
     + Argument ("path").type_file_out()
 
   + Option ("vector", "output a vector representing connectivities from a given seed point to target nodes, "
-                      "rather than a matrix of node-node connectivities");
+                      "rather than a matrix of node-node connectivities")
+
+  + Option ("extra_output", "generate an additional connectome during the same pass through the streamline data. "
+                            "The parcellation image may be the same as or different to nodes_in; "
+                            "the streamline assignment mechanism is shared between all connectomes. "
+                            "The metric is specified as a comma-separated list of any of the following: "
+                            "length, invlength, invnodevol, file=path (equivalent to the corresponding -scale_* options), "
+                            "and " + join(statistics, ", ") + " (equivalent to the -stat_edge option); "
+                            "use \"count\" to obtain the default streamline count (or sum of streamline weights).").allow_multiple()
+    + Argument ("nodes_in").type_image_in()
+    + Argument ("metric").type_text()
+    + Argument ("connectome_out").type_file_out();
 
   REFERENCES
   + "If using the default streamline-parcel assignment mechanism (or -assignment_radial_search option): " // Internal
@@ -126,98 +148,223 @@ void usage ()
 
 
 
+// A node parcellation image, along with the streamline assignment
+//   mechanism to be used with it
+class Parcellation
+{ MEMALIGN(Parcellation)
+  public:
+    Parcellation (const std::string& path) :
+        path (path),
+        max_node_index (0)
+    {
+      auto header = Header::open (path);
+      MR::Connectome::check (header);
+      image = header.get_image<node_t>();
+
+      // First, find out how many segmented nodes there are, so the matrix can be pre-allocated
+      // Also check for node volume for all nodes
+      vector<uint32_t> node_volumes (1, 0);
+      for (auto i = Loop (image, 0, 3) (image); i; ++i) {
+        if (image.value() > max_node_index) {
+          max_node_index = image.value();
+          node_volumes.resize (max_node_index + 1, 0);
+        }
+        ++node_volumes[image.value()];
+      }
+
+      for (size_t i = 1; i != node_volumes.size(); ++i) {
+        if (!node_volumes[i])
+          missing_nodes.insert (i);
+      }
+      if (missing_nodes.size()) {
+        WARN ("The following nodes are missing from the parcellation image \"" + path + "\":");
+        std::set<node_t>::iterator i = missing_nodes.begin();
+        std::string list = str(*i);
+        for (++i; i != missing_nodes.end(); ++i)
+          list += ", " + str(*i);
+        WARN (list);
+        WARN ("(This may indicate poor parcellation image preparation, use of incorrect or incomplete LUT file(s) in labelconvert, or very poor registration)");
+      }
+    }
+
+    const std::string path;
+    Image<node_t> image;
+    node_t max_node_index;
+    std::set<node_t> missing_nodes;
+    std::unique_ptr<Tck2nodes_base> tck2nodes;
+};
+
+
+
+// A single connectome to be generated
+class Output
+{ MEMALIGN(Output)
+  public:
+    Output (const size_t parcellation, const std::string& path) :
+        parcellation (parcellation),
+        statistic (stat_edge::SUM),
+        path (path) { }
+
+    size_t parcellation;
+    Metric metric;
+    stat_edge statistic;
+    std::string path;
+};
+
+
+
+// Parse the metric specification provided to the -extra_output option
+void parse_metric (const std::string& spec, Image<node_t>& node_image, Output& output)
+{
+  bool length = false, invlength = false, invnodevol = false, file = false, statistic = false;
+  for (const auto& entry : split (spec, ",", true)) {
+    const std::string token = strip (entry);
+    const std::string key = lowercase (token);
+    if (key == "count")
+      continue;
+    if (key == "length" || key == "invlength") {
+      if (length || invlength)
+        throw Exception ("Metric specification \"" + spec + "\" contains more than one length scaling");
+      if (key == "length") {
+        length = true;
+        output.metric.set_scale_length();
+      } else {
+        invlength = true;
+        output.metric.set_scale_invlength();
+      }
+    } else if (key == "invnodevol") {
+      if (!invnodevol)
+        output.metric.set_scale_invnodevol (node_image);
+      invnodevol = true;
+    } else if (key.substr (0, 5) == "file=") {
+      if (file)
+        throw Exception ("Metric specification \"" + spec + "\" contains more than one scaling file");
+      file = true;
+      try {
+        output.metric.set_scale_file (token.substr (5));
+      } catch (Exception& e) {
+        throw Exception (e, "Metric scaling file \"" + token.substr (5) + "\" should contain a list of numbers (one for each streamline)");
+      }
+    } else {
+      size_t index = 0;
+      for (; statistics[index]; ++index) {
+        if (key == statistics[index])
+          break;
+      }
+      if (!statistics[index])
+        throw Exception ("Unrecognised entry \"" + token + "\" in metric specification \"" + spec + "\"");
+      if (statistic)
+        throw Exception ("Metric specification \"" + spec + "\" contains more than one edge statistic");
+      statistic = true;
+      output.statistic = stat_edge(index);
+    }
+  }
+}
+
+
+
 template <typename T>
-void execute (Image<node_t>& node_image, const node_t max_node_index, const std::set<node_t>& missing_nodes)
+void execute (vector<Parcellation>& parcellations, const vector<Output>& outputs)
 {
   // Are we generating a matrix or a vector?
   const bool vector_output = get_options ("vector").size();
 
-  // Do we need to keep track of the nodes to which each streamline is
-  //   assigned, or would it be a waste of memory?
-  const bool track_assignments = get_options ("out_assignments").size();
-
-  // Get the metric, assignment mechanism & per-edge statistic for connectome construction
-  Metric metric;
-  Tractography::Connectome::setup_metric (metric, node_image);
-  std::unique_ptr<Tck2nodes_base> tck2nodes (load_assignment_mode (node_image));
-  auto opt = get_options ("stat_edge");
-  const stat_edge statistic = opt.size() ? stat_edge(int(opt[0][0])) : stat_edge::SUM;
-
   // Prepare for reading the track data
   Tractography::Properties properties;
   Tractography::Reader<float> reader (argument[0], properties);
 
   // Initialise classes in preparation for multi-threading
-  Mapping::TrackLoader loader (reader, properties["count"].empty() ? 0 : to<size_t>(properties["count"]), "Constructing connectome");
-  Tractography::Connectome::Mapper mapper (*tck2nodes, metric);
-  Tractography::Connectome::Matrix<T> connectome (max_node_index, statistic, vector_output, track_assignments);
-
-  // Multi-threaded connectome construction
-  if (tck2nodes->provides_pair()) {
-    Thread::run_queue (
-        loader,
-        Thread::batch (Tractography::Streamline<float>()),
-        Thread::multi (mapper),
-        Thread::batch (Mapped_track_nodepair()),
-        connectome);
-  } else {
-    Thread::run_queue (
-        loader,
-        Thread::batch (Tractography::Streamline<float>()),
-        Thread::multi (mapper),
-        Thread::batch (Mapped_track_nodelist()),
-        connectome);
+  Mapping::TrackLoader loader (reader, properties["count"].empty() ? 0 : to<size_t>(properties["count"]),
+                               outputs.size() > 1 ? "Constructing " + str(outputs.size()) + " connectomes" : "Constructing connectome");
+  vector<std::unique_ptr<Tractography::Connectome::Matrix<T>>> connectomes;
+  for (const auto& output : outputs)
+    connectomes.emplace_back (new Tractography::Connectome::Matrix<T> (parcellations[output.parcellation].max_node_index, output.statistic, vector_output));
+
+  // Multi-threaded connectome construction:
+  //   each thread accumulates into its own partial connectomes, and each of these
+  //   is reduced into its connectome once handed over; if the streamline assignments are
+  //   requested, these are streamed to file in order as they are generated.
+  //   All connectomes are generated within a single pass through the data.
+  {
+    Tractography::Connectome::Accumulator<T> accumulator;
+    for (size_t i = 0; i != outputs.size(); ++i)
+      accumulator.add (*parcellations[outputs[i].parcellation].tck2nodes, outputs[i].metric, *connectomes[i]);
+    auto opt = get_options ("out_assignments");
+    if (opt.size()) {
+      Tractography::Connectome::AssignmentWriter writer (opt[0][0], vector_output);
+      if (parcellations[0].tck2nodes->provides_pair()) {
+        Thread::run_ordered_queue (
+            loader,
+            Thread::batch (Tractography::Streamline<float>()),
+            Thread::multi (accumulator),
+            Thread::batch (Mapped_track_nodepair()),
+            writer);
+      } else {
+        Thread::run_ordered_queue (
+            loader,
+            Thread::batch (Tractography::Streamline<float>()),
+            Thread::multi (accumulator),
+            Thread::batch (Mapped_track_nodelist()),
+            writer);
+      }
+    } else {
+      Thread::run_queue (
+          loader,
+          Thread::batch (Tractography::Streamline<float>()),
+          Thread::multi (accumulator));
+    }
   }
 
-  connectome.finalize();
-  connectome.error_check (missing_nodes);
-
-  connectome.save (argument[2], get_options ("keep_unassigned").size(), get_options ("symmetric").size(), get_options ("zero_diagonal").size());
-
-  opt = get_options ("out_assignments");
-  if (opt.size())
-    connectome.write_assignments (opt[0][0]);
+  for (size_t i = 0; i != outputs.size(); ++i) {
+    auto& connectome = *connectomes[i];
+    connectome.finalize();
+    connectome.error_check (parcellations[outputs[i].parcellation].missing_nodes);
+    connectome.save (outputs[i].path, get_options ("keep_unassigned").size(), get_options ("symmetric").size(), get_options ("zero_diagonal").size());
+  }
 }
 
 
 
 void run ()
 {
-  auto node_header = Header::open (argument[1]);
-  MR::Connectome::check (node_header);
-  auto node_image = node_header.get_image<node_t>();
-
-  // First, find out how many segmented nodes there are, so the matrix can be pre-allocated
-  // Also check for node volume for all nodes
-  vector<uint32_t> node_volumes (1, 0);
-  node_t max_node_index = 0;
-  for (auto i = Loop (node_image, 0, 3) (node_image); i; ++i) {
-    if (node_image.value() > max_node_index) {
-      max_node_index = node_image.value();
-      node_volumes.resize (max_node_index + 1, 0);
+  vector<Parcellation> parcellations;
+  vector<Output> outputs;
+
+  // The connectome requested via the command-line arguments uses the
+  //   metric & per-edge statistic provided via command-line options
+  parcellations.emplace_back (argument[1]);
+  outputs.push_back (Output (0, argument[2]));
+  Tractography::Connectome::setup_metric (outputs[0].metric, parcellations[0].image);
+  auto opt = get_options ("stat_edge");
+  if (opt.size())
+    outputs[0].statistic = stat_edge(int(opt[0][0]));
+
+  // Additional connectomes: parcellation images are only loaded once,
+  //   regardless of how many connectomes are generated from them
+  opt = get_options ("extra_output");
+  for (const auto& o : opt) {
+    const std::string path (o[0]);
+    size_t index = 0;
+    for (; index != parcellations.size(); ++index) {
+      if (parcellations[index].path == path)
+        break;
     }
-    ++node_volumes[node_image.value()];
+    if (index == parcellations.size())
+      parcellations.emplace_back (path);
+    outputs.push_back (Output (index, o[2]));
+    parse_metric (o[1], parcellations[index].image, outputs.back());
   }
 
-  std::set<node_t> missing_nodes;
-  for (size_t i = 1; i != node_volumes.size(); ++i) {
-    if (!node_volumes[i])
-      missing_nodes.insert (i);
-  }
-  if (missing_nodes.size()) {
-    WARN ("The following nodes are missing from the parcellation image:");
-    std::set<node_t>::iterator i = missing_nodes.begin();
-    std::string list = str(*i);
-    for (++i; i != missing_nodes.end(); ++i)
-      list += ", " + str(*i);
-    WARN (list);
-    WARN ("(This may indicate poor parcellation image preparation, use of incorrect or incomplete LUT file(s) in labelconvert, or very poor registration)");
+  node_t max_node_index = 0;
+  for (auto& p : parcellations) {
+    p.tck2nodes.reset (load_assignment_mode (p.image));
+    max_node_index = std::max (max_node_index, p.max_node_index);
   }
 
   if (max_node_index >= node_count_ram_limit) {
     INFO ("Very large number of nodes detected; using single-precision floating-point storage");
-    execute<float> (node_image, max_node_index, missing_nodes);
+    execute<float> (parcellations, outputs);
   } else {
-    execute<double> (node_image, max_node_index, missing_nodes);
+    execute<double> (parcellations, outputs);
   }
 }
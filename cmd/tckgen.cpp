@@ -248,6 +248,11 @@ void run ()
   if (algorithm == 2)
     Algorithms::load_iFOD2_options (properties);
 
+  // FOD cache is only constructed by algorithms that sample an FOD image
+  //   (NullDist2 inherits this behaviour from iFOD2)
+  if (get_options ("fod_cache").size() && !(algorithm == 1 || algorithm == 2 || algorithm == 4 || algorithm == 5))
+    throw Exception ("-fod_cache option is only applicable to the iFOD1, iFOD2, NullDist2 and SD_Stream algorithms");
+
 
   //load ROIs and tractography specific options
   //NB must occur before seed check below due to -select option override
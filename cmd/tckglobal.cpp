@@ -185,7 +185,11 @@ void usage ()
 
   + Option ("lambda", "set the weight of the internal energy directly. (default = " + str(DEFAULT_LAMBDA, 2) + ")\n"
             "If provided, any value of -balance will be ignored.")
-    + Argument ("lam").type_float(0.0);
+    + Argument ("lam").type_float(0.0)
+
+  + Option ("blocks", "use a domain-decomposed sampler, in which the volume is partitioned into "
+            "checkerboarded spatial blocks that are distributed across threads in successive sweeps. "
+            "This avoids all spatial locking between threads, and scales better to large numbers of threads.");
 
 }
 
@@ -311,12 +315,17 @@ void run ()
   Eint->setConnPot(cpot);
   EnergySumComputer* Esum = new EnergySumComputer(stats, Eint, properties.lam_int, Eext, properties.lam_ext / ( wmscale2 * properties.weight*properties.weight));
 
-  MHSampler mhs (dwi, properties, stats, pgrid, Esum, mask);   // All EnergyComputers are recursively destroyed upon destruction of mhs, except for the shared data.
+  const size_t nthreads = Thread::threads_to_execute();
+  std::shared_ptr<BlockScheduler> scheduler;
+  if (get_options("blocks").size())
+    scheduler = make_shared<BlockScheduler>(pgrid, dwi, mask, nthreads);
+
+  MHSampler mhs (dwi, properties, stats, pgrid, Esum, mask, scheduler);   // All EnergyComputers are recursively destroyed upon destruction of mhs, except for the shared data.
 
 
   INFO("Start MH sampler");
 
-  Thread::run (Thread::multi(mhs), "MH sampler");
+  Thread::run (Thread::multi(mhs, nthreads), "MH sampler").wait();
 
   INFO("Final no. particles: " + std::to_string(pgrid.getTotalCount()));
   INFO("Final external energy: " + std::to_string(stats.getEextTotal()));
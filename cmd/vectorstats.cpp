@@ -169,9 +169,8 @@ void run()
   const std::string output_prefix = argument[3];
 
   // Load input data
-  matrix_type data (num_inputs, num_elements);
-  for (size_t subject = 0; subject != num_inputs; subject++)
-    (*importer[subject]) (data.row(subject));
+  Math::Stats::Measurements data (num_inputs, num_elements, get_options ("float32").size());
+  data.load (importer, "Loading input data");
 
   const bool nans_in_data = !data.allFinite();
   if (nans_in_data) {
@@ -264,7 +263,7 @@ void run()
       for (size_t i = 0; i != num_hypotheses; ++i)
         save_vector (null_distribution.col(i), output_prefix + "null_dist" + postfix(i) + ".csv");
     }
-    const matrix_type fwe_pvalues = MR::Math::Stats::fwe_pvalue (null_distribution, default_zstat);
+    const matrix_type fwe_pvalues = MR::Math::Stats::fwe_pvalue (null_distribution, default_zstat, get_options ("fwe_tail").size());
     for (size_t i = 0; i != num_hypotheses; ++i) {
       save_vector (fwe_pvalues.col(i), output_prefix + "fwe_1mpvalue" + postfix(i) + ".csv");
       save_vector (uncorrected_pvalues.col(i), output_prefix + "uncorrected_pvalue" + postfix(i) + ".csv");
@@ -37,7 +37,11 @@ void usage ()
     "warp image will also be a deformation field. If the input warp field is instead a displacment field, "
     "i.e. where each voxel stores an offset from which to sample the other image (but still in scanner "
     "space), then the -displacement option should be used; the output warp field will additionally be "
-    "calculated as a displacement field in this case.";
+    "calculated as a displacement field in this case."
+
+  + "The inverse is estimated using a fixed-point iteration at each voxel, solved first on "
+    "successively finer downsampled grids, with each level initialised from the upsampled "
+    "solution of the previous one.";
 
   ARGUMENTS
   + Argument ("in", "the input warp image.").type_image_in ()
@@ -74,7 +78,7 @@ void run ()
   Image<default_type> image_out (Image<default_type>::create (argument[1], header_out));
 
   if (displacement) {
-    Registration::Warp::invert_displacement (image_in, image_out);
+    Registration::Warp::invert_displacement_coarse_to_fine (image_in, image_out);
   } else {
     Registration::Warp::invert_deformation (image_in, image_out);
   }
@@ -126,7 +126,7 @@ namespace MR
         const default_type vox[3];
         const value_type value_when_out_of_bounds;
         const bool jac_modulate;
-        Adapter::Jacobian<Image<default_type> > jacobian_adapter;
+        Adapter::Jacobian<WarpType> jacobian_adapter;
     };
 
     //! @}
@@ -23,6 +23,7 @@
 
 #include "app.h"
 #include "debug.h"
+#include "memory_usage.h"
 #include "progressbar.h"
 #include "file/path.h"
 #include "file/config.h"
@@ -64,6 +65,10 @@ namespace MR
                          "(caution: using the same file as input and output might cause unexpected behaviour).")
       + Option ("nthreads", "use this number of threads in multi-threaded applications (set to 0 to disable multi-threading).")
         + Argument ("number").type_integer (0)
+      + Option ("memory_limit", "limit the memory used for large data structures (such as scratch images, images loaded into RAM, and model data) to this size, "
+                                "with optional suffix k, M, G or T (e.g. 16G); lower-memory strategies will be used where available, "
+                                "and the command will fail early if its projected memory use exceeds this limit.")
+        + Argument ("size").type_text()
       + Option ("config", "temporarily set the value of an MRtrix config file entry.").allow_multiple()
         + Argument ("key").type_text()
         + Argument ("value").type_text()
@@ -1175,6 +1180,10 @@ namespace MR
       //CONF A boolean value to indicate whether colours should be used in the terminal.
       terminal_use_colour = File::Config::get_bool ("TerminalColor", terminal_use_colour);
 
+      // determine the memory budget now, so that an invalid specification
+      //   is reported before any processing takes place
+      Memory::limit();
+
       // check for the existence of all specified input files (including optional ones that have been provided)
       // if necessary, also check for pre-existence of any output files with known paths
       //   (if the output is e.g. given as a prefix, the argument should be flagged as type_text())
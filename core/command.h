@@ -24,6 +24,7 @@
 
 #include "app.h"
 #include "exec_version.h"
+#include "memory_usage.h"
 #ifdef MRTRIX_PROJECT
 namespace MR {
   namespace App {
@@ -99,6 +100,7 @@ int main (int cmdline_argc, char** cmdline_argv)
 #endif
     ::MR::App::parse ();
     run ();
+    ::MR::Memory::report ();
   }
   catch (::MR::Exception& E) {
     E.display();
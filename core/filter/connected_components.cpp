@@ -17,6 +17,8 @@
 
 #include "filter/connected_components.h"
 
+#include "thread.h"
+
 namespace MR
 {
   namespace Filter
@@ -24,27 +26,22 @@ namespace MR
 
 
 
-    void Connector::Adjacency::initialise (const Header& header, const Voxel2Vector& v2v)
+    vector<vector<int>> Connector::neighbour_offsets (const size_t ndim, vector<bool> enabled_axes, const bool use_26_neighbours)
     {
-      data.clear();
-      // Simplify handling of 4D images: don't need to keep checking
-      //   size of axes against number of image dimensions
-      if (header.ndim() < 3)
-        throw Exception ("Connected components filter not designed to handle less than 3 axes");
-      if (header.ndim() > enabled_axes.size())
-        enabled_axes.resize (header.ndim(), false);
+      if (ndim > enabled_axes.size())
+        enabled_axes.resize (ndim, false);
       // Begin by disabling adjacency offsets for those axes for which adjacency is not permitted
       vector< vector<int> > offsets;
-      vector<int> o (header.ndim(), -1);
+      vector<int> o (ndim, -1);
       size_t start_axis = 0;
-      for (size_t axis = 0; axis != header.ndim(); ++axis) {
+      for (size_t axis = 0; axis != ndim; ++axis) {
         if (!enabled_axes[axis]) {
           o[axis] = 0;
           if (start_axis == axis)
             ++start_axis;
         }
       }
-      if (start_axis == header.ndim())
+      if (start_axis == ndim)
         throw Exception ("Cannot initialise connected component filter: All axes have been disabled");
       // Now generate a list of plausible offsets between adjacent elements
       while (*std::max_element (o.begin(), o.end()) < 2) {
@@ -56,19 +53,34 @@ namespace MR
           offsets.push_back (o);
         // Find the next offset to be tested
         ++o[start_axis];
-        for (size_t axis = start_axis; axis != header.ndim(); ++axis) {
+        for (size_t axis = start_axis; axis != ndim; ++axis) {
           if (enabled_axes[axis] && o[axis] == 2) {
             size_t next_enabled_axis;
             for (next_enabled_axis = axis+1;
-                 next_enabled_axis < header.ndim() && !enabled_axes[next_enabled_axis];
+                 next_enabled_axis < ndim && !enabled_axes[next_enabled_axis];
                  ++next_enabled_axis);
-            if (next_enabled_axis < header.ndim()) {
+            if (next_enabled_axis < ndim) {
               o[axis] = -1;
               ++o[next_enabled_axis];
             }
           }
         }
       }
+      return offsets;
+    }
+
+
+
+    void Connector::Adjacency::initialise (const Header& header, const Voxel2Vector& v2v)
+    {
+      data.clear();
+      // Simplify handling of 4D images: don't need to keep checking
+      //   size of axes against number of image dimensions
+      if (header.ndim() < 3)
+        throw Exception ("Connected components filter not designed to handle less than 3 axes");
+      if (header.ndim() > enabled_axes.size())
+        enabled_axes.resize (header.ndim(), false);
+      const vector<vector<int>> offsets = neighbour_offsets (header.ndim(), enabled_axes, use_26_neighbours);
       // Now we can generate, for each element in the image, a list of adjacent elements
       // This may appear different to previous code, given the use of the Voxel2Vector class
       vector<index_t> pos (header.ndim());
@@ -152,5 +164,176 @@ namespace MR
 
 
 
+
+
+
+    namespace
+    {
+      // Union-find with path halving; sets are always represented by
+      //   their lowest index, so that the root of each cluster is also
+      //   the first of its voxels in linear order
+      inline uint32_t find_root (vector<uint32_t>& parent, uint32_t i)
+      {
+        while (parent[i] != i) {
+          parent[i] = parent[parent[i]];
+          i = parent[i];
+        }
+        return i;
+      }
+
+      inline void merge (vector<uint32_t>& parent, const uint32_t a, const uint32_t b)
+      {
+        const uint32_t root_a = find_root (parent, a);
+        const uint32_t root_b = find_root (parent, b);
+        if (root_a < root_b)
+          parent[root_b] = root_a;
+        else if (root_b < root_a)
+          parent[root_a] = root_b;
+      }
+    }
+
+
+
+    GridConnector::GridConnector (const vector<size_t>& dims, const vector<size_t>& order,
+                                  const vector<bool>& enabled_axes, const bool use_26_neighbours) :
+        dims (dims),
+        order (order),
+        strides (dims.size(), 1),
+        num_voxels (1),
+        slab_axis (order.front())
+    {
+      if (dims.size() < 3)
+        throw Exception ("Connected components filter not designed to handle less than 3 axes");
+      assert (order.size() == dims.size());
+      for (const auto axis : order) {
+        strides[axis] = num_voxels;
+        num_voxels *= dims[axis];
+        if (dims[axis] > 1)
+          slab_axis = axis;
+      }
+      if (num_voxels >= size_t(std::numeric_limits<uint32_t>::max()))
+        throw Exception ("Image too large for connected components filter");
+      // The set of neighbours is symmetric: only those preceding each voxel
+      //   in linear order need to be visited
+      for (const auto& o : Connector::neighbour_offsets (dims.size(), enabled_axes, use_26_neighbours)) {
+        ssize_t delta = 0;
+        for (size_t axis = 0; axis != dims.size(); ++axis)
+          delta += o[axis] * ssize_t(strides[axis]);
+        if (delta < 0) {
+          offsets.push_back (o);
+          deltas.push_back (delta);
+        }
+      }
+    }
+
+
+
+    bool GridConnector::is_neighbour (const vector<size_t>& pos, const size_t offset) const
+    {
+      for (size_t axis = 0; axis != dims.size(); ++axis) {
+        const ssize_t p = ssize_t(pos[axis]) + offsets[offset][axis];
+        if (p < 0 || p >= ssize_t(dims[axis]))
+          return false;
+      }
+      return true;
+    }
+
+
+
+    void GridConnector::link (const vector<uint8_t>& mask, vector<uint32_t>& parent,
+                              const size_t from, const size_t to, const size_t lower_bound) const
+    {
+      vector<size_t> pos (dims.size());
+      size_t remainder = from;
+      for (auto axis = order.rbegin(); axis != order.rend(); ++axis) {
+        pos[*axis] = remainder / strides[*axis];
+        remainder -= pos[*axis] * strides[*axis];
+      }
+      for (size_t i = from; i != to; ++i) {
+        if (mask[i]) {
+          for (size_t n = 0; n != deltas.size(); ++n) {
+            const ssize_t j = ssize_t(i) + deltas[n];
+            if (j >= ssize_t(lower_bound) && mask[j] && is_neighbour (pos, n))
+              merge (parent, i, j);
+          }
+        }
+        for (size_t n = 0; n != order.size() && ++pos[order[n]] == dims[order[n]]; ++n)
+          pos[order[n]] = 0;
+      }
+    }
+
+
+
+    void GridConnector::run (const vector<uint8_t>& mask, vector<Connector::Cluster>& clusters, vector<uint32_t>& labels) const
+    {
+      assert (mask.size() == num_voxels);
+      vector<uint32_t> parent (num_voxels);
+
+      // Label each slab independently, considering only neighbours within the slab
+      const size_t num_slabs = std::min (dims[slab_axis], 4 * std::max (size_t(1), Thread::threads_to_execute()));
+      vector<size_t> slab_start;
+      for (size_t slab = 0; slab <= num_slabs; ++slab)
+        slab_start.push_back (strides[slab_axis] * ((slab * dims[slab_axis]) / num_slabs));
+
+      class Worker
+      { NOMEMALIGN
+        public:
+          Worker (const GridConnector& master, const vector<uint8_t>& mask, vector<uint32_t>& parent,
+                  const vector<size_t>& slab_start, std::atomic<size_t>& next_slab) :
+              master (master),
+              mask (mask),
+              parent (parent),
+              slab_start (slab_start),
+              next_slab (next_slab) { }
+
+          void execute ()
+          {
+            size_t slab;
+            while ((slab = next_slab++) < slab_start.size() - 1) {
+              const size_t from = slab_start[slab], to = slab_start[slab+1];
+              for (size_t i = from; i != to; ++i)
+                parent[i] = i;
+              master.link (mask, parent, from, to, from);
+            }
+          }
+
+        private:
+          const GridConnector& master;
+          const vector<uint8_t>& mask;
+          vector<uint32_t>& parent;
+          const vector<size_t>& slab_start;
+          std::atomic<size_t>& next_slab;
+      };
+
+      std::atomic<size_t> next_slab (0);
+      const size_t num_threads = std::min (num_slabs, std::max (size_t(1), Thread::threads_to_execute()));
+      Thread::run (Thread::multi (Worker (*this, mask, parent, slab_start, next_slab), num_threads),
+                   "connected components labelling");
+
+      // Merge equivalences across slab boundaries: neighbours of the first
+      //   plane of each slab that precede it lie within the previous slab
+      for (size_t slab = 1; slab != num_slabs; ++slab)
+        link (mask, parent, slab_start[slab], slab_start[slab] + strides[slab_axis], 0);
+
+      // Number clusters in order of their lowest index, which is the order
+      //   in which a depth-first search in linear order would find them
+      labels.assign (num_voxels, 0);
+      clusters.clear();
+      for (size_t i = 0; i != num_voxels; ++i) {
+        if (!mask[i])
+          continue;
+        const uint32_t root = find_root (parent, i);
+        if (root == i) {
+          clusters.push_back (Connector::Cluster (clusters.size() + 1));
+          labels[i] = clusters.size();
+        } else {
+          labels[i] = labels[root];
+        }
+        clusters[labels[i] - 1].size++;
+      }
+    }
+
+
+
   }
 }
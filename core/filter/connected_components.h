@@ -114,6 +114,10 @@ namespace MR
 
         Connector () { }
 
+        // Offsets to all neighbours of a voxel, for the given image
+        //   dimensionality, enabled axes and connectivity
+        static vector<vector<int>> neighbour_offsets (const size_t ndim, vector<bool> enabled_axes, const bool use_26_neighbours);
+
         // Perform connected components on vectorized binary data
         void run (vector<Cluster>&, vector<uint32_t>&) const;
         template <class VectorType>
@@ -210,6 +214,41 @@ namespace MR
 
 
 
+    // Connected components labelling performed directly on the image grid
+    //   using union-find, without storing per-voxel adjacency lists. The
+    //   image is divided into slabs along its outermost non-singleton axis,
+    //   each of which is labelled by a separate thread; equivalences across
+    //   slab boundaries are then merged. Clusters are numbered in order of
+    //   the first voxel encountered when looping over axes in the specified
+    //   order, i.e. identically to Connector::run() on data vectorised by
+    //   Voxel2Vector using the same loop order.
+    class GridConnector
+    { NOMEMALIGN
+      public:
+        GridConnector (const vector<size_t>& dims, const vector<size_t>& order,
+                       const vector<bool>& enabled_axes, const bool use_26_neighbours);
+
+        // mask and labels are indexed by voxel position in loop order, with
+        //   axis order[0] varying fastest; background voxels receive label 0
+        void run (const vector<uint8_t>& mask, vector<Connector::Cluster>& clusters, vector<uint32_t>& labels) const;
+
+      private:
+        vector<size_t> dims, order, strides;
+        size_t num_voxels, slab_axis;
+        // neighbours preceding each voxel in linear order: the remainder are
+        //   visited from the other side
+        vector<vector<int>> offsets;
+        vector<ssize_t> deltas;
+
+        bool is_neighbour (const vector<size_t>& pos, const size_t offset) const;
+        // merge each masked voxel in [from, to) with its preceding neighbours
+        //   at or beyond lower_bound
+        void link (const vector<uint8_t>& mask, vector<uint32_t>& parent,
+                   const size_t from, const size_t to, const size_t lower_bound) const;
+    };
+
+
+
     /** \addtogroup Filters
     @{ */
 
@@ -254,12 +293,13 @@ namespace MR
         template <class InputVoxelType, class OutputVoxelType>
         void operator() (InputVoxelType& in, OutputVoxelType& out)
         {
-          Voxel2Vector v2v (in, *this);
-
-          Connector connector;
-          connector.adjacency.set_axes (enabled_axes);
-          connector.adjacency.set_26_adjacency (do_26_connectivity);
-          connector.adjacency.initialise (in, v2v);
+          // Loop in the same order as Voxel2Vector, so that clusters are
+          //   discovered (and hence ordered among equal sizes) as before
+          const vector<size_t> order = Stride::order (*this);
+          vector<size_t> dims;
+          for (size_t axis = 0; axis != ndim(); ++axis)
+            dims.push_back (size (axis));
+          GridConnector connector (dims, order, enabled_axes, do_26_connectivity);
 
           std::unique_ptr<ProgressBar> progress;
           if (message.size()) {
@@ -269,7 +309,13 @@ namespace MR
 
           vector<Connector::Cluster> clusters;
           vector<uint32_t> labels;
-          connector.run (clusters, labels);
+          {
+            vector<uint8_t> mask (voxel_count (*this));
+            size_t i = 0;
+            for (auto l = Loop (order) (in); l; ++l)
+              mask[i++] = bool (in.value());
+            connector.run (mask, clusters, labels);
+          }
           if (progress) ++(*progress);
 
           // Sort clusters in order from largest to smallest
@@ -282,17 +328,12 @@ namespace MR
           for (uint32_t c = 0; c < clusters.size(); c++)
             index_lookup[clusters[c].label] = c + 1;
 
-          for (auto l = Loop (out) (out); l; ++l)
-            out.value() = 0;
-
-          for (uint32_t i = 0; i < v2v.size(); i++) {
-            assign_pos_of (v2v[i]).to (out);
-            if (largest_only) {
-              if (index_lookup[labels[i]] == 1)
-                out.value() = 1;
-            } else {
+          size_t i = 0;
+          for (auto l = Loop (order) (out); l; ++l, ++i) {
+            if (largest_only)
+              out.value() = (labels[i] && index_lookup[labels[i]] == 1) ? 1 : 0;
+            else
               out.value() = index_lookup[labels[i]];
-            }
           }
         }
 
@@ -87,6 +87,16 @@ namespace MR
     }
 
 
+    //! Whether an image is a packed fixel data store: the data files of many
+    //! inputs concatenated along the second axis, with the name of the
+    //! data file from which each column was derived stored in the header
+    template <class HeaderType>
+    FORCE_INLINE bool is_packed_store (const HeaderType& in)
+    {
+      return is_data_file (in) && in.keyval().count (packed_subjects_key);
+    }
+
+
     FORCE_INLINE bool is_directions_filename (const std::string& path)
     {
       for (std::initializer_list<const std::string>::iterator it = supported_sparse_formats.begin();
@@ -317,6 +327,37 @@ namespace MR
       return header;
     }
 
+    //! Generate a header for a packed fixel data store (NxMx1) from the header of a
+    //! single fixel data file, where M is the number of inputs; the data of all inputs
+    //! for each fixel are stored contiguously, so that contiguous ranges of fixels
+    //! can be read for all inputs at once
+    FORCE_INLINE Header packed_store_header (const Header& data_header, const vector<std::string>& subjects)
+    {
+      check_data_file (data_header);
+      Header header (data_header);
+      header.size(1) = subjects.size();
+      header.stride(0) = 2;
+      header.stride(1) = 1;
+      header.stride(2) = 3;
+      header.datatype() = DataType::Float32;
+      header.datatype().set_byte_order_native();
+      header.keyval()[packed_subjects_key] = join (subjects, "\n");
+      return header;
+    }
+
+    //! Get the names of the data files from which the columns of a packed fixel data store were derived
+    template <class HeaderType>
+    FORCE_INLINE vector<std::string> packed_store_subjects (const HeaderType& in)
+    {
+      if (!is_packed_store (in))
+        throw InvalidImageException (in.name() + " is not a packed fixel data store");
+      const vector<std::string> subjects = split_lines (in.keyval().at (packed_subjects_key));
+      if (subjects.size() != size_t(in.size(1)))
+        throw InvalidImageException ("Number of subjects listed in header of packed fixel data store " + in.name() + " (" + str(subjects.size()) + ")"
+                                     + " does not match its number of columns (" + str(in.size(1)) + ")");
+      return subjects;
+    }
+
     //! Generate a header for a fixel directions data file (Nx3x1) using an index image as a template
     template <class IndexHeaderType>
     FORCE_INLINE Header directions_header_from_index (IndexHeaderType& index) {
@@ -24,6 +24,7 @@ namespace MR
   namespace Fixel
   {
     const std::string n_fixels_key ("nfixels");
+    const std::string packed_subjects_key ("packed_fixel_subjects");
     const std::initializer_list <const std::string> supported_sparse_formats { ".mif", ".nii", ".mif.gz" , ".nii.gz" };
   }
 }
@@ -66,6 +66,7 @@ namespace MR
               throw Exception ("error writing back contents of file \"" + files[n].name + "\": " + strerror(errno));
           }
         }
+        allocation.release();
       }
       else {
         for (size_t n = 0; n < addresses.size(); ++n)
@@ -94,6 +95,7 @@ namespace MR
     {
       DEBUG ("loading image \"" + header.name() + "\"...");
       addresses.resize (files.size() > 1 && header.datatype().bits() *segsize != 8*size_t (bytes_per_segment) ? files.size() : 1);
+      allocation = Memory::Allocation (files.size() * bytes_per_segment, "image \"" + header.name() + "\"");
       addresses[0].reset (new uint8_t [files.size() * bytes_per_segment]);
       if (!addresses[0])
         throw Exception ("failed to allocate memory for image \"" + header.name() + "\"");
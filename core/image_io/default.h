@@ -18,6 +18,7 @@
 #define __image_handler_default_h__
 
 #include "types.h"
+#include "memory_usage.h"
 #include "image_io/base.h"
 #include "file/mmap.h"
 
@@ -38,6 +39,7 @@ namespace MR
       protected:
         vector<std::shared_ptr<File::MMap> > mmaps;
         int64_t bytes_per_segment;
+        Memory::Allocation allocation;
 
         virtual void load (const Header&, size_t);
         virtual void unload (const Header&);
@@ -18,6 +18,8 @@
 
 #include "image_io/scratch.h"
 #include "header.h"
+#include "signal_handler.h"
+#include "file/utils.h"
 
 namespace MR
 {
@@ -29,7 +31,18 @@ namespace MR
     void Scratch::load (const Header& header, size_t buffer_size)
     {
       assert (buffer_size);
+      if (!Memory::fits (buffer_size)) {
+        INFO ("scratch buffer for image \"" + header.name() + "\" (" + Memory::format_size (buffer_size)
+              + ") exceeds memory limit; storing in temporary file");
+        tmpfile = File::create_tempfile (buffer_size, "tmp");
+        SignalHandler::mark_file_for_deletion (tmpfile);
+        mmap.reset (new File::MMap (File::Entry (tmpfile), true, false));
+        addresses.push_back (std::unique_ptr<uint8_t[]> (mmap->address()));
+        return;
+      }
+
       DEBUG ("allocating scratch buffer for image \"" + header.name() + "\"...");
+      allocation = Memory::Allocation (buffer_size, "scratch buffer for image \"" + header.name() + "\"");
       try {
         addresses.push_back (std::unique_ptr<uint8_t[]> (new uint8_t [buffer_size]));
         memset (addresses[0].get(), 0, buffer_size);
@@ -41,9 +54,16 @@ namespace MR
 
     void Scratch::unload (const Header& header)
     {
-      if (addresses.size()) {
+      if (mmap) {
+        addresses[0].release();
+        mmap.reset();
+        File::remove (tmpfile);
+        SignalHandler::unmark_file_for_deletion (tmpfile);
+      }
+      else if (addresses.size()) {
         DEBUG ("deleting scratch buffer for image \"" + header.name() + "\"...");
         addresses[0].reset();
+        allocation.release();
       }
     }
 
@@ -17,6 +17,8 @@
 #ifndef __image_io_scratch_h__
 #define __image_io_scratch_h__
 
+#include "memory_usage.h"
+#include "file/mmap.h"
 #include "image_io/base.h"
 
 namespace MR
@@ -25,6 +27,10 @@ namespace MR
   {
 
 
+    //! Storage for temporary images
+    /*! The buffer is allocated in RAM, unless this would exceed the memory
+     * budget (see Memory::limit()), in which case it is memory-mapped from a
+     * temporary file in the TmpFileDir directory instead. */
     class Scratch : public Base
     { NOMEMALIGN
       public:
@@ -33,6 +39,10 @@ namespace MR
         virtual bool is_file_backed () const;
 
       protected:
+        std::unique_ptr<File::MMap> mmap;
+        std::string tmpfile;
+        Memory::Allocation allocation;
+
         virtual void load (const Header&, size_t);
         virtual void unload (const Header&);
     };
@@ -17,6 +17,7 @@
 #ifndef __math_constrained_least_squares_h__
 #define __math_constrained_least_squares_h__
 
+#include <algorithm>
 #include <set>
 #include "math/math.h"
 
@@ -236,10 +237,6 @@ namespace MR
 
             size_t operator() (vector_type& x, const vector_type& b)
             {
-#ifdef MRTRIX_ICLS_DEBUG
-              std::ofstream l_stream ("l.txt");
-              std::ofstream n_stream ("n.txt");
-#endif
               // compute unconstrained solution:
               y_u = P.b2d.transpose() * b;
               // compute constraint violations for unconstrained solution:
@@ -247,14 +244,71 @@ namespace MR
               if (P.t.size())
                 c_u -= P.t;
 
+              return solve (x, false);
+            }
+
+            //! solve for a block of problem vectors
+            /*! Each column of \a b is a separate problem vector, with the
+             * corresponding solution written to the same column of \a x,
+             * and the number of iterations to \a niter. The unconstrained
+             * solutions and their constraint violations are computed for all
+             * columns at once using matrix-matrix products. Unless \a
+             * warm_start is false, each solve is initialised using the active
+             * set at convergence of the previous column, which greatly
+             * reduces the number of iterations required when successive
+             * columns correspond to similar problems (e.g. neighbouring
+             * voxels); since the problem is strictly convex, the solution is
+             * unaffected, except where the problem is degenerate (i.e. as many
+             * constraints are active as there are unknowns), in which case
+             * the result may depend on the initial active set. */
+            void operator() (matrix_type& x, const matrix_type& b, vector<size_t>& niter, const bool warm_start = true)
+            {
+              Y_u.noalias() = P.b2d.transpose() * b;
+              C_u.noalias() = P.B * Y_u;
+              if (P.t.size())
+                C_u.colwise() -= P.t;
+
+              x.resize (P.H.cols(), b.cols());
+              niter.resize (b.cols());
+              for (ssize_t n = 0; n < b.cols(); ++n) {
+                y_u = Y_u.col (n);
+                c_u = C_u.col (n);
+                niter[n] = solve (x_block, warm_start && n);
+                x.col (n) = x_block;
+              }
+            }
+
+            const Problem<value_type>& problem () const { return P; }
+
+          protected:
+            const Problem<value_type>& P;
+            matrix_type BtB, B, Y_u, C_u;
+            vector_type y_u, c, c_u, lambda, lambda_prev, l, x_block;
+            vector<bool> active;
+
+
+            // solve for the unconstrained solution & constraint violations
+            //   currently in y_u & c_u; if warm_start is set, the inequality
+            //   constraints active at the end of the previous solve are used
+            //   as the initial active set
+            size_t solve (vector_type& x, const bool warm_start)
+            {
+#ifdef MRTRIX_ICLS_DEBUG
+              std::ofstream l_stream ("l.txt");
+              std::ofstream n_stream ("n.txt");
+#endif
               const size_t num_eq = P.num_equalities();
               const size_t num_ineq = P.num_constraints() - num_eq;
 
               // set all Lagrangian multipliers to zero:
               lambda.setZero();
               lambda_prev.setZero();
-              // set active set empty:
-              std::fill (active.begin(), active.end(), false);
+              // set active set empty, or retain previous active set:
+              bool warm_started = false;
+              if (warm_start)
+                warm_started = std::find (active.begin(), active.begin() + num_ineq, true) != active.begin() + num_ineq;
+              if (!warm_started)
+                std::fill (active.begin(), active.end(), false);
               if (num_eq > 0)
                 std::fill (active.begin() + num_ineq, active.end(), true);
 
@@ -267,9 +321,14 @@ namespace MR
               size_t min_c_index;
               size_t niter = 0;
 
-              while (c.head(num_ineq).minCoeff (&min_c_index) < -P.tol) {
-                bool active_set_changed = !active[min_c_index];
-                active[min_c_index] = true;
+              while (warm_started || c.head(num_ineq).minCoeff (&min_c_index) < -P.tol) {
+                bool active_set_changed = true;
+                if (warm_started)
+                  warm_started = false;
+                else {
+                  active_set_changed = !active[min_c_index];
+                  active[min_c_index] = true;
+                }
 
                 while (1) {
                   // form submatrix of active constraints:
@@ -355,14 +414,6 @@ namespace MR
               P.chol_HtH.template triangularView<Eigen::Lower>().transpose().solveInPlace (x);
               return niter;
             }
-
-            const Problem<value_type>& problem () const { return P; }
-
-          protected:
-            const Problem<value_type>& P;
-            matrix_type BtB, B;
-            vector_type y_u, c, c_u, lambda, lambda_prev, l;
-            vector<bool> active;
         };
 
 
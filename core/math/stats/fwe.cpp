@@ -18,8 +18,12 @@
 #include "math/stats/fwe.h"
 
 #include <algorithm>
+#include <memory>
 #include <types.h>
 
+#include "exception.h"
+#include "mrtrix.h"
+
 namespace MR
 {
   namespace Math
@@ -29,17 +33,82 @@ namespace MR
 
 
 
+      namespace
+      {
+
+        // Generalised Pareto distribution fitted to the largest values of a sorted null
+        //   distribution, using the probability-weighted moments estimator of
+        //   Hosking & Wallis (1987) (shape parameter k as per their convention)
+        class ParetoTail { NOMEMALIGN
+          public:
+            ParetoTail (const vector<value_type>& sorted_null_dist) :
+                threshold (std::numeric_limits<default_type>::infinity()),
+                fraction (0.0),
+                k (0.0),
+                sigma (0.0)
+            {
+              const size_t num_shuffles = sorted_null_dist.size();
+              if (num_shuffles < min_shuffles)
+                return;
+              const size_t num_exceedances = std::max (min_exceedances, num_shuffles / 10);
+              const default_type u = sorted_null_dist[num_shuffles - num_exceedances - 1];
+              default_type a0 = 0.0, a1 = 0.0;
+              for (size_t i = 0; i != num_exceedances; ++i) {
+                const default_type y = sorted_null_dist[num_shuffles - num_exceedances + i] - u;
+                a0 += y;
+                a1 += y * default_type(num_exceedances - 1 - i) / default_type(num_exceedances - 1);
+              }
+              a0 /= default_type(num_exceedances);
+              a1 /= default_type(num_exceedances);
+              // Degenerate if all exceedances are identical
+              if (!(a0 - 2.0*a1 > 0.0))
+                return;
+              threshold = u;
+              fraction = default_type(num_exceedances) / default_type(num_shuffles);
+              k = a0 / (a0 - 2.0*a1) - 2.0;
+              sigma = 2.0 * a0 * a1 / (a0 - 2.0*a1);
+              DEBUG ("Pareto tail fitted to " + str(num_exceedances) + " of " + str(num_shuffles) + " shuffles:"
+                     + " threshold " + str(threshold) + ", shape " + str(k) + ", scale " + str(sigma));
+            }
+
+            bool applies (const value_type stat) const { return stat > threshold; }
+
+            // Family-wise p-value for a statistic exceeding the tail threshold
+            default_type pvalue (const value_type stat) const
+            {
+              assert (applies (stat));
+              const default_type y = (stat - threshold) / sigma;
+              if (std::abs (k) < 1e-6)
+                return fraction * std::exp (-y);
+              const default_type base = 1.0 - k * y;
+              return base > 0.0 ? fraction * std::pow (base, 1.0 / k) : 0.0;
+            }
+
+          private:
+            default_type threshold, fraction, k, sigma;
+
+            static constexpr size_t min_shuffles = 200;
+            static constexpr size_t min_exceedances = 20;
+        };
+
+      }
+
+
+
       // FIXME Jump based on non-initialised value in the sort
       // Pre-fill the null distribution / stats matrices with NaNs, detect when it's not overwritten
-      matrix_type fwe_pvalue (const matrix_type& null_distributions, const matrix_type& statistics)
+      matrix_type fwe_pvalue (const matrix_type& null_distributions, const matrix_type& statistics, const bool tail_approximation)
       {
         assert (null_distributions.cols() == 1 || null_distributions.cols() == statistics.cols());
         matrix_type pvalues (statistics.rows(), statistics.cols());
 
-        auto s2p = [] (const vector<value_type>& null_dist, const matrix_type::ConstColXpr in, matrix_type::ColXpr out)
+        auto s2p = [&] (const vector<value_type>& null_dist, const matrix_type::ConstColXpr in, matrix_type::ColXpr out)
         {
+          std::unique_ptr<ParetoTail> tail (tail_approximation ? new ParetoTail (null_dist) : nullptr);
           for (ssize_t element = 0; element != in.size(); ++element) {
-            if (in[element] > 0.0) {
+            if (tail && tail->applies (in[element])) {
+              out[element] = 1.0 - tail->pvalue (in[element]);
+            } else if (in[element] > 0.0) {
               value_type pvalue = 1.0;
               for (size_t j = 0; j < size_t(null_dist.size()); ++j) {
                 if (in[element] < null_dist[j]) {
@@ -30,7 +30,11 @@ namespace MR
 
 
 
-      matrix_type fwe_pvalue (const matrix_type& null_dist, const matrix_type& stats);
+      // If tail_approximation is set, statistics lying beyond the bulk of the null
+      //   distribution are assigned p-values from a generalised Pareto distribution
+      //   fitted to the upper tail of that null distribution, rather than being
+      //   limited by the number of shuffles
+      matrix_type fwe_pvalue (const matrix_type& null_dist, const matrix_type& stats, const bool tail_approximation = false);
 
 
 
@@ -16,6 +16,8 @@
 
 #include "math/stats/glm.h"
 
+#include <chrono>
+
 #include "debug.h"
 #include "thread_queue.h"
 #include "math/betainc.h"
@@ -50,6 +52,7 @@ namespace MR
             "The contrast matrix must also reflect the presence of this additional column.";
 
 
+
         App::OptionGroup glm_options (const std::string& element_name)
         {
           using namespace App;
@@ -69,7 +72,11 @@ namespace MR
             + Option ("column", "add a column to the design matrix corresponding to subject " + element_name + "-wise values "
                                 "(note that the contrast matrix must include an additional column for each use of this option); "
                                 "the text file provided via this option should contain a file name for each subject").allow_multiple()
-              + Argument ("path").type_file_in();
+              + Argument ("path").type_file_in()
+
+            + Option ("float32", "store the input data for all subjects in single precision; this halves the memory "
+                                 "required to hold the data for large cohorts, while all model fitting "
+                                 "is still performed in double precision");
 
           return result;
         }
@@ -331,7 +338,7 @@ namespace MR
 
 
 
-        void all_stats (const matrix_type& measurements,
+        void all_stats (const Measurements& measurements,
                         const matrix_type& fixed_design,
                         const vector<CohortDataImport>& extra_data,
                         const vector<Hypothesis>& hypotheses,
@@ -343,7 +350,31 @@ namespace MR
                         matrix_type& stdev)
         {
           if (extra_data.empty() && measurements.allFinite()) {
-            all_stats (measurements, fixed_design, hypotheses, variance_groups, betas, abs_effect_size, std_effect_size, stdev);
+            if (measurements.cols() <= elements_per_chunk) {
+              all_stats (measurements.columns (0, measurements.cols()), fixed_design, hypotheses, variance_groups,
+                         betas, abs_effect_size, std_effect_size, stdev);
+              return;
+            }
+            // Compute in chunks of elements, so that no full-size double-precision
+            //   copy of the measurement matrix or the model residuals is ever made
+            const ssize_t num_vgs = variance_groups.size() ? variance_groups.maxCoeff()+1 : 1;
+            betas.resize (fixed_design.cols(), measurements.cols());
+            abs_effect_size.resize (measurements.cols(), hypotheses.size());
+            std_effect_size.resize (measurements.cols(), hypotheses.size());
+            stdev.resize (num_vgs, measurements.cols());
+            matrix_type chunk_betas, chunk_abs_effect_size, chunk_std_effect_size, chunk_stdev;
+            ProgressBar progress ("Calculating basic properties of default permutation",
+                                  (measurements.cols() + elements_per_chunk - 1) / elements_per_chunk);
+            for (ssize_t chunk_start = 0; chunk_start < measurements.cols(); chunk_start += elements_per_chunk) {
+              const ssize_t chunk_size = std::min (elements_per_chunk, measurements.cols() - chunk_start);
+              all_stats (measurements.columns (chunk_start, chunk_size), fixed_design, hypotheses, variance_groups,
+                         chunk_betas, chunk_abs_effect_size, chunk_std_effect_size, chunk_stdev);
+              betas.middleCols (chunk_start, chunk_size) = chunk_betas;
+              abs_effect_size.middleRows (chunk_start, chunk_size) = chunk_abs_effect_size;
+              std_effect_size.middleRows (chunk_start, chunk_size) = chunk_std_effect_size;
+              stdev.middleCols (chunk_start, chunk_size) = chunk_stdev;
+              ++progress;
+            }
             return;
           }
 
@@ -374,7 +405,7 @@ namespace MR
           class Functor
           { MEMALIGN(Functor)
             public:
-              Functor (const matrix_type& data, const matrix_type& design_fixed, const vector<CohortDataImport>& extra_data, const vector<Hypothesis>& hypotheses, const index_array_type& variance_groups,
+              Functor (const Measurements& data, const matrix_type& design_fixed, const vector<CohortDataImport>& extra_data, const vector<Hypothesis>& hypotheses, const index_array_type& variance_groups,
                        vector_type& cond, matrix_type& betas, matrix_type& abs_effect_size, matrix_type& std_effect_size, matrix_type& stdev) :
                   data (data),
                   design_fixed (design_fixed),
@@ -392,7 +423,7 @@ namespace MR
               }
               bool operator() (const size_t& element_index)
               {
-                const matrix_type element_data = data.col (element_index);
+                const matrix_type element_data = data.columns (element_index, 1);
                 matrix_type element_design (design_fixed.rows(), design_fixed.cols() + extra_data.size());
                 element_design.leftCols (design_fixed.cols()) = design_fixed;
                 // For each element-wise design matrix column,
@@ -451,7 +482,7 @@ namespace MR
                 return true;
               }
             private:
-              const matrix_type& data;
+              const Measurements& data;
               const matrix_type& design_fixed;
               const vector<CohortDataImport>& extra_data;
               const vector<Hypothesis>& hypotheses;
@@ -564,7 +595,71 @@ namespace MR
 
 
 
-        TestFixedHomoscedastic::TestFixedHomoscedastic (const matrix_type& measurements, const matrix_type& design, const vector<Hypothesis>& hypotheses) :
+        // Apply a shuffling matrix to data
+        // Where the shuffling matrix is a signed permutation matrix (i.e. each row contains
+        //   a single non-zero entry of unit magnitude), as is the case for all permutations
+        //   and sign-flips, this is performed as a row gather rather than a dense matrix product
+        class TestFixedHomoscedastic::RowShuffle
+        { NOMEMALIGN
+          public:
+            RowShuffle (const matrix_type& shuffling_matrix) :
+                S (shuffling_matrix),
+                source (S.rows(), 0),
+                sign (S.rows(), value_type(0)),
+                is_signed_permutation (true)
+            {
+              for (ssize_t row = 0; row != S.rows() && is_signed_permutation; ++row) {
+                bool found = false;
+                for (ssize_t col = 0; col != S.cols(); ++col) {
+                  if (S(row, col)) {
+                    if (found || std::abs (S(row, col)) != value_type(1)) {
+                      is_signed_permutation = false;
+                      break;
+                    }
+                    source[row] = col;
+                    sign[row] = S(row, col);
+                    found = true;
+                  }
+                }
+              }
+            }
+
+            void operator() (const matrix_type& in, matrix_type& out) const
+            {
+              if (!is_signed_permutation) {
+                out.noalias() = S * in;
+                return;
+              }
+              out.resize (S.rows(), in.cols());
+              for (ssize_t row = 0; row != S.rows(); ++row)
+                out.row (row) = sign[row] * in.row (source[row]);
+            }
+
+          private:
+            const matrix_type& S;
+            vector<ssize_t> source;
+            vector<value_type> sign;
+            bool is_signed_permutation;
+        };
+
+        // Accumulate the time elapsed since the previous checkpoint into a stage counter
+        class TestFixedHomoscedastic::StageClock
+        { NOMEMALIGN
+          public:
+            StageClock () : last (std::chrono::steady_clock::now()) { }
+            void operator() (std::atomic<uint64_t>& counter)
+            {
+              const auto now = std::chrono::steady_clock::now();
+              counter += std::chrono::duration_cast<std::chrono::nanoseconds> (now - last).count();
+              last = now;
+            }
+          private:
+            std::chrono::steady_clock::time_point last;
+        };
+
+
+
+        TestFixedHomoscedastic::TestFixedHomoscedastic (const Measurements& measurements, const matrix_type& design, const vector<Hypothesis>& hypotheses) :
             TestBase (measurements, design, hypotheses),
             pinvM (Math::pinv (M)),
             Rm (matrix_type::Identity (num_inputs(), num_inputs()) - (M*pinvM))
@@ -575,7 +670,49 @@ namespace MR
             partitions.emplace_back (h.partition (design));
             XtX.emplace_back (partitions.back().X.transpose()*partitions.back().X);
             one_over_dof.push_back (1.0 / (num_inputs() - partitions.back().rank_x - partitions.back().rank_z));
+            // Regression against nuisance regressors is applied as a rank-limited projection
+            //   rather than via multiplication by the (dense) residual-forming matrix Rz
+            pinvZ.emplace_back (partitions.back().rank_z ?
+                                Math::pinv (partitions.back().Z) :
+                                matrix_type (matrix_type::Zero (0, num_inputs())));
           }
+          for (auto& t : stage_time_ns)
+            t = 0;
+        }
+
+
+
+        TestFixedHomoscedastic::~TestFixedHomoscedastic()
+        {
+          for (const auto& t : stage_timings())
+            DEBUG ("Fixed GLM test: " + t.first + ": " + str(t.second) + "s");
+        }
+
+
+
+        vector<std::pair<std::string, default_type>> TestFixedHomoscedastic::stage_timings() const
+        {
+          const char* const names[] = { "nuisance regression", "shuffling", "model fit", "statistic" };
+          vector<std::pair<std::string, default_type>> result;
+          for (size_t i = 0; i != num_stages; ++i)
+            result.emplace_back (names[i], 1.0e-9 * default_type(stage_time_ns[i].load()));
+          return result;
+        }
+
+
+
+        void TestFixedHomoscedastic::shuffle (const size_t ih, const matrix_type& y_chunk, const RowShuffle& shuffler, StageClock& clock,
+                                              matrix_type& Rz_y, matrix_type& Sy) const
+        {
+          // Freedman-Lane: the initial 'effective' regression against the nuisance
+          //   variables, followed by permutation of the resulting residuals
+          if (pinvZ[ih].rows())
+            Rz_y.noalias() = y_chunk - partitions[ih].Z * (pinvZ[ih] * y_chunk);
+          else
+            Rz_y = y_chunk;
+          clock (stage_time_ns[NUISANCE]);
+          shuffler (Rz_y, Sy);
+          clock (stage_time_ns[SHUFFLE]);
         }
 
 
@@ -588,76 +725,91 @@ namespace MR
           stats .resize (num_elements(), num_hypotheses());
           zstats.resize (num_elements(), num_hypotheses());
 
-          matrix_type Sy, lambdas, residuals, beta;
+          matrix_type y_chunk, Rz_y, Sy, lambdas, residuals, beta;
           vector_type sse;
-
-          // Freedman-Lane for fixed design matrix case
-          // Each hypothesis needs to be handled explicitly on its own
-          for (size_t ih = 0; ih != c.size(); ++ih) {
-
-            // First, we perform permutation of the input data
-            // In Freedman-Lane, the initial 'effective' regression against the nuisance
-            //   variables, and permutation of the data, are done in a single step
+          const RowShuffle shuffler (shuffling_matrix);
+          StageClock clock;
+
+          // Elements are processed in chunks, such that the memory required for
+          //   intermediate data does not scale with the total number of elements
+          for (ssize_t chunk_start = 0; chunk_start < y.cols(); chunk_start += elements_per_chunk) {
+            const ssize_t chunk_size = std::min (elements_per_chunk, y.cols() - chunk_start);
+            y_chunk = y.columns (chunk_start, chunk_size);
+
+            // Freedman-Lane for fixed design matrix case
+            // Each hypothesis needs to be handled explicitly on its own
+            for (size_t ih = 0; ih != c.size(); ++ih) {
+
+              // First, we perform permutation of the input data
+              // In Freedman-Lane, the initial 'effective' regression against the nuisance
+              //   variables, and permutation of the data, are done in a single step
 #ifdef GLM_TEST_DEBUG
-            VAR (shuffling_matrix.rows());
-            VAR (shuffling_matrix.cols());
-            VAR (partitions[ih].Rz.rows());
-            VAR (partitions[ih].Rz.cols());
-            VAR (y.rows());
-            VAR (y.cols());
+              VAR (shuffling_matrix.rows());
+              VAR (shuffling_matrix.cols());
+              VAR (partitions[ih].Rz.rows());
+              VAR (partitions[ih].Rz.cols());
+              VAR (y.rows());
+              VAR (y.cols());
 #endif
-            Sy.noalias() = shuffling_matrix * partitions[ih].Rz * y;
+              shuffle (ih, y_chunk, shuffler, clock, Rz_y, Sy);
 #ifdef GLM_TEST_DEBUG
-            VAR (Sy.rows());
-            VAR (Sy.cols());
-            VAR (pinvM.rows());
-            VAR (pinvM.cols());
+              VAR (Sy.rows());
+              VAR (Sy.cols());
+              VAR (pinvM.rows());
+              VAR (pinvM.cols());
 #endif
-            // Now, we regress this shuffled data against the full model
-            lambdas.noalias() = pinvM * Sy;
+              // Now, we regress this shuffled data against the full model
+              lambdas.noalias() = pinvM * Sy;
 #ifdef GLM_TEST_DEBUG
-            VAR (lambdas.rows());
-            VAR (lambdas.cols());
-            //VAR (matrix_type(c[ih]).rows());
-            //VAR (matrix_type(c[ih]).cols());
-            VAR (Rm.rows());
-            VAR (Rm.cols());
-            VAR (XtX[ih].rows());
-            VAR (XtX[ih].cols());
-            VAR (one_over_dof);
+              VAR (lambdas.rows());
+              VAR (lambdas.cols());
+              //VAR (matrix_type(c[ih]).rows());
+              //VAR (matrix_type(c[ih]).cols());
+              VAR (Rm.rows());
+              VAR (Rm.cols());
+              VAR (XtX[ih].rows());
+              VAR (XtX[ih].cols());
+              VAR (one_over_dof);
 #endif
-            const size_t dof = num_inputs() - partitions[ih].rank_x - partitions[ih].rank_z;
-            const default_type one_over_dof = 1.0 / default_type(dof);
-            sse = (Rm*Sy).colwise().squaredNorm();
+              const size_t dof = num_inputs() - partitions[ih].rank_x - partitions[ih].rank_z;
+              const default_type one_over_dof = 1.0 / default_type(dof);
+              // Residuals of the full model; equivalent to Rm*Sy, but without
+              //   a dense multiplication by the residual-forming matrix
+              residuals.noalias() = Sy - M * lambdas;
+              sse = residuals.colwise().squaredNorm();
 #ifdef GLM_TEST_DEBUG
-            VAR (dof);
-            VAR (one_over_dof);
-            VAR (sse.size());
+              VAR (dof);
+              VAR (one_over_dof);
+              VAR (sse.size());
 #endif
-            for (size_t ie = 0; ie != num_elements(); ++ie) {
-              beta.noalias() = c[ih].matrix() * lambdas.col (ie);
-              const default_type F = ((beta.transpose() * XtX[ih] * beta) (0,0) / c[ih].rank()) /
-                                     (one_over_dof * sse[ie]);
-              if (!std::isfinite (F)) {
-                stats  (ie, ih) = zstats (ie, ih) = value_type(0);
-              } else if (c[ih].is_F()) {
-                stats  (ie, ih) = F;
+              clock (stage_time_ns[FIT]);
+              for (ssize_t ie_chunk = 0; ie_chunk != chunk_size; ++ie_chunk) {
+                const ssize_t ie = chunk_start + ie_chunk;
+                beta.noalias() = c[ih].matrix() * lambdas.col (ie_chunk);
+                const default_type F = ((beta.transpose() * XtX[ih] * beta) (0,0) / c[ih].rank()) /
+                                       (one_over_dof * sse[ie_chunk]);
+                if (!std::isfinite (F)) {
+                  stats  (ie, ih) = zstats (ie, ih) = value_type(0);
+                } else if (c[ih].is_F()) {
+                  stats  (ie, ih) = F;
 #ifdef MRTRIX_USE_ZSTATISTIC_LOOKUP
-                zstats (ie, ih) = stat2z->F2z (F, c[ih].rank(), dof);
+                  zstats (ie, ih) = stat2z->F2z (F, c[ih].rank(), dof);
 #else
-                zstats (ie, ih) = Math::F2z (F, c[ih].rank(), dof);
+                  zstats (ie, ih) = Math::F2z (F, c[ih].rank(), dof);
 #endif
-              } else {
-                assert (beta.rows() == 1);
-                stats  (ie, ih) = std::sqrt (F) * (beta.sum() > 0.0 ? 1.0 : -1.0);
+                } else {
+                  assert (beta.rows() == 1);
+                  stats  (ie, ih) = std::sqrt (F) * (beta.sum() > 0.0 ? 1.0 : -1.0);
 #ifdef MRTRIX_USE_ZSTATISTIC_LOOKUP
-                zstats (ie, ih) = stat2z->t2z (stats (ie, ih), dof);
+                  zstats (ie, ih) = stat2z->t2z (stats (ie, ih), dof);
 #else
-                zstats (ie, ih) = Math::t2z (stats (ie, ih), dof);
+                  zstats (ie, ih) = Math::t2z (stats (ie, ih), dof);
 #endif
+                }
               }
-            }
+              clock (stage_time_ns[STATISTIC]);
 
+            }
           }
         }
 
@@ -669,7 +821,7 @@ namespace MR
 
 
 
-        TestFixedHeteroscedastic::TestFixedHeteroscedastic (const matrix_type& measurements, const matrix_type& design, const vector<Hypothesis>& hypotheses, const index_array_type& variance_groups) :
+        TestFixedHeteroscedastic::TestFixedHeteroscedastic (const Measurements& measurements, const matrix_type& design, const vector<Hypothesis>& hypotheses, const index_array_type& variance_groups) :
             TestFixedHomoscedastic (measurements, design, hypotheses),
             VG (variance_groups),
             num_vgs (VG.maxCoeff() + 1),
@@ -711,109 +863,119 @@ namespace MR
           stats.resize (num_elements(), num_hypotheses());
           zstats.resize (num_elements(), num_hypotheses());
 
-          matrix_type Sy, lambdas;
+          matrix_type y_chunk, Rz_y, Sy, lambdas;
           Eigen::Array<default_type, Eigen::Dynamic, Eigen::Dynamic> sq_residuals, sse, Wterms;
+          const RowShuffle shuffler (shuffling_matrix);
+          StageClock clock;
           Eigen::Matrix<default_type, Eigen::Dynamic, 1> W (num_inputs());
 #ifdef GLM_TEST_DEBUG
           VAR (shuffling_matrix);
 #endif
 
-          for (size_t ih = 0; ih != c.size(); ++ih) {
-            // First two steps are identical to the homoscedastic case
-            Sy.noalias() = shuffling_matrix * partitions[ih].Rz * y;
+          for (ssize_t chunk_start = 0; chunk_start < y.cols(); chunk_start += elements_per_chunk) {
+            const ssize_t chunk_size = std::min (elements_per_chunk, y.cols() - chunk_start);
+            y_chunk = y.columns (chunk_start, chunk_size);
+
+            for (size_t ih = 0; ih != c.size(); ++ih) {
+              // First two steps are identical to the homoscedastic case
+              shuffle (ih, y_chunk, shuffler, clock, Rz_y, Sy);
 #ifdef GLM_TEST_DEBUG
-            VAR (Sy);
+              VAR (Sy);
 #endif
-            lambdas.noalias() = pinvM * Sy;
+              lambdas.noalias() = pinvM * Sy;
 #ifdef GLM_TEST_DEBUG
-            VAR (lambdas);
+              VAR (lambdas);
 #endif
-            // Compute sum of residuals per VG immediately
-            // Variance groups appear across rows, and one column per element tested
-            // Immediately calculate squared residuals; simplifies summation over variance groups
-            sq_residuals = (Rm*Sy).array().square();
+              // Compute sum of residuals per VG immediately
+              // Variance groups appear across rows, and one column per element tested
+              // Immediately calculate squared residuals; simplifies summation over variance groups
+              sq_residuals = (Sy - M * lambdas).array().square();
 #ifdef GLM_TEST_DEBUG
-            VAR (sq_residuals);
-            VAR (sq_residuals.rows());
-            VAR (sq_residuals.cols());
+              VAR (sq_residuals);
+              VAR (sq_residuals.rows());
+              VAR (sq_residuals.cols());
 #endif
-            sse = matrix_type::Zero (num_variance_groups(), num_elements());
-            for (size_t input = 0; input != num_inputs(); ++input)
-              sse.row(VG[input]) += sq_residuals.row(input);
+              sse = matrix_type::Zero (num_variance_groups(), chunk_size);
+              for (size_t input = 0; input != num_inputs(); ++input)
+                sse.row(VG[input]) += sq_residuals.row(input);
 #ifdef GLM_TEST_DEBUG
-            VAR (sse);
-            VAR (sse.rows());
-            VAR (sse.cols());
+              VAR (sse);
+              VAR (sse.rows());
+              VAR (sse.cols());
 #endif
-            // These terms are what appears in the weighting matrix based on the VG to which each input belongs;
-            //   one row per variance group, one column per element to be tested
-            Wterms = sse.array().inverse().colwise() * Rnn_sums;
-            for (size_t col = 0; col != num_elements(); ++col) {
-              for (size_t row = 0; row != num_vgs; ++row) {
-                if (!std::isfinite (Wterms (row, col)))
-                  Wterms (row, col) = 0.0;
+              // These terms are what appears in the weighting matrix based on the VG to which each input belongs;
+              //   one row per variance group, one column per element to be tested
+              Wterms = sse.array().inverse().colwise() * Rnn_sums;
+              for (ssize_t col = 0; col != chunk_size; ++col) {
+                for (size_t row = 0; row != num_vgs; ++row) {
+                  if (!std::isfinite (Wterms (row, col)))
+                    Wterms (row, col) = 0.0;
+                }
               }
-            }
 #ifdef GLM_TEST_DEBUG
-            VAR (Wterms);
-            VAR (Wterms.rows());
-            VAR (Wterms.cols());
+              VAR (Wterms);
+              VAR (Wterms.rows());
+              VAR (Wterms.cols());
 #endif
-            for (size_t ie = 0; ie != num_elements(); ++ie) {
-              // Need to construct the weights diagonal matrix; is unique for each element
-              default_type W_trace (0.0);
-              for (size_t input = 0; input != num_inputs(); ++input) {
-                W[input] = Wterms(VG[input], ie);
-                W_trace += W[input];
-              }
+              clock (stage_time_ns[FIT]);
+              for (ssize_t ie_chunk = 0; ie_chunk != chunk_size; ++ie_chunk) {
+                const ssize_t ie = chunk_start + ie_chunk;
+                // Need to construct the weights diagonal matrix; is unique for each element
+                default_type W_trace (0.0);
+                for (size_t input = 0; input != num_inputs(); ++input) {
+                  W[input] = Wterms(VG[input], ie_chunk);
+                  W_trace += W[input];
+                }
 #ifdef GLM_TEST_DEBUG
-              VAR (W_trace);
+                VAR (W_trace);
 #endif
-              const default_type numerator = lambdas.col (ie).transpose() * c[ih].matrix().transpose() * (c[ih].matrix() * (M.transpose() * W.asDiagonal() * M).inverse() * c[ih].matrix().transpose()).inverse() * c[ih].matrix() * lambdas.col (ie);
+                const default_type numerator = lambdas.col (ie_chunk).transpose() * c[ih].matrix().transpose() * (c[ih].matrix() * (M.transpose() * W.asDiagonal() * M).inverse() * c[ih].matrix().transpose()).inverse() * c[ih].matrix() * lambdas.col (ie_chunk);
 #ifdef GLM_TEST_DEBUG
-              VAR (numerator);
+                VAR (numerator);
 #endif
-              default_type gamma (0.0);
-              for (size_t vg_index = 0; vg_index != num_vgs; ++vg_index)
-                // Since Wnn is the same for every n in the variance group, can compute that summation as the product of:
-                //   - the value inserted in W for that particular VG
-                //   - the number of inputs that are a part of that VG
-                gamma += inv_Rnn_sums[vg_index] * Math::pow2 (1.0 - ((Wterms(vg_index, ie) * inputs_per_vg[vg_index]) / W_trace));
-              gamma = 1.0 + (gamma_weights[ih] * gamma);
+                default_type gamma (0.0);
+                for (size_t vg_index = 0; vg_index != num_vgs; ++vg_index)
+                  // Since Wnn is the same for every n in the variance group, can compute that summation as the product of:
+                  //   - the value inserted in W for that particular VG
+                  //   - the number of inputs that are a part of that VG
+                  gamma += inv_Rnn_sums[vg_index] * Math::pow2 (1.0 - ((Wterms(vg_index, ie_chunk) * inputs_per_vg[vg_index]) / W_trace));
+                gamma = 1.0 + (gamma_weights[ih] * gamma);
 #ifdef GLM_TEST_DEBUG
-              VAR (gamma);
+                VAR (gamma);
 #endif
-              const default_type denominator = gamma * c[ih].rank();
-              const default_type G = numerator / denominator;
-              if (!std::isfinite (G)) {
-                stats  (ie, ih) = zstats (ie, ih) = value_type(0);
-              } else {
-                stats  (ie, ih) = c[ih].is_F() ?
-                                  G :
-                                  std::sqrt (G) * ((c[ih].matrix() * lambdas.col (ie)).sum() > 0.0 ? 1.0 : -1.0);
-                if (c[ih].is_F() && c[ih].rank() > 1) {
-                  const default_type dof = 2.0 * default_type(c[ih].rank() - 1) / (3.0 * (gamma - 1.0));
+                const default_type denominator = gamma * c[ih].rank();
+                const default_type G = numerator / denominator;
+                if (!std::isfinite (G)) {
+                  stats  (ie, ih) = zstats (ie, ih) = value_type(0);
+                } else {
+                  stats  (ie, ih) = c[ih].is_F() ?
+                                    G :
+                                    std::sqrt (G) * ((c[ih].matrix() * lambdas.col (ie_chunk)).sum() > 0.0 ? 1.0 : -1.0);
+                  if (c[ih].is_F() && c[ih].rank() > 1) {
+                    const default_type dof = 2.0 * default_type(c[ih].rank() - 1) / (3.0 * (gamma - 1.0));
 #ifdef GLM_TEST_DEBUG
-                  VAR (dof);
+                    VAR (dof);
 #endif
-                  zstats (ie, ih) = stat2z->F2z (G, c[ih].rank(), dof);
-                } else {
-                  const default_type dof = Math::welch_satterthwaite (Wterms.col (ie).inverse(), inputs_per_vg);
+                    zstats (ie, ih) = stat2z->F2z (G, c[ih].rank(), dof);
+                  } else {
+                    const default_type dof = Math::welch_satterthwaite (Wterms.col (ie_chunk).inverse(), inputs_per_vg);
 #ifdef GLM_TEST_DEBUG
-                  VAR (dof);
+                    VAR (dof);
 #endif
-                  zstats (ie, ih) = c[ih].is_F() ?
+                    zstats (ie, ih) = c[ih].is_F() ?
 #ifdef MRTRIX_USE_ZSTATISTIC_LOOKUP
-                                    stat2z->G2z (G, c[ih].rank(), dof) :
-                                    stat2z->v2z (stats (ie, ih), dof);
+                                      stat2z->G2z (G, c[ih].rank(), dof) :
+                                      stat2z->v2z (stats (ie, ih), dof);
 #else
-                                    Math::F2z (G, c[ih].rank(), dof) :
-                                    Math::t2z (stats (ie, ih), dof);
+                                      Math::F2z (G, c[ih].rank(), dof) :
+                                      Math::t2z (stats (ie, ih), dof);
 #endif
+                  }
                 }
               }
-            }
+              clock (stage_time_ns[STATISTIC]);
 
+            }
           }
         }
 
@@ -829,7 +991,7 @@ namespace MR
 
 
         TestVariableHomoscedastic::TestVariableHomoscedastic (const vector<CohortDataImport>& importers,
-                                                              const matrix_type& measurements,
+                                                              const Measurements& measurements,
                                                               const matrix_type& design,
                                                               const vector<Hypothesis>& hypotheses,
                                                               const bool nans_in_data,
@@ -900,7 +1062,7 @@ namespace MR
               dof.row (ie).fill (NaN);
             } else {
               apply_mask (element_mask,
-                          y.col (ie),
+                          y.column (ie),
                           shuffling_matrix,
                           extra_column_data,
                           Mfull_masked,
@@ -1004,7 +1166,7 @@ namespace MR
 
 
         void TestVariableHomoscedastic::apply_mask (const BitSet& mask,
-                                                    matrix_type::ConstColXpr data,
+                                                    const vector_type& data,
                                                     const matrix_type& shuffling_matrix,
                                                     const matrix_type& extra_column_data,
                                                     matrix_type& Mfull_masked,
@@ -1079,7 +1241,7 @@ namespace MR
 
 
         TestVariableHeteroscedastic::TestVariableHeteroscedastic (const vector<CohortDataImport>& importers,
-                                                                  const matrix_type& measurements,
+                                                                  const Measurements& measurements,
                                                                   const matrix_type& design,
                                                                   const vector<Hypothesis>& hypotheses,
                                                                   const index_array_type& variance_groups,
@@ -1122,7 +1284,7 @@ namespace MR
               zstats.row (ie).setZero();
             } else {
               apply_mask (element_mask,
-                          y.col (ie),
+                          y.column (ie),
                           shuffling_matrix,
                           extra_column_data,
                           Mfull_masked,
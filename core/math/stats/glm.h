@@ -17,6 +17,9 @@
 #ifndef __math_stats_glm_h__
 #define __math_stats_glm_h__
 
+#include <array>
+#include <atomic>
+
 #include "app.h"
 #include "types.h"
 
@@ -24,6 +27,7 @@
 #include "math/least_squares.h"
 #include "math/zstatistic.h"
 #include "math/stats/import.h"
+#include "math/stats/measurements.h"
 #include "math/stats/typedefs.h"
 
 #include "misc/bitset.h"
@@ -189,7 +193,8 @@ namespace MR
         /*! Compute all GLM-related statistics
          * This function can be used when the design matrix varies between elements,
          * due to importing external data for each element from external files
-         * @param measurements a matrix storing the measured data for each subject in a column
+         * @param measurements the measured data for each subject in a row; these are processed in
+         * chunks of elements, such that no full-size copy of the data is ever made
          * @param design the fixed portion of the design matrix
          * @param extra_columns the variable columns of the design matrix
          * @param hypotheses a vector of Hypothesis class instances defining the effects of interest
@@ -198,7 +203,7 @@ namespace MR
          * @param std_effect_size the matrix containing the output standardised effect size
          * @param stdev the matrix containing the output standard deviation
          */
-        void all_stats (const matrix_type& measurements, const matrix_type& design, const vector<CohortDataImport>& extra_columns, const vector<Hypothesis>& hypotheses, const index_array_type& variance_groups,
+        void all_stats (const Measurements& measurements, const matrix_type& design, const vector<CohortDataImport>& extra_columns, const vector<Hypothesis>& hypotheses, const index_array_type& variance_groups,
                         vector_type& cond, matrix_type& betas, matrix_type& abs_effect_size, matrix_type& std_effect_size, matrix_type& stdev);
 
         //! @}
@@ -212,7 +217,7 @@ namespace MR
         class TestBase
         { MEMALIGN(TestBase)
           public:
-            TestBase (const matrix_type& measurements, const matrix_type& design, const vector<Hypothesis>& hypotheses) :
+            TestBase (const Measurements& measurements, const matrix_type& design, const vector<Hypothesis>& hypotheses) :
                 y (measurements),
                 M (design),
                 c (hypotheses),
@@ -250,7 +255,8 @@ namespace MR
             virtual size_t num_factors() const { return M.cols(); }
 
           protected:
-            const matrix_type& y, M;
+            const Measurements& y;
+            const matrix_type& M;
             const vector<Hypothesis>& c;
             std::shared_ptr<Math::Zstatistic> stat2z;
 
@@ -274,14 +280,16 @@ namespace MR
         { MEMALIGN(TestFixedHomoscedastic)
           public:
             /*!
-             * @param measurements a matrix storing the measured data across subjects in each column
+             * @param measurements the measured data, with one row per subject and one column per element
              * @param design the design matrix
              * @param hypotheses a vector of Hypothesis instances
              */
-            TestFixedHomoscedastic (const matrix_type& measurements,
+            TestFixedHomoscedastic (const Measurements& measurements,
                                     const matrix_type& design,
                                     const vector<Hypothesis>& hypotheses);
 
+            ~TestFixedHomoscedastic();
+
             /*! Compute the statistics
              * @param shuffling_matrix a matrix to permute / sign flip the residuals (for permutation testing)
              * @param stats the vector containing the output statistics (one column per hypothesis)
@@ -289,13 +297,32 @@ namespace MR
              */
             void operator() (const matrix_type& shuffling_matrix, matrix_type& stats, matrix_type& zstats) const override;
 
+            /*! Get the total execution time of each stage of computation
+             * Times are in seconds, summed across all threads and all invocations of the functor
+             */
+            vector<std::pair<std::string, default_type>> stage_timings() const;
+
           protected:
+            class RowShuffle;
+            class StageClock;
+
             // New classes to store information relevant to Freedman-Lane implementation
             vector<Hypothesis::Partition> partitions;
             const matrix_type pinvM;
             const matrix_type Rm;
             vector<matrix_type> XtX;
             vector<default_type> one_over_dof;
+            // Pseudo-inverse of the nuisance regressors for each hypothesis;
+            //   empty where there are no nuisance regressors
+            vector<matrix_type> pinvZ;
+
+            enum stage_t { NUISANCE, SHUFFLE, FIT, STATISTIC, num_stages };
+            mutable std::array<std::atomic<uint64_t>, num_stages> stage_time_ns;
+
+            // Regress the data for a chunk of elements against the nuisance regressors
+            //   of a given hypothesis, and then shuffle the result
+            void shuffle (const size_t ih, const matrix_type& y_chunk, const RowShuffle& shuffler, StageClock& clock,
+                          matrix_type& Rz_y, matrix_type& Sy) const;
 
         };
         //! @}
@@ -316,12 +343,12 @@ namespace MR
         { MEMALIGN(TestFixedHeteroscedastic)
           public:
             /*!
-             * @param measurements a matrix storing the measured data across subjects in each column
+             * @param measurements the measured data, with one row per subject and one column per element
              * @param design the design matrix
              * @param hypotheses a vector of Hypothesis instances
              * @param variance_groups a vector of integers corresponding to variance group assignments (should be indexed from zero)
              */
-            TestFixedHeteroscedastic (const matrix_type& measurements,
+            TestFixedHeteroscedastic (const Measurements& measurements,
                                       const matrix_type& design,
                                       const vector<Hypothesis>& hypotheses,
                                       const index_array_type& variance_groups);
@@ -374,7 +401,7 @@ namespace MR
         { MEMALIGN(TestVariableHomoscedastic)
           public:
             TestVariableHomoscedastic (const vector<CohortDataImport>& importers,
-                                       const matrix_type& measurements,
+                                       const Measurements& measurements,
                                        const matrix_type& design,
                                        const vector<Hypothesis>& hypotheses,
                                        const bool nans_in_data,
@@ -398,7 +425,7 @@ namespace MR
 
             void get_mask (const size_t ie, BitSet&, const matrix_type& extra_columns) const;
             void apply_mask (const BitSet& mask,
-                             matrix_type::ConstColXpr data,
+                             const vector_type& data,
                              const matrix_type& shuffling_matrix,
                              const matrix_type& extra_column_data,
                              matrix_type& Mfull_masked,
@@ -428,7 +455,7 @@ namespace MR
         { MEMALIGN(TestVariableHeteroscedastic)
           public:
             TestVariableHeteroscedastic (const vector<CohortDataImport>& importers,
-                                         const matrix_type& measurements,
+                                         const Measurements& measurements,
                                          const matrix_type& design,
                                          const vector<Hypothesis>& hypotheses,
                                          const index_array_type& variance_groups,
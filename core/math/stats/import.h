@@ -102,6 +102,9 @@ namespace MR
 
           size_t size() const { return files.size(); }
 
+          //! Add an input for which the mechanism of data access has already been constructed
+          void add (std::shared_ptr<SubjectDataImportBase> subject) { files.push_back (subject); }
+
           std::shared_ptr<SubjectDataImportBase> operator[] (const size_t i) const
           {
             assert (i < files.size());
@@ -0,0 +1,165 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include "math/stats/measurements.h"
+
+#include "progressbar.h"
+#include "thread_queue.h"
+
+namespace MR
+{
+  namespace Math
+  {
+    namespace Stats
+    {
+
+
+
+      Measurements::Measurements (const size_t num_inputs, const size_t num_elements, const bool single_precision) :
+          is_float (single_precision)
+      {
+        if (is_float)
+          float_data.resize (num_inputs, num_elements);
+        else
+          double_data.resize (num_inputs, num_elements);
+      }
+
+
+
+      void Measurements::load (const CohortDataImport& importer, const std::string& message)
+      {
+        assert (importer.size() == size_t(rows()));
+
+        class Source
+        { NOMEMALIGN
+          public:
+            Source (const size_t num_inputs, const std::string& message) :
+                num_inputs (num_inputs),
+                counter (0),
+                progress (message, num_inputs) { }
+            bool operator() (size_t& index)
+            {
+              index = counter++;
+              if (index >= num_inputs)
+                return false;
+              ++progress;
+              return true;
+            }
+          private:
+            const size_t num_inputs;
+            size_t counter;
+            ProgressBar progress;
+        };
+
+        // Each input is written to its own row of the measurement matrix,
+        //   so different inputs can be safely imported concurrently
+        class Loader
+        { NOMEMALIGN
+          public:
+            Loader (const CohortDataImport& importer, Measurements& data) :
+                importer (importer),
+                data (data) { }
+            bool operator() (const size_t& index)
+            {
+              if (data.is_float) {
+                // Import into a double-precision buffer for this thread,
+                //   then down-convert into the measurement matrix
+                buffer.resize (1, data.float_data.cols());
+                (*importer[index]) (buffer.row (0));
+                data.float_data.row (index) = buffer.row (0).cast<float>();
+              } else {
+                (*importer[index]) (data.double_data.row (index));
+              }
+              return true;
+            }
+          private:
+            const CohortDataImport& importer;
+            Measurements& data;
+            matrix_type buffer;
+        };
+
+        Source source (importer.size(), message);
+        Loader loader (importer, *this);
+        Thread::run_queue (source, size_t(), Thread::multi (loader));
+      }
+
+
+
+      void Measurements::load (const Image<float>& store, const std::string& message)
+      {
+        if (store.size(0) != cols() || store.size(1) != rows())
+          throw Exception ("Dimensions of image \"" + store.name() + "\" (" + str(store.size(0)) + "x" + str(store.size(1)) + ")"
+                           + " do not match expected number of elements (" + str(cols()) + ") and inputs (" + str(rows()) + ")");
+
+        class Source
+        { NOMEMALIGN
+          public:
+            Source (const ssize_t num_elements, const std::string& message) :
+                num_elements (num_elements),
+                first (0),
+                progress (message, (num_elements + elements_per_chunk - 1) / elements_per_chunk) { }
+            bool operator() (std::pair<ssize_t, ssize_t>& chunk)
+            {
+              if (first >= num_elements)
+                return false;
+              chunk = std::make_pair (first, std::min (first + elements_per_chunk, num_elements));
+              first = chunk.second;
+              ++progress;
+              return true;
+            }
+          private:
+            const ssize_t num_elements;
+            ssize_t first;
+            ProgressBar progress;
+        };
+
+        // Each chunk of elements is written to its own block of columns
+        //   of the measurement matrix
+        class Loader
+        { NOMEMALIGN
+          public:
+            Loader (const Image<float>& store, Measurements& data) :
+                store (store),
+                data (data) { }
+            bool operator() (const std::pair<ssize_t, ssize_t>& chunk)
+            {
+              for (store.index(0) = chunk.first; store.index(0) != chunk.second; ++store.index(0)) {
+                const ssize_t element = store.index(0);
+                for (ssize_t input = 0; input != store.size(1); ++input) {
+                  store.index(1) = input;
+                  if (data.is_float)
+                    data.float_data (input, element) = store.value();
+                  else
+                    data.double_data (input, element) = store.value();
+                }
+              }
+              return true;
+            }
+          private:
+            Image<float> store;
+            Measurements& data;
+        };
+
+        Source source (cols(), message);
+        Loader loader (store, *this);
+        Thread::run_queue (source, std::pair<ssize_t, ssize_t>(), Thread::multi (loader));
+      }
+
+
+
+    }
+  }
+}
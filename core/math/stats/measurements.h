@@ -0,0 +1,126 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#ifndef __math_stats_measurements_h__
+#define __math_stats_measurements_h__
+
+#include <string>
+
+#include "image.h"
+#include "math/stats/import.h"
+#include "math/stats/typedefs.h"
+
+
+namespace MR
+{
+  namespace Math
+  {
+    namespace Stats
+    {
+
+
+
+      //! Number of elements processed at once when loading measurements from
+      //!   a single image, or computing the GLM for a fixed design matrix;
+      //!   bounds the size of intermediate matrices
+      constexpr ssize_t elements_per_chunk = 1024;
+
+
+
+      /** \addtogroup Statistics
+      @{ */
+      /*! Storage of the measurement matrix for a cohort
+       * The measured data are stored with one row per input and one column
+       * per element being tested. For large cohorts, the data may optionally
+       * be held in single precision, halving the memory footprint of the
+       * largest matrix held during statistical inference. Regardless of the
+       * storage precision, data are always yielded in double precision, in
+       * blocks of columns, such that the GLM can be computed in chunks of
+       * elements without ever duplicating the whole matrix.
+       */
+      class Measurements
+      { NOMEMALIGN
+        public:
+          using float_matrix_type = Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic>;
+
+          Measurements (const size_t num_inputs, const size_t num_elements, const bool single_precision = false);
+
+          //! Load the data for all inputs, importing multiple inputs concurrently
+          void load (const CohortDataImport& importer, const std::string& message);
+
+          //! Load the data for all inputs from a single image, with elements along
+          //!   the first axis and inputs along the second; contiguous chunks of
+          //!   elements are read concurrently, each for all inputs at once
+          void load (const Image<float>& store, const std::string& message);
+
+          ssize_t rows() const { return single_precision() ? float_data.rows() : double_data.rows(); }
+          ssize_t cols() const { return single_precision() ? float_data.cols() : double_data.cols(); }
+          bool single_precision() const { return is_float; }
+
+          //! Get a copy of a contiguous block of columns (elements) in double precision
+          matrix_type columns (const ssize_t first, const ssize_t count) const
+          {
+            assert (first >= 0 && count >= 0 && first + count <= cols());
+            if (is_float)
+              return float_data.middleCols (first, count).cast<value_type>();
+            return double_data.middleCols (first, count);
+          }
+
+          //! Get the data for all inputs for a single element
+          vector_type column (const ssize_t index) const
+          {
+            assert (index >= 0 && index < cols());
+            if (is_float)
+              return float_data.col (index).cast<value_type>().array();
+            return double_data.col (index).array();
+          }
+
+          value_type operator() (const ssize_t row, const ssize_t col) const
+          {
+            return is_float ? value_type (float_data (row, col)) : double_data (row, col);
+          }
+
+          bool allFinite() const { return is_float ? float_data.allFinite() : double_data.allFinite(); }
+          bool allFinite (const ssize_t index) const
+          {
+            return is_float ? float_data.col (index).allFinite() : double_data.col (index).allFinite();
+          }
+
+          //! Fill the data for all inputs for a particular element with a fixed value
+          void fill (const ssize_t index, const value_type value)
+          {
+            if (is_float)
+              float_data.col (index).fill (float (value));
+            else
+              double_data.col (index).fill (value);
+          }
+
+        protected:
+          const bool is_float;
+          matrix_type double_data;
+          float_matrix_type float_data;
+
+      };
+      //! @}
+
+
+
+    }
+  }
+}
+
+
+#endif
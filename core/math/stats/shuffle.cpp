@@ -22,6 +22,7 @@
 
 #include "math/factorial.h"
 #include "math/math.h"
+#include "math/rng.h"
 
 namespace MR
 {
@@ -32,6 +33,55 @@ namespace MR
 
 
 
+      namespace
+      {
+        // Counter-based random number generator (SplitMix64):
+        //   each combination of seed and counter values yields an
+        //   independent stream, without any shared state
+        class CounterRNG
+        { NOMEMALIGN
+          public:
+            using result_type = uint64_t;
+            CounterRNG (const uint64_t seed, const uint64_t index, const uint64_t attempt, const uint64_t stream) :
+                state (mix (mix (mix (seed ^ stream) + index) + attempt)) { }
+            static constexpr result_type min() { return 0; }
+            static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+            result_type operator() () { return mix (state += 0x9E3779B97F4A7C15ULL); }
+
+            static uint64_t mix (uint64_t z)
+            {
+              z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+              z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+              return z ^ (z >> 31);
+            }
+          private:
+            uint64_t state;
+        };
+
+        uint64_t hash (const Shuffler::PermuteLabels& labels)
+        {
+          uint64_t result = labels.size();
+          for (const auto i : labels)
+            result = CounterRNG::mix (result ^ i);
+          return result;
+        }
+
+        uint64_t hash (const BitSet& flips)
+        {
+          uint64_t result = flips.size(), word = 0;
+          for (size_t i = 0; i != flips.size(); ++i) {
+            word = (word << 1) | (flips[i] ? 1 : 0);
+            if ((i & 63) == 63) {
+              result = CounterRNG::mix (result ^ word);
+              word = 0;
+            }
+          }
+          return CounterRNG::mix (result ^ word);
+        }
+      }
+
+
+
       const char* error_types[] = { "ee", "ise", "both", nullptr };
 
 
@@ -62,7 +112,22 @@ namespace MR
                                   "where each relabelling is defined as a column vector of size m, and the number of columns, n, defines "
                                   "the number of permutations. Can be generated with the palm_quickperms function in PALM (http://fsl.fmrib.ox.ac.uk/fsl/fslwiki/PALM). "
                                   "Overrides the -nshuffles option.")
-          + Argument ("file").type_file_in();
+          + Argument ("file").type_file_in()
+
+        + Option ("adaptive", "terminate shuffling early once the family-wise error p-value of every element has been resolved: "
+                              "that is, once the confidence interval of each p-value either excludes the significance threshold "
+                              "(see -adaptive_alpha), or is narrower than plus or minus the specified precision. "
+                              "In this case the number of shuffles (whether from -nshuffles or -permutations) becomes an upper limit.")
+          + Argument ("precision").type_float (0.0, 1.0)
+
+        + Option ("adaptive_alpha", "the significance threshold against which family-wise error p-values are classified "
+                                    "when terminating shuffling early using the -adaptive option "
+                                    "(default: " + str(DEFAULT_ADAPTIVE_ALPHA, 2) + ")")
+          + Argument ("value").type_float (0.0, 1.0)
+
+        + Option ("fwe_tail", "approximate the upper tail of the null distribution using a generalised Pareto distribution, "
+                              "such that small family-wise error p-values are estimated more accurately than is possible "
+                              "from the empirical null distribution alone");
 
         if (include_nonstationarity) {
 
@@ -177,7 +242,8 @@ namespace MR
                           const index_array_type& eb_whole,
                           const std::string msg) :
           rows (num_rows),
-          nshuffles (num_shuffles)
+          nshuffles (num_shuffles),
+          counter (0)
       {
         initialise (error_types, true, is_nonstationarity, eb_within, eb_whole);
         if (msg.size())
@@ -197,17 +263,37 @@ namespace MR
           output.data.resize (0, 0);
           return false;
         }
+        // Random shuffles are generated here as they are required; if duplicates are not
+        //   permitted, further candidates are generated for this index until a shuffle
+        //   not previously encountered is found
+        PermuteLabels random_labels;
+        if (random_permutations) {
+          size_t attempt = 0;
+          do {
+            random_permutation (counter, attempt++, random_labels);
+          } while (!permit_duplicate_permutations && !permutation_hashes.insert (hash (random_labels)).second);
+        }
+        BitSet random_flips (random_signflips ? rows : 0);
+        if (random_signflips) {
+          size_t attempt = 0;
+          do {
+            random_signflip (counter, attempt++, random_flips);
+          } while (!permit_duplicate_signflips && !signflip_hashes.insert (hash (random_flips)).second);
+        }
+        const PermuteLabels* labels = random_permutations ? &random_labels : (permutations.size() ? &permutations[counter] : nullptr);
+        const BitSet* flips = random_signflips ? &random_flips : (signflips.size() ? &signflips[counter] : nullptr);
+
         // TESTME Think I need to adjust the signflips application based on the permutations
-        if (permutations.size()) {
+        if (labels) {
           output.data = matrix_type::Zero (rows, rows);
           for (size_t i = 0; i != rows; ++i)
-            output.data (i, permutations[counter][i]) = 1.0;
+            output.data (i, (*labels)[i]) = 1.0;
         } else {
           output.data = matrix_type::Identity (rows, rows);
         }
-        if (signflips.size()) {
+        if (flips) {
           for (size_t r = 0; r != rows; ++r) {
-            if (signflips[counter][r]) {
+            if ((*flips)[r]) {
               for (size_t c = 0; c != rows; ++c) {
                 if (output.data (r, c))
                   output.data (r, c) *= -1.0;
@@ -229,6 +315,15 @@ namespace MR
       {
         counter = 0;
         progress.reset();
+        permutation_hashes.clear();
+        signflip_hashes.clear();
+      }
+
+
+
+      void Shuffler::done()
+      {
+        progress.reset (nullptr);
       }
 
 
@@ -255,6 +350,17 @@ namespace MR
         const bool ee = (error_types == error_t::EE || error_types == error_t::BOTH);
         const bool ise = (error_types == error_t::ISE || error_types == error_t::BOTH);
 
+        random_permutations = random_signflips = false;
+        permit_duplicate_permutations = permit_duplicate_signflips = false;
+        // Only include the default shuffling if this is the actual permutation testing;
+        //   if we're doing nonstationarity correction, don't include the default
+        include_default = !is_nonstationarity;
+        seed = Math::RNG::get_seed();
+        blocks_within = eb_within.size() ? indices2blocks (eb_within) : vector<vector<size_t>>();
+        blocks_whole = eb_whole.size() ? indices2blocks (eb_whole) : vector<vector<size_t>>();
+        permutation_hashes.clear();
+        signflip_hashes.clear();
+
         size_t max_num_permutations;
         if (eb_within.size()) {
           vector<size_t> counts (eb_within.maxCoeff()+1, 0);
@@ -336,13 +442,12 @@ namespace MR
               generate_all_permutations (rows, eb_within, eb_whole);
               assert (permutations.size() == max_num_permutations);
             } else {
-              // - Only include the default shuffling if this is the actual permutation testing;
-              //   if we're doing nonstationarity correction, don't include the default
-              // - Permit duplicates (specifically of permutations only) if an adequate number cannot be generated
-              generate_random_permutations (nshuffles, rows, eb_within, eb_whole, !is_nonstationarity, nshuffles > max_num_permutations);
+              // Permit duplicates (specifically of permutations only) if an adequate number cannot be generated
+              random_permutations = true;
+              permit_duplicate_permutations = nshuffles > max_num_permutations;
             }
           } else if (nshuffles < max_shuffles) {
-            generate_random_permutations (nshuffles, rows, eb_within, eb_whole, !is_nonstationarity, false);
+            random_permutations = true;
           } else {
             generate_all_permutations (rows, eb_within, eb_whole);
             assert (permutations.size() == max_shuffles);
@@ -364,10 +469,11 @@ namespace MR
               generate_all_signflips (rows, eb_whole);
               assert (signflips.size() == max_num_signflips);
             } else {
-              generate_random_signflips (nshuffles, rows, eb_whole, !is_nonstationarity, nshuffles > max_num_signflips);
+              random_signflips = true;
+              permit_duplicate_signflips = nshuffles > max_num_signflips;
             }
           } else if (nshuffles < max_shuffles) {
-            generate_random_signflips (nshuffles, rows, eb_whole, !is_nonstationarity, false);
+            random_signflips = true;
           } else {
             generate_all_signflips (rows, eb_whole);
             assert (signflips.size() == max_shuffles);
@@ -414,106 +520,44 @@ namespace MR
 
 
 
-      bool Shuffler::is_duplicate (const PermuteLabels& v1, const PermuteLabels& v2) const
-      {
-        assert (v1.size() == v2.size());
-        for (size_t i = 0; i < v1.size(); i++) {
-          if (v1[i] != v2[i])
-            return false;
-        }
-        return true;
-      }
-
-
-
-      bool Shuffler::is_duplicate (const PermuteLabels& perm) const
-      {
-        for (const auto& p : permutations) {
-          if (is_duplicate (perm, p))
-            return true;
-        }
-        return false;
-      }
-
-
-
-      void Shuffler::generate_random_permutations (const size_t num_perms,
-                                                   const size_t num_rows,
-                                                   const index_array_type& eb_within,
-                                                   const index_array_type& eb_whole,
-                                                   const bool include_default,
-                                                   const bool permit_duplicates)
+      void Shuffler::random_permutation (const size_t index, const size_t attempt, PermuteLabels& output) const
       {
-        permutations.clear();
-        permutations.reserve (num_perms);
-
-        PermuteLabels default_labelling (num_rows);
-        for (size_t i = 0; i < num_rows; ++i)
-          default_labelling[i] = i;
-
-        size_t p = 0;
-        if (include_default) {
-          permutations.push_back (default_labelling);
-          ++p;
-        }
-
-        // Unrestricted exchangeability
-        if (!eb_within.size() && !eb_whole.size()) {
-          for (; p != num_perms; ++p) {
-            PermuteLabels permuted_labelling (default_labelling);
-            do {
-              std::random_shuffle (permuted_labelling.begin(), permuted_labelling.end());
-            } while (!permit_duplicates && is_duplicate (permuted_labelling));
-            permutations.push_back (permuted_labelling);
-          }
+        output.resize (rows);
+        for (size_t i = 0; i != rows; ++i)
+          output[i] = i;
+        if (include_default && !index)
           return;
-        }
-
-        vector<vector<size_t>> blocks;
+        CounterRNG rng (seed, index, attempt, 0);
 
         // Within-block exchangeability
-        if (eb_within.size()) {
-          blocks = indices2blocks (eb_within);
-          PermuteLabels permuted_labelling (default_labelling);
-          for (; p != num_perms; ++p) {
-            do {
-              permuted_labelling = default_labelling;
-              // Random permutation within each block independently
-              for (size_t ib = 0; ib != blocks.size(); ++ib) {
-                vector<size_t> permuted_block (blocks[ib]);
-                std::random_shuffle (permuted_block.begin(), permuted_block.end());
-                for (size_t i = 0; i != permuted_block.size(); ++i)
-                  permuted_labelling[blocks[ib][i]] = permuted_block[i];
-              }
-            } while (!permit_duplicates && is_duplicate (permuted_labelling));
-            permutations.push_back (permuted_labelling);
+        if (blocks_within.size()) {
+          // Random permutation within each block independently
+          for (const auto& block : blocks_within) {
+            vector<size_t> permuted_block (block);
+            std::shuffle (permuted_block.begin(), permuted_block.end(), rng);
+            for (size_t i = 0; i != permuted_block.size(); ++i)
+              output[block[i]] = permuted_block[i];
           }
           return;
         }
 
         // Whole-block exchangeability
-        blocks = indices2blocks (eb_whole);
-        const size_t num_blocks = blocks.size();
-        assert (!(num_rows % num_blocks));
-        const size_t block_size = num_rows / num_blocks;
-        PermuteLabels default_blocks (num_blocks);
-        for (size_t i = 0; i != num_blocks; ++i)
-          default_blocks[i] = i;
-        PermuteLabels permuted_labelling (default_labelling);
-        for (; p != num_perms; ++p) {
-          do {
-            // Randomly order a list corresponding to the block indices, and then
-            //   generate the full permutation label listing accordingly
-            PermuteLabels permuted_blocks (default_blocks);
-            std::random_shuffle (permuted_blocks.begin(), permuted_blocks.end());
-            for (size_t ib = 0; ib != num_blocks; ++ib) {
-              for (size_t i = 0; i != block_size; ++i)
-                permuted_labelling[blocks[ib][i]] = blocks[permuted_blocks[ib]][i];
-            }
-          } while (!permit_duplicates && is_duplicate (permuted_labelling));
-          permutations.push_back (permuted_labelling);
+        if (blocks_whole.size()) {
+          // Randomly order a list corresponding to the block indices, and then
+          //   generate the full permutation label listing accordingly
+          PermuteLabels permuted_blocks (blocks_whole.size());
+          for (size_t i = 0; i != blocks_whole.size(); ++i)
+            permuted_blocks[i] = i;
+          std::shuffle (permuted_blocks.begin(), permuted_blocks.end(), rng);
+          for (size_t ib = 0; ib != blocks_whole.size(); ++ib) {
+            for (size_t i = 0; i != blocks_whole[ib].size(); ++i)
+              output[blocks_whole[ib][i]] = blocks_whole[permuted_blocks[ib]][i];
+          }
+          return;
         }
 
+        // Unrestricted exchangeability
+        std::shuffle (output.begin(), output.end(), rng);
       }
 
 
@@ -619,61 +663,34 @@ namespace MR
 
 
 
-      bool Shuffler::is_duplicate (const BitSet& sign) const
-      {
-        for (const auto& s : signflips) {
-          if (sign == s)
-            return true;
-        }
-        return false;
-      }
-
-
-
-      void Shuffler::generate_random_signflips (const size_t num_signflips,
-                                                const size_t num_rows,
-                                                const index_array_type& block_indices,
-                                                const bool include_default,
-                                                const bool permit_duplicates)
+      void Shuffler::random_signflip (const size_t index, const size_t attempt, BitSet& output) const
       {
-        signflips.clear();
-        signflips.reserve (num_signflips);
-        size_t s = 0;
-        if (include_default) {
-          BitSet default_labelling (num_rows, false);
-          signflips.push_back (default_labelling);
-          ++s;
-        }
-        std::random_device rd;
-        std::mt19937 generator (rd());
-        std::uniform_int_distribution<> distribution (0, 1);
-
-        BitSet rows_to_flip (num_rows);
+        assert (output.size() == rows);
+        output.clear();
+        if (include_default && !index)
+          return;
+        CounterRNG rng (seed, index, attempt, 1);
 
         // Whole-block sign-flipping
-        if (block_indices.size()) {
-          const auto blocks = indices2blocks (block_indices);
-          for (; s != num_signflips; ++s) {
-            do {
-              for (size_t ib = 0; ib != blocks.size(); ++ib) {
-                const bool value = distribution (generator);
-                for (const auto i : blocks[ib])
-                  rows_to_flip[i] = value;
-              }
-            } while (!permit_duplicates && is_duplicate (rows_to_flip));
-            signflips.push_back (rows_to_flip);
+        if (blocks_whole.size()) {
+          uint64_t bits = 0;
+          for (size_t ib = 0; ib != blocks_whole.size(); ++ib) {
+            if (!(ib & 63))
+              bits = rng();
+            if ((bits >> (ib & 63)) & 1) {
+              for (const auto i : blocks_whole[ib])
+                output[i] = true;
+            }
           }
           return;
         }
 
         // Unrestricted sign-flipping
-        for (; s != num_signflips; ++s) {
-          do {
-            // TODO Should be a faster mechanism for generating / storing random bits
-            for (size_t ir = 0; ir != num_rows; ++ir)
-              rows_to_flip[ir] = distribution (generator);
-          } while (!permit_duplicates && is_duplicate (rows_to_flip));
-          signflips.push_back (rows_to_flip);
+        uint64_t bits = 0;
+        for (size_t ir = 0; ir != rows; ++ir) {
+          if (!(ir & 63))
+            bits = rng();
+          output[ir] = (bits >> (ir & 63)) & 1;
         }
       }
 
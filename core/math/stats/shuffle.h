@@ -18,6 +18,8 @@
 #ifndef __math_stats_shuffle_h__
 #define __math_stats_shuffle_h__
 
+#include <unordered_set>
+
 #include "app.h"
 #include "progressbar.h"
 #include "types.h"
@@ -29,6 +31,7 @@
 
 #define DEFAULT_NUMBER_SHUFFLES 5000
 #define DEFAULT_NUMBER_SHUFFLES_NONSTATIONARITY 5000
+#define DEFAULT_ADAPTIVE_ALPHA 0.05
 
 
 namespace MR
@@ -88,6 +91,9 @@ namespace MR
 
           // Don't store the full set of shuffling matrices;
           //   generate each as it is required, based on the more compressed representations
+          // Note that shuffles must still be generated serially, in order of index:
+          //   unless duplicates are permitted, whether a candidate for a given index is
+          //   accepted depends on the hashes of all shuffles generated before it
           bool operator() (Shuffle& output);
 
           size_t size() const { return nshuffles; }
@@ -95,6 +101,9 @@ namespace MR
           // Go back to the first permutation
           void reset();
 
+          // Finalise the progress bar, where shuffling is terminated before all shuffles have been drawn
+          void done();
+
 
         private:
           const size_t rows;
@@ -103,6 +112,19 @@ namespace MR
           size_t nshuffles, counter;
           std::unique_ptr<ProgressBar> progress;
 
+          // Where random shuffles are required, these are not pre-generated and stored;
+          //   instead, each is generated on demand as a deterministic function of
+          //   a seed, the shuffle index, and the number of candidates already rejected
+          //   as duplicates for that index
+          bool random_permutations, random_signflips;
+          bool include_default, permit_duplicate_permutations, permit_duplicate_signflips;
+          uint64_t seed;
+          vector<vector<size_t>> blocks_within, blocks_whole;
+          // Rather than comparing each new random shuffle against all of those previously
+          //   generated, only a hash of each previous shuffle is retained; this is shared
+          //   state, and is the reason that shuffle generation is not thread-safe
+          std::unordered_set<uint64_t> permutation_hashes, signflip_hashes;
+
 
           void initialise (const error_t error_types,
                            const bool nshuffles_explicit,
@@ -116,19 +138,10 @@ namespace MR
           index_array_type load_blocks (const std::string& filename, const bool equal_sizes);
 
 
-          // For generating unique permutations
-          bool is_duplicate (const PermuteLabels&, const PermuteLabels&) const;
-          bool is_duplicate (const PermuteLabels&) const;
-
           // Note that this function does not take into account identical rows and therefore generated
           // permutations are not guaranteed to be unique wrt the computed test statistic.
           // Providing the number of rows is large then the likelihood of generating duplicates is low.
-          void generate_random_permutations (const size_t num_perms,
-                                             const size_t num_rows,
-                                             const index_array_type& eb_within,
-                                             const index_array_type& eb_whole,
-                                             const bool include_default,
-                                             const bool permit_duplicates);
+          void random_permutation (const size_t index, const size_t attempt, PermuteLabels& output) const;
 
           void generate_all_permutations (const size_t num_rows,
                                           const index_array_type& eb_within,
@@ -137,13 +150,7 @@ namespace MR
           void load_permutations (const std::string& filename);
 
           // Similar functions required for sign-flipping
-          bool is_duplicate (const BitSet&) const;
-
-          void generate_random_signflips (const size_t num_signflips,
-                                          const size_t num_rows,
-                                          const index_array_type& blocks,
-                                          const bool include_default,
-                                          const bool permit_duplicates);
+          void random_signflip (const size_t index, const size_t attempt, BitSet& output) const;
 
           void generate_all_signflips (const size_t num_rows,
                                        const index_array_type& blocks);
@@ -0,0 +1,193 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+
+#ifndef MRTRIX_WINDOWS
+# include <sys/resource.h>
+#endif
+
+#include "memory_usage.h"
+#include "app.h"
+#include "file/config.h"
+
+namespace MR
+{
+  namespace Memory
+  {
+
+    namespace {
+
+      std::atomic<size_t> __current (0);
+      std::atomic<size_t> __peak (0);
+
+      size_t determine_limit ()
+      {
+        auto opt = App::get_options ("memory_limit");
+        if (opt.size())
+          return parse_size (opt[0][0]);
+
+        //ENVVAR name: MRTRIX_MEMORY_LIMIT
+        //ENVVAR set the memory budget for large allocations by MRtrix3
+        //ENVVAR applications, e.g. "16G". This overrides the
+        //ENVVAR :option:`MemoryLimit` setting in the configuration file, but
+        //ENVVAR will be overridden by the ``-memory_limit`` command-line option.
+        const char* from_env = getenv ("MRTRIX_MEMORY_LIMIT");
+        if (from_env && *from_env)
+          return parse_size (from_env);
+
+        //CONF option: MemoryLimit
+        //CONF default: not set (no limit)
+        //CONF The memory budget for large allocations (such as scratch
+        //CONF images, images loaded into RAM, and model data), as a size
+        //CONF with optional suffix k, M, G or T (e.g. 16G). Commands will
+        //CONF then use lower-memory strategies where available (e.g.
+        //CONF storing scratch images in temporary files), or fail early if
+        //CONF the projected memory use exceeds this budget.
+        const std::string from_config = File::Config::get ("MemoryLimit");
+        if (from_config.size())
+          return parse_size (from_config);
+
+        return 0;
+      }
+
+    }
+
+
+
+    size_t limit ()
+    {
+      static const size_t value = determine_limit();
+      return value;
+    }
+
+    size_t current () { return __current; }
+    size_t peak () { return __peak; }
+
+
+
+    bool fits (size_t bytes)
+    {
+      const size_t budget = limit();
+      return !budget || (bytes <= budget && __current <= budget - bytes);
+    }
+
+
+
+    void check (size_t bytes, const std::string& description)
+    {
+      if (!fits (bytes))
+        throw Exception ("projected memory use for " + description + " (" + format_size (bytes) + ") "
+                         + "exceeds memory limit of " + format_size (limit())
+                         + (current() ? " (" + format_size (current()) + " already in use)" : std::string()));
+    }
+
+
+
+    size_t parse_size (const std::string& spec)
+    {
+      const std::string s = strip (spec);
+      size_t pos = 0;
+      while (pos < s.size() && (std::isdigit (s[pos]) || s[pos] == '.'))
+        ++pos;
+      if (!pos)
+        throw Exception ("invalid memory size \"" + spec + "\"");
+      default_type value;
+      try {
+        value = to<default_type> (s.substr (0, pos));
+      } catch (Exception& e) {
+        throw Exception (e, "invalid memory size \"" + spec + "\"");
+      }
+      std::string suffix = lowercase (strip (s.substr (pos)));
+      if (suffix.size() > 1 && suffix.back() == 'b')
+        suffix.pop_back();
+      if (suffix.size() && suffix != "b") {
+        const size_t exponent = std::string ("kmgt").find (suffix);
+        if (suffix.size() != 1 || exponent == std::string::npos)
+          throw Exception ("invalid suffix in memory size \"" + spec + "\" (expected k, M, G or T)");
+        value *= std::pow (1024.0, exponent + 1);
+      }
+      if (value < 1.0)
+        throw Exception ("memory size \"" + spec + "\" must be positive");
+      if (!(value < default_type (std::numeric_limits<size_t>::max())))
+        throw Exception ("memory size \"" + spec + "\" is too large");
+      return size_t (value);
+    }
+
+
+
+    std::string format_size (size_t bytes)
+    {
+      const char* units[] = { "B", "kB", "MB", "GB", "TB" };
+      default_type value = bytes;
+      size_t n = 0;
+      while (value >= 1024.0 && n < 4) {
+        value /= 1024.0;
+        ++n;
+      }
+      return str (value, n ? 4 : 0) + " " + units[n];
+    }
+
+
+
+    void report ()
+    {
+      if (!peak() && !limit())
+        return;
+      std::string message = "peak tracked memory use " + format_size (peak());
+      if (limit())
+        message += " (limit " + format_size (limit()) + ")";
+#ifndef MRTRIX_WINDOWS
+      struct rusage usage;
+      if (!getrusage (RUSAGE_SELF, &usage)) {
+# ifdef MRTRIX_MACOSX
+        const size_t maxrss = usage.ru_maxrss;
+# else
+        const size_t maxrss = size_t (usage.ru_maxrss) * 1024;
+# endif
+        message += ", peak resident memory " + format_size (maxrss);
+      }
+#endif
+      INFO (message);
+    }
+
+
+
+    Allocation::Allocation (size_t bytes, const std::string& description) :
+        bytes (bytes)
+    {
+      const size_t total = __current += bytes;
+      size_t previous = __peak;
+      while (total > previous && !__peak.compare_exchange_weak (previous, total));
+      DEBUG ("memory allocation of " + format_size (bytes) + " for " + description
+             + "; " + format_size (total) + " now tracked");
+    }
+
+    void Allocation::release ()
+    {
+      if (bytes) {
+        __current -= bytes;
+        bytes = 0;
+      }
+    }
+
+  }
+}
+
@@ -0,0 +1,96 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#ifndef __memory_usage_h__
+#define __memory_usage_h__
+
+#include <string>
+
+#include "memory.h"
+
+namespace MR
+{
+
+  //! Accounting of large allocations against an optional memory budget
+  /*! Code responsible for allocations whose size scales with the input data
+   * (scratch images, images loaded into RAM, model arrays) registers them
+   * here using a Memory::Allocation object. This allows the peak tracked use
+   * to be reported, and allows such code to check whether a prospective
+   * allocation fits within the budget specified by the user (via the
+   * -memory_limit option, the MRTRIX_MEMORY_LIMIT environment variable, or
+   * the MemoryLimit config file entry) \e before committing to it, so that
+   * it can select a lower-memory strategy or fail early with an informative
+   * error message.
+   *
+   * Note that only the allocations explicitly registered are accounted for;
+   * the budget is therefore a limit on the large data structures, not on
+   * the total memory footprint of the process. */
+  namespace Memory
+  {
+
+    //! the memory budget in bytes, or zero if unlimited
+    size_t limit ();
+
+    //! the total size of all currently registered allocations
+    size_t current ();
+    //! the maximal total size of registered allocations so far
+    size_t peak ();
+
+    //! whether a further allocation of \a bytes remains within the budget
+    bool fits (size_t bytes);
+
+    //! throw an exception if a further allocation of \a bytes would exceed the budget
+    void check (size_t bytes, const std::string& description);
+
+    //! parse a memory size, with optional (binary) suffix k, M, G or T
+    size_t parse_size (const std::string& spec);
+    //! format a memory size in human-readable form
+    std::string format_size (size_t bytes);
+
+    //! report peak memory use, if any was tracked, at the INFO level
+    void report ();
+
+
+
+    //! RAII registration of a large allocation
+    class Allocation { NOMEMALIGN
+      public:
+        Allocation () : bytes (0) { }
+        Allocation (size_t bytes, const std::string& description);
+        Allocation (const Allocation&) = delete;
+        Allocation (Allocation&& that) noexcept : bytes (that.bytes) { that.bytes = 0; }
+        ~Allocation () { release(); }
+
+        Allocation& operator= (const Allocation&) = delete;
+        Allocation& operator= (Allocation&& that) noexcept {
+          release();
+          bytes = that.bytes;
+          that.bytes = 0;
+          return *this;
+        }
+
+        size_t size () const { return bytes; }
+        void release ();
+
+      private:
+        size_t bytes;
+    };
+
+  }
+}
+
+#endif
+
@@ -86,6 +86,7 @@ namespace MR {
            writer_t writer;
            functor_t func;
            size_t batch_size;
+           Profile::StageID stage;
 
            __Source (queue_t& queue, Functor& functor, const queued_t& item) :
              writer (queue),
@@ -93,13 +94,14 @@ namespace MR {
              batch_size (__batch_size<queued_t> (item)) { }
 
            void execute () {
+             Profile::Stage profile (stage);
              size_t count = 0;
              auto out = writer.placeholder();
              do {
-               if (!func (out->item))
+               if (!profile.work ([&] { return func (out->item); }))
                  break;
                out->index = count++;
-             } while (out.write());
+             } while (profile.wait_out ([&] { return out.write(); }));
            }
          };
 
@@ -125,6 +127,7 @@ namespace MR {
            writer_t writer;
            functor_t func;
            const size_t batch_size;
+           Profile::StageID stage;
 
            __Pipe (queue1_t& queue_in, Functor& functor, queue2_t& queue_out, const queued2_t& item2) :
              reader (queue_in),
@@ -133,13 +136,14 @@ namespace MR {
              batch_size (__batch_size<queued2_t> (item2)) { }
 
            void execute () {
+             Profile::Stage profile (stage);
              auto in = reader.placeholder();
              auto out = writer.placeholder();
-             while (in.read()) {
-               if (!func (in->item, out->item))
+             while (profile.wait_in ([&] { return in.read(); })) {
+               if (!profile.work ([&] { return func (in->item, out->item); }))
                  break;
                out->index = in->index;
-               out.write();
+               profile.wait_out ([&] { return out.write(); });
              }
            }
 
@@ -161,25 +165,27 @@ namespace MR {
 
            reader_t reader;
            functor_t func;
+           Profile::StageID stage;
 
            __Sink (queue_t& queue, Functor& functor) :
              reader (queue),
              func (__job<Functor>::functor (functor)) { }
 
            void execute () {
+             Profile::Stage profile (stage);
              size_t expected = 0;
              auto in = reader.placeholder();
              std::set<queued_t*,CompareItems> buffer;
-             while (in.read()) {
+             while (profile.wait_in ([&] { return in.read(); })) {
                if (in->index > expected) {
                  buffer.emplace (in.stash());
                  continue;
                }
-               if (!func (in->item))
+               if (!profile.work ([&] { return func (in->item); }))
                  return;
                ++expected;
                while (!buffer.empty() && (*buffer.begin())->index <= expected) {
-                 if (!func ((*buffer.begin())->item))
+                 if (!profile.work ([&] { return func ((*buffer.begin())->item); }))
                    return;
                  in.recycle (*buffer.begin());
                  buffer.erase (buffer.begin());
@@ -224,6 +230,7 @@ namespace MR {
            writer_t writer;
            functor_t func;
            size_t batch_size;
+           Profile::StageID stage;
 
            __Source (queue_t& queue, Functor& functor, const passed_t& item) :
              writer (queue),
@@ -231,20 +238,21 @@ namespace MR {
              batch_size (__batch_size<passed_t> (item)) { }
 
            void execute () {
+             Profile::Stage profile (stage);
              size_t count = 0;
              auto out = writer.placeholder();
              bool stop = false;
              do {
                out->item.resize (batch_size);
                for (size_t n = 0; n < batch_size; ++n) {
-                 if (!func (out->item[n])) {
+                 if (!profile.work ([&] { return func (out->item[n]); })) {
                    out->item.resize(n);
                    stop = true;
                    break;
                  }
                }
                out->index = count++;
-             } while (out.write() && !stop);
+             } while (profile.wait_out ([&] { return out.write(); }) && !stop);
            }
          };
 
@@ -271,6 +279,7 @@ namespace MR {
            writer_t writer;
            functor_t func;
            const size_t batch_size;
+           Profile::StageID stage;
 
            __Pipe (queue1_t& queue_in, Functor& functor, queue2_t& queue_out, const passed2_t& item2) :
              reader (queue_in),
@@ -279,18 +288,19 @@ namespace MR {
              batch_size (__batch_size<passed2_t> (item2)) { }
 
            void execute () {
+             Profile::Stage profile (stage);
              auto in = reader.placeholder();
              auto out = writer.placeholder();
-             while (in.read()) {
+             while (profile.wait_in ([&] { return in.read(); })) {
                out->item.resize (in->item.size());
                size_t k = 0;
                for (size_t n = 0; n < in->item.size(); ++n) {
-                 if (func (in->item[n], out->item[k]))
+                 if (profile.work ([&] { return func (in->item[n], out->item[k]); }))
                    ++k;
                }
                out->item.resize (k);
                out->index = in->index;
-               if (!out.write())
+               if (!profile.wait_out ([&] { return out.write(); }))
                  return;
              }
            }
@@ -313,27 +323,29 @@ namespace MR {
 
            reader_t reader;
            functor_t func;
+           Profile::StageID stage;
 
            __Sink (queue_t& queue, Functor& functor) :
              reader (queue),
              func (__job<Functor>::functor (functor)) { }
 
            void execute () {
+             Profile::Stage profile (stage);
              size_t expected = 0;
              auto in = reader.placeholder();
              std::set<queued_t*,CompareItems> buffer;
-             while (in.read()) {
+             while (profile.wait_in ([&] { return in.read(); })) {
                if (in->index > expected) {
                  buffer.emplace (in.stash());
                  continue;
                }
                for (size_t n = 0; n < in->item.size(); ++n)
-                 if (!func (in->item[n]))
+                 if (!profile.work ([&] { return func (in->item[n]); }))
                    return;
                ++expected;
                while (!buffer.empty() && (*buffer.begin())->index <= expected) {
                  for (size_t n = 0; n < (*buffer.begin())->item.size(); ++n)
-                   if (!func ((*buffer.begin())->item[n]))
+                   if (!profile.work ([&] { return func ((*buffer.begin())->item[n]); }))
                      return;
                  in.recycle (*buffer.begin());
                  buffer.erase (buffer.begin());
@@ -20,6 +20,8 @@
 #include "app.h"
 #include "thread.h"
 #include "file/config.h"
+#include "file/json.h"
+#include "file/path.h"
 #include "thread_queue.h"
 
 namespace MR
@@ -135,6 +137,156 @@ namespace MR
     __Backend* __Backend::backend = nullptr;
     std::mutex __Backend::mutex;
 
+
+
+
+
+    namespace Profile
+    {
+
+      namespace {
+
+        class Entry { NOMEMALIGN
+          public:
+            size_t pipeline;
+            std::string stage;
+            size_t thread;
+            Record record;
+        };
+
+        std::mutex entries_mutex;
+        vector<Entry> entries;
+        std::atomic<size_t> pipeline_count (0);
+
+        //CONF option: QueueProfile
+        //CONF default: not set (no instrumentation)
+        //CONF Path of a file to which to write timing information for each
+        //CONF stage of the multi-threaded pipelines run by a command: the
+        //CONF number of items processed by each thread, and the time spent
+        //CONF processing or waiting on the queues. The report is written in
+        //CONF JSON format if the path ends in ".json", and as CSV otherwise.
+
+        //ENVVAR name: MRTRIX_QUEUE_PROFILE
+        //ENVVAR This has the same effect as the :option:`QueueProfile`
+        //ENVVAR configuration file entry, and can be used to request timing
+        //ENVVAR information for the multi-threaded pipelines of a single
+        //ENVVAR command without modifying the configuration file.
+        const std::string& report_path ()
+        {
+          static const std::string path = [] {
+            const char* from_env = getenv ("MRTRIX_QUEUE_PROFILE");
+            return from_env ? std::string (from_env) : File::Config::get ("QueueProfile");
+          }();
+          return path;
+        }
+
+        void write_report ()
+        {
+          std::lock_guard<std::mutex> lock (entries_mutex);
+          std::ofstream out (report_path());
+          if (!out)
+            throw Exception ("error opening file \"" + report_path() + "\" for writing");
+          if (Path::has_suffix (report_path(), ".json")) {
+            nlohmann::json json;
+            json["command"] = App::NAME;
+            json["threads"] = number_of_threads();
+            json["records"] = nlohmann::json::array();
+            for (const auto& e : entries) {
+              nlohmann::json record;
+              record["pipeline"] = e.pipeline;
+              record["stage"] = e.stage;
+              record["thread"] = e.thread;
+              record["items"] = e.record.items;
+              record["wall"] = e.record.wall;
+              record["busy"] = e.record.busy;
+              record["wait_in"] = e.record.wait_in;
+              record["wait_out"] = e.record.wait_out;
+              json["records"].push_back (record);
+            }
+            out << json.dump(4) << "\n";
+          } else {
+            out << "command,pipeline,stage,thread,items,wall,busy,wait_in,wait_out\n";
+            for (const auto& e : entries)
+              out << App::NAME << "," << e.pipeline << "," << e.stage << "," << e.thread << ","
+                  << e.record.items << "," << e.record.wall << "," << e.record.busy << ","
+                  << e.record.wait_in << "," << e.record.wait_out << "\n";
+          }
+        }
+
+        // The records of all pipelines run by the command are written in a
+        //   single report on exit, rather than as each pipeline completes
+        void write_report_on_exit ()
+        {
+          try {
+            write_report();
+          }
+          catch (Exception& e) {
+            e.display();
+            WARN ("unable to write pipeline timing report to \"" + report_path() + "\"");
+          }
+        }
+
+        std::once_flag report_registered;
+
+      }
+
+
+
+      bool enabled ()
+      {
+        return report_path().size();
+      }
+
+
+
+      Pipeline::Pipeline () :
+          id (enabled() ? ++pipeline_count : 0)
+      {
+        if (id)
+          std::call_once (report_registered, [] { std::atexit (write_report_on_exit); });
+      }
+
+
+
+      Pipeline::~Pipeline ()
+      {
+        if (!id)
+          return;
+        std::lock_guard<std::mutex> lock (entries_mutex);
+        for (const auto& stage : stages) {
+          size_t threads = 0;
+          Record total;
+          for (const auto& e : entries) {
+            if (e.pipeline == id && e.stage == stage) {
+              ++threads;
+              total.items += e.record.items;
+              total.wall += e.record.wall;
+              total.busy += e.record.busy;
+              total.wait_in += e.record.wait_in;
+              total.wait_out += e.record.wait_out;
+            }
+          }
+          auto percent = [&] (const double t) { return str (total.wall ? 100.0 * t / total.wall : 0.0, 3) + "%"; };
+          INFO ("pipeline " + str(id) + ", stage \"" + stage + "\": " + str(threads) + " thread" + (threads > 1 ? "s" : "")
+                + ", " + str(total.items) + " items; busy " + percent (total.busy) + ", waiting for input "
+                + percent (total.wait_in) + ", waiting for output " + percent (total.wait_out));
+        }
+      }
+
+
+
+      void Stage::submit ()
+      {
+        record.wall = std::chrono::duration<double> (clock::now() - start).count();
+        std::lock_guard<std::mutex> lock (entries_mutex);
+        size_t thread = 0;
+        for (const auto& e : entries)
+          thread += (e.pipeline == id.pipeline && e.stage == id.name);
+        entries.push_back ({ id.pipeline, id.name, thread, record });
+      }
+
+    }
+
   }
 }
 
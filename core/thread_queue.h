@@ -18,6 +18,8 @@
 #define __mrtrix_thread_queue_h__
 
 #include <stack>
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 
 #include "exception.h"
@@ -626,6 +628,109 @@ namespace MR
 
 
 
+     //! Optional per-stage timing instrumentation for Thread::run_queue()
+     /*! When enabled (by setting the MRTRIX_QUEUE_PROFILE environment
+      * variable or the QueueProfile configuration file entry to the path of
+      * an output file), each thread of each stage of a multi-threaded
+      * pipeline records the number of items it processed, the time spent
+      * within its functor, and the time spent waiting for input from, or
+      * for space on, its queues. A summary per stage is reported at INFO
+      * level once each pipeline completes, and the records of all pipelines
+      * are written to the output file once the command exits: in JSON format
+      * if its name ends in ".json", or as CSV otherwise.
+      *
+      * Pipelines run without multi-threading (i.e. with -nthreads 0) are
+      * not instrumented. */
+     namespace Profile {
+
+       //! whether pipeline instrumentation has been requested
+       bool enabled ();
+
+       //! identifies one stage of one pipeline
+       class StageID { NOMEMALIGN
+         public:
+           StageID (size_t pipeline = 0, const char* name = "unnamed") : pipeline (pipeline), name (name) { }
+           size_t pipeline;
+           const char* name;
+       };
+
+       //! the timings of one thread executing one stage of a pipeline
+       class Record { NOMEMALIGN
+         public:
+           Record () : items (0), wall (0.0), busy (0.0), wait_in (0.0), wait_out (0.0) { }
+           size_t items;
+           double wall, busy, wait_in, wait_out;
+       };
+
+       //! register a pipeline for the lifetime of this object
+       /*! The per-stage summary is produced on destruction. */
+       class Pipeline { NOMEMALIGN
+         public:
+           Pipeline ();
+           Pipeline (const Pipeline&) = delete;
+           ~Pipeline ();
+
+           StageID stage (const char* name) {
+             stages.push_back (name);
+             return { id, name };
+           }
+
+         private:
+           const size_t id;
+           vector<std::string> stages;
+       };
+
+       //! accumulate the timings of the calling thread for one stage
+       /*! Each of the work(), wait_in() and wait_out() methods invokes the
+        * functor provided, adds the time taken to the relevant total, and
+        * returns the functor's return value; only those invocations of
+        * work() that return true are counted as items processed. The record
+        * is submitted on destruction. If instrumentation is disabled, these
+        * simply invoke the functor. */
+       class Stage { NOMEMALIGN
+         public:
+           using clock = std::chrono::steady_clock;
+
+           Stage (const StageID& id) : id (id), active (id.pipeline), start (active ? clock::now() : clock::time_point()) { }
+           Stage (const Stage&) = delete;
+           ~Stage () { if (active) submit(); }
+
+           template <class Functor>
+             FORCE_INLINE bool work (Functor&& functor) {
+               const bool result = time (record.busy, functor);
+               if (active && result) ++record.items;
+               return result;
+             }
+           template <class Functor>
+             FORCE_INLINE bool wait_in (Functor&& functor) { return time (record.wait_in, functor); }
+           template <class Functor>
+             FORCE_INLINE bool wait_out (Functor&& functor) { return time (record.wait_out, functor); }
+
+         private:
+           const StageID id;
+           const bool active;
+           const clock::time_point start;
+           Record record;
+
+           template <class Functor>
+             FORCE_INLINE bool time (double& total, Functor& functor) {
+               if (!active)
+                 return functor();
+               const auto t0 = clock::now();
+               const bool result = functor();
+               total += std::chrono::duration<double> (clock::now() - t0).count();
+               return result;
+             }
+
+           void submit ();
+       };
+
+     }
+
+
+
+
+
 
      //* \cond skip
 
@@ -750,6 +855,7 @@ namespace MR
            writer_t writer;
            functor_t func;
            size_t batch_size;
+           Profile::StageID stage;
 
            __Source (queue_t& queue, Functor& functor, const Item& item) :
              writer (queue),
@@ -757,12 +863,13 @@ namespace MR
              batch_size (__batch_size<Item> (item)) { }
 
            void execute () {
+             Profile::Stage profile (stage);
              auto out = StoreItem<Item> (batch_size, writer);
              do {
-               if (!func (out.value()))
+               if (!profile.work ([&] { return func (out.value()); }))
                  break;
-             } while (out.write());
-             out.flush();
+             } while (profile.wait_out ([&] { return out.write(); }));
+             profile.wait_out ([&] { out.flush(); return true; });
            }
          };
 
@@ -786,6 +893,7 @@ namespace MR
            writer_t writer;
            functor_t func;
            const size_t batch_size;
+           Profile::StageID stage;
 
            __Pipe (queue1_t& queue_in, Functor& functor, queue2_t& queue_out, const Item2& item2) :
              reader (queue_in),
@@ -794,15 +902,16 @@ namespace MR
              batch_size (__batch_size<Item2> (item2)) { }
 
            void execute () {
+             Profile::Stage profile (stage);
              auto in = FetchItem<Item1> (reader);
              auto out = StoreItem<Item2> (batch_size, writer);
-             while (in.read()) {
-               if (func (in.value(), out.value())) {
-                 if (!out.write())
+             while (profile.wait_in ([&] { return in.read(); })) {
+               if (profile.work ([&] { return func (in.value(), out.value()); })) {
+                 if (!profile.wait_out ([&] { return out.write(); }))
                    break;
                }
              }
-             out.flush();
+             profile.wait_out ([&] { out.flush(); return true; });
            }
 
          };
@@ -821,15 +930,17 @@ namespace MR
 
            reader_t reader;
            functor_t func;
+           Profile::StageID stage;
 
            __Sink (queue_t& queue, Functor& functor) :
              reader (queue),
              func (__job<Functor>::functor (functor)) { }
 
            void execute () {
+             Profile::Stage profile (stage);
              auto in = FetchItem<Item> (reader);
-             while (in.read()) {
-               if (!func (in.value()))
+             while (profile.wait_in ([&] { return in.read(); })) {
+               if (!profile.work ([&] { return func (in.value()); }))
                  return;
              }
            }
@@ -1061,9 +1172,12 @@ namespace MR
            return;
          }
 
+         Profile::Pipeline profile;
          typename Type<Item>::queue queue ("source->sink", capacity);
          __Source<Item,Source> source_functor (queue, source, item);
          __Sink<Item,Sink> sink_functor (queue, sink);
+         source_functor.stage = profile.stage ("source");
+         sink_functor.stage = profile.stage ("sink");
 
          auto t1 = run (__job<Source>::get (source, source_functor), "source");
          auto t2 = run (__job<Sink>::get (sink, sink_functor), "sink");
@@ -1141,12 +1255,16 @@ namespace MR
            }
 
 
+           Profile::Pipeline profile;
            typename Type<Item1>::queue queue1 ("source->pipe", capacity);
            typename Type<Item2>::queue queue2 ("pipe->sink", capacity);
 
            __Source<Item1,Source> source_functor (queue1, source, item1);
            __Pipe<Item1,Pipe,Item2> pipe_functor (queue1, pipe, queue2, item2);
            __Sink<Item2,Sink> sink_functor (queue2, sink);
+           source_functor.stage = profile.stage ("source");
+           pipe_functor.stage = profile.stage ("pipe");
+           sink_functor.stage = profile.stage ("sink");
 
            auto t1 = run (__job<Source>::get (source, source_functor), "source");
            auto t2 = run (__job<Pipe>::get (pipe, pipe_functor), "pipe");
@@ -1189,6 +1307,7 @@ namespace MR
            }
 
 
+           Profile::Pipeline profile;
            typename Type<Item1>::queue queue1 ("source->pipe", capacity);
            typename Type<Item2>::queue queue2 ("pipe->pipe", capacity);
            typename Type<Item3>::queue queue3 ("pipe->sink", capacity);
@@ -1197,6 +1316,10 @@ namespace MR
            __Pipe<Item1,Pipe1,Item2> pipe1_functor (queue1, pipe1, queue2, item2);
            __Pipe<Item2,Pipe2,Item3> pipe2_functor (queue2, pipe2, queue3, item3);
            __Sink<Item3,Sink> sink_functor (queue3, sink);
+           source_functor.stage = profile.stage ("source");
+           pipe1_functor.stage = profile.stage ("pipe1");
+           pipe2_functor.stage = profile.stage ("pipe2");
+           sink_functor.stage = profile.stage ("sink");
 
            auto t1 = run (__job<Source>::get (source, source_functor), "source");
            auto t2 = run (__job<Pipe1>::get (pipe1, pipe1_functor), "pipe1");
@@ -241,6 +241,25 @@ namespace MR
             Mt_b = shared.M.transpose() * DW_signals;
           }
 
+        // as above, but using projections of the DW signals precomputed
+        //   for many voxels at once, i.e. the corresponding columns of
+        //   (rconv * signals) and (M^T * signals). If warm_start is set,
+        //   the FOD is initialised from the set of negative amplitudes
+        //   found for the previous voxel rather than from the
+        //   unconstrained inverse.
+        template <class VectorType1, class VectorType2>
+          void set (const VectorType1& init_FOD, const VectorType2& Mt_DW_signals, const bool warm_start) {
+            Mt_b = Mt_DW_signals;
+            old_neg.assign (1, -1);
+            if (warm_start && neg.size()) {
+              solve();
+              old_neg = neg;
+              return;
+            }
+            F.head (shared.rconv.rows()) = init_FOD;
+            F.tail (F.size()-shared.rconv.rows()).setZero();
+          }
+
         bool iterate() {
           neg.clear();
           HR_amps = shared.HR_trans * F;
@@ -251,16 +270,7 @@ namespace MR
           if (old_neg == neg)
             return true;
 
-          work.triangularView<Eigen::Lower>() = shared.Mt_M.triangularView<Eigen::Lower>();
-
-          if (neg.size()) {
-            for (size_t i = 0; i < neg.size(); i++)
-              HR_T.row (i) = shared.HR_trans.row (neg[i]);
-            auto HR_T_view = HR_T.topRows (neg.size());
-            work.triangularView<Eigen::Lower>() += HR_T_view.transpose() * HR_T_view;
-          }
-
-          F.noalias() = llt.compute (work.triangularView<Eigen::Lower>()).solve (Mt_b);
+          solve();
 
           old_neg = neg;
 
@@ -277,6 +287,20 @@ namespace MR
         Eigen::VectorXd F, init_F, HR_amps, Mt_b;
         Eigen::LLT<Eigen::MatrixXd> llt;
         vector<int> neg, old_neg;
+
+        // solve for F given the current set of negative amplitudes:
+        void solve() {
+          work.triangularView<Eigen::Lower>() = shared.Mt_M.triangularView<Eigen::Lower>();
+
+          if (neg.size()) {
+            for (size_t i = 0; i < neg.size(); i++)
+              HR_T.row (i) = shared.HR_trans.row (neg[i]);
+            auto HR_T_view = HR_T.topRows (neg.size());
+            work.triangularView<Eigen::Lower>() += HR_T_view.transpose() * HR_T_view;
+          }
+
+          F.noalias() = llt.compute (work.triangularView<Eigen::Lower>()).solve (Mt_b);
+        }
     };
 
 
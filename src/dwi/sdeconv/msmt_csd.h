@@ -268,6 +268,13 @@ namespace MR
             niter = solver (output, data);
           }
 
+          // solve for a block of voxels at once, one per column of data;
+          //   each voxel's solve is initialised from the active constraints
+          //   of the previous voxel
+          void operator() (const Eigen::MatrixXd& data, Eigen::MatrixXd& output, vector<size_t>& niters) {
+            solver (output, data, niters);
+          }
+
           size_t niter;
           const Shared& shared;
 
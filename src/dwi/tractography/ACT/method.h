@@ -23,8 +23,7 @@
 #include "dwi/tractography/tracking/shared.h"
 #include "dwi/tractography/tracking/types.h"
 
-#include "interp/linear.h"
-#include "interp/masked.h"
+#include "dwi/tractography/ACT/tissue_lookup.h"
 
 
 #define GMWMI_NORMAL_PERTURBATION 0.001
@@ -49,33 +48,54 @@ namespace MR
                 sgm_depth (0),
                 seed_in_sgm (false),
                 sgm_seed_to_wm (false),
-                act_image (shared.act().voxel) { }
+                lookup (*shared.act().lookup),
+                tissues_deferred (false) { }
 
             ACT_Method_additions (const ACT_Method_additions& that) :
                 sgm_depth (0),
                 seed_in_sgm (false),
                 sgm_seed_to_wm (false),
-                act_image (that.act_image) { }
+                lookup (that.lookup),
+                tissues_deferred (false) { }
 
             ACT_Method_additions() = delete;
 
 
-            const Tissues& tissues() const { return tissue_values; }
+            const Tissues& tissues() const
+            {
+              if (tissues_deferred) {
+                lookup.interpolate (deferred_pos, tissue_values);
+                tissues_deferred = false;
+              }
+              return tissue_values;
+            }
 
 
             term_t check_structural (const Eigen::Vector3f& pos)
             {
-              if (!fetch_tissue_data (pos))
-                return EXIT_IMAGE;
+              // Within the WM interior, the interpolated tissues are guaranteed to be
+              //   valid WM: skip the interpolation unless the values are requested
+              if (lookup.in_wm_interior (pos)) {
+                deferred_pos = pos;
+                tissues_deferred = true;
+              } else {
+
+                if (!fetch_tissue_data (pos))
+                  return EXIT_IMAGE;
+
+                if (tissues().is_csf())
+                  return (sgm_depth ? EXIT_SGM : ENTER_CSF);
+
+                if (tissues().is_gm()) {
+                  if (tissues().get_cgm() >= tissues().get_sgm())
+                    return ENTER_CGM;
+                  ++sgm_depth;
+                  return CONTINUE;
+                }
 
-              if (tissues().is_csf())
-                return (sgm_depth ? EXIT_SGM : ENTER_CSF);
+              }
 
-              if (tissues().is_gm()) {
-                if (tissues().get_cgm() >= tissues().get_sgm())
-                  return ENTER_CGM;
-                ++sgm_depth;
-              } else if (sgm_depth) {
+              if (sgm_depth) {
                 if (seed_in_sgm && !sgm_seed_to_wm) {
                   sgm_seed_to_wm = true;
                   sgm_depth = 0;
@@ -139,15 +159,12 @@ namespace MR
 
             bool fetch_tissue_data (const Eigen::Vector3f& pos)
             {
-              if (!act_image.scanner (pos)) {
-                tissue_values.reset();
-                return false;
-              }
-              return tissue_values.set (act_image);
+              tissues_deferred = false;
+              return lookup.interpolate (pos, tissue_values);
             }
 
 
-            bool in_pathology() const { return (tissue_values.valid() && tissue_values.is_path()); }
+            bool in_pathology() const { return (tissues().valid() && tissues().is_path()); }
 
             void reverse_track() { sgm_depth = 0; }
 
@@ -158,8 +175,10 @@ namespace MR
 
 
           private:
-            Interp::Masked<Interp::Linear<Image<float>>> act_image;
-            Tissues tissue_values;
+            const TissueLookup& lookup;
+            mutable Tissues tissue_values;
+            mutable bool tissues_deferred;
+            Eigen::Vector3f deferred_pos;
 
         };
 
@@ -19,6 +19,7 @@
 
 #include "memory.h"
 #include "dwi/tractography/ACT/gmwmi.h"
+#include "dwi/tractography/ACT/tissue_lookup.h"
 
 
 namespace MR
@@ -39,6 +40,7 @@ namespace MR
               bt (false)
             {
               verify_5TT_image (voxel);
+              lookup.reset (new TissueLookup (voxel));
               property_set.set (bt, "backtrack");
               if (property_set.find ("crop_at_gmwmi") != property_set.end())
                 gmwmi_finder.reset (new GMWMI_finder (voxel));
@@ -59,6 +61,7 @@ namespace MR
             Image<float> voxel;
             bool bt;
 
+            std::unique_ptr<TissueLookup> lookup;
             std::unique_ptr<GMWMI_finder> gmwmi_finder;
 
 
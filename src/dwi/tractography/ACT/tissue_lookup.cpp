@@ -0,0 +1,177 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include "dwi/tractography/ACT/tissue_lookup.h"
+
+#include "algo/loop.h"
+
+
+// Margin by which WM must dominate the other tissues at every corner of a
+//   cell for it to be flagged as WM interior; this absorbs the rounding
+//   error of the interpolation, and the small weights it discards
+#define ACT_WM_INTERIOR_MARGIN 1e-3f
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+      namespace ACT
+      {
+
+
+
+        namespace {
+
+          // A voxel is WM interior if its tissue fractions need no clamping, and WM
+          //   exceeds total GM, CSF and pathological tissue; these conditions are
+          //   linear, and are therefore preserved by any interpolation between
+          //   such voxels, guaranteeing that the interpolated tissues are valid
+          //   and neither GM nor CSF
+          bool is_wm_interior (const float* t)
+          {
+            for (size_t i = 0; i != 5; ++i) {
+              if (!(t[i] >= 0.0f && t[i] <= 1.0f))
+                return false;
+            }
+            const float wm = t[2] - ACT_WM_INTERIOR_MARGIN;
+            return (wm > t[0] + t[1]) && (wm > t[3]) && (wm > t[4]) &&
+                (t[0] + t[1] + t[2] + t[3] + t[4] >= TISSUE_SUM_THRESHOLD + ACT_WM_INTERIOR_MARGIN);
+          }
+
+        }
+
+
+
+        TissueLookup::TissueLookup (Image<float>& image) :
+            transform (image),
+            dim { image.size(0), image.size(1), image.size(2) },
+            num_stored (0),
+            num_interior (0),
+            index (dim[0] * dim[1] * dim[2], 0),
+            records (nullptr)
+        {
+          for (auto l = Loop (image, 0, 3) (image); l; ++l) {
+            for (auto v = Loop (image, 3) (image); v; ++v) {
+              if (image.value()) {
+                index[offset (image.index(0), image.index(1), image.index(2))] = ++num_stored;
+                break;
+              }
+            }
+          }
+
+          // align records to 32 bytes, so that none straddles a cache line
+          buffer.assign (record_size * (num_stored + 1), 0.0f);
+          const size_t misalignment = (reinterpret_cast<uintptr_t> (buffer.data()) % (record_size * sizeof (float))) / sizeof (float);
+          records = buffer.data() + (misalignment ? record_size - misalignment : 0);
+
+          vector<bool> wm_interior (index.size(), false);
+          for (auto l = Loop (image, 0, 3) (image); l; ++l) {
+            const ssize_t voxel = offset (image.index(0), image.index(1), image.index(2));
+            if (!index[voxel])
+              continue;
+            float* r = records + record_size * (index[voxel] - 1);
+            for (image.index(3) = 0; image.index(3) != 5; ++image.index(3))
+              r[image.index(3)] = image.value();
+            wm_interior[voxel] = is_wm_interior (r);
+          }
+
+          for (ssize_t z = 0; z != dim[2]; ++z) {
+            for (ssize_t y = 0; y != dim[1]; ++y) {
+              for (ssize_t x = 0; x != dim[0]; ++x) {
+                bool interior = true;
+                for (ssize_t dz = 0; interior && dz != 2; ++dz)
+                  for (ssize_t dy = 0; interior && dy != 2; ++dy)
+                    for (ssize_t dx = 0; interior && dx != 2; ++dx)
+                      interior = wm_interior[offset (clamp (x+dx, 0), clamp (y+dy, 1), clamp (z+dz, 2))];
+                if (interior) {
+                  index[offset (x, y, z)] |= wm_interior_flag;
+                  ++num_interior;
+                }
+              }
+            }
+          }
+
+          DEBUG ("ACT tissue lookup: " + str(num_stored) + " voxels containing tissue, "
+                 + str(num_interior) + " interpolation cells within WM interior");
+        }
+
+
+
+        bool TissueLookup::interpolate (const Eigen::Vector3f& pos, Tissues& tissues) const
+        {
+          const Eigen::Vector3d v = transform.scanner2voxel * pos.cast<default_type>();
+          for (size_t axis = 0; axis != 3; ++axis) {
+            if (v[axis] <= -0.5 || v[axis] >= dim[axis] - 0.5) {
+              tissues.reset();
+              return false;
+            }
+          }
+
+          // As Interp::Masked: no tissue in the nearest voxel yields invalid tissue values
+          if (!index[offset (std::round (v[0]), std::round (v[1]), std::round (v[2]))])
+            return tissues.set (NaN, NaN, NaN, NaN, NaN);
+
+          ssize_t c[3];
+          float w[3][2];
+          for (size_t axis = 0; axis != 3; ++axis) {
+            const default_type floor = std::floor (v[axis]);
+            c[axis] = floor;
+            const default_type f = (v[axis] < 0.0 || v[axis] > dim[axis] - 1.0) ? 0.0 : v[axis] - floor;
+            w[axis][0] = float (1.0 - f);
+            w[axis][1] = float (f);
+          }
+
+          // Gather the corner values per tissue, and combine them in the same
+          //   way as Interp::Linear, so that results are bitwise identical
+          Eigen::Matrix<float, 8, 1> factors;
+          Eigen::Matrix<float, 8, 5> corners;
+          size_t i = 0;
+          for (ssize_t z = 0; z != 2; ++z) {
+            const ssize_t iz = clamp (c[2] + z, 2);
+            for (ssize_t y = 0; y != 2; ++y) {
+              const ssize_t iy = clamp (c[1] + y, 1);
+              const float partial_weight = w[1][y] * w[2][z];
+              for (ssize_t x = 0; x != 2; ++x, ++i) {
+                factors[i] = w[0][x] * partial_weight;
+                if (factors[i] < 1.0e-6f)
+                  factors[i] = 0.0f;
+                const uint32_t entry = index[offset (clamp (c[0] + x, 0), iy, iz)];
+                if (entry & ~wm_interior_flag)
+                  corners.row(i) = Eigen::Map<const Eigen::Matrix<float, 1, 5>> (record (entry));
+                else
+                  corners.row(i).setZero();
+              }
+            }
+          }
+
+          float t[5];
+          for (size_t n = 0; n != 5; ++n) {
+            const Eigen::Matrix<float, 8, 1> coeff_vec (corners.col(n));
+            t[n] = coeff_vec.dot (factors);
+          }
+
+          return tissues.set (t[0], t[1], t[2], t[3], t[4]);
+        }
+
+
+
+      }
+    }
+  }
+}
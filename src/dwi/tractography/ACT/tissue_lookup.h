@@ -0,0 +1,115 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#ifndef __dwi_tractography_act_tissue_lookup_h__
+#define __dwi_tractography_act_tissue_lookup_h__
+
+#include "image.h"
+#include "transform.h"
+#include "types.h"
+#include "dwi/tractography/ACT/tissues.h"
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+      namespace ACT
+      {
+
+
+        //! Packed copy of a 5TT image for tissue lookups during tracking
+        /*! The five tissue fractions of each voxel containing any tissue are
+         * held in a single 32-byte record aligned to half a cache line, so
+         * that each of the eight voxels involved in trilinear interpolation
+         * is fetched with a single memory access; voxels containing no
+         * tissue are not stored.
+         *
+         * In addition, each interpolation cell (identified by the voxel at
+         * its lower corner) is flagged if all of its corners are WM with a
+         * sufficient margin that any interpolated value within it is
+         * guaranteed to be valid WM; within such cells, no ACT termination
+         * decision can change, and interpolation can be skipped entirely.
+         *
+         * Interpolation reproduces the behaviour of
+         * Interp::Masked<Interp::Linear>. */
+        class TissueLookup { MEMALIGN(TissueLookup)
+          public:
+            TissueLookup (Image<float>& image);
+            TissueLookup (const TissueLookup&) = delete;
+
+            //! interpolate the tissue fractions at scanner-space \a pos
+            /*! As for Tissues::set(), returns whether the resulting tissue
+             * values are valid. */
+            bool interpolate (const Eigen::Vector3f& pos, Tissues& tissues) const;
+
+            //! whether \a pos lies within a cell that is entirely WM interior
+            bool in_wm_interior (const Eigen::Vector3f& pos) const
+            {
+              ssize_t cell[3];
+              return voxel_cell (transform.scanner2voxel * pos.cast<default_type>(), cell) &&
+                  (index[offset (cell[0], cell[1], cell[2])] & wm_interior_flag);
+            }
+
+            size_t num_voxels () const { return num_stored; }
+            size_t num_wm_interior () const { return num_interior; }
+
+          private:
+            static constexpr uint32_t wm_interior_flag = uint32_t(1) << 31;
+            static constexpr size_t record_size = 8;
+
+            const Transform transform;
+            const ssize_t dim[3];
+            size_t num_stored, num_interior;
+
+            // slot + 1 of each voxel (zero if not stored), with the interior flag in the top bit
+            vector<uint32_t> index;
+            vector<float> buffer;
+            float* records;
+
+            FORCE_INLINE ssize_t offset (const ssize_t x, const ssize_t y, const ssize_t z) const {
+              return x + dim[0] * (y + dim[1] * z);
+            }
+
+            FORCE_INLINE ssize_t clamp (const ssize_t x, const size_t axis) const {
+              return x < 0 ? 0 : (x >= dim[axis] ? dim[axis]-1 : x);
+            }
+
+            FORCE_INLINE const float* record (const uint32_t entry) const {
+              return records + record_size * ((entry & ~wm_interior_flag) - 1);
+            }
+
+            // lower corner of the interpolation cell containing voxel position v;
+            //   false if v lies outside the image or below the first voxel centre
+            FORCE_INLINE bool voxel_cell (const Eigen::Vector3d& v, ssize_t* cell) const {
+              for (size_t axis = 0; axis != 3; ++axis) {
+                if (!(v[axis] >= 0.0 && v[axis] < dim[axis] - 0.5))
+                  return false;
+                cell[axis] = std::floor (v[axis]);
+              }
+              return true;
+            }
+        };
+
+
+      }
+    }
+  }
+}
+
+#endif
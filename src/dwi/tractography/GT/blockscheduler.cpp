@@ -0,0 +1,205 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include "dwi/tractography/GT/blockscheduler.h"
+
+#include "transform.h"
+#include "math/math.h"
+
+
+namespace MR {
+  namespace DWI {
+    namespace Tractography {
+      namespace GT {
+
+
+        // BLOCK ------------------------------------------------------------------------
+
+        bool BlockScheduler::Block::contains (const Point_t& pos) const
+        {
+          Point_t gpos = pGrid.pos2grid (pos);
+          for (size_t a = 0; a != 3; ++a) {
+            ssize_t c = std::lround (gpos[a]);
+            if ((c < lo[a]) || (c >= lo[a] + block_width))
+              return false;
+          }
+          return true;
+        }
+
+
+        Point_t BlockScheduler::Block::random_position (Math::RNG::Uniform<float>& rng) const
+        {
+          Point_t gpos;
+          for (size_t a = 0; a != 3; ++a)
+            gpos[a] = lo[a] - 0.5f + rng() * block_width;
+          return pGrid.grid2pos (gpos);
+        }
+
+
+        size_t BlockScheduler::Block::count () const
+        {
+          size_t n = 0;
+          for (ssize_t x = lo[0]; x != lo[0] + block_width; ++x)
+            for (ssize_t y = lo[1]; y != lo[1] + block_width; ++y)
+              for (ssize_t z = lo[2]; z != lo[2] + block_width; ++z) {
+                const ParticleGrid::ParticleVectorType* cell = pGrid.at (x, y, z);
+                if (cell)
+                  n += cell->size();
+              }
+          return n;
+        }
+
+
+        Particle* BlockScheduler::Block::random_particle (Math::RNG::Uniform<float>& rng) const
+        {
+          const size_t n = count();
+          if (!n)
+            return nullptr;
+          size_t k = std::min (size_t (rng() * n), n-1);
+          for (ssize_t x = lo[0]; x != lo[0] + block_width; ++x)
+            for (ssize_t y = lo[1]; y != lo[1] + block_width; ++y)
+              for (ssize_t z = lo[2]; z != lo[2] + block_width; ++z) {
+                const ParticleGrid::ParticleVectorType* cell = pGrid.at (x, y, z);
+                if (!cell)
+                  continue;
+                if (k < cell->size())
+                  return (*cell)[k];
+                k -= cell->size();
+              }
+          return nullptr;
+        }
+
+
+
+        // SCHEDULER --------------------------------------------------------------------
+
+        BlockScheduler::BlockScheduler (const ParticleGrid& pgrid, const Header& dwi, Image<bool>& mask, const size_t nthreads)
+          : pGrid (pgrid),
+            nthreads (std::max (nthreads, size_t(1))),
+            cellmask (pgrid.size(0) * pgrid.size(1) * pgrid.size(2), false),
+            colour (7), next (0),
+            nwaiting (0), generation (0), finished (false), aborted (false), stopped (false)
+        {
+          DEBUG("Initialise block scheduler for global tractography.");
+
+          // Flag particle grid cells that contain sampling domain voxels
+          Transform T (dwi);
+          size_t nvox = 0;
+          for (ssize_t i = 0; i != dwi.size(0); ++i)
+            for (ssize_t j = 0; j != dwi.size(1); ++j)
+              for (ssize_t k = 0; k != dwi.size(2); ++k) {
+                if (mask.valid()) {
+                  mask.index(0) = i; mask.index(1) = j; mask.index(2) = k;
+                  if (!mask.value())
+                    continue;
+                }
+                ++nvox;
+                Point_t pos = (T.voxel2scanner * Eigen::Vector3d (i, j, k)).cast<float>();
+                Point_t gpos = pGrid.pos2grid (pos);
+                ssize_t c[3];
+                for (size_t a = 0; a != 3; ++a)
+                  c[a] = std::max (ssize_t(0), std::min (ssize_t (pGrid.size(a))-1, ssize_t (std::lround (gpos[a]))));
+                cellmask[c[2] + pGrid.size(2) * (c[1] + pGrid.size(1) * c[0])] = true;
+              }
+          if (!nvox)
+            throw Exception ("Global tractography sampling domain is empty");
+
+          const double blocklength = block_width * 2.0 * Particle::L;
+          vfrac = Math::pow3 (blocklength) / (nvox * dwi.spacing(0) * dwi.spacing(1) * dwi.spacing(2));
+
+          for (size_t a = 0; a != 3; ++a)
+            nblocks[a] = pGrid.size(a) / block_width + 2;
+        }
+
+
+        bool BlockScheduler::next_block (Block& block)
+        {
+          const size_t idx = next.fetch_add (1, std::memory_order_relaxed);
+          if (idx >= blocks[colour].size())
+            return false;
+          block.lo = blocks[colour][idx];
+          return true;
+        }
+
+
+        bool BlockScheduler::sync ()
+        {
+          std::unique_lock<std::mutex> lock (mutex);
+          if (aborted)
+            return false;
+          const size_t current = generation;
+          if (++nwaiting == nthreads) {
+            nwaiting = 0;
+            if (++colour == 8) {
+              colour = 0;
+              new_sweep();
+            }
+            next = 0;
+            // All threads must agree on termination, so latch it on release
+            stopped = finished;
+            ++generation;
+            cond.notify_all();
+          } else {
+            cond.wait (lock, [&] { return generation != current || aborted; });
+          }
+          return !stopped && !aborted;
+        }
+
+
+        void BlockScheduler::abort ()
+        {
+          std::lock_guard<std::mutex> lock (mutex);
+          aborted = true;
+          cond.notify_all();
+        }
+
+
+        void BlockScheduler::new_sweep ()
+        {
+          std::uniform_int_distribution<ssize_t> dist (0, block_width-1);
+          for (size_t a = 0; a != 3; ++a)
+            offset[a] = dist (rng);
+          for (auto& b : blocks)
+            b.clear();
+          Eigen::Matrix<ssize_t, 3, 1> b, lo;
+          for (b[0] = 0; b[0] != nblocks[0]; ++b[0])
+            for (b[1] = 0; b[1] != nblocks[1]; ++b[1])
+              for (b[2] = 0; b[2] != nblocks[2]; ++b[2]) {
+                lo = b * block_width - offset;
+                if (is_active (lo))
+                  blocks[(b[0] & 1) | ((b[1] & 1) << 1) | ((b[2] & 1) << 2)].push_back (lo);
+              }
+          // randomise processing order to avoid systematic spatial bias within a colour
+          for (auto& c : blocks)
+            std::shuffle (c.begin(), c.end(), rng);
+        }
+
+
+        bool BlockScheduler::is_active (const Eigen::Matrix<ssize_t, 3, 1>& lo) const
+        {
+          for (ssize_t x = std::max (lo[0], ssize_t(0)); x < std::min (lo[0] + block_width, ssize_t (pGrid.size(0))); ++x)
+            for (ssize_t y = std::max (lo[1], ssize_t(0)); y < std::min (lo[1] + block_width, ssize_t (pGrid.size(1))); ++y)
+              for (ssize_t z = std::max (lo[2], ssize_t(0)); z < std::min (lo[2] + block_width, ssize_t (pGrid.size(2))); ++z)
+                if (cellmask[z + pGrid.size(2) * (y + pGrid.size(1) * x)])
+                  return true;
+          return false;
+        }
+
+
+      }
+    }
+  }
+}
@@ -0,0 +1,156 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#ifndef __gt_blockscheduler_h__
+#define __gt_blockscheduler_h__
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+#include "image.h"
+#include "math/rng.h"
+
+#include "dwi/tractography/GT/gt.h"
+#include "dwi/tractography/GT/particle.h"
+#include "dwi/tractography/GT/particlegrid.h"
+
+
+namespace MR {
+  namespace DWI {
+    namespace Tractography {
+      namespace GT {
+
+        /**
+         * @brief BlockScheduler partitions the particle grid into checkerboarded
+         *        spatial blocks, such that sampler threads can process all blocks
+         *        of one colour concurrently without any spatial locking.
+         *
+         * Blocks are cubes of block_width particle grid cells (i.e. 6L), which
+         * exceeds the 5L interaction range otherwise guarded by SpatialLock.
+         * Blocks are coloured by the parity of their index along each axis
+         * (8 colours), so that any two blocks of the same colour are separated
+         * by at least one full block. Each sweep processes the 8 colours in
+         * turn, with all threads synchronising between colours; the origin of
+         * the block partition is randomly offset every sweep so that particles
+         * are not permanently confined to a fixed set of blocks.
+         */
+        class BlockScheduler
+        { MEMALIGN(BlockScheduler)
+        public:
+
+          static constexpr ssize_t block_width = 3;
+          static constexpr size_t proposals_per_block = 64;
+
+
+          class Block
+          { MEMALIGN(Block)
+          public:
+            Block (const ParticleGrid& pgrid) : pGrid (pgrid), lo (0, 0, 0) { }
+
+            /**
+             * @brief Whether a position (in scanner space) lies within this block.
+             */
+            bool contains (const Point_t& pos) const;
+
+            /**
+             * @brief Draw a position uniformly within the block (in scanner space).
+             */
+            Point_t random_position (Math::RNG::Uniform<float>& rng) const;
+
+            /**
+             * @brief Number of particles currently in the block.
+             */
+            size_t count () const;
+
+            /**
+             * @brief Select a random particle from the block (uniformly).
+             */
+            Particle* random_particle (Math::RNG::Uniform<float>& rng) const;
+
+          protected:
+            const ParticleGrid& pGrid;
+            Eigen::Matrix<ssize_t, 3, 1> lo;
+            friend class BlockScheduler;
+          };
+
+
+          BlockScheduler (const ParticleGrid& pgrid, const Header& dwi, Image<bool>& mask, const size_t nthreads);
+
+          BlockScheduler (const BlockScheduler&) = delete;
+          BlockScheduler& operator= (const BlockScheduler&) = delete;
+
+          /**
+           * @brief Fetch the next unprocessed block of the current colour.
+           * @return false if no blocks of the current colour remain.
+           */
+          bool next_block (Block& block);
+
+          /**
+           * @brief Wait for all sampler threads to complete the current colour,
+           *        then advance to the next colour (and sweep, if required).
+           * @return false if sampling has terminated.
+           */
+          bool sync ();
+
+          /**
+           * @brief Signal that the iteration budget has been exhausted; all
+           *        threads will terminate at the next synchronisation point.
+           */
+          void finish () { finished = true; }
+
+          /**
+           * @brief Signal that a sampler thread has failed; threads waiting at
+           *        (or subsequently reaching) the synchronisation point are
+           *        released, and all will terminate.
+           */
+          void abort ();
+
+          /**
+           * @brief Volume of a block relative to the volume of the sampling
+           *        domain, used to scale the birth / death acceptance ratios.
+           */
+          double volume_fraction () const { return vfrac; }
+
+        protected:
+          const ParticleGrid& pGrid;
+          const size_t nthreads;
+          vector<bool> cellmask;
+          double vfrac;
+
+          Math::RNG rng;
+          Eigen::Matrix<ssize_t, 3, 1> offset, nblocks;
+          vector<Eigen::Matrix<ssize_t, 3, 1>> blocks[8];
+          size_t colour;
+          std::atomic<size_t> next;
+
+          std::mutex mutex;
+          std::condition_variable cond;
+          size_t nwaiting, generation;
+          std::atomic<bool> finished, aborted;
+          bool stopped; // finished as of the last barrier release (guarded by mutex)
+
+          void new_sweep ();
+          bool is_active (const Eigen::Matrix<ssize_t, 3, 1>& lo) const;
+        };
+
+
+      }
+    }
+  }
+}
+
+#endif // __gt_blockscheduler_h__
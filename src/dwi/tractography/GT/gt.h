@@ -21,6 +21,7 @@
 #define FRAC_BURNIN 10
 #define FRAC_PHASEOUT 10
 
+#include <atomic>
 #include <iostream>
 #include <mutex>
 
@@ -89,14 +90,24 @@ namespace MR {
 
 
           bool next() {
+            return next (1);
+          }
+
+          /**
+           * @brief Advance the iteration count by a batch of n proposals,
+           *        applying any cooling steps crossed in the process.
+           */
+          bool next(const uint64_t n) {
             std::lock_guard<std::mutex> lock (mutex);
-            ++n_iter;
-            if (n_iter % ITER_BIGSTEP == 0) {
-              if ((n_iter >= n_max/FRAC_BURNIN) && (n_iter < n_max - n_max/FRAC_PHASEOUT))
+            const uint64_t bigsteps = (n_iter + n) / ITER_BIGSTEP - n_iter / ITER_BIGSTEP;
+            for (uint64_t k = 1; k <= bigsteps; ++k) {
+              const uint64_t it = (n_iter / ITER_BIGSTEP + k) * ITER_BIGSTEP;
+              if ((it >= n_max/FRAC_BURNIN) && (it < n_max - n_max/FRAC_PHASEOUT))
                 Tint *= alpha;
               progress++;
               out << *this << std::endl;
             }
+            n_iter += n;
             return (n_iter < n_max);
           }
 
@@ -159,7 +170,6 @@ namespace MR {
           }
 
           void incN(const char p, unsigned int i = 1) {
-            std::lock_guard<std::mutex> lock (mutex);
             switch (p) {
               case 'b': n_gen[0] += i; break;
               case 'd': n_gen[1] += i; break;
@@ -171,7 +181,6 @@ namespace MR {
           }
 
           void incNa(const char p, unsigned int i = 1) {
-            std::lock_guard<std::mutex> lock (mutex);
             switch (p) {
               case 'b': n_acc[0] += i; break;
               case 'd': n_acc[1] += i; break;
@@ -202,8 +211,8 @@ namespace MR {
           double EextTot, EintTot;
           double alpha;
 
-          unsigned long n_gen[5];
-          unsigned long n_acc[5];
+          std::atomic<unsigned long> n_gen[5];
+          std::atomic<unsigned long> n_acc[5];
           unsigned long n_iter;
           const uint64_t n_max;
 
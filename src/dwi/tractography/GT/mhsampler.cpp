@@ -28,6 +28,31 @@ namespace MR {
         
         void MHSampler::execute()
         {          
+          if (scheduler) {
+            // Domain-decomposed sampling: all proposals are confined to the
+            // block currently owned by this thread, hence no locking required.
+            // On failure, release the other threads from the barrier before
+            // propagating the exception, otherwise they would wait forever.
+            BlockScheduler::Block blk (pGrid);
+            try {
+              while (scheduler->sync()) {
+                while (scheduler->next_block(blk)) {
+                  block = &blk;
+                  for (size_t k = 0; k != BlockScheduler::proposals_per_block; ++k)
+                    next();
+                  block = nullptr;
+                  if (!stats.next(BlockScheduler::proposals_per_block))
+                    scheduler->finish();
+                }
+              }
+            } catch (...) {
+              block = nullptr;
+              scheduler->abort();
+              throw;
+            }
+            return;
+          }
+          
           do {
             next();
           } while (stats.next());
@@ -65,13 +90,24 @@ namespace MR {
           
           Point_t pos;
           SpatialLock<float>::Guard spatial_guard (*lock);
-          do {
-            pos = getRandPosInMask();
-          } while (! spatial_guard.try_lock(pos));
+          double density = props.density;
+          size_t count;
+          if (block) {
+            pos = block->random_position(rng_uniform);
+            if (!inMask(T.scanner2voxel.cast<float>() * pos))
+              return;
+            density *= scheduler->volume_fraction();
+            count = block->count();
+          } else {
+            do {
+              pos = getRandPosInMask();
+            } while (! spatial_guard.try_lock(pos));
+            count = pGrid.getTotalCount();
+          }
           Point_t dir = getRandDir();
           
           double dE = E->stageAdd(pos, dir);
-          double R = std::exp(-dE) * props.density / (pGrid.getTotalCount()+1) * props.p_death / props.p_birth;
+          double R = std::exp(-dE) * density / (count+1) * props.p_death / props.p_birth;
           if (R > rng_uniform()) {
             E->acceptChanges();
             pGrid.add(pos, dir);
@@ -88,16 +124,21 @@ namespace MR {
           //TRACE;
           stats.incN('d');
           
-          Particle* par;
           SpatialLock<float>::Guard spatial_guard (*lock);
-          do {
-            par = pGrid.getRandom();
-            if (par == NULL || par->hasPredecessor() || par->hasSuccessor())
-              return;
-          } while (! spatial_guard.try_lock(par->getPosition()));
+          Particle* par = getRandParticle(spatial_guard);
+          if (par == NULL || par->hasPredecessor() || par->hasSuccessor())
+            return;
+          double density = props.density;
+          size_t count;
+          if (block) {
+            density *= scheduler->volume_fraction();
+            count = block->count();
+          } else {
+            count = pGrid.getTotalCount();
+          }
           
           double dE = E->stageRemove(par);
-          double R = std::exp(-dE) * pGrid.getTotalCount() / props.density * props.p_birth / props.p_death;
+          double R = std::exp(-dE) * count / density * props.p_birth / props.p_death;
           if (R > rng_uniform()) {
             E->acceptChanges();
             pGrid.remove(par);
@@ -114,18 +155,15 @@ namespace MR {
           //TRACE;
           stats.incN('r');
           
-          Particle* par;
           SpatialLock<float>::Guard spatial_guard (*lock);
-          do {
-            par = pGrid.getRandom();
-            if (par == NULL)
-              return;
-          } while (! spatial_guard.try_lock(par->getPosition()));
+          Particle* par = getRandParticle(spatial_guard);
+          if (par == NULL)
+            return;
 
           Point_t pos, dir;
           moveRandom(par, pos, dir);
           
-          if (!inMask(T.scanner2voxel.cast<float>() * pos)) {
+          if (!inMask(T.scanner2voxel.cast<float>() * pos) || (block && !block->contains(pos))) {
             return;
           }
           double dE = E->stageShift(par, pos, dir);
@@ -146,17 +184,14 @@ namespace MR {
           //TRACE;
           stats.incN('o');
           
-          Particle* par;
           SpatialLock<float>::Guard spatial_guard (*lock);
-          do {
-            par = pGrid.getRandom();
-            if (par == NULL)
-              return;
-          } while (! spatial_guard.try_lock(par->getPosition()));
+          Particle* par = getRandParticle(spatial_guard);
+          if (par == NULL)
+            return;
 
           Point_t pos, dir;
           bool moved = moveOptimal(par, pos, dir);
-          if (!moved || !inMask(T.scanner2voxel.cast<float>() * pos)) {
+          if (!moved || !inMask(T.scanner2voxel.cast<float>() * pos) || (block && !block->contains(pos))) {
             return;
           }
           
@@ -179,13 +214,10 @@ namespace MR {
           //TRACE;
           stats.incN('c');
           
-          Particle* par;
           SpatialLock<float>::Guard spatial_guard (*lock);
-          do {
-            par = pGrid.getRandom();
-            if (par == NULL)
-              return;
-          } while (! spatial_guard.try_lock(par->getPosition()));
+          Particle* par = getRandParticle(spatial_guard);
+          if (par == NULL)
+            return;
 
           int alpha0 = (rng_uniform() < 0.5) ? -1 : 1;
           ParticleEnd pe0;
@@ -231,6 +263,20 @@ namespace MR {
         }
         
         
+        Particle* MHSampler::getRandParticle(SpatialLock<float>::Guard& guard)
+        {
+          if (block)
+            return block->random_particle(rng_uniform);
+          Particle* par;
+          do {
+            par = pGrid.getRandom();
+            if (par == NULL)
+              return NULL;
+          } while (! guard.try_lock(par->getPosition()));
+          return par;
+        }
+        
+        
         bool MHSampler::inMask(const Point_t p)
         {
           if ((p[0] <= -0.5) || (p[0] >= dims[0]-0.5) || 
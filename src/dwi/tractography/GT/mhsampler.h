@@ -27,6 +27,7 @@
 #include "dwi/tractography/GT/particlegrid.h"
 #include "dwi/tractography/GT/energy.h"
 #include "dwi/tractography/GT/spatiallock.h"
+#include "dwi/tractography/GT/blockscheduler.h"
 
 
 namespace MR {
@@ -41,10 +42,11 @@ namespace MR {
         { MEMALIGN(MHSampler)
         public:
           MHSampler(const Image<float>& dwi, Properties &p, Stats &s, ParticleGrid &pgrid, 
-                    EnergyComputer* e, Image<bool>& m)
+                    EnergyComputer* e, Image<bool>& m, std::shared_ptr<BlockScheduler> bs = nullptr)
             : props(p), stats(s), pGrid(pgrid), E(e), T(dwi), 
               dims{size_t(dwi.size(0)), size_t(dwi.size(1)), size_t(dwi.size(2))}, 
               mask(m), lock(make_shared<SpatialLock<float>>(5*Particle::L)), 
+              scheduler(bs), block(nullptr),
               sigpos(Particle::L / 8.), sigdir(0.2)
           {
             DEBUG("Initialise Metropolis Hastings sampler.");
@@ -52,7 +54,9 @@ namespace MR {
           
           MHSampler(const MHSampler& other)
             : props(other.props), stats(other.stats), pGrid(other.pGrid), E(other.E->clone()), 
-              T(other.T), dims(other.dims), mask(other.mask), lock(other.lock), rng_uniform(), rng_normal(), sigpos(other.sigpos), sigdir(other.sigdir)
+              T(other.T), dims(other.dims), mask(other.mask), lock(other.lock), 
+              scheduler(other.scheduler), block(nullptr),
+              rng_uniform(), rng_normal(), sigpos(other.sigpos), sigdir(other.sigdir)
           {
             DEBUG("Copy Metropolis Hastings sampler.");
           }
@@ -82,6 +86,8 @@ namespace MR {
           Image<bool> mask;
           
           std::shared_ptr< SpatialLock<float> > lock;
+          std::shared_ptr< BlockScheduler > scheduler;
+          const BlockScheduler::Block* block;     // block currently owned by this thread (scheduled mode only)
           Math::RNG::Uniform<float> rng_uniform;
           Math::RNG::Normal<float> rng_normal;
           float sigpos, sigdir;
@@ -89,6 +95,8 @@ namespace MR {
           
           Point_t getRandPosInMask();
           
+          Particle* getRandParticle(SpatialLock<float>::Guard& guard);
+          
           bool inMask(const Point_t p);
           
           Point_t getRandDir();
@@ -17,6 +17,8 @@
 #ifndef __gt_particle_h__
 #define __gt_particle_h__
 
+#include <atomic>
+
 #include "types.h"
 
 
@@ -45,7 +47,7 @@ namespace MR {
             predecessor = nullptr;
             successor = nullptr;
             visited = false;
-            alive = false;
+            alive.store (false, std::memory_order_relaxed);
           }
           
           Particle(const Point_t& p, const Point_t& d)
@@ -65,7 +67,7 @@ namespace MR {
             predecessor = nullptr;
             successor = nullptr;
             visited = false;
-            alive = true;
+            alive.store (true, std::memory_order_release);
           }
           
           inline void finalize()
@@ -74,7 +76,7 @@ namespace MR {
               removePredecessor();
             if (successor)
               removeSuccessor();
-            alive = false;
+            alive.store (false, std::memory_order_release);
           }
 
           // disable copy and assignment
@@ -188,7 +190,7 @@ namespace MR {
           
           bool isAlive() const
           {
-            return alive;
+            return alive.load (std::memory_order_acquire);
           }
           
 
@@ -198,7 +200,8 @@ namespace MR {
           Particle* predecessor;
           Particle* successor;
           bool visited;
-          bool alive;
+          // read by ParticlePool::random() without locking
+          std::atomic<bool> alive;
           
           void setPredecessor(Particle* p1)
           {
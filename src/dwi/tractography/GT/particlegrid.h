@@ -20,6 +20,7 @@
 #include <mutex>
 
 #include "header.h"
+#include "memory_usage.h"
 #include "transform.h"
 #include "dwi/tractography/file.h"
 #include "math/rng.h"
@@ -49,7 +50,10 @@ namespace MR {
             dims[0] = Math::ceil<size_t>( image.size(0) * image.spacing(0) / (2.0*Particle::L) );
             dims[1] = Math::ceil<size_t>( image.size(1) * image.spacing(1) / (2.0*Particle::L) );
             dims[2] = Math::ceil<size_t>( image.size(2) * image.spacing(2) / (2.0*Particle::L) );
+            const size_t bytes = dims[0]*dims[1]*dims[2] * sizeof(ParticleVectorType);
+            Memory::check(bytes, "global tractography particle grid");
             grid.resize(dims[0]*dims[1]*dims[2]);
+            allocation = Memory::Allocation(bytes, "global tractography particle grid");
             
             // Initialise scanner-to-grid transform
             Eigen::DiagonalMatrix<default_type, 3> newspacing (2.0*Particle::L, 2.0*Particle::L, 2.0*Particle::L);
@@ -58,6 +62,7 @@ namespace MR {
                                   image.spacing(2)/2.0 - Particle::L);
             T_s2g = image.transform() * newspacing;
             T_s2g = T_s2g.inverse().translate(shift);
+            T_g2s = T_s2g.inverse();
           }
           
           ParticleGrid(const ParticleGrid&) = delete;
@@ -92,8 +97,9 @@ namespace MR {
           std::mutex mutex;
           ParticlePool pool;
           vector<ParticleVectorType> grid;
+          Memory::Allocation allocation;
           Math::RNG rng;
-          transform_type T_s2g;
+          transform_type T_s2g, T_g2s;
           size_t dims[3];
           
           
@@ -114,6 +120,21 @@ namespace MR {
             z = Math::round<size_t>(gpos[2]);
           }
           
+          inline Point_t pos2grid(const Point_t& pos) const
+          {
+            return T_s2g.cast<float>() * pos;
+          }
+          
+          inline Point_t grid2pos(const Point_t& gpos) const
+          {
+            return T_g2s.cast<float>() * gpos;
+          }
+          
+          inline size_t size(const size_t axis) const
+          {
+            return dims[axis];
+          }
+          
         protected:
           inline size_t xyz2idx(const size_t x, const size_t y, const size_t z) const
           {
@@ -17,10 +17,10 @@
 #ifndef __gt_particlepool_h__
 #define __gt_particlepool_h__
 
-#include <deque>
-#include <stack>
-#include <mutex>
+#include <atomic>
+#include <functional>
 
+#include "memory_usage.h"
 #include "math/rng.h"
 
 #include "dwi/tractography/GT/particle.h"
@@ -33,60 +33,83 @@ namespace MR {
         /**
          * @brief ParticlePool manages creation and deletion of particles,
          *        minimizing the no. calls to new/delete.
+         *
+         * Particles are stored in fixed-size chunks that are never moved or
+         * released until the pool is cleared, such that pointers remain valid
+         * for the lifetime of the pool. Slots are handed out through an atomic
+         * counter, and destroyed particles are recycled through a lock-free
+         * (tagged) free list, so that concurrent create / destroy / random
+         * calls from multiple sampler threads never block each other.
          */
         class ParticlePool
         { MEMALIGN(ParticlePool)
         public:
-          ParticlePool() { }
+          ParticlePool() :
+              chunks (new std::atomic<Particle*> [max_chunks]),
+              links (new std::atomic<std::atomic<uint32_t>*> [max_chunks]),
+              allocations (new Memory::Allocation [max_chunks]),
+              nallocated (0), nalive (0), freehead (0)
+          {
+            for (size_t c = 0; c != max_chunks; ++c) {
+              chunks[c].store (nullptr, std::memory_order_relaxed);
+              links[c].store (nullptr, std::memory_order_relaxed);
+            }
+          }
           
           ParticlePool(const ParticlePool&) = delete;
           ParticlePool& operator=(const ParticlePool&) = delete;
-          ~ParticlePool() { }
+          ~ParticlePool() {
+            clear();
+            delete[] chunks;
+            delete[] links;
+            delete[] allocations;
+          }
           
           /**
            * @brief Creates a new particle and returns a pointer to its address.
            */
           Particle* create(const Point_t& pos, const Point_t& dir)
           {
-            std::lock_guard<std::mutex> lock (mutex);
-            if (avail.empty()) {
-              pool.emplace_back(pos, dir);
-              return &pool.back();
-            } else {
-              Particle* p = avail.top();
-              p->init(pos, dir);
-              avail.pop();
-              return p;
+            Particle* p = pop_free();
+            if (!p) {
+              const uint32_t idx = nallocated.fetch_add (1, std::memory_order_relaxed);
+              if (idx >= max_chunks * chunk_size)
+                throw Exception ("maximum number of particles in global tractography exceeded");
+              p = slot (idx, true);
             }
+            p->init(pos, dir);
+            nalive.fetch_add (1, std::memory_order_relaxed);
+            return p;
           }
           
           /**
            * @brief Destroys the particle at pointer p.
            */
           void destroy(Particle* p) {
-            std::lock_guard<std::mutex> lock (mutex);
             p->finalize();
-            avail.push(p);
+            nalive.fetch_sub (1, std::memory_order_relaxed);
+            push_free (index_of (p));
           }
           
           /**
            * @brief Return number of Particles in the pool.
            */
           inline size_t size() const {
-            return pool.size() - avail.size();
+            return nalive.load (std::memory_order_relaxed);
           }
           
           /**
            * @brief Select random particle from the pool (uniformly).
            */
           Particle* random() {
-            std::lock_guard<std::mutex> lock (mutex);
-            if (pool.size() > avail.size())
+            thread_local Math::RNG rng;
+            const uint32_t n = std::min (nallocated.load (std::memory_order_acquire), uint32_t(max_chunks * chunk_size));
+            if (n && size() > 0)
             {
-              std::uniform_int_distribution<size_t> dist(0, pool.size()-1);
+              std::uniform_int_distribution<uint32_t> dist(0, n-1);
               for (int k = 0; k != 5; ++k) {
-                Particle* p = &pool[dist(rng)];
-                if (p->isAlive())
+                Particle* p = slot (dist(rng), false);
+                if (p && p->isAlive())
                   return p;
               }
             }
@@ -95,19 +118,97 @@ namespace MR {
           
           /**
            * @brief Clear pool.
+           * @note Not thread-safe: must not be called while sampling is in progress.
            */
           void clear() {
-            std::lock_guard<std::mutex> lock (mutex);
-            pool.clear();
-            std::stack<Particle*, deque<Particle*> > e {};
-            avail.swap(e);
+            for (size_t c = 0; c != max_chunks; ++c) {
+              delete[] chunks[c].exchange (nullptr);
+              delete[] links[c].exchange (nullptr);
+              allocations[c].release();
+            }
+            nallocated = 0;
+            nalive = 0;
+            freehead = 0;
           }
           
         protected:
-          std::mutex mutex;
-          deque<Particle> pool;
-          std::stack<Particle*, deque<Particle*> > avail;
-          Math::RNG rng;
+          static constexpr size_t chunk_bits = 16;
+          static constexpr size_t chunk_size = size_t(1) << chunk_bits;
+          static constexpr size_t max_chunks = size_t(1) << 15;
+
+          std::atomic<Particle*>* chunks;
+          std::atomic<std::atomic<uint32_t>*>* links;
+          // registration of each chunk with the memory budget; only written by the thread that allocates the chunk
+          Memory::Allocation* allocations;
+          std::atomic<uint32_t> nallocated;
+          std::atomic<size_t> nalive;
+          // free list head: upper 32 bits hold an ABA tag, lower 32 bits hold (index+1), 0 = empty
+          std::atomic<uint64_t> freehead;
+
+
+          Particle* slot (const uint32_t idx, const bool allocate)
+          {
+            const size_t c = idx >> chunk_bits;
+            Particle* base = chunks[c].load (std::memory_order_acquire);
+            if (!base) {
+              if (!allocate)
+                return nullptr;
+              const size_t chunk_bytes = chunk_size * (sizeof (Particle) + sizeof (std::atomic<uint32_t>));
+              Memory::check (chunk_bytes, "global tractography particle pool");
+              // link table first, such that it is in place before any particle in the chunk can be released
+              std::atomic<uint32_t>* newlinks = new std::atomic<uint32_t> [chunk_size];
+              std::atomic<uint32_t>* expected_links = nullptr;
+              if (!links[c].compare_exchange_strong (expected_links, newlinks, std::memory_order_acq_rel))
+                delete[] newlinks;
+              Particle* newbase = new Particle [chunk_size];
+              if (chunks[c].compare_exchange_strong (base, newbase, std::memory_order_acq_rel)) {
+                base = newbase;
+                allocations[c] = Memory::Allocation (chunk_bytes, "global tractography particle pool");
+              }
+              else
+                delete[] newbase;
+            }
+            return base + (idx & (chunk_size-1));
+          }
+
+          std::atomic<uint32_t>& link (const uint32_t idx) {
+            return links[idx >> chunk_bits].load (std::memory_order_acquire)[idx & (chunk_size-1)];
+          }
+
+          uint32_t index_of (const Particle* p) const
+          {
+            const size_t nchunks = (nallocated.load (std::memory_order_acquire) + chunk_size - 1) >> chunk_bits;
+            for (size_t c = 0; c != std::min (nchunks, max_chunks); ++c) {
+              const Particle* base = chunks[c].load (std::memory_order_acquire);
+              if (base && !std::less<const Particle*>() (p, base) && std::less<const Particle*>() (p, base + chunk_size))
+                return uint32_t ((c << chunk_bits) + (p - base));
+            }
+            assert (false);
+            return 0;
+          }
+
+          Particle* pop_free()
+          {
+            uint64_t head = freehead.load (std::memory_order_acquire);
+            while (uint32_t (head)) {
+              const uint32_t idx = uint32_t (head) - 1;
+              const uint64_t next = (((head >> 32) + 1) << 32) | link (idx).load (std::memory_order_relaxed);
+              if (freehead.compare_exchange_weak (head, next, std::memory_order_acq_rel, std::memory_order_acquire))
+                return slot (idx, false);
+            }
+            return nullptr;
+          }
+
+          void push_free (const uint32_t idx)
+          {
+            uint64_t head = freehead.load (std::memory_order_relaxed);
+            uint64_t next;
+            do {
+              link (idx).store (uint32_t (head), std::memory_order_relaxed);
+              next = (((head >> 32) + 1) << 32) | (uint64_t(idx) + 1);
+            } while (!freehead.compare_exchange_weak (head, next, std::memory_order_release, std::memory_order_relaxed));
+          }
+
         };
 
       }
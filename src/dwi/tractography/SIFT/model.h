@@ -18,7 +18,10 @@
 #define __dwi_tractography_sift_model_h__
 
 
+#include <fstream>
+
 #include "app.h"
+#include "memory_usage.h"
 #include "thread_queue.h"
 #include "types.h"
 
@@ -93,6 +96,7 @@ namespace MR
         protected:
           std::string tck_file_path;
           vector<TrackContribution*> contributions;
+          Memory::Allocation contributions_allocation;
 
           using Fixel_map<Fixel>::accessor;
           using Fixel_map<Fixel>::begin;
@@ -179,6 +183,17 @@ namespace MR
         if (!count)
           throw Exception ("Cannot map streamlines: track file " + Path::basename(path) + " is empty");
 
+        // Approximate projection of the memory required, assuming one fixel
+        //   contribution per streamline vertex (stored as three floats); since
+        //   this can be substantially in error, exceeding the memory limit is
+        //   not treated as fatal
+        const std::streamoff file_size = std::max (std::ifstream (path, std::ios::binary | std::ios::ate).tellg(), std::streampos (0));
+        const size_t projected = count * (sizeof (TrackContribution*) + sizeof (TrackContribution))
+                                 + size_t (file_size / (3 * sizeof (float))) * sizeof (Track_fixel_contribution);
+        if (!Memory::fits (projected))
+          WARN ("approximate memory required for streamline-fixel contributions (" + Memory::format_size (projected) + ") "
+                + "exceeds memory limit of " + Memory::format_size (Memory::limit()) + "; command may fail to complete");
+
         contributions.assign (count, nullptr);
 
         {
@@ -201,6 +216,13 @@ namespace MR
           }
         }
 
+        size_t bytes = contributions.size() * sizeof (TrackContribution*);
+        for (const auto i : contributions) {
+          if (i)
+            bytes += sizeof (TrackContribution) + i->dim() * sizeof (Track_fixel_contribution);
+        }
+        contributions_allocation = Memory::Allocation (bytes, "streamline-fixel contributions");
+
         tck_file_path = path;
 
         INFO ("Proportionality coefficient after streamline mapping is " + str (mu()));
@@ -62,6 +62,8 @@ namespace MR
             throw Exception ("Algorithm iFOD1 expects as input a spherical harmonic (SH) image");
           }
 
+          init_fod_cache();
+
           set_step_and_angle (rk4 ? Defaults::stepsize_voxels_rk4 : Defaults::stepsize_voxels_firstorder,
                               Defaults::angle_ifod1,
                               rk4);
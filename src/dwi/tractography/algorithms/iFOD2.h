@@ -66,6 +66,8 @@ namespace MR
                     throw Exception ("Algorithm iFOD2 expects as input a spherical harmonic (SH) image");
                   }
 
+                  init_fod_cache();
+
                   if (rk4)
                     throw Exception ("4th-order Runge-Kutta integration not valid for iFOD2 algorithm");
 
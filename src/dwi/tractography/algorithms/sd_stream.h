@@ -46,6 +46,8 @@ class SDStream : public MethodBase { MEMALIGN(SDStream)
             throw Exception ("Algorithm SD_STREAM expects as input a spherical harmonic (SH) image");
           }
 
+          init_fod_cache();
+
           if (is_act() && act().backtrack())
             throw Exception ("Backtracking not valid for deterministic algorithms");
 
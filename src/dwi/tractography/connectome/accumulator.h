@@ -0,0 +1,196 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#ifndef __dwi_tractography_connectome_accumulator_h__
+#define __dwi_tractography_connectome_accumulator_h__
+
+#include "dwi/tractography/streamline.h"
+#include "dwi/tractography/connectome/mapped_track.h"
+#include "dwi/tractography/connectome/mapper.h"
+#include "dwi/tractography/connectome/matrix.h"
+
+
+namespace MR {
+namespace DWI {
+namespace Tractography {
+namespace Connectome {
+
+
+
+
+// Maps streamlines to nodes and accumulates their contributions directly
+//   into per-thread partial connectomes; this avoids funnelling every mapped
+//   streamline through a single-threaded writer stage. The partial connectomes
+//   are handed over to, and reduced into, their parent Matrix upon
+//   destruction, and so all copies of this class must be destroyed prior to
+//   calling Matrix::finalize().
+//
+// Any number of connectomes can be generated in a single pass through the
+//   streamline data: each parcellation (i.e. Tck2nodes_base instance) may be
+//   combined with any number of metrics, each contributing to its own Matrix.
+//   The node assignments of each streamline are computed only once for each
+//   parcellation, regardless of the number of metrics associated with it.
+//   Connectomes must all be added prior to the class being copy-constructed.
+template <typename T>
+class Accumulator
+{ MEMALIGN(Accumulator<T>)
+
+  public:
+    Accumulator () { }
+
+    Accumulator (const Tck2nodes_base& tck2nodes, const Metric& metric, Matrix<T>& matrix)
+    {
+      add (tck2nodes, metric, matrix);
+    }
+
+    Accumulator (const Accumulator& that)
+    {
+      for (const auto& p : that.parcellations) {
+        parcellations.push_back (Parcellation (p.tck2nodes));
+        for (const auto& t : p.targets)
+          parcellations.back().targets.push_back (Target (t.metric, t.matrix));
+      }
+    }
+
+    Accumulator (Accumulator&&) = default;
+
+    ~Accumulator()
+    {
+      for (auto& p : parcellations) {
+        for (auto& t : p.targets) {
+          if (t.partial)
+            t.matrix.merge (std::move (*t.partial));
+        }
+      }
+    }
+
+
+    void add (const Tck2nodes_base& tck2nodes, const Metric& metric, Matrix<T>& matrix)
+    {
+      for (auto& p : parcellations) {
+        if (&p.tck2nodes == &tck2nodes) {
+          p.targets.push_back (Target (metric, matrix));
+          return;
+        }
+      }
+      parcellations.push_back (Parcellation (tck2nodes));
+      parcellations.back().targets.push_back (Target (metric, matrix));
+    }
+
+    size_t size() const
+    {
+      size_t result = 0;
+      for (const auto& p : parcellations)
+        result += p.targets.size();
+      return result;
+    }
+
+
+    bool operator() (const Tractography::Streamline<float>& in)
+    {
+      for (auto& p : parcellations)
+        p (in);
+      return true;
+    }
+
+    // These versions additionally yield the node assignments of each
+    //   streamline for the first parcellation added, e.g. for streaming to
+    //   an AssignmentWriter
+    bool operator() (const Tractography::Streamline<float>& in, Mapped_track_nodepair& out)
+    {
+      assert (parcellations.size());
+      parcellations[0] (in, out);
+      for (size_t i = 1; i != parcellations.size(); ++i)
+        parcellations[i] (in);
+      return true;
+    }
+
+    bool operator() (const Tractography::Streamline<float>& in, Mapped_track_nodelist& out)
+    {
+      assert (parcellations.size());
+      parcellations[0] (in, out);
+      for (size_t i = 1; i != parcellations.size(); ++i)
+        parcellations[i] (in);
+      return true;
+    }
+
+
+  private:
+    class Target
+    { MEMALIGN(Target)
+      public:
+        Target (const Metric& metric, Matrix<T>& matrix) :
+            metric (metric),
+            matrix (matrix),
+            partial (new typename Matrix<T>::Partial (matrix)) { }
+        Target (Target&&) = default;
+
+        const Metric& metric;
+        Matrix<T>& matrix;
+        std::unique_ptr<typename Matrix<T>::Partial> partial;
+    };
+
+    class Parcellation
+    { MEMALIGN(Parcellation)
+      public:
+        Parcellation (const Tck2nodes_base& tck2nodes) :
+            tck2nodes (tck2nodes) { }
+        Parcellation (Parcellation&&) = default;
+
+        void operator() (const Tractography::Streamline<float>& in)
+        {
+          if (tck2nodes.provides_pair())
+            (*this) (in, pair);
+          else
+            (*this) (in, list);
+        }
+
+        // Node assignment is performed once, using the first metric; the
+        //   contribution of the streamline is then re-evaluated for each
+        //   subsequent metric without re-mapping
+        template <class TrackType>
+        void operator() (const Tractography::Streamline<float>& in, TrackType& out)
+        {
+          assert (targets.size());
+          Mapper (tck2nodes, targets[0].metric) (in, out);
+          (*targets[0].partial) (out);
+          for (size_t i = 1; i != targets.size(); ++i) {
+            out.set_factor (targets[i].metric (in, out.get_nodes()));
+            (*targets[i].partial) (out);
+          }
+        }
+
+        const Tck2nodes_base& tck2nodes;
+        vector<Target> targets;
+        Mapped_track_nodepair pair;
+        Mapped_track_nodelist list;
+    };
+
+    vector<Parcellation> parcellations;
+
+};
+
+
+
+
+}
+}
+}
+}
+
+
+#endif
+
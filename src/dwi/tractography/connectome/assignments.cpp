@@ -0,0 +1,69 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include "dwi/tractography/connectome/assignments.h"
+
+#include "app.h"
+
+
+namespace MR {
+namespace DWI {
+namespace Tractography {
+namespace Connectome {
+
+
+
+AssignmentWriter::AssignmentWriter (const std::string& path, const bool vector_output) :
+    out (path),
+    vector_output (vector_output)
+{
+  out << "# " << App::command_history_string << "\n";
+}
+
+
+
+bool AssignmentWriter::operator() (const Mapped_track_nodepair& in)
+{
+  if (vector_output)
+    out << str(in.get_second_node()) << "\n";
+  else
+    out << str(in.get_first_node()) << " " << str(in.get_second_node()) << "\n";
+  return true;
+}
+
+
+
+bool AssignmentWriter::operator() (const Mapped_track_nodelist& in)
+{
+  list = in.get_nodes();
+  if (list.empty()) {
+    out << "0\n";
+    return true;
+  }
+  std::sort (list.begin(), list.end());
+  out << str(list[0]);
+  for (size_t i = 1; i != list.size(); ++i)
+    out << " " << str(list[i]);
+  out << "\n";
+  return true;
+}
+
+
+
+}
+}
+}
+}
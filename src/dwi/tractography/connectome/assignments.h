@@ -0,0 +1,62 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#ifndef __dwi_tractography_connectome_assignments_h__
+#define __dwi_tractography_connectome_assignments_h__
+
+#include "file/ofstream.h"
+
+#include "dwi/tractography/connectome/mapped_track.h"
+
+
+namespace MR {
+namespace DWI {
+namespace Tractography {
+namespace Connectome {
+
+
+
+
+// Writes the node assignments of each streamline to file as they are
+//   generated, rather than storing them all in memory; must be used as the
+//   sink of an ordered queue, such that streamlines are received in order
+class AssignmentWriter
+{ MEMALIGN(AssignmentWriter)
+
+  public:
+    AssignmentWriter (const std::string& path, const bool vector_output);
+
+    bool operator() (const Mapped_track_nodepair&);
+    bool operator() (const Mapped_track_nodelist&);
+
+  private:
+    File::OFStream out;
+    const bool vector_output;
+    vector<node_t> list;
+
+};
+
+
+
+
+}
+}
+}
+}
+
+
+#endif
+
@@ -44,6 +44,8 @@ class Mapper
       metric (that.metric) { }
 
 
+    bool provides_pair() const { return tck2nodes.provides_pair(); }
+
     bool operator() (const Tractography::Streamline<float>& in, Mapped_track_nodepair& out)
     {
       assert (tck2nodes.provides_pair());
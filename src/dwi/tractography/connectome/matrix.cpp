@@ -41,94 +41,117 @@ const App::Option EdgeStatisticOption
 
 
 template <typename T>
-bool Matrix<T>::operator() (const Mapped_track_nodepair& in)
+Matrix<T>::Partial::Partial (const Matrix& master) :
+    Partial (master, !master.vector_output && master.mat2vec->mat_size() > node_count_sparse_limit) { }
+
+template <typename T>
+Matrix<T>::Partial::Partial (const Matrix& master, const bool sparse_storage) :
+    master (master),
+    sparse (sparse_storage && !master.vector_output)
 {
-  assert (in.get_first_node()  < mat2vec->mat_size());
-  assert (in.get_second_node() < mat2vec->mat_size());
-  assert (assignments_lists.empty());
-  if (is_vector()) {
-    assert (assignments_pairs.empty());
-    apply_data (in.get_second_node(), in.get_factor(), in.get_weight());
-    inc_count (in.get_second_node(), in.get_weight());
-    if (track_assignments) {
-      if (in.get_track_index() == assignments_single.size()) {
-        assignments_single.push_back (in.get_second_node());
-      } else if (in.get_track_index() < assignments_single.size()) {
-        assignments_single[in.get_track_index()] = in.get_second_node();
-      } else {
-        assignments_single.resize (in.get_track_index() + 1, 0);
-        assignments_single[in.get_track_index()] = in.get_second_node();
-      }
-    }
+  if (sparse)
+    return;
+  data = vector_type::Constant (master.data.size(), initial_value (master.statistic));
+  if (master.statistic == stat_edge::MEAN)
+    counts = vector_type::Zero (master.data.size());
+}
+
+
+
+template <typename T>
+template <class TrackType>
+void Matrix<T>::Partial::accumulate (const TrackType& in)
+{
+  if (sparse) {
+    master.for_each_edge (in, [&] (const uint64_t index) {
+      auto it = sparse_data.emplace (index, std::make_pair (initial_value (master.statistic), T(0))).first;
+      master.apply_data (it->second.first, in.get_factor(), in.get_weight());
+      it->second.second += in.get_weight();
+    });
   } else {
-    assert (assignments_single.empty());
-    apply_data (in.get_first_node(), in.get_second_node(), in.get_factor(), in.get_weight());
-    inc_count (in.get_first_node(), in.get_second_node(), in.get_weight());
-    if (track_assignments) {
-      if (in.get_track_index() == assignments_pairs.size()) {
-        assignments_pairs.push_back (in.get_nodes());
-      } else if (in.get_track_index() < assignments_pairs.size()) {
-        assignments_pairs[in.get_track_index()] = in.get_nodes();
-      } else {
-        assignments_pairs.resize (in.get_track_index() + 1, std::make_pair<size_t, size_t> (0, 0));
-        assignments_pairs[in.get_track_index()] = in.get_nodes();
-      }
-    }
+    master.for_each_edge (in, [&] (const uint64_t index) {
+      master.apply_data (data[index], in.get_factor(), in.get_weight());
+      if (counts.size())
+        counts[index] += in.get_weight();
+    });
   }
-  return true;
 }
 
 
 
+template <typename T>
+template <class TrackType>
+void Matrix<T>::accumulate (const TrackType& in)
+{
+  for_each_edge (in, [&] (const uint64_t index) {
+    apply_data (data[index], in.get_factor(), in.get_weight());
+    if (counts.size())
+      counts[index] += in.get_weight();
+  });
+}
+
+
+
+template <typename T>
+void Matrix<T>::Partial::operator() (const Mapped_track_nodepair& in)
+{
+  accumulate (in);
+}
+
+template <typename T>
+void Matrix<T>::Partial::operator() (const Mapped_track_nodelist& in)
+{
+  accumulate (in);
+}
+
+
+
+template <typename T>
+bool Matrix<T>::operator() (const Mapped_track_nodepair& in)
+{
+  accumulate (in);
+  return true;
+}
+
 template <typename T>
 bool Matrix<T>::operator() (const Mapped_track_nodelist& in)
 {
-  assert (assignments_single.empty());
-  assert (assignments_pairs.empty());
-  vector<node_t> list (in.get_nodes());
-  for (vector<node_t>::const_iterator i = list.begin(); i != list.end(); ++i) {
-    assert (*i < data.rows());
-  }
-  if (is_vector()) {
-    if (list.empty()) {
-      apply_data (0, in.get_factor(), in.get_weight());
-      inc_count (0, in.get_weight());
-      list.push_back (0);
-    } else {
-      for (vector<node_t>::const_iterator n = list.begin(); n != list.end(); ++n) {
-        apply_data (*n, in.get_factor(), in.get_weight());
-        inc_count (*n, in.get_weight());
-      }
-    }
-  } else { // Matrix output
-    if (list.empty()) {
-      apply_data (0, 0, in.get_factor(), in.get_weight());
-      inc_count (0, 0, in.get_weight());
-      list.push_back (0);
-    } else if (list.size() == 1) {
-      apply_data (0, list.front(), in.get_factor(), in.get_weight());
-      inc_count (0, list.front(), in.get_weight());
-    } else {
-      for (size_t i = 0; i != list.size(); ++i) {
-        for (size_t j = i; j != list.size(); ++j) {
-          apply_data (list[i], list[j], in.get_factor(), in.get_weight());
-          inc_count (list[i], list[j], in.get_weight());
-        }
-      }
+  accumulate (in);
+  return true;
+}
+
+
+
+template <typename T>
+void Matrix<T>::merge (Partial&& partial)
+{
+  assert (&partial.master == this);
+  std::lock_guard<std::mutex> lock (mutex);
+  if (partial.sparse) {
+    for (const auto& i : partial.sparse_data) {
+      reduce (data[i.first], i.second.first);
+      if (counts.size())
+        counts[i.first] += i.second.second;
     }
+    decltype(partial.sparse_data)().swap (partial.sparse_data);
+    return;
   }
-  if (track_assignments) {
-    std::sort (list.begin(), list.end());
-    if (in.get_track_index() == assignments_lists.size()) {
-      assignments_lists.push_back (std::move (list));
-    } else if (in.get_track_index() < assignments_lists.size()) {
-      assignments_lists[in.get_track_index()] = std::move (list);
-    } else {
-      assignments_lists.resize (in.get_track_index() + 1, vector<node_t>());
-      assignments_lists[in.get_track_index()] = std::move (list);
-    }
+  switch (statistic) {
+    case stat_edge::SUM:
+    case stat_edge::MEAN:
+      data += partial.data;
+      break;
+    case stat_edge::MIN:
+      data = data.cwiseMin (partial.data);
+      break;
+    case stat_edge::MAX:
+      data = data.cwiseMax (partial.data);
+      break;
   }
-  return true;
+  if (counts.size())
+    counts += partial.counts;
+  partial.data.resize (0);
+  partial.counts.resize (0);
 }
 
 
@@ -192,28 +215,6 @@ void Matrix<T>::error_check (const std::set<node_t>& missing_nodes)
 
 
 
-template <typename T>
-void Matrix<T>::write_assignments (const std::string& path) const
-{
-  if (!track_assignments)
-    throw Exception ("Cannot write streamline assignments to file as they were not stored during processing");
-  File::OFStream stream (path);
-  stream << "# " << App::command_history_string << "\n";
-  for (auto i = assignments_single.begin(); i != assignments_single.end(); ++i)
-    stream << str(*i) << "\n";
-  for (auto i = assignments_pairs.begin(); i != assignments_pairs.end(); ++i)
-    stream << str(i->first) << " " << str(i->second) << "\n";
-  for (auto i = assignments_lists.begin(); i != assignments_lists.end(); ++i) {
-    assert (i->size());
-    stream << str((*i)[0]);
-    for (size_t j = 1; j != i->size(); ++j)
-      stream << " " << str((*i)[j]);
-    stream << "\n";
-  }
-}
-
-
-
 template <typename T>
 void Matrix<T>::save (const std::string& path,
                       const bool keep_unassigned,
@@ -259,22 +260,50 @@ void Matrix<T>::save (const std::string& path,
 
 
 template <typename T>
-void Matrix<T>::apply_data (const size_t index, const T value, const T weight)
+template <class Functor>
+void Matrix<T>::for_each_edge (const Mapped_track_nodepair& in, Functor&& functor) const
 {
-  T& target = data[index];
-  apply_data (target, value, weight);
+  if (is_vector()) {
+    assert (in.get_second_node() < data.size());
+    functor (in.get_second_node());
+  } else {
+    assert (in.get_first_node()  < mat2vec->mat_size());
+    assert (in.get_second_node() < mat2vec->mat_size());
+    functor ((*mat2vec) (in.get_first_node(), in.get_second_node()));
+  }
 }
 
 template <typename T>
-void Matrix<T>::apply_data (const size_t node_one, const size_t node_two, const T value, const T weight)
+template <class Functor>
+void Matrix<T>::for_each_edge (const Mapped_track_nodelist& in, Functor&& functor) const
 {
-  assert (mat2vec);
-  T& target = data[(*mat2vec) (node_one, node_two)];
-  apply_data (target, value, weight);
+  const vector<node_t>& list (in.get_nodes());
+  for (vector<node_t>::const_iterator i = list.begin(); i != list.end(); ++i) {
+    assert (*i < data.rows());
+  }
+  if (is_vector()) {
+    if (list.empty()) {
+      functor (0);
+    } else {
+      for (vector<node_t>::const_iterator n = list.begin(); n != list.end(); ++n)
+        functor (*n);
+    }
+  } else { // Matrix output
+    if (list.empty()) {
+      functor ((*mat2vec) (0, 0));
+    } else if (list.size() == 1) {
+      functor ((*mat2vec) (0, list.front()));
+    } else {
+      for (size_t i = 0; i != list.size(); ++i) {
+        for (size_t j = i; j != list.size(); ++j)
+          functor ((*mat2vec) (list[i], list[j]));
+      }
+    }
+  }
 }
 
 template <typename T>
-void Matrix<T>::apply_data (T& target, const T value, const T weight)
+void Matrix<T>::apply_data (T& target, const T value, const T weight) const
 {
   switch (statistic) {
     case stat_edge::SUM:
@@ -291,22 +320,20 @@ void Matrix<T>::apply_data (T& target, const T value, const T weight)
 }
 
 template <typename T>
-void Matrix<T>::inc_count (const size_t index, const T weight)
+void Matrix<T>::reduce (T& target, const T value) const
 {
-  if (statistic != stat_edge::MEAN)
-    return;
-  assert (counts.size());
-  counts[index] += weight;
-}
-
-template <typename T>
-void Matrix<T>::inc_count (const size_t node_one, const size_t node_two, const T weight)
-{
-  if (statistic != stat_edge::MEAN)
-    return;
-  assert (counts.size());
-  assert (mat2vec);
-  counts[(*mat2vec) (node_one, node_two)] += weight;
+  switch (statistic) {
+    case stat_edge::SUM:
+    case stat_edge::MEAN:
+      target += value;
+      return;
+    case stat_edge::MIN:
+      target = std::min (target, value);
+      break;
+    case stat_edge::MAX:
+      target = std::max (target, value);
+      break;
+  }
 }
 
 
@@ -17,7 +17,9 @@
 #ifndef __dwi_tractography_connectome_matrix_h__
 #define __dwi_tractography_connectome_matrix_h__
 
+#include <mutex>
 #include <set>
+#include <unordered_map>
 
 #include "types.h"
 
@@ -45,6 +47,10 @@ extern const App::Option EdgeStatisticOption;
 //   order for mechanisms relating to RAM usage reduction to be activated
 constexpr node_t node_count_ram_limit = 1024;
 
+// The number of nodes that must be exceeded in a connectome matrix in order
+//   for per-thread partial connectomes to be stored sparsely
+constexpr node_t node_count_sparse_limit = 10000;
+
 
 template <typename T>
 class Matrix
@@ -53,37 +59,62 @@ class Matrix
   public:
     using vector_type = Eigen::Matrix<T, Eigen::Dynamic, 1>;
 
-    Matrix (const node_t max_node_index, const stat_edge stat, const bool vector_output, const bool track_assignments) :
+
+    // Partial connectome, accumulating the contributions of those streamlines
+    //   processed by a single thread; each is reduced into the parent Matrix as
+    //   soon as it is handed over via merge(). For parcellations with a very
+    //   large number of nodes, only those edges encountered are stored, within
+    //   a hash table.
+    class Partial
+    { MEMALIGN(Partial)
+      public:
+        Partial (const Matrix& master);
+        // Explicitly select sparse storage (primarily for testing);
+        //   connectivity vectors are always stored densely
+        Partial (const Matrix& master, const bool sparse);
+
+        void operator() (const Mapped_track_nodepair&);
+        void operator() (const Mapped_track_nodelist&);
+
+      private:
+        template <class TrackType>
+        void accumulate (const TrackType&);
+
+        const Matrix& master;
+        const bool sparse;
+        vector_type data, counts;
+        std::unordered_map<uint64_t, std::pair<T, T>> sparse_data;
+
+        friend class Matrix;
+    };
+
+
+    Matrix (const node_t max_node_index, const stat_edge stat, const bool vector_output) :
         statistic (stat),
         vector_output (vector_output),
-        track_assignments (track_assignments),
         mat2vec (vector_output ?
                  nullptr :
                  new MR::Connectome::Mat2Vec (max_node_index+1)),
-        data   (vector_type::Zero (vector_output ?
-                                   (max_node_index + 1) :
-                                   mat2vec->vec_size())),
+        data   (vector_type::Constant (vector_output ?
+                                       (max_node_index + 1) :
+                                       mat2vec->vec_size(),
+                                       initial_value (stat))),
         counts (stat == stat_edge::MEAN ?
                 vector_type::Zero (vector_output ?
                                    (max_node_index + 1) :
                                    mat2vec->vec_size()) :
-                vector_type())
-    {
-      if (statistic == stat_edge::MIN)
-        data = vector_type::Constant (vector_output ? (max_node_index + 1) : mat2vec->vec_size(), std::numeric_limits<T>::infinity());
-      else if (statistic == stat_edge::MAX)
-        data = vector_type::Constant (vector_output ? (max_node_index + 1) : mat2vec->vec_size(), -std::numeric_limits<T>::infinity());
-    }
+                vector_type()) { }
 
     bool operator() (const Mapped_track_nodepair&);
     bool operator() (const Mapped_track_nodelist&);
 
+    // Thread-safe; the partial is reduced into this matrix immediately
+    void merge (Partial&&);
+
     void finalize();
 
     void error_check (const std::set<node_t>&);
 
-    void write_assignments (const std::string&) const;
-
     bool is_vector() const { return (vector_output); }
 
     void save (const std::string&, const bool, const bool, const bool) const;
@@ -92,20 +123,32 @@ class Matrix
   private:
     const stat_edge statistic;
     const bool vector_output;
-    const bool track_assignments;
 
     const std::unique_ptr<MR::Connectome::Mat2Vec> mat2vec;
 
     vector_type data, counts;
-    vector<node_t> assignments_single;
-    vector<NodePair> assignments_pairs;
-    vector< vector<node_t> > assignments_lists;
-
-    FORCE_INLINE void apply_data (const size_t, const T, const T);
-    FORCE_INLINE void apply_data (const size_t, const size_t, const T, const T);
-    FORCE_INLINE void apply_data (T&, const T, const T);
-    FORCE_INLINE void inc_count (const size_t, const T);
-    FORCE_INLINE void inc_count (const size_t, const size_t, const T);
+
+    std::mutex mutex;
+
+    static T initial_value (const stat_edge stat)
+    {
+      return (stat == stat_edge::MIN ?
+              std::numeric_limits<T>::infinity() :
+              (stat == stat_edge::MAX ? -std::numeric_limits<T>::infinity() : T(0)));
+    }
+
+    template <class TrackType>
+    void accumulate (const TrackType&);
+
+    // Invoke functor for the vector index of each element of
+    //   the connectome to which a mapped streamline contributes
+    template <class Functor>
+    FORCE_INLINE void for_each_edge (const Mapped_track_nodepair&, Functor&&) const;
+    template <class Functor>
+    FORCE_INLINE void for_each_edge (const Mapped_track_nodelist&, Functor&&) const;
+
+    FORCE_INLINE void apply_data (T&, const T, const T) const;
+    FORCE_INLINE void reduce (T&, const T) const;
 
 };
 
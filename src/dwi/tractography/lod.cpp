@@ -0,0 +1,124 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include "dwi/tractography/lod.h"
+
+#include "math/math.h"
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+      namespace LOD
+      {
+
+
+
+        void decimate (const vector<Eigen::Vector3f>& vertices, const float tolerance, vector<size_t>& retained)
+        {
+          retained.clear();
+          if (vertices.size() < 3) {
+            for (size_t i = 0; i != vertices.size(); ++i)
+              retained.push_back (i);
+            return;
+          }
+
+          // Explicit stack of segments rather than recursion, since
+          //   streamlines may contain many thousands of vertices
+          vector<bool> keep (vertices.size(), false);
+          keep.front() = keep.back() = true;
+          vector<std::pair<size_t, size_t>> segments;
+          segments.emplace_back (0, vertices.size() - 1);
+          const float tolerance_sq = Math::pow2 (tolerance);
+
+          while (segments.size()) {
+            const size_t first = segments.back().first;
+            const size_t last = segments.back().second;
+            segments.pop_back();
+            if (last - first < 2)
+              continue;
+
+            const Eigen::Vector3f& p0 (vertices[first]);
+            const Eigen::Vector3f chord (vertices[last] - p0);
+            const float chord_length_sq = chord.squaredNorm();
+
+            size_t furthest = first;
+            float max_distance_sq = 0.0f;
+            for (size_t i = first + 1; i != last; ++i) {
+              const Eigen::Vector3f offset (vertices[i] - p0);
+              float distance_sq;
+              if (chord_length_sq > 0.0f) {
+                // Distance to the chord as a line segment, not an infinite line
+                const float t = std::min (1.0f, std::max (0.0f, offset.dot (chord) / chord_length_sq));
+                distance_sq = (offset - t * chord).squaredNorm();
+              } else {
+                distance_sq = offset.squaredNorm();
+              }
+              if (distance_sq > max_distance_sq) {
+                max_distance_sq = distance_sq;
+                furthest = i;
+              }
+            }
+
+            if (max_distance_sq > tolerance_sq) {
+              keep[furthest] = true;
+              segments.emplace_back (first, furthest);
+              segments.emplace_back (furthest, last);
+            }
+          }
+
+          for (size_t i = 0; i != keep.size(); ++i) {
+            if (keep[i])
+              retained.push_back (i);
+          }
+        }
+
+
+
+        size_t subsample_level (const size_t index)
+        {
+          // SplitMix64 finaliser; the number of trailing zero bits of a
+          //   well-mixed hash is geometrically distributed with p = 0.5
+          uint64_t z = uint64_t(index) + 0x9E3779B97F4A7C15ULL;
+          z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+          z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+          z ^= (z >> 31);
+          size_t level = 0;
+          while (level < 63 && !(z & 1)) {
+            z >>= 1;
+            ++level;
+          }
+          return level;
+        }
+
+
+
+        size_t level_for_count (const size_t count, const size_t max_count)
+        {
+          size_t level = 0;
+          while (level < 63 && (count >> level) > max_count)
+            ++level;
+          return level;
+        }
+
+
+
+      }
+    }
+  }
+}
@@ -0,0 +1,86 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#ifndef __dwi_tractography_lod_h__
+#define __dwi_tractography_lod_h__
+
+#include "types.h"
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+      namespace LOD
+      {
+
+
+
+        // Functions for generating reduced level-of-detail representations of
+        //   tractograms for display: removal of vertices that do not visibly
+        //   contribute to the streamline trajectory at a given screen-space
+        //   resolution, and deterministic subsampling of streamlines.
+        // These contain no rendering code, so that they can be verified
+        //   independently of any graphical display.
+
+
+
+        // Determine which vertices of a streamline must be retained such that
+        //   no vertex deviates from the polyline through the retained vertices
+        //   by more than the specified tolerance (Ramer-Douglas-Peucker);
+        //   the first and last vertices are always retained.
+        // Indices of the retained vertices are provided in ascending order, such
+        //   that the same selection can be applied to any per-vertex data.
+        void decimate (const vector<Eigen::Vector3f>& vertices, const float tolerance, vector<size_t>& retained);
+
+
+
+        // Deterministic subsampling of streamlines: the streamline with a given
+        //   index is retained at all levels up to and including that returned by
+        //   this function. Level L retains approximately 1 in 2^L streamlines,
+        //   and any streamline retained at level L is also retained at every
+        //   lower level, so switching between levels does not reshuffle the
+        //   streamlines displayed.
+        size_t subsample_level (const size_t index);
+
+        inline bool in_subset (const size_t index, const size_t level)
+        {
+          return subsample_level (index) >= level;
+        }
+
+        // The lowest subsampling level for which the expected number of
+        //   streamlines retained out of count does not exceed max_count
+        size_t level_for_count (const size_t count, const size_t max_count);
+
+
+
+        // Distance in scanner space corresponding to a number of screen pixels,
+        //   given the field of view spanned by the height of the viewport
+        inline float screen_space_tolerance (const float fov, const int viewport_height, const float pixels)
+        {
+          return pixels * fov / float(std::max (1, viewport_height));
+        }
+
+
+
+      }
+    }
+  }
+}
+
+#endif
+
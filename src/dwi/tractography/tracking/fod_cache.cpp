@@ -0,0 +1,185 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include "dwi/tractography/tracking/fod_cache.h"
+
+#include "algo/loop.h"
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+      namespace Tracking
+      {
+
+
+
+        namespace {
+          constexpr size_t cache_line = 64;
+
+          size_t element_size_for (const FODCache::format_t format)
+          {
+            return format == FODCache::format_t::FLOAT32 ? sizeof (float) : sizeof (int16_t);
+          }
+        }
+
+
+
+        FODCache::format_t FODCache::parse_format (const std::string& name)
+        {
+          const std::string lname = lowercase (name);
+          if (lname == "float32") return format_t::FLOAT32;
+          if (lname == "float16") return format_t::FLOAT16;
+          if (lname == "int16") return format_t::INT16;
+          throw Exception ("unknown FOD cache format \"" + name + "\"");
+        }
+
+
+
+        FODCache::FODCache (Image<float>& source, const format_t format) :
+            format (format),
+            transform (source),
+            dim { source.size(0), source.size(1), source.size(2) },
+            ncoefs (source.size(3)),
+            element_size (element_size_for (format)),
+            stride (cache_line * ((ncoefs * element_size + cache_line - 1) / cache_line)),
+            num_stored (0),
+            index (dim[0] * dim[1] * dim[2], 0),
+            data (nullptr)
+        {
+          // first pass: identify voxels with any non-zero (or non-finite) coefficient
+          for (auto l = Loop (source, 0, 3) (source); l; ++l) {
+            for (auto v = Loop (source, 3) (source); v; ++v) {
+              if (source.value()) {
+                index[source.index(0) + dim[0] * (source.index(1) + dim[1] * source.index(2))] = ++num_stored;
+                break;
+              }
+            }
+          }
+          if (num_stored >= std::numeric_limits<uint32_t>::max())
+            throw Exception ("too many voxels in FOD image for tracking cache");
+
+          buffer.assign (num_stored * stride + cache_line, 0);
+          data = buffer.data() + (cache_line - (reinterpret_cast<uintptr_t> (buffer.data()) % cache_line)) % cache_line;
+          if (format == format_t::INT16)
+            scale.assign (num_stored, 0.0f);
+
+          Eigen::VectorXf voxel (ncoefs);
+          for (auto l = Loop (source, 0, 3) (source); l; ++l) {
+            const uint32_t entry = index[source.index(0) + dim[0] * (source.index(1) + dim[1] * source.index(2))];
+            if (!entry)
+              continue;
+            const size_t slot = entry - 1;
+            for (auto v = Loop (source, 3) (source); v; ++v)
+              voxel[source.index(3)] = source.value();
+            switch (format) {
+              case format_t::FLOAT32:
+                coefs<float> (slot) = voxel;
+                break;
+              case format_t::FLOAT16:
+                coefs<Eigen::half> (slot) = voxel.cast<Eigen::half>();
+                break;
+              case format_t::INT16:
+                {
+                  const float max_abs = voxel.cwiseAbs().maxCoeff();
+                  if (!std::isfinite (max_abs)) {
+                    // keep the voxel invalid, as an interpolator would
+                    scale[slot] = NaN;
+                  } else if (max_abs) {
+                    scale[slot] = max_abs / float (std::numeric_limits<int16_t>::max());
+                    coefs<int16_t> (slot) = (voxel / scale[slot]).array().round().cast<int16_t>();
+                  }
+                }
+                break;
+            }
+          }
+
+          INFO ("FOD tracking cache: " + str(num_stored) + " voxels stored, " + str(stride) + " bytes per voxel, "
+                + str(bytes() / (1024*1024)) + " MB total");
+        }
+
+
+
+        void FODCache::accumulate (const size_t slot, const float weight, Eigen::VectorXf& values) const
+        {
+          switch (format) {
+            case format_t::FLOAT32:
+              values += weight * coefs<float> (slot);
+              return;
+            case format_t::FLOAT16:
+              values += weight * coefs<Eigen::half> (slot).cast<float>();
+              return;
+            case format_t::INT16:
+              values += (weight * scale[slot]) * coefs<int16_t> (slot).cast<float>();
+              return;
+          }
+        }
+
+
+
+        bool FODCache::get (const Eigen::Vector3f& position, Eigen::VectorXf& values) const
+        {
+          const Eigen::Vector3d voxel = transform.scanner2voxel * position.cast<default_type>();
+          for (size_t axis = 0; axis != 3; ++axis) {
+            if (voxel[axis] <= -0.5 || voxel[axis] >= dim[axis] - 0.5)
+              return false;
+          }
+
+          auto offset = [&] (const ssize_t x, const ssize_t y, const ssize_t z) { return x + dim[0] * (y + dim[1] * z); };
+
+          if (!index[offset (std::round (voxel[0]), std::round (voxel[1]), std::round (voxel[2]))])
+            return false;
+
+          ssize_t c[3];
+          float w[3][2];
+          for (size_t axis = 0; axis != 3; ++axis) {
+            const default_type floor = std::floor (voxel[axis]);
+            c[axis] = floor;
+            const float f = (voxel[axis] < 0.0 || voxel[axis] > dim[axis] - 1.0) ? 0.0f : float (voxel[axis] - floor);
+            w[axis][0] = 1.0f - f;
+            w[axis][1] = f;
+          }
+
+          values.setZero (ncoefs);
+          for (ssize_t z = 0; z < 2; ++z) {
+            const ssize_t iz = std::min (std::max (c[2] + z, ssize_t(0)), dim[2]-1);
+            for (ssize_t y = 0; y < 2; ++y) {
+              const ssize_t iy = std::min (std::max (c[1] + y, ssize_t(0)), dim[1]-1);
+              const float partial_weight = w[1][y] * w[2][z];
+              for (ssize_t x = 0; x < 2; ++x) {
+                const float weight = w[0][x] * partial_weight;
+                if (weight < 1.0e-6f)
+                  continue;
+                const ssize_t ix = std::min (std::max (c[0] + x, ssize_t(0)), dim[0]-1);
+                const uint32_t entry = index[offset (ix, iy, iz)];
+                if (entry)
+                  accumulate (entry - 1, weight, values);
+              }
+            }
+          }
+
+          return !std::isnan (values[0]);
+        }
+
+
+
+      }
+    }
+  }
+}
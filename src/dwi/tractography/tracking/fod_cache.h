@@ -0,0 +1,104 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#ifndef __dwi_tractography_tracking_fod_cache_h__
+#define __dwi_tractography_tracking_fod_cache_h__
+
+#include <Eigen/Core>
+
+#include "image.h"
+#include "types.h"
+#include "transform.h"
+
+
+namespace MR
+{
+  namespace DWI
+  {
+    namespace Tractography
+    {
+      namespace Tracking
+      {
+
+
+
+        //! A compact, read-only copy of an SH image for fast interpolation during tracking
+        /*! All coefficients of each voxel are stored contiguously, with each
+         * voxel padded to a multiple of 64 bytes so that it starts on a cache
+         * line. Only voxels containing at least one non-zero coefficient are
+         * stored; a per-voxel index maps the image grid onto these slots.
+         * Coefficients can optionally be quantised to half-precision floats,
+         * or to 16-bit integers with a per-voxel scale factor, to reduce the
+         * memory bandwidth required when many threads track concurrently.
+         *
+         * Interpolation reproduces the behaviour of
+         * Interp::Masked<Interp::Linear>: positions outside the image, or
+         * whose nearest voxel contains no data, are rejected. */
+        class FODCache { MEMALIGN(FODCache)
+          public:
+            enum class format_t { FLOAT32, FLOAT16, INT16 };
+
+            FODCache (Image<float>& source, const format_t format);
+            FODCache (const FODCache&) = delete;
+
+            //! trilinearly interpolate all coefficients at scanner-space \a position
+            /*! Returns false if the position is rejected, or the interpolated
+             * values are invalid. */
+            bool get (const Eigen::Vector3f& position, Eigen::VectorXf& values) const;
+
+            size_t num_voxels () const { return num_stored; }
+            size_t num_coefs () const { return ncoefs; }
+            size_t bytes () const { return buffer.size() + index.size() * sizeof (uint32_t) + scale.size() * sizeof (float); }
+
+            static format_t parse_format (const std::string& name);
+
+          private:
+            const format_t format;
+            const Transform transform;
+            const ssize_t dim[3];
+            const size_t ncoefs, element_size, stride;
+            size_t num_stored;
+
+            // slot + 1 of each voxel, or zero if the voxel is not stored
+            vector<uint32_t> index;
+            vector<uint8_t> buffer;
+            uint8_t* data;
+            // per-voxel scale factor for INT16 storage
+            vector<float> scale;
+
+            template <typename ValueType>
+              FORCE_INLINE Eigen::Map<const Eigen::Matrix<ValueType, Eigen::Dynamic, 1>, Eigen::Aligned16> coefs (const size_t slot) const {
+                return Eigen::Map<const Eigen::Matrix<ValueType, Eigen::Dynamic, 1>, Eigen::Aligned16> (
+                    reinterpret_cast<const ValueType*> (data + slot * stride), ncoefs);
+              }
+
+            template <typename ValueType>
+              FORCE_INLINE Eigen::Map<Eigen::Matrix<ValueType, Eigen::Dynamic, 1>, Eigen::Aligned16> coefs (const size_t slot) {
+                return Eigen::Map<Eigen::Matrix<ValueType, Eigen::Dynamic, 1>, Eigen::Aligned16> (
+                    reinterpret_cast<ValueType*> (data + slot * stride), ncoefs);
+              }
+
+            void accumulate (const size_t slot, const float weight, Eigen::VectorXf& values) const;
+        };
+
+
+
+      }
+    }
+  }
+}
+
+#endif
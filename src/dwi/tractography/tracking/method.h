@@ -59,6 +59,8 @@ namespace MR
             template <class InterpolatorType>
             FORCE_INLINE bool get_data (InterpolatorType& source, const Eigen::Vector3f& position)
             {
+              if (S.fod_cache)
+                return S.fod_cache->get (position, values);
               if (!source.scanner (position))
                 return false;
               for (auto l = Loop (3) (source); l; ++l)
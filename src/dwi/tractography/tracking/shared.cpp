@@ -288,6 +288,16 @@ namespace MR
 
 
 
+        void SharedBase::init_fod_cache()
+        {
+          auto it = properties.find ("fod_cache");
+          if (it == properties.end())
+            return;
+          fod_cache.reset (new FODCache (source, FODCache::parse_format (it->second)));
+        }
+
+
+
 #ifdef DEBUG_TERMINATIONS
         void SharedBase::add_termination (const term_t i, const Eigen::Vector3f& p) const
         {
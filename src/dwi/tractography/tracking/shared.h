@@ -27,6 +27,7 @@
 #include "dwi/tractography/roi.h"
 #include "dwi/tractography/ACT/shared.h"
 #include "dwi/tractography/resampling/downsampler.h"
+#include "dwi/tractography/tracking/fod_cache.h"
 #include "dwi/tractography/tracking/types.h"
 #include "dwi/tractography/tracking/tractography.h"
 
@@ -57,6 +58,7 @@ namespace MR
 
 
             Image<float> source;
+            std::unique_ptr<FODCache> fod_cache;
             Properties& properties;
             Eigen::Vector3f init_dir;
             size_t max_num_tracks, max_num_seeds;
@@ -84,6 +86,9 @@ namespace MR
             void set_num_points (const float angle_minradius_preds, const float max_step_postds);
             void set_cutoff (float cutoff);
 
+            // Build a compact copy of the SH image for interpolation, if requested
+            void init_fod_cache();
+
             // This gets overloaded for iFOD2, as each sample is output rather than just each step, and there are
             //   multiple samples per step
             // (Only utilised for Exec::satisfy_wm_requirement())
@@ -28,6 +28,8 @@ namespace MR
 
       using namespace App;
 
+      const char* fod_cache_formats[] = { "float32", "float16", "int16", nullptr };
+
       const OptionGroup TrackOption = OptionGroup ("Streamlines tractography options")
 
       + Option ("select",
@@ -84,6 +86,14 @@ namespace MR
             "(default: " + str(Defaults::max_trials_per_step) + ").")
           + Argument ("number").type_integer (1)
 
+      + Option ("fod_cache",
+            "hold the FOD image in a compact cache restricted to voxels containing data, "
+            "with all coefficients of each voxel stored contiguously, for faster interpolation "
+            "(only valid for iFOD1 / iFOD2 / NullDist2 / SD_Stream). Options are: float32, float16, int16. "
+            "The float16 and int16 (scaled per voxel) formats reduce memory bandwidth requirements "
+            "when running many threads, at the expense of a small quantisation error.")
+          + Argument ("format").type_choice (fod_cache_formats)
+
       + Option ("noprecomputed",
             "do NOT pre-compute legendre polynomial values. Warning: "
             "this will slow down the algorithm by a factor of approximately 4.")
@@ -132,6 +142,9 @@ namespace MR
         opt = get_options ("trials");
         if (opt.size()) properties["max_trials"] = str<unsigned int> (opt[0][0]);
 
+        opt = get_options ("fod_cache");
+        if (opt.size()) properties["fod_cache"] = fod_cache_formats[int(opt[0][0])];
+
         opt = get_options ("noprecomputed");
         if (opt.size()) properties["sh_precomputed"] = "0";
 
@@ -18,6 +18,7 @@
 #include "fixel/filter/smooth.h"
 
 #include "image_helpers.h"
+#include "progressbar.h"
 #include "thread_queue.h"
 #include "transform.h"
 #include "fixel/helpers.h"
@@ -87,12 +88,11 @@ namespace MR
         stdev = fwhm / 2.3548f;
         gaussian_const1 = 1.0 / (stdev * std::sqrt (2.0 * Math::pi));
         gaussian_const2 = -1.0 / (2.0 * stdev * stdev);
+        kernel = std::make_shared<Kernel>();
       }
 
 
 
-      // TODO Provide an alternative functor for when the input & output images contain more than one column
-      //   (more efficient to construct the smoothing kernel once per fixel, then loop over image channels)
       void Smooth::operator() (Image<float>& input, Image<float>& output) const
       {
         Fixel::check_data_file (input);
@@ -182,6 +182,158 @@ namespace MR
 
 
 
+      const Smooth::Kernel& Smooth::Kernel::get (const Smooth& master)
+      {
+        std::call_once (initialised, [&] { initialise (master); });
+        return *this;
+      }
+
+
+
+      void Smooth::Kernel::initialise (const Smooth& master)
+      {
+        offsets.assign (master.matrix.size() + 1, 0);
+        in_mask.assign (master.matrix.size(), false);
+        disconnected.assign (master.matrix.size(), false);
+        using weight_list = vector<std::pair<Matrix::fixel_index_type, float>>;
+        vector<weight_list> rows (master.matrix.size());
+
+        class Worker
+        { MEMALIGN(Worker)
+          public:
+            Worker (const Smooth& master, vector<weight_list>& rows, vector<bool>& in_mask, vector<bool>& disconnected, std::mutex& mutex) :
+                master (master),
+                matrix (master.matrix),
+                mask (master.mask_image),
+                rows (rows),
+                in_mask (in_mask),
+                disconnected (disconnected),
+                mutex (mutex) { }
+
+            bool operator() (const size_t fixel)
+            {
+              mask.index(0) = fixel;
+              if (!mask.value())
+                return true;
+              const Eigen::Vector3f& pos (master.fixel_positions[fixel]);
+              const auto connectivity = matrix[fixel];
+              weight_list& row (rows[fixel]);
+              for (const auto& c : connectivity) {
+                mask.index(0) = c.index();
+                if (mask.value()) {
+                  const float weight = c.value() * master.gaussian_const1 * std::exp (master.gaussian_const2 * (master.fixel_positions[c.index()] - pos).squaredNorm());
+                  if (weight >= master.threshold)
+                    row.emplace_back (c.index(), weight);
+                }
+              }
+              // vector<bool> packs bits, so concurrent writes must be serialised
+              std::lock_guard<std::mutex> lock (mutex);
+              in_mask[fixel] = true;
+              disconnected[fixel] = connectivity.empty();
+              return true;
+            }
+
+          private:
+            const Smooth& master;
+            Matrix::Reader matrix;
+            Image<bool> mask;
+            vector<weight_list>& rows;
+            vector<bool>& in_mask;
+            vector<bool>& disconnected;
+            std::mutex& mutex;
+        };
+
+        {
+          ProgressBar progress ("Computing fixel smoothing kernel");
+          size_t counter = 0;
+          std::mutex mutex;
+          Thread::run_queue ([&] (size_t& fixel) { return (fixel = counter++) < master.matrix.size(); },
+                             Thread::batch (size_t()),
+                             Thread::multi (Worker (master, rows, in_mask, disconnected, mutex)));
+        }
+
+        for (size_t fixel = 0; fixel != rows.size(); ++fixel)
+          offsets[fixel+1] = offsets[fixel] + rows[fixel].size();
+        indices.reserve (offsets.back());
+        weights.reserve (offsets.back());
+        for (auto& row : rows) {
+          for (const auto& w : row) {
+            indices.push_back (w.first);
+            weights.push_back (w.second);
+          }
+          weight_list().swap (row);
+        }
+        INFO ("Fixel smoothing kernel: " + str(weights.size()) + " non-zero weights across " + str(rows.size()) + " fixels");
+      }
+
+
+
+      void Smooth::operator() (const data_matrix_type& input, data_matrix_type& output) const
+      {
+        if (size_t (input.rows()) != matrix.size())
+          throw Exception ("Number of rows in fixel data matrix (" + str(input.rows()) +
+                           ") does not match fixel connectivity matrix (" + str(matrix.size()) + ")");
+
+        const Kernel& K (kernel->get (*this));
+        output.resize (input.rows(), input.cols());
+
+        // Each worker accumulates an entire row of the output (all inputs for
+        //   one fixel), reading the contiguous rows of the input for each of
+        //   that fixel's neighbours
+        class Worker
+        { MEMALIGN(Worker)
+          public:
+            Worker (const Kernel& kernel, const data_matrix_type& input, data_matrix_type& output) :
+                kernel (kernel),
+                input (input),
+                output (output),
+                sum_weights (input.cols()) { }
+
+            bool operator() (const size_t fixel)
+            {
+              auto out = output.row (fixel);
+              if (!kernel.in_mask[fixel]) {
+                out.fill (std::numeric_limits<float>::quiet_NaN());
+                return true;
+              }
+              out.setZero();
+              sum_weights.setZero();
+              for (uint64_t i = kernel.offsets[fixel]; i != kernel.offsets[fixel+1]; ++i) {
+                const float weight = kernel.weights[i];
+                const auto in = input.row (kernel.indices[i]);
+                for (ssize_t col = 0; col != in.size(); ++col) {
+                  if (std::isfinite (in[col])) {
+                    out[col] += weight * in[col];
+                    sum_weights[col] += weight;
+                  }
+                }
+              }
+              for (ssize_t col = 0; col != out.size(); ++col) {
+                if (sum_weights[col])
+                  out[col] /= sum_weights[col];
+                else if (kernel.disconnected[fixel])
+                  out[col] = input (fixel, col);
+                else
+                  out[col] = std::numeric_limits<float>::quiet_NaN();
+              }
+              return true;
+            }
+
+          private:
+            const Kernel& kernel;
+            const data_matrix_type& input;
+            data_matrix_type& output;
+            Eigen::Matrix<default_type, Eigen::Dynamic, 1> sum_weights;
+        };
+
+        size_t counter = 0;
+        Thread::run_queue ([&] (size_t& fixel) { return (fixel = counter++) < matrix.size(); },
+                           Thread::batch (size_t()),
+                           Thread::multi (Worker (K, input, output)));
+      }
+
+
+
     }
   }
 }
@@ -18,6 +18,8 @@
 #ifndef __fixel_filter_smooth_h__
 #define __fixel_filter_smooth_h__
 
+#include <mutex>
+
 #include "fixel/matrix.h"
 #include "fixel/filter/base.h"
 
@@ -48,12 +50,21 @@ namespace MR
        * smooth_filter (fixel_data_in, fixel_data_out);
        *
        * \endcode
+       *
+       * Many fixel data vectors (e.g. one per subject) can instead be smoothed
+       * together, with each column of a (fixels x inputs) matrix corresponding
+       * to one input. In this case the smoothing kernel (connectivity values
+       * multiplied by Gaussian spatial weights, with the mask and weight
+       * threshold applied) is computed once and held in memory, and applied
+       * to all columns in a single multi-threaded pass over the fixels.
        */
 
       class Smooth : public Base
       { MEMALIGN (Smooth)
 
         public:
+          using data_matrix_type = Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>;
+
           Smooth (Image<index_type> index_image,
                   const Matrix::Reader& matrix,
                   const Image<bool>& mask_image,
@@ -72,12 +83,30 @@ namespace MR
           void set_fwhm (const float fwhm);
 
           void operator() (Image<float>& input, Image<float>& output) const override;
+          void operator() (const data_matrix_type& input, data_matrix_type& output) const;
 
         protected:
+          // Smoothing weights of all fixels in compressed sparse row form;
+          //   fixels outside of the mask have no weights, and are flagged separately.
+          //   These are computed on first use only, by whichever thread gets there first.
+          class Kernel
+          { NOMEMALIGN
+            public:
+              const Kernel& get (const Smooth& master);
+              vector<uint64_t> offsets;
+              vector<Matrix::fixel_index_type> indices;
+              vector<float> weights;
+              vector<bool> in_mask, disconnected;
+            private:
+              std::once_flag initialised;
+              void initialise (const Smooth& master);
+          };
+
           Image<bool> mask_image;
           Matrix::Reader matrix;
           vector<Eigen::Vector3f> fixel_positions;
           float stdev, gaussian_const1, gaussian_const2, threshold;
+          std::shared_ptr<Kernel> kernel;
 
       };
     //! @}
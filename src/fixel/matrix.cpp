@@ -17,7 +17,12 @@
 
 #include "fixel/matrix.h"
 
+#include <atomic>
+#include <fstream>
+
 #include "app.h"
+#include "progressbar.h"
+#include "thread.h"
 #include "thread_queue.h"
 #include "types.h"
 #include "file/ofstream.h"
@@ -41,10 +46,16 @@ namespace MR
 
       void InitFixel::add (const vector<index_type>& indices)
       {
+        add (indices.data(), indices.data() + indices.size());
+      }
+
+      void InitFixel::add (const index_type* const indices_begin, const index_type* const indices_end)
+      {
+        const index_type* const indices = indices_begin;
         if ((*this).empty()) {
-          (*this).reserve (indices.size());
-          for (auto i : indices)
-            (*this).emplace_back (InitElement (i));
+          (*this).reserve (indices_end - indices_begin);
+          for (auto i = indices_begin; i != indices_end; ++i)
+            (*this).emplace_back (InitElement (*i));
           track_count = 1;
           return;
         }
@@ -62,7 +73,7 @@ namespace MR
         // - On second pass, from back to front, move elements from previous back of vector to new back,
         //   inserting new elements at appropriate locations to retain sortedness of list
         const ssize_t old_size = (*this).size();
-        const ssize_t in_count = indices.size();
+        const ssize_t in_count = indices_end - indices_begin;
         size_t intersection = 0;
         while (self_index < old_size && in_index < in_count) {
           if ((*this)[self_index].index() == indices[in_index]) {
@@ -78,14 +89,14 @@ namespace MR
         }
 
         self_index = old_size - 1;
-        in_index = indices.size() - 1;
+        in_index = in_count - 1;
 
         // It's possible that a resize() call may always result in requesting
         //   a re-assignment of memory that exactly matches the size, which may in turn
         //   lead to memory bloat due to inability to return the old memory
         // If this occurs, iteratively calling push_back() may instead engage the
         //   memory-reservation-doubling behaviour
-        while ((*this).size() < old_size + indices.size() - intersection)
+        while (ssize_t((*this).size()) < old_size + in_count - ssize_t(intersection))
           (*this).push_back (InitElement());
         ssize_t out_index = (*this).size() - 1;
 
@@ -123,13 +134,11 @@ namespace MR
 
 
 
-      init_matrix_type generate (
-          const std::string& track_filename,
-          Image<index_type>& index_image,
-          Image<bool>& fixel_mask,
-          const float angular_threshold)
-      {
+      namespace {
 
+
+
+        // Maps each streamline to the list of fixels it traverses
         class TrackProcessor { MEMALIGN(TrackProcessor)
 
           public:
@@ -198,6 +207,138 @@ namespace MR
         };
 
 
+
+
+        // Fixel visitations of many streamlines, stored contiguously
+        class VisitationBlock
+        { NOMEMALIGN
+          public:
+            VisitationBlock() :
+                offsets (1, 0) { }
+
+            void add (const vector<index_type>& fixels)
+            {
+              indices.insert (indices.end(), fixels.begin(), fixels.end());
+              offsets.push_back (indices.size());
+            }
+
+            size_t size() const { return offsets.size() - 1; }
+            size_t num_visitations() const { return indices.size(); }
+
+            const index_type* begin (const size_t streamline) const { return indices.data() + offsets[streamline]; }
+            const index_type* end   (const size_t streamline) const { return indices.data() + offsets[streamline+1]; }
+
+            void clear()
+            {
+              indices.clear();
+              offsets.resize (1);
+            }
+
+            vector<index_type> indices;
+            vector<size_t> offsets;
+        };
+
+
+
+        // Add a block of streamline visitations to those rows of the
+        //   connectivity matrix corresponding to fixels [first_fixel, first_fixel + matrix.size()).
+        //   The rows are partitioned into shards, each of which is only ever
+        //   updated by one thread, and so no locking is required.
+        void accumulate (const VisitationBlock& block, init_matrix_type& matrix, const index_type first_fixel)
+        {
+          constexpr size_t shards_per_thread = 16;
+
+          class Worker
+          { MEMALIGN(Worker)
+            public:
+              Worker (const VisitationBlock& block, init_matrix_type& matrix, const index_type first_fixel,
+                      const size_t num_shards, std::atomic<size_t>& next_shard) :
+                  block (block),
+                  matrix (matrix),
+                  first_fixel (first_fixel),
+                  num_shards (num_shards),
+                  next_shard (next_shard) { }
+
+              void execute()
+              {
+                size_t shard;
+                while ((shard = next_shard++) < num_shards) {
+                  const index_type shard_begin = first_fixel + (shard * matrix.size()) / num_shards;
+                  const index_type shard_end = first_fixel + ((shard+1) * matrix.size()) / num_shards;
+                  // Fixel lists are sorted, so the fixels belonging to this shard are contiguous
+                  for (size_t streamline = 0; streamline != block.size(); ++streamline) {
+                    const index_type* const begin = block.begin (streamline);
+                    const index_type* const end = block.end (streamline);
+                    for (auto f = std::lower_bound (begin, end, shard_begin); f != end && *f < shard_end; ++f)
+                      matrix[*f - first_fixel].add (begin, end);
+                  }
+                }
+              }
+
+            private:
+              const VisitationBlock& block;
+              init_matrix_type& matrix;
+              const index_type first_fixel;
+              const size_t num_shards;
+              std::atomic<size_t>& next_shard;
+          };
+
+          if (!block.size())
+            return;
+          const size_t num_threads = std::max (size_t(1), Thread::threads_to_execute());
+          const size_t num_shards = std::min (matrix.size(), num_threads * shards_per_thread);
+          std::atomic<size_t> next_shard (0);
+          try {
+            Thread::run (Thread::multi (Worker (block, matrix, first_fixel, num_shards, next_shard), num_threads), "fixel-fixel connectivity accumulation");
+          } catch (std::bad_alloc&) {
+            throw Exception ("Error assigning memory for CFE connectivity matrix");
+          }
+        }
+
+
+
+        // Number of streamlines to map to fixels before adding their
+        //   contributions to the connectivity matrix
+        constexpr size_t streamlines_per_block = 100000;
+
+
+
+        // Writes the normalised connectivity matrix one fixel at a time
+        class Writer
+        { NOMEMALIGN
+          public:
+            Writer (const size_t num_fixels,
+                    const std::string& path,
+                    const KeyValues& keyvals);
+
+            void operator() (const size_t fixel_index, const InitFixel& row, const connectivity_value_type threshold);
+
+            void finalise();
+
+          private:
+            const std::string leadin;
+            const size_t dim_padding;
+            Image<index_image_type> index_image;
+            File::OFStream fixel_stream, value_stream;
+            size_t data_count;
+            vector<index_type> fixel_buffer;
+            vector<connectivity_value_type> value_buffer;
+        };
+
+
+
+      }
+
+
+
+
+
+      init_matrix_type generate (
+          const std::string& track_filename,
+          Image<index_type>& index_image,
+          Image<bool>& fixel_mask,
+          const float angular_threshold)
+      {
         auto directions_image = Fixel::find_directions_header (Path::dirname (index_image.name())).template get_image<default_type>().with_direct_io ({+2,+1});
         DWI::Tractography::Properties properties;
         DWI::Tractography::Reader<float> track_file (track_filename, properties);
@@ -208,23 +349,30 @@ namespace MR
         mapper.set_use_precise_mapping (true);
         TrackProcessor track_processor (mapper, index_image, directions_image, fixel_mask, angular_threshold);
         init_matrix_type connectivity_matrix (Fixel::get_number_of_fixels (index_image));
-        Thread::run_queue (loader,
-                           Thread::batch (DWI::Tractography::Streamline<float>()),
-                           track_processor,
-                           Thread::batch (vector<index_type>()),
-                           // Inline lambda function for receiving streamline fixel visitations and
-                           //   updating the connectivity matrix
-                           [&] (const vector<index_type>& fixels)
-                           {
-                             try {
-                               for (auto f : fixels)
-                                 connectivity_matrix[f].add (fixels);
+
+        // Alternate between mapping a block of streamlines to fixels, and
+        //   adding the resulting fixel lists to the matrix, both multi-threaded
+        VisitationBlock block;
+        bool tracks_remaining = true;
+        while (tracks_remaining) {
+          size_t count = 0;
+          Thread::run_queue ([&] (DWI::Tractography::Streamline<float>& tck)
+                             {
+                               if (count++ == streamlines_per_block)
+                                 return false;
+                               return (tracks_remaining = loader (tck));
+                             },
+                             Thread::batch (DWI::Tractography::Streamline<float>()),
+                             Thread::multi (track_processor),
+                             Thread::batch (vector<index_type>()),
+                             [&] (const vector<index_type>& fixels)
+                             {
+                               block.add (fixels);
                                return true;
-                             } catch (...) {
-                               throw Exception ("Error assigning memory for CFE connectivity matrix");
-                               return false;
-                             }
-                           });
+                             });
+          accumulate (block, connectivity_matrix, 0);
+          block.clear();
+        }
         return connectivity_matrix;
       }
 
@@ -232,12 +380,109 @@ namespace MR
 
 
 
-      void normalise_and_write (init_matrix_type& matrix,
-                                const connectivity_value_type threshold,
-                                const std::string& path,
-                                const KeyValues& keyvals)
+      void generate_and_write (
+          const std::string& track_filename,
+          Image<index_type>& index_image,
+          Image<bool>& fixel_mask,
+          const float angular_threshold,
+          const connectivity_value_type threshold,
+          const std::string& path,
+          const size_t num_passes,
+          const KeyValues& keyvals)
       {
+        if (num_passes <= 1) {
+          auto matrix = generate (track_filename, index_image, fixel_mask, angular_threshold);
+          normalise_and_write (matrix, threshold, path, keyvals);
+          return;
+        }
 
+        const size_t num_fixels = Fixel::get_number_of_fixels (index_image);
+        const std::string temp_path = File::create_tempfile (0, "fixels");
+        try {
+
+          // Map all streamlines to fixels, storing the fixel lists on disk
+          {
+            auto directions_image = Fixel::find_directions_header (Path::dirname (index_image.name())).template get_image<default_type>().with_direct_io ({+2,+1});
+            DWI::Tractography::Properties properties;
+            DWI::Tractography::Reader<float> track_file (track_filename, properties);
+            const uint32_t num_tracks = properties["count"].empty() ? 0 : to<uint32_t>(properties["count"]);
+            DWI::Tractography::Mapping::TrackLoader loader (track_file, num_tracks, "mapping streamlines to fixels");
+            DWI::Tractography::Mapping::TrackMapperBase mapper (index_image);
+            mapper.set_upsample_ratio (DWI::Tractography::Mapping::determine_upsample_ratio (index_image, properties, 0.333f));
+            mapper.set_use_precise_mapping (true);
+            TrackProcessor track_processor (mapper, index_image, directions_image, fixel_mask, angular_threshold);
+            File::OFStream temp_stream (temp_path, std::ios_base::out | std::ios_base::binary);
+            Thread::run_queue (loader,
+                               Thread::batch (DWI::Tractography::Streamline<float>()),
+                               Thread::multi (track_processor),
+                               Thread::batch (vector<index_type>()),
+                               [&] (const vector<index_type>& fixels)
+                               {
+                                 if (fixels.size()) {
+                                   const uint32_t count = fixels.size();
+                                   temp_stream.write (reinterpret_cast<const char*> (&count), sizeof (uint32_t));
+                                   temp_stream.write (reinterpret_cast<const char*> (fixels.data()), count * sizeof (index_type));
+                                 }
+                                 return true;
+                               });
+          }
+
+          // Construct, normalise & write the matrix for one subset of fixels at a time
+          Writer writer (num_fixels, path, keyvals);
+          VisitationBlock block;
+          vector<index_type> fixels;
+          for (size_t pass = 0; pass != num_passes; ++pass) {
+            const index_type first_fixel = (pass * num_fixels) / num_passes;
+            const index_type last_fixel = ((pass+1) * num_fixels) / num_passes;
+            init_matrix_type matrix (last_fixel - first_fixel);
+            {
+              ProgressBar progress ("computing fixel-fixel connectivity matrix (pass " + str(pass+1) + " of " + str(num_passes) + ")");
+              std::ifstream temp_stream (temp_path, std::ios_base::in | std::ios_base::binary);
+              uint32_t count;
+              while (temp_stream.read (reinterpret_cast<char*> (&count), sizeof (uint32_t))) {
+                fixels.resize (count);
+                if (!temp_stream.read (reinterpret_cast<char*> (fixels.data()), count * sizeof (index_type)))
+                  throw Exception ("Error reading streamline fixel visitations from temporary file \"" + temp_path + "\"");
+                // Only retain those streamlines that traverse at least one fixel in this pass
+                if (std::lower_bound (fixels.begin(), fixels.end(), first_fixel) != std::lower_bound (fixels.begin(), fixels.end(), last_fixel))
+                  block.add (fixels);
+                if (block.size() == streamlines_per_block) {
+                  accumulate (block, matrix, first_fixel);
+                  block.clear();
+                  ++progress;
+                }
+              }
+              accumulate (block, matrix, first_fixel);
+              block.clear();
+            }
+            for (index_type fixel = first_fixel; fixel != last_fixel; ++fixel) {
+              writer (fixel, matrix[fixel - first_fixel], threshold);
+              // Force deallocation of memory used for this fixel in the generated matrix
+              InitFixel().swap (matrix[fixel - first_fixel]);
+            }
+          }
+          writer.finalise();
+
+        } catch (...) {
+          File::remove (temp_path);
+          throw;
+        }
+        File::remove (temp_path);
+      }
+
+
+
+
+
+      Writer::Writer (const size_t num_fixels,
+                      const std::string& path,
+                      const KeyValues& keyvals) :
+          leadin ("mrtrix image\ndim: "),
+          // Need enough space for the largest possible 64-bit unsigned integer,
+          //   plus ",1,1" for the two dummy axes
+          dim_padding (std::log10 (std::numeric_limits<size_t>::max()) + 4),
+          data_count (0)
+      {
         if (Path::exists (path)) {
           if (!Path::is_dir (path)) {
             if (App::overwrite_files) {
@@ -252,7 +497,7 @@ namespace MR
 
         Header index_header;
         index_header.ndim() = 4;
-        index_header.size(0) = matrix.size();
+        index_header.size(0) = num_fixels;
         index_header.size(1) = 1;
         index_header.size(2) = 1;
         index_header.size(3) = 2;
@@ -263,20 +508,15 @@ namespace MR
         index_header.spacing(0) = index_header.spacing(1) = index_header.spacing(2) = 1.0;
         index_header.transform() = transform_type::Identity();
         index_header.keyval() = keyvals;
-        index_header.keyval()["nfixels"] = str(matrix.size());
+        index_header.keyval()["nfixels"] = str(num_fixels);
         index_header.datatype() = DataType::from<index_image_type>();
-        Image<index_image_type> index_image = Image<index_image_type>::create (Path::join (path, "index.mif"), index_header);
+        index_image = Image<index_image_type>::create (Path::join (path, "index.mif"), index_header);
 
         // Can't use function write_mrtrix_header() as the file offset of the
         //   first entry of the "dim" field needs to be known
         //   (and enough space needs to be left to fill in a large number upon completion)
-        File::OFStream fixel_stream (Path::join (path, "fixels.mif"), std::ios_base::out | std::ios_base::binary);
-        File::OFStream value_stream (Path::join (path, "values.mif"), std::ios_base::out | std::ios_base::binary);
-
-        const std::string leadin = "mrtrix image\ndim: ";
-        // Need enough space for the largest possible 64-bit unsigned integer,
-        //   plus ",1,1" for the two dummy axes
-        const size_t dim_padding = std::log10 (std::numeric_limits<size_t>::max()) + 4;
+        fixel_stream.open (Path::join (path, "fixels.mif"), std::ios_base::out | std::ios_base::binary);
+        value_stream.open (Path::join (path, "values.mif"), std::ios_base::out | std::ios_base::binary);
 
         Eigen::IOFormat fmt(Eigen::FullPrecision, Eigen::DontAlignCols, ", ", "\ntransform: ", "", "", "\ntransform: ", "");
 
@@ -292,7 +532,7 @@ namespace MR
             stream << DataType::from<index_type>().specifier();
           stream << transform_type::Identity().matrix().topLeftCorner(3,4).format(fmt) << "\n";
           stream << "scaling: 0,1\n";
-          stream << "nfixels: " + str(matrix.size()) + "\n";
+          stream << "nfixels: " + str(num_fixels) + "\n";
           File::KeyValue::write (stream, keyvals, "", true);
           stream << "file: ";
           uint64_t offset = uint64_t(stream.tellp()) + 18;
@@ -300,42 +540,40 @@ namespace MR
           stream << ". " << offset << "\nEND\n";
           stream << std::string (offset - uint64_t(stream.tellp()), '\0');
         }
+      }
 
-        ProgressBar progress ("Normalising and writing fixel-fixel connectivity matrix to directory \"" + path + "\"", matrix.size());
-        size_t data_count = 0;
-        vector<index_type> fixel_buffer;
-        vector<connectivity_value_type> value_buffer;
-        for (size_t fixel_index = 0; fixel_index != matrix.size(); ++fixel_index) {
 
-          fixel_buffer.clear();
-          value_buffer.clear();
-          fixel_buffer.reserve (matrix[fixel_index].size());
-          value_buffer.reserve (matrix[fixel_index].size());
-
-          const connectivity_value_type normalisation_factor = connectivity_value_type(1) / connectivity_value_type (matrix[fixel_index].count());
-          for (auto& it : matrix[fixel_index]) {
-            const connectivity_value_type connectivity = normalisation_factor * it.value();
-            if (connectivity >= threshold) {
-              fixel_buffer.push_back (it.index());
-              value_buffer.push_back (connectivity);
-            }
+
+      void Writer::operator() (const size_t fixel_index, const InitFixel& row, const connectivity_value_type threshold)
+      {
+        fixel_buffer.clear();
+        value_buffer.clear();
+        fixel_buffer.reserve (row.size());
+        value_buffer.reserve (row.size());
+
+        const connectivity_value_type normalisation_factor = connectivity_value_type(1) / connectivity_value_type (row.count());
+        for (auto& it : row) {
+          const connectivity_value_type connectivity = normalisation_factor * it.value();
+          if (connectivity >= threshold) {
+            fixel_buffer.push_back (it.index());
+            value_buffer.push_back (connectivity);
           }
+        }
 
-          index_image.index (0) = fixel_index;
-          index_image.index (3) = 0; index_image.value() = uint64_t(fixel_buffer.size());
-          index_image.index (3) = 1; index_image.value() = fixel_buffer.size() ? data_count : uint64_t(0);
+        index_image.index (0) = fixel_index;
+        index_image.index (3) = 0; index_image.value() = uint64_t(fixel_buffer.size());
+        index_image.index (3) = 1; index_image.value() = fixel_buffer.size() ? data_count : uint64_t(0);
 
-          fixel_stream.write (reinterpret_cast<const char*>(fixel_buffer.data()), fixel_buffer.size() * sizeof (index_type));
-          value_stream.write (reinterpret_cast<const char*>(value_buffer.data()), value_buffer.size() * sizeof (connectivity_value_type));
+        fixel_stream.write (reinterpret_cast<const char*>(fixel_buffer.data()), fixel_buffer.size() * sizeof (index_type));
+        value_stream.write (reinterpret_cast<const char*>(value_buffer.data()), value_buffer.size() * sizeof (connectivity_value_type));
 
-          data_count += fixel_buffer.size();
+        data_count += fixel_buffer.size();
+      }
 
-          // Force deallocation of memory used for this fixel in the generated matrix
-          InitFixel().swap (matrix[fixel_index]);
 
-          ++progress;
-        }
 
+      void Writer::finalise()
+      {
         // Update headers to reflect the number of fixel-fixel connections
         std::string dim_string = str(data_count) + ",1,1";
         dim_string += std::string (dim_padding - dim_string.size(), ' ');
@@ -344,7 +582,26 @@ namespace MR
           stream.seekp (leadin.size());
           stream << dim_string;
         }
+      }
+
+
+
 
+
+      void normalise_and_write (init_matrix_type& matrix,
+                                const connectivity_value_type threshold,
+                                const std::string& path,
+                                const KeyValues& keyvals)
+      {
+        Writer writer (matrix.size(), path, keyvals);
+        ProgressBar progress ("Normalising and writing fixel-fixel connectivity matrix to directory \"" + path + "\"", matrix.size());
+        for (size_t fixel_index = 0; fixel_index != matrix.size(); ++fixel_index) {
+          writer (fixel_index, matrix[fixel_index], threshold);
+          // Force deallocation of memory used for this fixel in the generated matrix
+          InitFixel().swap (matrix[fixel_index]);
+          ++progress;
+        }
+        writer.finalise();
       }
 
 
@@ -452,6 +709,86 @@ namespace MR
 
 
 
+
+      bool CSR::select_quantisation (const Reader& reader, const bool quantise)
+      {
+        // Projection based on all connections stored, i.e. prior to masking
+        const size_t fixed_bytes = (reader.size() + 1) * sizeof (uint64_t) + reader.size() * sizeof (connectivity_value_type);
+        const size_t full_bytes = fixed_bytes + reader.num_connections() * (sizeof (fixel_index_type) + sizeof (connectivity_value_type));
+        const size_t quantised_bytes = fixed_bytes + reader.num_connections() * (sizeof (fixel_index_type) + sizeof (uint16_t));
+        if (!quantise && !Memory::fits (full_bytes)) {
+          Memory::check (quantised_bytes, "quantised fixel-fixel connectivity matrix");
+          WARN ("Fixel-fixel connectivity matrix at full precision (" + Memory::format_size (full_bytes) + ") exceeds memory limit; "
+                "connectivity values will be quantised to 16 bits");
+          return true;
+        }
+        Memory::check (quantise ? quantised_bytes : full_bytes, "fixel-fixel connectivity matrix");
+        INFO ("Projected memory use of fixel-fixel connectivity matrix: " + Memory::format_size (quantise ? quantised_bytes : full_bytes));
+        return quantise;
+      }
+
+
+
+      CSR::CSR (const Reader& reader, const connectivity_value_type C, const bool quantise) :
+          quantised (select_quantisation (reader, quantise)),
+          offsets (reader.size() + 1, 0),
+          norm_multipliers (reader.size(), connectivity_value_type (1))
+      {
+        indices.reserve (reader.num_connections());
+        if (quantised)
+          quantised_values.reserve (reader.num_connections());
+        else
+          values.reserve (reader.num_connections());
+
+        ProgressBar progress ("loading fixel-fixel connectivity matrix into memory", reader.size());
+        for (size_t fixel = 0; fixel != reader.size(); ++fixel) {
+          auto connections = reader[fixel];
+          // Need to re-normalise based on the value of the power C
+          if (C != connectivity_value_type (1)) {
+            default_type sum = 0.0;
+            for (auto& c : connections) {
+              c.exponentiate (C);
+              sum += c.value();
+            }
+            connections.normalise (connectivity_value_type (sum));
+          }
+          norm_multipliers[fixel] = connections.norm_multiplier;
+          for (const auto& c : connections) {
+            indices.push_back (c.index());
+            if (quantised)
+              quantised_values.push_back (uint16_t (std::round (std::min (std::max (c.value(), connectivity_value_type (0)), connectivity_value_type (1))
+                                                                * connectivity_value_type (std::numeric_limits<uint16_t>::max()))));
+            else
+              values.push_back (c.value());
+          }
+          offsets[fixel+1] = indices.size();
+          ++progress;
+        }
+
+        // Memory reserved for connections outside of the fixel mask
+        if (indices.size() != reader.num_connections()) {
+          indices.shrink_to_fit();
+          values.shrink_to_fit();
+          quantised_values.shrink_to_fit();
+        }
+        allocation = Memory::Allocation (offsets.size() * sizeof (uint64_t)
+                                         + indices.size() * sizeof (fixel_index_type)
+                                         + values.size() * sizeof (connectivity_value_type)
+                                         + quantised_values.size() * sizeof (uint16_t)
+                                         + norm_multipliers.size() * sizeof (connectivity_value_type),
+                                         "fixel-fixel connectivity matrix");
+        INFO ("Fixel-fixel connectivity matrix loaded into memory: "
+              + str(indices.size()) + " connections, "
+              + str(allocation.size() / (1024*1024)) + "MB");
+      }
+
+
+
+
+
+
+
+
     }
   }
 }
@@ -20,6 +20,7 @@
 
 #include "image.h"
 #include "types.h"
+#include "memory_usage.h"
 #include "file/ofstream.h"
 #include "fixel/index_remapper.h"
 
@@ -76,6 +77,7 @@ namespace MR
           InitFixel() :
               track_count (0) { }
           void add (const vector<fixel_index_type>& indices);
+          void add (const fixel_index_type* const indices_begin, const fixel_index_type* const indices_end);
           count_type count() const { return track_count; }
         private:
           count_type track_count;
@@ -149,6 +151,9 @@ namespace MR
 
 
       // Generate a fixel-fixel connectivity matrix
+      // Streamlines are mapped to fixels in blocks; the fixel lists of each
+      //   block are then added to the matrix by multiple threads, each of
+      //   which is responsible for a distinct subset of fixels
       init_matrix_type generate (
           const std::string& track_filename,
           Image<fixel_index_type>& index_image,
@@ -189,6 +194,24 @@ namespace MR
 
 
 
+      // Generate, normalise and write a fixel-fixel connectivity matrix
+      // If num_passes is greater than one, the fixels traversed by each
+      //   streamline are first written to a temporary file; the matrix is
+      //   then generated, normalised and written for a subset of the fixels
+      //   at a time, with each pass re-reading the temporary file. This
+      //   reduces peak memory usage by approximately a factor of num_passes.
+      void generate_and_write (
+          const std::string& track_filename,
+          Image<fixel_index_type>& index_image,
+          Image<bool>& fixel_mask,
+          const float angular_threshold,
+          const connectivity_value_type threshold,
+          const std::string& path,
+          const size_t num_passes = 1,
+          const KeyValues& keyvals = KeyValues());
+
+
+
       // Wrapper class for reading the connectivity matrix from the filesystem
       class Reader
       { MEMALIGN(Reader)
@@ -218,6 +241,9 @@ namespace MR
           size_t size() const { return index_image.size (0); }
           size_t size (const size_t) const;
 
+          // Total number of fixel-fixel connections stored, prior to masking
+          size_t num_connections() const { return fixel_image.size (0); }
+
         protected:
           const std::string directory;
           // Not to be manipulated directly; need to copy in order to ensure thread-safety
@@ -231,6 +257,63 @@ namespace MR
 
 
 
+
+      // Fixel-fixel connectivity matrix loaded into memory in compressed sparse
+      //   row (CSR) form, for repeated traversal (e.g. across permutations).
+      //   The fixel mask, the connectivity exponent C and the per-fixel
+      //   normalisation are all applied once at load time. Connectivity values
+      //   can optionally be quantised to 16 bits, which halves the memory
+      //   required for their storage at the expense of a maximal error of
+      //   1/131070 in each (normalised) value; this is done automatically if
+      //   the full-precision matrix would exceed the memory budget.
+      class CSR
+      { MEMALIGN(CSR)
+
+        public:
+          CSR (const Reader& reader,
+               const connectivity_value_type C = connectivity_value_type (1),
+               const bool quantise = false);
+
+          size_t size() const { return norm_multipliers.size(); }
+          size_t size (const size_t fixel) const { return offsets[fixel+1] - offsets[fixel]; }
+          size_t num_connections() const { return indices.size(); }
+          bool is_quantised() const { return quantised; }
+
+          // Multiplicative factor to be applied to the sum of connectivity
+          //   values of a fixel in order for them to sum to unity
+          connectivity_value_type norm_multiplier (const size_t fixel) const { return norm_multipliers[fixel]; }
+
+          // Invoke functor (fixel_index_type, connectivity_value_type) for
+          //   each connection of a fixel
+          template <class Functor>
+          FORCE_INLINE void visit (const size_t fixel, Functor&& functor) const
+          {
+            const uint64_t end = offsets[fixel+1];
+            if (quantised) {
+              for (uint64_t i = offsets[fixel]; i != end; ++i)
+                functor (indices[i], connectivity_value_type (quantised_values[i]) * dequantise_multiplier);
+            } else {
+              for (uint64_t i = offsets[fixel]; i != end; ++i)
+                functor (indices[i], values[i]);
+            }
+          }
+
+        private:
+          const bool quantised;
+          vector<uint64_t> offsets;
+          vector<fixel_index_type> indices;
+          vector<connectivity_value_type> values;
+          vector<uint16_t> quantised_values;
+          vector<connectivity_value_type> norm_multipliers;
+          Memory::Allocation allocation;
+
+          static bool select_quantisation (const Reader& reader, const bool quantise);
+
+          static constexpr connectivity_value_type dequantise_multiplier = connectivity_value_type (1) / connectivity_value_type (std::numeric_limits<uint16_t>::max());
+      };
+
+
+
     }
   }
 }
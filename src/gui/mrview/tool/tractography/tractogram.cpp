@@ -14,11 +14,17 @@
  * For more details, see http://www.mrtrix.org/.
  */
 
+#include <atomic>
+#include <deque>
+#include <future>
+#include <mutex>
+
 #include "progressbar.h"
 #include "gui/mrview/tool/tractography/tractogram.h"
 #include "gui/mrview/window.h"
 #include "gui/projection.h"
 #include "dwi/tractography/file.h"
+#include "dwi/tractography/lod.h"
 #include "dwi/tractography/properties.h"
 #include "dwi/tractography/scalar_file.h"
 #include "gui/opengl/lighting.h"
@@ -28,6 +34,18 @@
 
 const size_t MAX_BUFFER_SIZE = 2796200;  // number of points to fill 32MB
 
+// Level-of-detail geometry: vertices are removed where their deviation from the
+//   simplified trajectory is below LOD_TOLERANCE (mm); this geometry is drawn
+//   whenever that tolerance corresponds to no more than LOD_MAX_PIXEL_ERROR pixels
+//   on screen. Tractograms with more than LOD_MAX_STREAMLINES streamlines are
+//   additionally subsampled for this purpose.
+const float LOD_TOLERANCE = 0.25f;
+const float LOD_MAX_PIXEL_ERROR = 1.0f;
+const size_t LOD_MAX_STREAMLINES = 1000000;
+
+// Interval (ms) at which streamlines read in the background are uploaded to the GPU
+const int LOAD_POLL_INTERVAL = 100;
+
 namespace MR
 {
   namespace GUI
@@ -358,6 +376,139 @@ namespace MR
 
 
 
+        // Streamlines are read, and their vertex buffers assembled, in a
+        //   background thread; completed batches are retrieved from the GUI
+        //   thread (which alone may access the OpenGL context) and uploaded
+        //   to the GPU as they become available
+        class Tractogram::Loader
+        { MEMALIGN(Loader)
+          public:
+            class Batch
+            { MEMALIGN(Batch)
+              public:
+                Batch () : num_tracks (0), num_lod_tracks (0) { }
+                vector<Eigen::Vector3f> vertices, lod_vertices, tangents;
+                vector<GLint> starts, sizes, lod_starts, lod_sizes;
+                size_t num_tracks, num_lod_tracks;
+            };
+
+            // The file header is parsed immediately, such that any
+            //   error in opening the file is reported to the caller
+            Loader (const std::string& filename, DWI::Tractography::Properties& properties) :
+                file (filename, properties),
+                lod_level (0),
+                cancelled (false),
+                complete (false)
+            {
+              const auto count = properties.find ("count");
+              if (count != properties.end()) {
+                try {
+                  lod_level = DWI::Tractography::LOD::level_for_count (to<size_t> (count->second), LOD_MAX_STREAMLINES);
+                } catch (...) { }
+              }
+              thread = std::async (std::launch::async, &Loader::execute, this);
+            }
+
+            ~Loader ()
+            {
+              cancelled = true;
+              if (thread.valid()) {
+                try { thread.get(); }
+                catch (Exception& e) { e.display(); }
+              }
+            }
+
+            // Retrieve the next completed batch, if any
+            bool next (Batch& batch)
+            {
+              std::lock_guard<std::mutex> lock (mutex);
+              if (batches.empty())
+                return false;
+              batch = std::move (batches.front());
+              batches.pop_front();
+              return true;
+            }
+
+            // Whether all batches have been generated (though not necessarily retrieved)
+            bool finished () const { return complete; }
+
+            // Block until reading is complete, rethrowing any error encountered
+            void wait ()
+            {
+              if (thread.valid())
+                thread.get();
+            }
+
+          private:
+            DWI::Tractography::Reader<float> file;
+            size_t lod_level;
+            std::atomic<bool> cancelled, complete;
+            std::mutex mutex;
+            std::deque<Batch> batches;
+            std::future<void> thread;
+
+            // Pre- and post-padding support downsampling: the first and last
+            //   track vertices are used even when the stride is greater than one
+            static void append (const vector<Eigen::Vector3f>& tck, vector<Eigen::Vector3f>& buffer, vector<GLint>& starts, vector<GLint>& sizes)
+            {
+              for (size_t i = 0; i < track_padding; ++i)
+                buffer.push_back (tck.front());
+              starts.push_back (buffer.size() - 1);
+              buffer.insert (buffer.end(), tck.begin(), tck.end());
+              for (size_t i = 0; i < track_padding; ++i)
+                buffer.push_back (tck.back());
+              sizes.push_back (tck.size());
+            }
+
+            void push (Batch& batch)
+            {
+              std::lock_guard<std::mutex> lock (mutex);
+              batches.push_back (std::move (batch));
+              batch = Batch();
+            }
+
+            void execute ()
+            {
+              try {
+                DWI::Tractography::Streamline<float> tck;
+                vector<size_t> retained;
+                vector<Eigen::Vector3f> decimated;
+                Batch batch;
+                size_t index = 0;
+                while (!cancelled && file (tck)) {
+                  if (tck.empty())
+                    continue;
+                  append (tck, batch.vertices, batch.starts, batch.sizes);
+                  batch.tangents.push_back ((tck.back() - tck.front()).normalized());
+                  ++batch.num_tracks;
+                  if (DWI::Tractography::LOD::in_subset (index++, lod_level)) {
+                    DWI::Tractography::LOD::decimate (tck, LOD_TOLERANCE, retained);
+                    decimated.clear();
+                    for (const auto i : retained)
+                      decimated.push_back (tck[i]);
+                    append (decimated, batch.lod_vertices, batch.lod_starts, batch.lod_sizes);
+                    ++batch.num_lod_tracks;
+                  }
+                  if (batch.vertices.size() >= MAX_BUFFER_SIZE)
+                    push (batch);
+                }
+                if (batch.num_tracks)
+                  push (batch);
+                file.close();
+              } catch (...) {
+                complete = true;
+                throw;
+              }
+              complete = true;
+            }
+        };
+
+
+
+
+
+
+
         Tractogram::Tractogram (Tractography& tool, const std::string& filename) :
             Displayable (filename),
             show_colour_bar (true),
@@ -387,7 +538,12 @@ namespace MR
 
         Tractogram::~Tractogram ()
         {
+          loader.reset();
           GL::assert_context_is_current();
+          if (lod_vertex_buffers.size())
+            gl::DeleteBuffers (lod_vertex_buffers.size(), &lod_vertex_buffers[0]);
+          if (lod_vertex_array_objects.size())
+            gl::DeleteVertexArrays (lod_vertex_array_objects.size(), &lod_vertex_array_objects[0]);
           if (vertex_buffers.size())
             gl::DeleteBuffers (vertex_buffers.size(), &vertex_buffers[0]);
           if (vertex_array_objects.size())
@@ -471,6 +627,9 @@ namespace MR
 
           glPointSize(point_size_screenspace);
 
+          const bool lod = use_lod (transform);
+          auto draw = [&] () { if (lod) render_lod_streamlines(); else render_streamlines(); };
+
           if (tractography_tool.line_opacity < 1.0) {
             gl::Enable (gl::BLEND);
             gl::BlendEquation (gl::FUNC_ADD);
@@ -478,18 +637,18 @@ namespace MR
             gl::Disable (gl::DEPTH_TEST);
             gl::DepthMask (gl::TRUE_);
             gl::BlendColor (1.0, 1.0, 1.0, tractography_tool.line_opacity / 0.5);
-            render_streamlines();
+            draw();
             gl::BlendFunc (gl::CONSTANT_ALPHA, gl::ONE_MINUS_CONSTANT_ALPHA);
             gl::Enable (gl::DEPTH_TEST);
             gl::DepthMask (gl::TRUE_);
             gl::BlendColor (1.0, 1.0, 1.0, tractography_tool.line_opacity / 0.5);
-            render_streamlines();
+            draw();
 
           } else {
             gl::Disable (gl::BLEND);
             gl::Enable (gl::DEPTH_TEST);
             gl::DepthMask (gl::TRUE_);
-            render_streamlines();
+            draw();
           }
 
           if (tractography_tool.line_opacity < 1.0) {
@@ -575,6 +734,35 @@ namespace MR
 
 
 
+        inline void Tractogram::render_lod_streamlines ()
+        {
+          GL::assert_context_is_current();
+          // Vertex attributes of level-of-detail buffers are set upon upload,
+          //   since no stride is ever applied to them
+          for (size_t buf = 0, N = lod_vertex_buffers.size(); buf < N; ++buf) {
+            gl::BindVertexArray (lod_vertex_array_objects[buf]);
+            gl::MultiDrawArrays (gl::LINE_STRIP, &lod_track_starts[buf][0], &lod_track_sizes[buf][0], lod_num_tracks_per_buffer[buf]);
+          }
+          GL::assert_context_is_current();
+        }
+
+
+
+
+        bool Tractogram::use_lod (const Projection& transform) const
+        {
+          if (lod_vertex_buffers.empty() || geometry_type == TrackGeometryType::Points)
+            return false;
+          // Level-of-detail geometry has no per-vertex colour or scalar buffers
+          if (color_type == TrackColourType::Ends || color_type == TrackColourType::ScalarFile ||
+              threshold_type != TrackThresholdType::None)
+            return false;
+          return LOD_TOLERANCE <= DWI::Tractography::LOD::screen_space_tolerance (window().FOV(), transform.height(), LOD_MAX_PIXEL_ERROR);
+        }
+
+
+
+
         inline void Tractogram::update_stride ()
         {
           // Note: If streamlines have been resampled at all,
@@ -604,51 +792,63 @@ namespace MR
 
         void Tractogram::load_tracks()
         {
-          // Make sure to set graphics context!
-          // We're setting up vertex array objects
-          GL::Context::Grab context;
-          GL::assert_context_is_current();
+          loader.reset (new Loader (filename, properties));
+          on_FOV_changed();
+          QTimer::singleShot (0, this, SLOT (on_load_timer()));
+        }
 
-          DWI::Tractography::Reader<float> file (filename, properties);
-          DWI::Tractography::Streamline<float> tck;
-          vector<Eigen::Vector3f> buffer;
-          vector<GLint> starts;
-          vector<GLint> sizes;
-          size_t tck_count = 0;
 
-          on_FOV_changed();
 
-          while (file (tck)) {
 
-            const size_t N = tck.size();
-            if (!N) continue;
+        void Tractogram::finish_loading()
+        {
+          if (!loader)
+            return;
+          loader->wait();
+          upload_loaded_tracks();
+        }
+
 
-            // Pre padding
-            // To support downsampling, we want to ensure that the starting track vertex
-            // is used even when we're using a stride > 1
-            for (size_t i = 0; i < track_padding; ++i)
-              buffer.push_back (tck.front());
 
-            starts.push_back (buffer.size() - 1);
 
-            buffer.insert (buffer.end(), tck.begin(), tck.end());
+        void Tractogram::on_load_timer()
+        {
+          if (!loader)
+            return;
+          try {
+            upload_loaded_tracks();
+          } catch (Exception& e) {
+            e.display();
+          }
+          if (loader)
+            QTimer::singleShot (LOAD_POLL_INTERVAL, this, SLOT (on_load_timer()));
+          window().updateGL();
+        }
 
-            // Post padding
-            // Similarly, to support downsampling, we also want to ensure the final track vertex
-            // will be used even we're using a stride > 1
-            for (size_t i = 0; i < track_padding; ++i)
-              buffer.push_back (tck.back());
 
-            sizes.push_back (N);
-            tck_count++;
-            if (buffer.size() >= MAX_BUFFER_SIZE)
-              load_tracks_onto_GPU (buffer, starts, sizes, tck_count);
 
-            endpoint_tangents.push_back ((tck.back() - tck.front()).normalized());
+
+        void Tractogram::upload_loaded_tracks()
+        {
+          // Make sure to set graphics context!
+          // We're setting up vertex array objects
+          GL::Context::Grab context;
+          GL::assert_context_is_current();
+
+          // Check for completion before retrieving batches, such that
+          //   no batch generated in the meantime can be missed
+          const bool finished = loader->finished();
+          Loader::Batch batch;
+          while (loader->next (batch)) {
+            endpoint_tangents.insert (endpoint_tangents.end(), batch.tangents.begin(), batch.tangents.end());
+            load_tracks_onto_GPU (batch.vertices, batch.starts, batch.sizes, batch.num_tracks);
+            if (batch.num_lod_tracks)
+              load_lod_tracks_onto_GPU (batch.lod_vertices, batch.lod_starts, batch.lod_sizes, batch.num_lod_tracks);
+          }
+          if (finished) {
+            std::unique_ptr<Loader> complete (std::move (loader));
+            complete->wait();
           }
-          if (buffer.size())
-            load_tracks_onto_GPU (buffer, starts, sizes, tck_count);
-          file.close();
           GL::assert_context_is_current();
         }
 
@@ -657,6 +857,8 @@ namespace MR
 
         void Tractogram::load_end_colours()
         {
+          finish_loading();
+
           // These data are now retained in memory - no need to re-scan track file
           if (colour_buffers.size())
             return;
@@ -697,6 +899,8 @@ namespace MR
 
         void Tractogram::load_intensity_track_scalars (const std::string& filename)
         {
+          finish_loading();
+
           // Make sure to set graphics context!
           // We're setting up vertex array objects
           GL::Context::Grab context;
@@ -792,6 +996,8 @@ namespace MR
 
         void Tractogram::load_threshold_track_scalars (const std::string& filename)
         {
+          finish_loading();
+
           // Make sure to set graphics context!
           // We're setting up vertex array objects
           GL::Context::Grab context;
@@ -977,6 +1183,8 @@ namespace MR
           gl::BindBuffer (gl::ARRAY_BUFFER, vertexbuffer);
           gl::BufferData (gl::ARRAY_BUFFER, buffer.size() * sizeof(Eigen::Vector3f), &buffer[0][0], gl::STATIC_DRAW);
 
+          vao_dirty = true;
+
           vertex_array_objects.push_back (vertex_array_object);
           vertex_buffers.push_back (vertexbuffer);
           track_starts.push_back (starts);
@@ -992,6 +1200,43 @@ namespace MR
           GL::assert_context_is_current();
         }
 
+        void Tractogram::load_lod_tracks_onto_GPU (vector<Eigen::Vector3f>& buffer,
+            vector<GLint>& starts,
+            vector<GLint>& sizes,
+            size_t& tck_count)
+        {
+          GL::assert_context_is_current();
+
+          GLuint vertex_array_object;
+          gl::GenVertexArrays (1, &vertex_array_object);
+          gl::BindVertexArray (vertex_array_object);
+
+          GLuint vertexbuffer;
+          gl::GenBuffers (1, &vertexbuffer);
+          gl::BindBuffer (gl::ARRAY_BUFFER, vertexbuffer);
+          gl::BufferData (gl::ARRAY_BUFFER, buffer.size() * sizeof(Eigen::Vector3f), &buffer[0][0], gl::STATIC_DRAW);
+
+          // Vertex attributes are packed prev, curr, next, with unit stride
+          gl::EnableVertexAttribArray (0);
+          gl::VertexAttribPointer (0, 3, gl::FLOAT, gl::FALSE_, 3*sizeof(float), (void*)(3*sizeof(float)));
+          gl::EnableVertexAttribArray (1);
+          gl::VertexAttribPointer (1, 3, gl::FLOAT, gl::FALSE_, 3*sizeof(float), (void*)0);
+          gl::EnableVertexAttribArray (2);
+          gl::VertexAttribPointer (2, 3, gl::FLOAT, gl::FALSE_, 3*sizeof(float), (void*)(6*sizeof(float)));
+
+          lod_vertex_array_objects.push_back (vertex_array_object);
+          lod_vertex_buffers.push_back (vertexbuffer);
+          lod_track_starts.push_back (starts);
+          lod_track_sizes.push_back (sizes);
+          lod_num_tracks_per_buffer.push_back (tck_count);
+
+          buffer.clear();
+          starts.clear();
+          sizes.clear();
+          tck_count = 0;
+          GL::assert_context_is_current();
+        }
+
         void Tractogram::load_end_colours_onto_GPU (vector<Eigen::Vector3f>& buffer)
         {
           GL::assert_context_is_current();
@@ -53,7 +53,12 @@ namespace MR
                 visitor.render_tractogram_colourbar(*this);
             }
 
+            // Streamlines are read in a background thread, and displayed
+            //   progressively as batches of them are uploaded to the GPU
             void load_tracks();
+            // Block until all streamlines have been loaded
+            void finish_loading();
+            bool is_loading() const { return bool(loader); }
 
             void load_end_colours();
             void load_intensity_track_scalars (const std::string&);
@@ -121,6 +126,8 @@ namespace MR
             void scalingChanged ();
 
           private:
+            class Loader;
+
             static const int track_padding = 6;
             Tractography& tractography_tool;
 
@@ -154,18 +161,38 @@ namespace MR
             //   may be used for streamline colouring and thresholding
             float threshold_min, threshold_max;
 
+            std::unique_ptr<Loader> loader;
+
+            // Reduced level-of-detail copy of the streamlines (decimated, and
+            //   subsampled if very numerous), drawn in place of the full geometry
+            //   whenever the difference would be smaller than a screen pixel
+            vector<GLuint> lod_vertex_buffers;
+            vector<GLuint> lod_vertex_array_objects;
+            vector<vector<GLint> > lod_track_starts;
+            vector<vector<GLint> > lod_track_sizes;
+            vector<size_t> lod_num_tracks_per_buffer;
+
 
             void load_tracks_onto_GPU (vector<Eigen::Vector3f>& buffer,
                                        vector<GLint>& starts,
                                        vector<GLint>& sizes,
                                        size_t& tck_count);
 
+            void load_lod_tracks_onto_GPU (vector<Eigen::Vector3f>& buffer,
+                                           vector<GLint>& starts,
+                                           vector<GLint>& sizes,
+                                           size_t& tck_count);
+
+            void upload_loaded_tracks ();
+
             void load_end_colours_onto_GPU (vector<Eigen::Vector3f>&);
 
             void load_intensity_scalars_onto_GPU (vector<float>& buffer, size_t& tck_count);
             void load_threshold_scalars_onto_GPU (vector<float>& buffer, size_t& tck_count);
 
             void render_streamlines ();
+            void render_lod_streamlines ();
+            bool use_lod (const Projection& transform) const;
 
             void update_stride ();
 
@@ -173,6 +200,7 @@ namespace MR
             void on_FOV_changed() {
               should_update_stride = true;
             }
+            void on_load_timer();
         };
       }
     }
@@ -18,10 +18,11 @@
 #ifndef __registration_metric_cc_helper_h__
 #define __registration_metric_cc_helper_h__
 
-#include "debug.h"
+#include "image.h"
 #include "math/math.h"
 #include "image_helpers.h"
-#include "algo/neighbourhooditerator.h"
+#include "algo/iterator.h"
+#include "algo/threaded_loop.h"
 
 namespace MR
 {
@@ -30,6 +31,104 @@ namespace MR
     namespace Metric
     {
 
+      namespace detail {
+
+        // Neighbourhood sums accumulated per voxel, along axis 3 of the scratch image
+        enum { cc_count, cc_sum1, cc_sum2, cc_sum11, cc_sum22, cc_sum12, cc_num_sums };
+
+
+        template <class Im1ImageType, class Im2ImageType, class Im1MaskType, class Im2MaskType>
+        class CCSumsKernel { MEMALIGN(CCSumsKernel<Im1ImageType,Im2ImageType,Im1MaskType,Im2MaskType>)
+          public:
+            CCSumsKernel (const Im1MaskType& im1_mask, const Im2MaskType& im2_mask) :
+                im1_mask (im1_mask),
+                im2_mask (im2_mask) { }
+
+            void operator() (Im1ImageType& im1_image, Im2ImageType& im2_image, Image<default_type>& sums) {
+              sums.row(3) = 0.0;
+              if (im1_mask.valid()) {
+                assign_pos_of (im1_image, 0, 3).to (im1_mask);
+                if (!im1_mask.value())
+                  return;
+              }
+              if (im2_mask.valid()) {
+                assign_pos_of (im1_image, 0, 3).to (im2_mask);
+                if (!im2_mask.value())
+                  return;
+              }
+              const default_type v1 = im1_image.value();
+              const default_type v2 = im2_image.value();
+              if (std::isnan (v1) || std::isnan (v2))
+                return;
+              sums.index(3) = cc_count;  sums.value() = 1.0;
+              sums.index(3) = cc_sum1;   sums.value() = v1;
+              sums.index(3) = cc_sum2;   sums.value() = v2;
+              sums.index(3) = cc_sum11;  sums.value() = v1 * v1;
+              sums.index(3) = cc_sum22;  sums.value() = v2 * v2;
+              sums.index(3) = cc_sum12;  sums.value() = v1 * v2;
+            }
+
+          private:
+            Im1MaskType im1_mask;
+            Im2MaskType im2_mask;
+        };
+
+
+        // Replaces each line of sums along the given axis with its sum over a
+        // window of the given half-width, truncated at the image boundaries
+        class BoxSumKernel { MEMALIGN(BoxSumKernel)
+          public:
+            BoxSumKernel (const Image<default_type>& sums, const size_t axis, const ssize_t radius) :
+                sums (sums),
+                axis (axis),
+                radius (radius),
+                cumulative (sums.size (axis) + 1, ssize_t (cc_num_sums)) { }
+
+            void operator() (const Iterator& pos) {
+              assign_pos_of (pos, 0, 3).to (sums);
+              const ssize_t size = sums.size (axis);
+              cumulative.row(0).setZero();
+              for (sums.index (axis) = 0; sums.index (axis) < size; ++sums.index (axis)) {
+                const ssize_t n = sums.index (axis);
+                cumulative.row (n+1) = cumulative.row (n) + Eigen::VectorXd (sums.row (3)).transpose();
+              }
+              for (sums.index (axis) = 0; sums.index (axis) < size; ++sums.index (axis)) {
+                const ssize_t n = sums.index (axis);
+                const ssize_t lower = std::max (n - radius, ssize_t (0));
+                const ssize_t upper = std::min (n + radius, size - 1);
+                sums.row (3) = (cumulative.row (upper+1) - cumulative.row (lower)).transpose();
+              }
+            }
+
+          private:
+            Image<default_type> sums;
+            const size_t axis;
+            const ssize_t radius;
+            Eigen::MatrixXd cumulative;
+        };
+
+      }
+
+
+
+      //! allocate the scratch image of neighbourhood sums used by cc_precompute()
+      /*! This can be reused across calls to cc_precompute() for images on the same voxel grid. */
+      inline Image<default_type> cc_sums_scratch (const Header& template_header) {
+        Header header (template_header);
+        header.ndim() = 4;
+        header.size(3) = detail::cc_num_sums;
+        Stride::set (header, Stride::contiguous_along_axis (3, header));
+        return Image<default_type>::scratch (header, "cross correlation neighbourhood sums");
+      }
+
+
+
+      //! compute the local cross-correlation terms over a box neighbourhood of the given extent
+      /*! The neighbourhood sums of both images, their squares and their
+       * product (over voxels within both masks) are computed using separable
+       * running sums, such that the cost is independent of the extent. The
+       * neighbourhood is truncated at the image boundaries. The scratch image
+       * \a sums is (re)allocated if not already valid for this voxel grid. */
       template <class Im1ImageType, class Im2ImageType, class Im1MaskType, class Im2MaskType, class DerivedImageType>
         void cc_precompute (Im1ImageType& im1_image,
                             Im2ImageType& im2_image,
@@ -40,76 +139,52 @@ namespace MR
                             DerivedImageType& C,
                             DerivedImageType& im1_meansubtr,
                             DerivedImageType& im2_meansubtr,
+                            Image<default_type>& sums,
                             const vector<size_t>& extent) {
-          // TODO check extent
-          int nmax = extent[0] * extent[1] * extent[2];
-          Eigen::VectorXd n1 = Eigen::VectorXd(nmax);
-          Eigen::VectorXd n2 = Eigen::VectorXd(nmax);
-          Eigen::Vector3d pos;
-          for (auto l = Loop("precomputing cross correlation values") (im1_image); l; ++l) {
-            pos[0] = im1_image.index(0);
-            pos[1] = im1_image.index(1);
-            pos[2] = im1_image.index(2);
-            assign_pos_of(im1_image, 0, 3).to(A, B, C, im1_meansubtr, im2_meansubtr);
-            default_type m1(0.0);
-            default_type m2(0.0);
-
-            n1.setZero();
-            n2.setZero();
-
-            int nvox(0);
-            auto niter = NeighbourhoodIterator(im1_image, extent);
-            while (niter.loop()) {
-              if (im1_mask.valid()) {
-                assign_pos_of(niter, 0, 3).to(im1_mask);
-                if (!im1_mask.value())
-                  continue;
-              }
-              if (im2_mask.valid()) {
-                assign_pos_of(niter, 0, 3).to(im2_mask);
-                if (!im2_mask.value())
-                  continue;
-              }
-              assign_pos_of(niter, 0, 3).to(im1_image);
-              assign_pos_of(niter, 0, 3).to(im2_image);
+          using namespace detail;
+          assert (extent.size() >= 3);
 
-              n1[nvox] = im1_image.value();
-              n2[nvox] = im2_image.value();
+          if (!sums.valid() || !dimensions_match (sums, im1_image, 0, 3))
+            sums = cc_sums_scratch (im1_image);
 
-              m1 += n1[nvox];
-              m2 += n2[nvox];
-              nvox++;
-            }
+          ThreadedLoop ("precomputing cross correlation values", im1_image, 0, 3)
+              .run (CCSumsKernel<Im1ImageType,Im2ImageType,Im1MaskType,Im2MaskType> (im1_mask, im2_mask), im1_image, im2_image, sums);
+
+          for (size_t axis = 0; axis < 3; ++axis) {
+            vector<size_t> outer_axes;
+            for (size_t n = 0; n < 3; ++n)
+              if (n != axis)
+                outer_axes.push_back (n);
+            ThreadedLoop (sums, outer_axes, vector<size_t>()).run_outer (BoxSumKernel (sums, axis, (extent[axis] - 1) / 2));
+          }
 
-            if (nvox == 0) {
+          auto finalise = [] (Im1ImageType& im1_image, Im2ImageType& im2_image, Image<default_type>& sums,
+                              DerivedImageType& A, DerivedImageType& B, DerivedImageType& C,
+                              DerivedImageType& im1_meansubtr, DerivedImageType& im2_meansubtr) {
+            sums.index(3) = cc_count;
+            const default_type nvox = sums.value();
+            if (nvox == 0.0) {
               A.value() = NaN;
               C.value() = NaN;
               B.value() = NaN;
               im1_meansubtr.value() = NaN;
               im2_meansubtr.value() = NaN;
-              continue;
+              return;
             }
-
-            // local mean subtracted
-            n1.array() -= n1.sum() / nvox;
-            n2.array() -= n2.sum() / nvox;
-            A.value() = n1.adjoint() * n2;
-            B.value() = n1.adjoint() * n1;
-            C.value() = n2.adjoint() * n2;
-
-            // reset image positions
-            im1_image.index(0) = pos[0];
-            im1_image.index(1) = pos[1];
-            im1_image.index(2) = pos[2];
-
-            im2_image.index(0) = pos[0];
-            im2_image.index(1) = pos[1];
-            im2_image.index(2) = pos[2];
-
-            im1_meansubtr.value() = im1_image.value() - m1 / nvox;
-            im2_meansubtr.value() = im2_image.value() - m2 / nvox;
-          }
-
+            sums.index(3) = cc_sum1;  const default_type s1 = sums.value();
+            sums.index(3) = cc_sum2;  const default_type s2 = sums.value();
+            sums.index(3) = cc_sum11; const default_type s11 = sums.value();
+            sums.index(3) = cc_sum22; const default_type s22 = sums.value();
+            sums.index(3) = cc_sum12; const default_type s12 = sums.value();
+            // local mean subtracted; the variances can only be negative through
+            // round-off, in which case their product must not pass as valid
+            A.value() = s12 - s1 * s2 / nvox;
+            B.value() = std::max (s11 - s1 * s1 / nvox, 0.0);
+            C.value() = std::max (s22 - s2 * s2 / nvox, 0.0);
+            im1_meansubtr.value() = im1_image.value() - s1 / nvox;
+            im2_meansubtr.value() = im2_image.value() - s2 / nvox;
+          };
+          ThreadedLoop (im1_image, 0, 3).run (finalise, im1_image, im2_image, sums, A, B, C, im1_meansubtr, im2_meansubtr);
         }
 
     }
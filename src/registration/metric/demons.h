@@ -66,10 +66,11 @@ namespace MR
           }
 
 
+          template <class UpdateType>
           void operator() (const Im1ImageType& im1_image,
                            const Im2ImageType& im2_image,
-                           Image<default_type>& im1_update,
-                           Image<default_type>& im2_update) {
+                           UpdateType& im1_update,
+                           UpdateType& im2_update) {
 
             if (im1_image.index(0) == 0 || im1_image.index(0) == im1_image.size(0) - 1 ||
                 im1_image.index(1) == 0 || im1_image.index(1) == im1_image.size(1) - 1 ||
@@ -112,7 +113,7 @@ namespace MR
 
             assign_pos_of (im1_image, 0, 3).to (im1_gradient, im2_gradient);
 
-            Eigen::Matrix<typename Im1ImageType::value_type, 3, 1> grad = (im2_gradient.value() + im1_gradient.value()).array() / 2.0;
+            Eigen::Vector3d grad = ((im2_gradient.value() + im1_gradient.value()).array() / 2.0).matrix().template cast<default_type>();
             default_type denominator = speed_squared / normaliser + grad.squaredNorm();
             if (abs (speed) < intensity_difference_threshold || denominator < denominator_threshold) {
               im1_update.row(3) = 0.0;
@@ -81,10 +81,11 @@ namespace MR
           }
 
 
+          template <class UpdateType>
           void operator() (Im1ImageType& im1_image,
                            Im2ImageType& im2_image,
-                           Image<default_type>& im1_update,
-                           Image<default_type>& im2_update) {
+                           UpdateType& im1_update,
+                           UpdateType& im2_update) {
             assert (im1_image.size(3) == nvols);
             assert (im2_image.size(3) == nvols);
 
@@ -136,7 +137,7 @@ namespace MR
                 continue;
               im1_gradient.index(3) = vol;
               im2_gradient.index(3) = vol;
-              grad = (im2_gradient.value() + im1_gradient.value()).array() / 2.0;
+              grad = ((im2_gradient.value() + im1_gradient.value()).array() / 2.0).matrix().template cast<default_type>();
 
               default_type denominator = speed_squared[vol] / normaliser + grad.squaredNorm();
               if (denominator < denominator_threshold)
@@ -67,13 +67,14 @@ namespace MR
             im2_mask = mask;
           }
 
+          template <class UpdateType>
           void operator() (const Im1ImageType& im1_meansubtracted,
                            const Im2ImageType& im2_meansubtracted,
                            const Im2ImageType& A,
                            const Im2ImageType& B,
                            const Im2ImageType& C,
-                           Image<default_type>& im1_update,
-                           Image<default_type>& im2_update) {
+                           UpdateType& im1_update,
+                           UpdateType& im2_update) {
 
             if (im1_meansubtracted.index(0) == 0 || im1_meansubtracted.index(0) == im1_meansubtracted.size(0) - 1 ||
                 im1_meansubtracted.index(1) == 0 || im1_meansubtracted.index(1) == im1_meansubtracted.size(1) - 1 ||
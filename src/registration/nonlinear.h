@@ -49,6 +49,13 @@ namespace MR
 
       public:
 
+        // All internal displacement fields, update fields and warped images
+        // are held in single precision: this halves the memory footprint of
+        // the registration, while the precision retained (~1e-7 relative) is
+        // far below any meaningful displacement or intensity difference
+        using value_type = float;
+        using field_type = Image<value_type>;
+
         NonLinear ():
           is_initialised (false),
           max_iter (1, 50),
@@ -158,36 +165,39 @@ namespace MR
                 warped_header.ndim() = 4;
                 warped_header.size(3) = im1_smoothed.size(3);
               }
-              auto im1_warped = Image<default_type>::scratch (warped_header);
-              auto im2_warped = Image<default_type>::scratch (warped_header);
+              auto im1_warped = field_type::scratch (warped_header);
+              auto im2_warped = field_type::scratch (warped_header);
 
-              Image<default_type> im_cca, im_ccc, im_ccb, im_cc1, im_cc2;
+              field_type im_cca, im_ccc, im_ccb, im_cc1, im_cc2;
+              Image<default_type> im_cc_sums;
               if (use_cc) {
                 DEBUG ("Initialising CC images");
-                im_cca = Image<default_type>::scratch(warped_header);
-                im_ccb = Image<default_type>::scratch(warped_header);
-                im_ccc = Image<default_type>::scratch(warped_header);
-                im_cc1 = Image<default_type>::scratch(warped_header);
-                im_cc2 = Image<default_type>::scratch(warped_header);
+                im_cc_sums = Metric::cc_sums_scratch (warped_header);
+                im_cca = field_type::scratch(warped_header);
+                im_ccb = field_type::scratch(warped_header);
+                im_ccc = field_type::scratch(warped_header);
+                im_cc1 = field_type::scratch(warped_header);
+                im_cc2 = field_type::scratch(warped_header);
               }
 
               Header field_header (midway_image_header_resized);
               field_header.ndim() = 4;
               field_header.size(3) = 3;
 
-              im1_to_mid_new = make_shared<Image<default_type>>(Image<default_type>::scratch (field_header));
-              im2_to_mid_new = make_shared<Image<default_type>>(Image<default_type>::scratch (field_header));
-              im1_update = make_shared<Image<default_type>>(Image<default_type>::scratch (field_header));
-              im2_update = make_shared<Image<default_type>>(Image<default_type>::scratch (field_header));
-              im1_update_new = make_shared<Image<default_type>>(Image<default_type>::scratch (field_header));
-              im2_update_new = make_shared<Image<default_type>>(Image<default_type>::scratch (field_header));
+              // The update fields are overwritten in place by the metric: if the
+              // resulting cost does not improve, the registration at this level
+              // has converged and the update is discarded anyway
+              im1_to_mid_new = make_shared<field_type>(field_type::scratch (field_header));
+              im2_to_mid_new = make_shared<field_type>(field_type::scratch (field_header));
+              im1_update = make_shared<field_type>(field_type::scratch (field_header));
+              im2_update = make_shared<field_type>(field_type::scratch (field_header));
 
               if (!is_initialised) {
                 if (level == 0) {
-                  im1_to_mid = make_shared<Image<default_type>>(Image<default_type>::scratch (field_header));
-                  im2_to_mid = make_shared<Image<default_type>>(Image<default_type>::scratch (field_header));
-                  mid_to_im1 = make_shared<Image<default_type>>(Image<default_type>::scratch (field_header));
-                  mid_to_im2 = make_shared<Image<default_type>>(Image<default_type>::scratch (field_header));
+                  im1_to_mid = make_shared<field_type>(field_type::scratch (field_header));
+                  im2_to_mid = make_shared<field_type>(field_type::scratch (field_header));
+                  mid_to_im1 = make_shared<field_type>(field_type::scratch (field_header));
+                  mid_to_im2 = make_shared<field_type>(field_type::scratch (field_header));
                 } else {
                   DEBUG ("Upsampling fields");
                   {
@@ -214,8 +224,8 @@ namespace MR
                   smooth_filter (*im2_update);
                 }
 
-                Image<default_type> im1_deform_field = Image<default_type>::scratch (field_header);
-                Image<default_type> im2_deform_field = Image<default_type>::scratch (field_header);
+                field_type im1_deform_field = field_type::scratch (field_header);
+                field_type im2_deform_field = field_type::scratch (field_header);
 
                 if (iteration > 1) {
                   DEBUG ("updating displacement field");
@@ -268,7 +278,7 @@ namespace MR
                 size_t voxel_count = 0;
 
                 if (use_cc) {
-                  Metric::cc_precompute (im1_warped, im2_warped, im1_mask_warped, im2_mask_warped, im_cca, im_ccb, im_ccc, im_cc1, im_cc2, cc_extent);
+                  Metric::cc_precompute (im1_warped, im2_warped, im1_mask_warped, im2_mask_warped, im_cca, im_ccb, im_ccc, im_cc1, im_cc2, im_cc_sums, cc_extent);
                   // display<Image<default_type>>(im_cca);
                   // display<Image<default_type>>(im_ccb);
                   // display<Image<default_type>>(im_ccc);
@@ -278,23 +288,23 @@ namespace MR
 
                 if (im1_image.ndim() == 4) {
                   assert (!use_cc && "TODO");
-                  Metric::Demons4D<Im1ImageType, Im2ImageType, Im1MaskType, Im2MaskType> metric (
+                  Metric::Demons4D<field_type, field_type, Im1MaskType, Im2MaskType> metric (
                     cost_new, voxel_count, im1_warped, im2_warped, im1_mask_warped, im2_mask_warped, &stage_contrasts);
-                  ThreadedLoop (im1_warped, 0, 3).run (metric, im1_warped, im2_warped, *im1_update_new, *im2_update_new);
+                  ThreadedLoop (im1_warped, 0, 3).run (metric, im1_warped, im2_warped, *im1_update, *im2_update);
                 } else {
                   if (use_cc) {
-                    Metric::DemonsCC<Im1ImageType, Im2ImageType, Im1MaskType, Im2MaskType> metric (
+                    Metric::DemonsCC<field_type, field_type, Im1MaskType, Im2MaskType> metric (
                       cost_new, voxel_count, im_cc1, im_cc2, im1_mask_warped, im2_mask_warped);
-                    ThreadedLoop (im_cc1, 0, 3).run (metric, im_cc1, im_cc2, im_cca, im_ccb, im_ccc, *im1_update_new, *im2_update_new);
+                    ThreadedLoop (im_cc1, 0, 3).run (metric, im_cc1, im_cc2, im_cca, im_ccb, im_ccc, *im1_update, *im2_update);
                   } else {
-                    Metric::Demons<Im1ImageType, Im2ImageType, Im1MaskType, Im2MaskType> metric (
+                    Metric::Demons<field_type, field_type, Im1MaskType, Im2MaskType> metric (
                       cost_new, voxel_count, im1_warped, im2_warped, im1_mask_warped, im2_mask_warped);
-                    ThreadedLoop (im1_warped, 0, 3).run (metric, im1_warped, im2_warped, *im1_update_new, *im2_update_new);
+                    ThreadedLoop (im1_warped, 0, 3).run (metric, im1_warped, im2_warped, *im1_update, *im2_update);
                   }
                 }
 
                 if (App::log_level >= 3)
-                  display<Image<default_type>>(*im1_update_new);
+                  display<field_type>(*im1_update);
 
                 cost_new /= static_cast<default_type>(voxel_count);
 
@@ -305,15 +315,15 @@ namespace MR
                     std::swap (im1_to_mid_new, im1_to_mid);
                     std::swap (im2_to_mid_new, im2_to_mid);
                   }
-                  std::swap (im1_update_new, im1_update);
-                  std::swap (im2_update_new, im2_update);
 
                   DEBUG ("inverting displacement field");
+                  Warp::InversionStats inversion_stats;
                   {
                     LogLevelLatch level (0);
-                    Warp::invert_displacement (*im1_to_mid, *mid_to_im1);
-                    Warp::invert_displacement (*im2_to_mid, *mid_to_im2);
+                    inversion_stats += Warp::invert_displacement (*im1_to_mid, *mid_to_im1);
+                    inversion_stats += Warp::invert_displacement (*im2_to_mid, *mid_to_im2);
                   }
+                  DEBUG ("  inversion: " + inversion_stats.summary());
 
 
                 } else {
@@ -372,22 +382,22 @@ namespace MR
             field_header.ndim() = 4;
             field_header.size(3) = 3;
 
-            im1_to_mid = make_shared<Image<default_type>> (Image<default_type>::scratch (field_header));
+            im1_to_mid = make_shared<field_type> (field_type::scratch (field_header));
             input_warps.index(4) = 0;
             threaded_copy (input_warps, *im1_to_mid, 0, 4);
             Registration::Warp::deformation2displacement (*im1_to_mid, *im1_to_mid);
 
-            mid_to_im1 = make_shared<Image<default_type>> (Image<default_type>::scratch (field_header));
+            mid_to_im1 = make_shared<field_type> (field_type::scratch (field_header));
             input_warps.index(4) = 1;
             threaded_copy (input_warps, *mid_to_im1, 0, 4);
             Registration::Warp::deformation2displacement (*mid_to_im1, *mid_to_im1);
 
-            im2_to_mid = make_shared<Image<default_type>> (Image<default_type>::scratch (field_header));
+            im2_to_mid = make_shared<field_type> (field_type::scratch (field_header));
             input_warps.index(4) = 2;
             threaded_copy (input_warps, *im2_to_mid, 0, 4);
             Registration::Warp::deformation2displacement (*im2_to_mid, *im2_to_mid);
 
-            mid_to_im2 = make_shared<Image<default_type>> (Image<default_type>::scratch (field_header));
+            mid_to_im2 = make_shared<field_type> (field_type::scratch (field_header));
             input_warps.index(4) = 3;
             threaded_copy (input_warps, *mid_to_im2, 0, 4);
             Registration::Warp::deformation2displacement (*mid_to_im2, *mid_to_im2);
@@ -444,19 +454,19 @@ namespace MR
             return (ssize_t) *std::max_element(fod_lmax.begin(), fod_lmax.end());
           }
 
-          std::shared_ptr<Image<default_type> > get_im1_to_mid() {
+          std::shared_ptr<field_type> get_im1_to_mid() {
             return im1_to_mid;
           }
 
-          std::shared_ptr<Image<default_type> > get_im2_to_mid() {
+          std::shared_ptr<field_type> get_im2_to_mid() {
             return im2_to_mid;
           }
 
-          std::shared_ptr<Image<default_type> > get_mid_to_im1() {
+          std::shared_ptr<field_type> get_mid_to_im1() {
             return mid_to_im1;
           }
 
-          std::shared_ptr<Image<default_type> > get_mid_to_im2() {
+          std::shared_ptr<field_type> get_mid_to_im2() {
             return mid_to_im2;
           }
 
@@ -529,14 +539,14 @@ namespace MR
 
         protected:
 
-          std::shared_ptr<Image<default_type> > reslice (Image<default_type>& image, Header& header) {
-            std::shared_ptr<Image<default_type> > temp = make_shared<Image<default_type> > (Image<default_type>::scratch (header));
+          std::shared_ptr<field_type> reslice (field_type& image, Header& header) {
+            std::shared_ptr<field_type> temp = make_shared<field_type> (field_type::scratch (header));
             Filter::reslice<Interp::Linear> (image, *temp);
             return temp;
           }
 
-          bool has_negative_jacobians (Image<default_type>& field) {
-            Adapter::Jacobian<Image<default_type> > jacobian (field);
+          bool has_negative_jacobians (field_type& field) {
+            Adapter::Jacobian<field_type> jacobian (field);
             for (auto i = Loop (0,3) (jacobian); i; ++i) {
               if (jacobian.value().determinant() < 0.0)
                 return true;
@@ -567,17 +577,15 @@ namespace MR
           vector<MultiContrastSetting> contrasts, stage_contrasts;
 
           // Internally the warp is stored as a displacement field to enable easy smoothing near the boundaries
-          std::shared_ptr<Image<default_type> > im1_to_mid_new;
-          std::shared_ptr<Image<default_type> > im2_to_mid_new;
-          std::shared_ptr<Image<default_type> > im1_to_mid;
-          std::shared_ptr<Image<default_type> > im2_to_mid;
-          std::shared_ptr<Image<default_type> > mid_to_im1;
-          std::shared_ptr<Image<default_type> > mid_to_im2;
-
-          std::shared_ptr<Image<default_type> > im1_update;
-          std::shared_ptr<Image<default_type> > im2_update;
-          std::shared_ptr<Image<default_type> > im1_update_new;
-          std::shared_ptr<Image<default_type> > im2_update_new;
+          std::shared_ptr<field_type> im1_to_mid_new;
+          std::shared_ptr<field_type> im2_to_mid_new;
+          std::shared_ptr<field_type> im1_to_mid;
+          std::shared_ptr<field_type> im2_to_mid;
+          std::shared_ptr<field_type> mid_to_im1;
+          std::shared_ptr<field_type> mid_to_im2;
+
+          std::shared_ptr<field_type> im1_update;
+          std::shared_ptr<field_type> im2_update;
 
     };
   }
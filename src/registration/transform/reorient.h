@@ -207,13 +207,13 @@ namespace MR
         }
       }
 
-      template <class FODImageType>
-      class NonLinearKernelMultiContrast { MEMALIGN(NonLinearKernelMultiContrast<FODImageType>)
+      template <class FODImageType, class WarpType = Image<default_type>>
+      class NonLinearKernelMultiContrast { MEMALIGN(NonLinearKernelMultiContrast<FODImageType,WarpType>)
 
         public:
           NonLinearKernelMultiContrast (ssize_t n_vol,
                         ssize_t max_n_SH,
-                        Image<default_type>& warp,
+                        WarpType& warp,
                         const Eigen::MatrixXd& directions,
                         const vector<vector<ssize_t>>& vstart_nvols,
                         const bool modulate) :
@@ -274,7 +274,7 @@ namespace MR
 
           protected:
             const ssize_t max_n_SH, n_dirs;
-            Adapter::Jacobian<Image<default_type> > jacobian_adapter;
+            Adapter::Jacobian<WarpType> jacobian_adapter;
             const Eigen::MatrixXd& directions;
             const bool modulate;
             const vector<vector<ssize_t>> start_nvols;
@@ -286,11 +286,11 @@ namespace MR
       };
 
 
-      template <class FODImageType>
-      class NonLinearKernel { MEMALIGN(NonLinearKernel<FODImageType>)
+      template <class FODImageType, class WarpType = Image<default_type>>
+      class NonLinearKernel { MEMALIGN(NonLinearKernel<FODImageType,WarpType>)
 
         public:
-          NonLinearKernel (const ssize_t n_SH, Image<default_type>& warp, const Eigen::MatrixXd& directions, const bool modulate) :
+          NonLinearKernel (const ssize_t n_SH, WarpType& warp, const Eigen::MatrixXd& directions, const bool modulate) :
                            n_SH (n_SH),
                            jacobian_adapter (warp),
                            directions (directions),
@@ -327,7 +327,7 @@ namespace MR
           }
           protected:
             const ssize_t n_SH;
-            Adapter::Jacobian<Image<default_type> > jacobian_adapter;
+            Adapter::Jacobian<WarpType> jacobian_adapter;
             const Eigen::MatrixXd& directions;
             const bool modulate;
             const Eigen::MatrixXd FOD_to_aPSF_transform;
@@ -336,10 +336,10 @@ namespace MR
       };
 
 
-      template <class FODImageType>
+      template <class FODImageType, class WarpType>
       void reorient_warp (const std::string progress_message,
                           FODImageType& fod_image,
-                          Image<default_type>& warp,
+                          WarpType& warp,
                           const Eigen::MatrixXd& directions,
                           const bool modulate = false,
                           vector<MultiContrastSetting> multi_contrast_settings = vector<MultiContrastSetting>())
@@ -353,17 +353,17 @@ namespace MR
         if (start_nvols.size()) {
           DEBUG ("reorienting warp using MultiContrast NonLinearKernel");
           ThreadedLoop (progress_message, fod_image, 0, 3)
-              .run (NonLinearKernelMultiContrast<FODImageType>(fod_image.size(3), (ssize_t) max_n_SH, warp, directions, start_nvols, modulate), fod_image);
+              .run (NonLinearKernelMultiContrast<FODImageType,WarpType>(fod_image.size(3), (ssize_t) max_n_SH, warp, directions, start_nvols, modulate), fod_image);
         } else {
           DEBUG ("reorienting warp using NonLinearKernel");
           ThreadedLoop (progress_message, fod_image, 0, 3)
-              .run (NonLinearKernel<FODImageType>(fod_image.size(3), warp, directions, modulate), fod_image);
+              .run (NonLinearKernel<FODImageType,WarpType>(fod_image.size(3), warp, directions, modulate), fod_image);
         }
       }
 
-      template <class FODImageType>
+      template <class FODImageType, class WarpType>
       void reorient_warp (FODImageType& fod_image,
-                          Image<default_type>& warp,
+                          WarpType& warp,
                           const Eigen::MatrixXd& directions,
                           const bool modulate = false,
                           vector<MultiContrastSetting> multi_contrast_settings = vector<MultiContrastSetting>())
@@ -378,11 +378,11 @@ namespace MR
         if (start_nvols.size()) {
           DEBUG ("reorienting warp using MultiContrast NonLinearKernel");
           ThreadedLoop (fod_image, 0, 3)
-              .run (NonLinearKernelMultiContrast<FODImageType>(fod_image.size(3), (ssize_t) max_n_SH, warp, directions, start_nvols, modulate), fod_image);
+              .run (NonLinearKernelMultiContrast<FODImageType,WarpType>(fod_image.size(3), (ssize_t) max_n_SH, warp, directions, start_nvols, modulate), fod_image);
         } else {
           DEBUG ("reorienting warp using NonLinearKernel");
           ThreadedLoop (fod_image, 0, 3)
-              .run (NonLinearKernel<FODImageType>(fod_image.size(3), warp, directions, modulate), fod_image);
+              .run (NonLinearKernel<FODImageType,WarpType>(fod_image.size(3), warp, directions, modulate), fod_image);
         }
       }
 
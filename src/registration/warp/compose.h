@@ -67,13 +67,14 @@ namespace MR
             MR::Transform image_transform;
         };
 
-        class ComposeDispKernel { MEMALIGN(ComposeDispKernel)
+        template <class DisplacementFieldType>
+        class ComposeDispKernel { MEMALIGN(ComposeDispKernel<DisplacementFieldType>)
           public:
-            ComposeDispKernel (Image<default_type>& disp_input1, Image<default_type>& disp_input2, default_type step) :
+            ComposeDispKernel (DisplacementFieldType& disp_input1, DisplacementFieldType& disp_input2, default_type step) :
                                disp1_transform (disp_input1), disp2_interp (disp_input2), step (step) {}
 
 
-            void operator() (Image<default_type>& disp_input1, Image<default_type>& disp_output) {
+            void operator() (DisplacementFieldType& disp_input1, DisplacementFieldType& disp_output) {
               Eigen::Vector3d voxel ((default_type)disp_input1.index(0), (default_type)disp_input1.index(1), (default_type)disp_input1.index(2));
               Eigen::Vector3d voxel_position = disp1_transform.voxel2scanner * voxel;
               Eigen::Vector3d original_position = voxel_position + Eigen::Vector3d(disp_input1.row(3));
@@ -81,7 +82,7 @@ namespace MR
               if (!disp2_interp) {
                 disp_output.row(3) = disp_input1.row(3);
               } else {
-                Eigen::Vector3d displacement (Eigen::Vector3d(disp2_interp.row(3)).array() * step);
+                Eigen::Vector3d displacement (disp2_interp.row(3).template cast<default_type>().array() * step);
                 Eigen::Vector3d new_position = displacement + original_position;
                 disp_output.row(3) = new_position - voxel_position;
               }
@@ -89,7 +90,7 @@ namespace MR
 
           protected:
             MR::Transform disp1_transform;
-            Interp::Linear<Image<default_type> > disp2_interp;
+            Interp::Linear<DisplacementFieldType> disp2_interp;
             default_type step;
         };
 
@@ -112,12 +113,12 @@ namespace MR
               if (!deform1_interp) {
                   deform.row(3) = out_of_bounds;
                 } else {
-                  Eigen::Vector3d position2 = deform1_interp.row(3);
+                  Eigen::Vector3d position2 = deform1_interp.row(3).template cast<default_type>();
                   deform2_interp.scanner (position2);
                   if (!deform2_interp) {
                     deform.row(3) = out_of_bounds;
                   } else {
-                    Eigen::Vector3d position3 = deform2_interp.row(3);
+                    Eigen::Vector3d position3 = deform2_interp.row(3).template cast<default_type>();
                     deform.row(3) = linear2 * position3;
                   }
                }
@@ -125,7 +126,7 @@ namespace MR
 
           protected:
             const transform_type linear1;
-            Interp::Linear<DeformationField2Type> deform1_interp;
+            Interp::Linear<DeformationField1Type> deform1_interp;
             Interp::Linear<DeformationField2Type> deform2_interp;
             const transform_type linear2;
             Eigen::Vector3d out_of_bounds;
@@ -149,19 +150,21 @@ namespace MR
       }
 
       // Compose two displacement fields and output a displacement field. The input and output can be the same image.
-      FORCE_INLINE  void update_displacement (Image<default_type>& input, Image<default_type>& update, Image<default_type>& output, default_type step = 1.0)
+      template <class DisplacementFieldType>
+      FORCE_INLINE  void update_displacement (DisplacementFieldType& input, DisplacementFieldType& update, DisplacementFieldType& output, default_type step = 1.0)
       {
         check_dimensions (input, output, 0, 3);
-        ThreadedLoop (input, 0, 3).run (ComposeDispKernel (input, update, step), input, output);
+        ThreadedLoop (input, 0, 3).run (ComposeDispKernel<DisplacementFieldType> (input, update, step), input, output);
       }
 
       // Compose two displacement fields and output a displacement field using scaling and squaring.  The input and output can be the same image.
-      FORCE_INLINE  void update_displacement_scaling_and_squaring (Image<default_type>& input, Image<default_type>& update, Image<default_type>& output, const default_type step = 1.0)
+      template <class DisplacementFieldType>
+      FORCE_INLINE  void update_displacement_scaling_and_squaring (DisplacementFieldType& input, DisplacementFieldType& update, DisplacementFieldType& output, const default_type step = 1.0)
       {
         check_dimensions (input, output, 0, 3);
 
         default_type max_norm = 0.0;
-        auto max_norm_func = [&max_norm](Image<default_type>& update) {
+        auto max_norm_func = [&max_norm](DisplacementFieldType& update) {
           default_type norm = Eigen::Vector3d (update.row(3)).norm();
           if (norm > max_norm)
             max_norm = norm;
@@ -177,13 +180,13 @@ namespace MR
         } else {
           scale_factor = std::pow (2, std::ceil (std::log ((max_norm * step) / (min_vox_size / 2.0)) / std::log (2.0)));
 
-          std::shared_ptr<Image<default_type>> scaled_update = make_shared<Image<default_type> >(Image<default_type>::scratch (update));
-          std::shared_ptr<Image<default_type>> composed = make_shared<Image<default_type> >(Image<default_type>::scratch (update));
+          std::shared_ptr<DisplacementFieldType> scaled_update = make_shared<DisplacementFieldType> (DisplacementFieldType::scratch (update));
+          std::shared_ptr<DisplacementFieldType> composed = make_shared<DisplacementFieldType> (DisplacementFieldType::scratch (update));
 
           // Scaling
           default_type scaled_step = step / scale_factor; // apply the step size and scale factor at once
           ThreadedLoop (update).run (
-                [&scaled_step](Image<default_type>& update, Image<default_type>& scaled_update) {
+                [&scaled_step](DisplacementFieldType& update, DisplacementFieldType& scaled_update) {
                   scaled_update.row(3) = Eigen::Vector3d (update.row(3)) * scaled_step;
                 }, update, *scaled_update);
 
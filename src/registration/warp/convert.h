@@ -35,7 +35,7 @@ namespace MR
         MR::Transform transform (input);
         auto kernel = [&] (ImageType& input, ImageType& output) {
           Eigen::Vector3d voxel ((default_type)input.index(0), (default_type)input.index(1), (default_type)input.index(2));
-          output.row(3) = (transform.voxel2scanner * voxel).template cast<typename ImageType::value_type> () + Eigen::Vector3d (input.row(3));
+          output.row(3) = transform.voxel2scanner * voxel + Eigen::Vector3d (input.row(3));
         };
         ThreadedLoop (input, 0, 3).run (kernel, input, output);
       }
@@ -17,9 +17,15 @@
 #ifndef __registration_warp_invert_h__
 #define __registration_warp_invert_h__
 
+#include <mutex>
+
 #include "image.h"
 #include "interp/linear.h"
+#include "algo/loop.h"
 #include "algo/threaded_loop.h"
+#include "algo/threaded_copy.h"
+#include "adapter/reslice.h"
+#include "filter/resize.h"
 #include "registration/warp/convert.h"
 #include "transform.h"
 
@@ -30,26 +36,75 @@ namespace MR
     namespace Warp
     {
 
+      //! summary of the per-voxel fixed-point iterations performed while inverting a warp
+      class InversionStats { NOMEMALIGN
+        public:
+          InversionStats () : voxels (0), iterations (0), max_iterations (0), unconverged (0), outside (0) { }
+
+          void add (const size_t iter, const default_type error, const default_type error_tolerance) {
+            ++voxels;
+            iterations += iter;
+            max_iterations = std::max (max_iterations, iter);
+            if (!std::isfinite (error))
+              ++outside;
+            else if (error > error_tolerance)
+              ++unconverged;
+          }
+
+          InversionStats& operator+= (const InversionStats& other) {
+            voxels += other.voxels;
+            iterations += other.iterations;
+            max_iterations = std::max (max_iterations, other.max_iterations);
+            unconverged += other.unconverged;
+            outside += other.outside;
+            return *this;
+          }
+
+          default_type mean_iterations () const {
+            return voxels ? default_type (iterations) / default_type (voxels) : 0.0;
+          }
+
+          std::string summary () const {
+            return str(voxels) + " voxels, " + str(mean_iterations(), 3) + " iterations per voxel on average (max "
+              + str(max_iterations) + "), " + str(unconverged) + " voxels not converged, "
+              + str(outside) + " voxels mapped outside the warp";
+          }
+
+          size_t voxels, iterations, max_iterations, unconverged, outside;
+      };
+
+
       namespace {
 
 
-      class DisplacementThreadKernel { MEMALIGN(DisplacementThreadKernel)
+      template <class DisplacementFieldType, class InverseDisplacementFieldType>
+      class DisplacementThreadKernel { MEMALIGN(DisplacementThreadKernel<DisplacementFieldType,InverseDisplacementFieldType>)
 
         public:
-          DisplacementThreadKernel (Image<default_type> & displacement,
-                        Image<default_type> & displacement_inverse,
+          DisplacementThreadKernel (DisplacementFieldType& displacement,
+                        InverseDisplacementFieldType& displacement_inverse,
                         const size_t max_iter,
-                        const default_type error_tol) :
+                        const default_type error_tol,
+                        InversionStats& global_stats) :
                           displacement (displacement),
                           transform (displacement_inverse),
                           max_iter (max_iter),
-                          error_tolerance (error_tol) {}
+                          error_tolerance (error_tol),
+                          global_stats (global_stats),
+                          mutex (new std::mutex) {}
 
-          void operator() (Image<default_type>& displacement_inverse)
+          ~DisplacementThreadKernel () {
+            std::lock_guard<std::mutex> lock (*mutex);
+            global_stats += thread_stats;
+          }
+
+          void operator() (InverseDisplacementFieldType& displacement_inverse)
           {
             Eigen::Vector3d voxel ((default_type)displacement_inverse.index(0), (default_type)displacement_inverse.index(1), (default_type)displacement_inverse.index(2));
             Eigen::Vector3d truth = transform.voxel2scanner * voxel;
             Eigen::Vector3d current = truth + Eigen::Vector3d(displacement_inverse.row(3));
+            if (!current.allFinite())
+              current = truth;
 
             size_t iter = 0;
             default_type error = std::numeric_limits<default_type>::max();
@@ -57,6 +112,7 @@ namespace MR
               error = update (current, truth);
               ++iter;
             }
+            thread_stats.add (iter, error, error_tolerance);
             displacement_inverse.row(3) = current - truth;
           }
 
@@ -65,35 +121,49 @@ namespace MR
           default_type update (Eigen::Vector3d& current, const Eigen::Vector3d& truth)
           {
             displacement.scanner (current);
-            Eigen::Vector3d discrepancy = truth - (current + Eigen::Vector3d (displacement.row(3)));
+            Eigen::Vector3d discrepancy = truth - (current + displacement.row(3).template cast<default_type>());
             current += discrepancy;
             return discrepancy.dot (discrepancy);
           }
 
-          Interp::Linear<Image<default_type> > displacement;
+          Interp::Linear<DisplacementFieldType> displacement;
           MR::Transform transform;
           const size_t max_iter;
           default_type error_tolerance;
+          InversionStats& global_stats;
+          InversionStats thread_stats;
+          std::shared_ptr<std::mutex> mutex;
       };
 
 
-        class DeformationThreadKernel { MEMALIGN(DeformationThreadKernel)
+        template <class DeformationFieldType, class InverseDeformationFieldType>
+        class DeformationThreadKernel { MEMALIGN(DeformationThreadKernel<DeformationFieldType,InverseDeformationFieldType>)
 
           public:
-            DeformationThreadKernel (Image<default_type> & deform,
-                          Image<default_type> & inv_deform,
+            DeformationThreadKernel (DeformationFieldType& deform,
+                          InverseDeformationFieldType& inv_deform,
                           const size_t max_iter,
-                          const default_type error_tol) :
+                          const default_type error_tol,
+                          InversionStats& global_stats) :
                             deform (deform),
                             transform (inv_deform),
                             max_iter (max_iter),
-                            error_tolerance (error_tol) {}
+                            error_tolerance (error_tol),
+                            global_stats (global_stats),
+                            mutex (new std::mutex) {}
+
+            ~DeformationThreadKernel () {
+              std::lock_guard<std::mutex> lock (*mutex);
+              global_stats += thread_stats;
+            }
 
-            void operator() (Image<default_type>& inv_deform)
+            void operator() (InverseDeformationFieldType& inv_deform)
             {
               Eigen::Vector3d voxel ((default_type)inv_deform.index(0), (default_type)inv_deform.index(1), (default_type)inv_deform.index(2));
               Eigen::Vector3d truth = transform.voxel2scanner * voxel;
               Eigen::Vector3d current = inv_deform.row(3);
+              if (!current.allFinite())
+                current = truth;
 
               size_t iter = 0;
               default_type error = std::numeric_limits<default_type>::max();
@@ -101,6 +171,7 @@ namespace MR
                 error = update (current, truth);
                 ++iter;
               }
+              thread_stats.add (iter, error, error_tolerance);
               inv_deform.row(3) = current;
             }
 
@@ -109,16 +180,113 @@ namespace MR
             default_type update (Eigen::Vector3d& current, const Eigen::Vector3d& truth)
             {
               deform.scanner (current);
-              Eigen::Vector3d discrepancy = truth - Eigen::Vector3d (deform.row(3));
+              Eigen::Vector3d discrepancy = truth - deform.row(3).template cast<default_type>();
               current += discrepancy;
               return discrepancy.dot (discrepancy);
             }
 
-            Interp::Linear<Image<default_type> > deform;
+            Interp::Linear<DeformationFieldType> deform;
             MR::Transform transform;
             const size_t max_iter;
             default_type error_tolerance;
+            InversionStats& global_stats;
+            InversionStats thread_stats;
+            std::shared_ptr<std::mutex> mutex;
         };
+
+
+        template <class HeaderType>
+        inline default_type mean_spacing (const HeaderType& header)
+        {
+          return (header.spacing(0) + header.spacing(1) + header.spacing(2)) / 3.0;
+        }
+
+
+        // successively halved versions of the spatial grid, coarsest first,
+        // stopping before any axis would fall below min_size voxels
+        template <class HeaderType>
+        vector<Header> coarse_grids (const HeaderType& fine, const size_t min_size)
+        {
+          vector<Header> grids;
+          Header grid (fine);
+          while (std::min ({ grid.size(0), grid.size(1), grid.size(2) }) >= ssize_t (2 * min_size)) {
+            Filter::Resize resize (grid);
+            resize.set_scale_factor (0.5);
+            grid = Header (resize);
+            grids.push_back (grid);
+          }
+          std::reverse (grids.begin(), grids.end());
+          return grids;
+        }
+
+
+        // deformations are upsampled as displacements, so that fine voxels
+        // beyond the outermost coarse voxel centres start from a sensible estimate
+        template <class CoarseFieldType, class FineFieldType>
+        void upsample (CoarseFieldType& coarse, FineFieldType& fine, const bool is_deformation)
+        {
+          if (is_deformation)
+            deformation2displacement (coarse, coarse);
+          Adapter::Reslice<Interp::Linear, CoarseFieldType> interp (coarse, fine, Adapter::NoTransform,
+              Adapter::AutoOverSample, typename FineFieldType::value_type (0));
+          threaded_copy (interp, fine, 0, 4);
+          if (is_deformation)
+            displacement2deformation (fine, fine);
+        }
+
+
+        template <template <class, class> class KernelType, class FieldType, class InverseFieldType>
+        InversionStats invert_on_grid (FieldType& field, InverseFieldType& inverse, const std::string& message,
+                                       const size_t max_iter, const default_type error_tolerance)
+        {
+          InversionStats stats;
+          ThreadedLoop (message, inverse, 0, 3)
+            .run (KernelType<FieldType,InverseFieldType> (field, inverse, max_iter, error_tolerance, stats), inverse);
+          return stats;
+        }
+
+
+        // Solve for the inverse on a hierarchy of coarser grids first, each
+        // level being initialised with the linearly upsampled solution of the
+        // previous one. The fine grid then starts close to the solution, so
+        // that most voxels terminate within a few fixed-point iterations.
+        template <template <class, class> class KernelType, class FieldType, class InverseFieldType>
+        InversionStats invert_coarse_to_fine (FieldType& field, InverseFieldType& inverse, const bool is_deformation,
+                                              const std::string& message, const size_t max_iter,
+                                              const default_type error_tolerance, const size_t min_size)
+        {
+          using value_type = typename InverseFieldType::value_type;
+          InversionStats stats;
+          Image<value_type> estimate;
+
+          for (const auto& grid : coarse_grids (inverse, min_size)) {
+            auto level = Image<value_type>::scratch (grid, "coarse inverse warp");
+            if (estimate.valid())
+              upsample (estimate, level, is_deformation);
+            else if (is_deformation)
+              displacement2deformation (level, level);
+            auto level_stats = invert_on_grid<KernelType> (field, level,
+                message + " at " + str(grid.size(0)) + "x" + str(grid.size(1)) + "x" + str(grid.size(2)), max_iter,
+                error_tolerance * mean_spacing (level) / mean_spacing (inverse));
+            DEBUG ("warp inversion at grid " + str(grid.size(0)) + "x" + str(grid.size(1)) + "x" + str(grid.size(2)) + ": " + level_stats.summary());
+            stats += level_stats;
+            estimate = level;
+          }
+
+          if (estimate.valid()) {
+            upsample (estimate, inverse, is_deformation);
+          } else if (is_deformation) {
+            displacement2deformation (inverse, inverse);
+          } else {
+            for (auto l = Loop (inverse) (inverse); l; ++l)
+              inverse.value() = value_type (0);
+          }
+
+          auto level_stats = invert_on_grid<KernelType> (field, inverse, message, max_iter, error_tolerance);
+          DEBUG ("warp inversion at full resolution: " + level_stats.summary());
+          stats += level_stats;
+          return stats;
+        }
       }
 
 
@@ -126,42 +294,68 @@ namespace MR
         @{ */
 
           /*! Estimate the inverse of a deformation field
-           * Note that the output inv_warp can be passed as either a zero field or an initial estimate
+           * Note that the output inv_warp can be passed as either a zero field or an initial estimate.
+           * If no initial estimate is provided, the inverse is first solved on successively finer
+           * grids (down to \p min_size voxels along each axis), and each level initialised from the
+           * upsampled solution of the previous one.
            */
-          FORCE_INLINE void invert_deformation (Image<default_type>& deform_field, Image<default_type>& inv_deform_field, bool is_initialised = false, size_t max_iter = 50, default_type error_tolerance = 0.0001)
+          template <class DeformationFieldType, class InverseDeformationFieldType>
+          FORCE_INLINE InversionStats invert_deformation (DeformationFieldType& deform_field, InverseDeformationFieldType& inv_deform_field, bool is_initialised = false, size_t max_iter = 50, default_type error_tolerance = 0.0001, size_t min_size = 16)
           {
             check_dimensions (deform_field, inv_deform_field);
-            error_tolerance *= (deform_field.spacing(0) + deform_field.spacing(1) + deform_field.spacing(2)) / 3;
-
-            if (!is_initialised)
-              displacement2deformation (inv_deform_field, inv_deform_field);
-
-            ThreadedLoop ("inverting warp field...", inv_deform_field, 0, 3)
-              .run (DeformationThreadKernel (deform_field, inv_deform_field, max_iter, error_tolerance), inv_deform_field);
+            error_tolerance *= mean_spacing (deform_field);
+
+            InversionStats stats;
+            if (is_initialised)
+              stats = invert_on_grid<DeformationThreadKernel> (deform_field, inv_deform_field, "inverting warp field...", max_iter, error_tolerance);
+            else
+              stats = invert_coarse_to_fine<DeformationThreadKernel> (deform_field, inv_deform_field, true, "inverting warp field", max_iter, error_tolerance, min_size);
+            INFO ("warp inversion: " + stats.summary());
+            return stats;
           }
 
           /*! Estimate the inverse of a displacement field, output the inverse as a deformation field
            * Note that the output inv_warp can be passed as either a zero field or an initial estimate (as a deformation field)
            */
-          FORCE_INLINE void invert_displacement_deformation (Image<default_type>& disp, Image<default_type>& inv_deform, bool is_initialised = false, size_t max_iter = 50, default_type error_tolerance = 0.0001)
+          template <class DisplacementFieldType, class InverseDeformationFieldType>
+          FORCE_INLINE InversionStats invert_displacement_deformation (DisplacementFieldType& disp, InverseDeformationFieldType& inv_deform, bool is_initialised = false, size_t max_iter = 50, default_type error_tolerance = 0.0001)
           {
-            auto deform_field = Image<default_type>::scratch (disp);
+            auto deform_field = DisplacementFieldType::scratch (disp);
             Warp::displacement2deformation (disp, deform_field);
 
-            invert_deformation (deform_field, inv_deform, is_initialised, max_iter, error_tolerance);
+            return invert_deformation (deform_field, inv_deform, is_initialised, max_iter, error_tolerance);
          }
 
 
           /*! Estimate the inverse of a displacement field
            * Note that the output inv_warp can be passed as either a zero field or an initial estimate
            */
-          FORCE_INLINE void invert_displacement (Image<default_type>& disp_field, Image<default_type>& inv_disp_field, size_t max_iter = 50, default_type error_tolerance = 0.0001)
+          template <class DisplacementFieldType, class InverseDisplacementFieldType>
+          FORCE_INLINE InversionStats invert_displacement (DisplacementFieldType& disp_field, InverseDisplacementFieldType& inv_disp_field, size_t max_iter = 50, default_type error_tolerance = 0.0001)
+          {
+            check_dimensions (disp_field, inv_disp_field);
+            error_tolerance *= mean_spacing (disp_field);
+
+            auto stats = invert_on_grid<DisplacementThreadKernel> (disp_field, inv_disp_field, "inverting displacement field...", max_iter, error_tolerance);
+            INFO ("displacement field inversion: " + stats.summary());
+            return stats;
+          }
+
+
+          /*! Estimate the inverse of a displacement field from scratch, coarse-to-fine
+           * The initial contents of inv_disp_field are ignored: the inverse is first solved on
+           * successively finer grids (down to \p min_size voxels along each axis), with each level
+           * initialised from the upsampled solution of the previous one.
+           */
+          template <class DisplacementFieldType, class InverseDisplacementFieldType>
+          FORCE_INLINE InversionStats invert_displacement_coarse_to_fine (DisplacementFieldType& disp_field, InverseDisplacementFieldType& inv_disp_field, size_t max_iter = 50, default_type error_tolerance = 0.0001, size_t min_size = 16)
           {
             check_dimensions (disp_field, inv_disp_field);
-            error_tolerance *= (disp_field.spacing(0) + disp_field.spacing(1) + disp_field.spacing(2)) / 3;
+            error_tolerance *= mean_spacing (disp_field);
 
-            ThreadedLoop ("inverting displacement field...", inv_disp_field, 0, 3)
-              .run (DisplacementThreadKernel (disp_field, inv_disp_field, max_iter, error_tolerance), inv_disp_field);
+            auto stats = invert_coarse_to_fine<DisplacementThreadKernel> (disp_field, inv_disp_field, false, "inverting displacement field", max_iter, error_tolerance, min_size);
+            INFO ("displacement field inversion: " + stats.summary());
+            return stats;
           }
 
 
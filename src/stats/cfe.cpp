@@ -28,8 +28,9 @@ namespace MR
               const value_type E,
               const value_type H,
               const value_type C,
-              const bool norm) :
-        matrix (connectivity_matrix),
+              const bool norm,
+              const bool quantise) :
+        matrix (connectivity_matrix, C, quantise),
         dh (dh),
         E (E),
         H (H),
@@ -41,45 +42,51 @@ namespace MR
     void CFE::operator() (in_column_type stats, out_column_type enhanced_stats) const
     {
       enhanced_stats.setZero();
-      vector<default_type> connected_stats;
+      std::unique_ptr<Scratch> scratch;
+      {
+        std::lock_guard<std::mutex> lock (scratch_mutex);
+        if (scratch_pool.size()) {
+          scratch = std::move (scratch_pool.back());
+          scratch_pool.pop_back();
+        }
+      }
+      if (!scratch)
+        scratch.reset (new Scratch);
+      auto& extents (scratch->extents);
+      auto& h_pow_H (scratch->h_pow_H);
       for (size_t fixel = 0; fixel < matrix.size(); ++fixel) {
         if (stats[fixel] < dh)
           continue;
-        auto connections = matrix[fixel];
-        // Need to re-normalise based on the value of the power C
-        if (C != 1.0) {
-          default_type sum = 0.0;
-          for (auto& c : connections) {
-            c.exponentiate (C);
-            sum += c.value();
-          }
-          connections.normalise (Fixel::Matrix::connectivity_value_type (sum));
-        }
         // Rather than allocating data for the stats and then looping over dh,
-        //   divide statistic by dh to determine the number of cluster sizes that should
-        //   be incremented, and dynamically increment all cluster sizes for that
-        //   particular connected fixel
-        vector<Fixel::Matrix::connectivity_value_type> extents (std::floor (stats[fixel]/dh), Fixel::Matrix::connectivity_value_type(0));
-        for (const auto& connection : connections) {
-          const default_type connection_stat = stats[connection.index()];
-          if (connection_stat > dh) {
-            const size_t cluster_count = std::min (extents.size(), size_t(std::floor (connection_stat / dh)));
-            for (size_t cluster_index = 0; cluster_index != cluster_count; ++cluster_index)
-              extents[cluster_index] += connection.value();
-          }
-        }
-        // Pre-calculate h^H
-        if (h_pow_H.size() < extents.size()) {
-          const size_t old_size = h_pow_H.size();
-          h_pow_H.resize (extents.size());
-          for (size_t ih = old_size; ih != h_pow_H.size(); ++ih)
+        //   divide statistic by dh to determine the number of cluster sizes that
+        //   should be incremented by each connected fixel; this is done by
+        //   incrementing only the largest such cluster size, and subsequently
+        //   computing the extents of all cluster sizes via a suffix sum
+        const ssize_t num_bins = std::floor (stats[fixel]/dh);
+        if (h_pow_H.size() < num_bins) {
+          // Pre-calculate h^H
+          const ssize_t old_size = h_pow_H.size();
+          h_pow_H.conservativeResize (num_bins);
+          extents.resize (num_bins);
+          for (ssize_t ih = old_size; ih != num_bins; ++ih)
             h_pow_H[ih] = std::pow (dh*(ih+1), H);
         }
-        for (size_t cluster_index = 0; cluster_index != extents.size(); ++cluster_index)
-          enhanced_stats[fixel] += std::pow (extents[cluster_index], E) * h_pow_H[cluster_index];
+        auto bins = extents.head (num_bins);
+        bins.setZero();
+        matrix.visit (fixel, [&] (const Fixel::Matrix::fixel_index_type index, const Fixel::Matrix::connectivity_value_type value)
+        {
+          const default_type connection_stat = stats[index];
+          if (connection_stat > dh)
+            bins[std::min (num_bins, ssize_t(std::floor (connection_stat / dh))) - 1] += value;
+        });
+        for (ssize_t cluster_index = num_bins - 2; cluster_index >= 0; --cluster_index)
+          bins[cluster_index] += bins[cluster_index+1];
+        enhanced_stats[fixel] = (bins.pow (E) * h_pow_H.head (num_bins)).sum();
         if (normalise)
-          enhanced_stats[fixel] *= connections.norm_multiplier;
+          enhanced_stats[fixel] *= matrix.norm_multiplier (fixel);
       }
+      std::lock_guard<std::mutex> lock (scratch_mutex);
+      scratch_pool.push_back (std::move (scratch));
     }
 
 
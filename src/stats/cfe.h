@@ -17,6 +17,9 @@
 #ifndef __stats_cfe_h__
 #define __stats_cfe_h__
 
+#include <memory>
+#include <mutex>
+
 #include "types.h"
 #include "math/stats/typedefs.h"
 #include "stats/enhance.h"
@@ -36,17 +39,31 @@ namespace MR
 
     class CFE : public Stats::EnhancerBase { MEMALIGN (CFE)
       public:
+        // The connectivity matrix is loaded into memory upon construction,
+        //   with the connectivity exponent C & normalisation pre-applied;
+        //   set quantise to store connectivity values using 16 bits
         CFE (const Fixel::Matrix::Reader& connectivity_matrix,
              const value_type dh, const value_type E, const value_type H, const value_type C,
-             const bool norm);
+             const bool norm, const bool quantise = false);
         virtual ~CFE() { }
 
       protected:
-        Fixel::Matrix::Reader matrix;
+        // Scratch buffers for a single thread, re-used across fixels and across calls:
+        //   cumulative histogram of connectivity per cluster size, and pre-calculated h^H
+        class Scratch { NOMEMALIGN
+          public:
+            Eigen::Array<default_type, Eigen::Dynamic, 1> extents, h_pow_H;
+        };
+
+        const Fixel::Matrix::CSR matrix;
         const value_type dh, E, H, C;
         const bool normalise;
 
-        mutable vector<value_type> h_pow_H;
+        // The enhancer is shared between threads; each call takes a set of
+        //   scratch buffers from this pool, and returns it once complete, such
+        //   that there are only ever as many sets as there are concurrent threads
+        mutable std::mutex scratch_mutex;
+        mutable vector<std::unique_ptr<Scratch>> scratch_pool;
 
         void operator() (in_column_type, out_column_type) const override;
     };
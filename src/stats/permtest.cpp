@@ -16,6 +16,8 @@
 
 #include "stats/permtest.h"
 
+#include <algorithm>
+
 namespace MR
 {
   namespace Stats
@@ -25,6 +27,88 @@ namespace MR
 
 
 
+      namespace
+      {
+
+        // Adaptive permutation testing: shuffles are processed in batches of
+        //   geometrically increasing size, and after each batch the family-wise
+        //   p-value of every element is checked for whether it has been resolved
+        constexpr size_t adaptive_initial_batch = 200;
+        constexpr default_type adaptive_batch_growth = 1.5;
+        // Two-sided 99.9% confidence; stringent since the decision is revisited after every batch
+        constexpr default_type adaptive_z = 3.2905;
+
+
+
+        // Draw no more than a fixed number of shuffles from the shuffler
+        class BatchSource { NOMEMALIGN
+          public:
+            BatchSource (Math::Stats::Shuffler& shuffler, const size_t count) :
+                shuffler (shuffler),
+                remaining (count),
+                taken (0) { }
+
+            bool operator() (Math::Stats::Shuffle& output)
+            {
+              if (!remaining || !shuffler (output))
+                return false;
+              --remaining;
+              ++taken;
+              return true;
+            }
+
+            size_t count() const { return taken; }
+
+          private:
+            Math::Stats::Shuffler& shuffler;
+            size_t remaining, taken;
+        };
+
+
+
+        // Whether the Wilson score interval for the family-wise p-value of every element,
+        //   based on the first num_shuffles rows of the null distribution, either excludes
+        //   the significance threshold alpha or has a half-width less than the requested precision
+        bool fwe_resolved (const matrix_type& null_dist,
+                           const size_t num_shuffles,
+                           const matrix_type& default_enhanced_statistics,
+                           const default_type alpha,
+                           const default_type precision)
+        {
+          const default_type n = default_type(num_shuffles);
+          const default_type z2 = Math::pow2 (adaptive_z);
+          vector<value_type> sorted_null_dist (num_shuffles);
+          for (ssize_t ih = 0; ih != default_enhanced_statistics.cols(); ++ih) {
+            const ssize_t null_col = null_dist.cols() == 1 ? 0 : ih;
+            for (size_t shuffle = 0; shuffle != num_shuffles; ++shuffle)
+              sorted_null_dist[shuffle] = null_dist (shuffle, null_col);
+            std::sort (sorted_null_dist.begin(), sorted_null_dist.end());
+            for (ssize_t ie = 0; ie != default_enhanced_statistics.rows(); ++ie) {
+              const value_type stat = default_enhanced_statistics (ie, ih);
+              // Non-positive (and non-finite) statistics are assigned p=1 regardless
+              if (!(stat > 0.0))
+                continue;
+              const size_t exceedances = sorted_null_dist.end() - std::upper_bound (sorted_null_dist.begin(), sorted_null_dist.end(), stat);
+              const default_type p = default_type(exceedances) / n;
+              const default_type denominator = 1.0 + z2 / n;
+              const default_type centre = (p + 0.5 * z2 / n) / denominator;
+              const default_type half_width = adaptive_z * std::sqrt (p * (1.0 - p) / n + 0.25 * z2 / Math::pow2 (n)) / denominator;
+              if (centre + half_width < alpha || centre - half_width > alpha || half_width < precision)
+                continue;
+              return false;
+            }
+          }
+          return true;
+        }
+
+      }
+
+
+
+
+
+
+
       PreProcessor::PreProcessor (const std::shared_ptr<Math::Stats::GLM::TestBase> stats_calculator,
                                   const std::shared_ptr<EnhancerBase> enhancer,
                                   const default_type skew,
@@ -224,7 +308,39 @@ namespace MR
         null_dist_contributions = count_matrix_type::Zero (stats_calculator->num_elements(), stats_calculator->num_hypotheses());
 
         count_matrix_type global_uncorrected_pvalue_count (count_matrix_type::Zero (stats_calculator->num_elements(), stats_calculator->num_hypotheses()));
-        {
+        size_t num_shuffles = shuffler.size();
+        auto opt = App::get_options ("adaptive");
+        if (opt.size()) {
+          const default_type precision = opt[0][0];
+          const default_type alpha = App::get_option_value ("adaptive_alpha", DEFAULT_ADAPTIVE_ALPHA);
+          num_shuffles = 0;
+          size_t batch_size = adaptive_initial_batch;
+          while (true) {
+            BatchSource source (shuffler, batch_size);
+            {
+              Processor processor (stats_calculator, enhancer,
+                                   empirical_enhanced_statistic,
+                                   default_enhanced_statistics,
+                                   null_dist,
+                                   null_dist_contributions,
+                                   global_uncorrected_pvalue_count);
+              Thread::run_queue (source, Math::Stats::Shuffle(), Thread::multi (processor));
+            }
+            num_shuffles += source.count();
+            if (source.count() < batch_size || num_shuffles == shuffler.size())
+              break;
+            if (fwe_resolved (null_dist, num_shuffles, default_enhanced_statistics, alpha, precision)) {
+              INFO ("Family-wise error p-values resolved after " + str(num_shuffles) + " of " + str(shuffler.size()) + " shuffles");
+              break;
+            }
+            batch_size = std::ceil (batch_size * adaptive_batch_growth);
+          }
+          // The shuffler itself only finalises its progress bar on being exhausted
+          shuffler.done();
+          null_dist.conservativeResize (num_shuffles, null_dist.cols());
+        } else {
+          if (App::get_options ("adaptive_alpha").size())
+            WARN ("Option -adaptive_alpha has no effect unless -adaptive is also specified");
           Processor processor (stats_calculator, enhancer,
                                empirical_enhanced_statistic,
                                default_enhanced_statistics,
@@ -233,7 +349,7 @@ namespace MR
                                global_uncorrected_pvalue_count);
           Thread::run_queue (shuffler, Math::Stats::Shuffle(), Thread::multi (processor));
         }
-        uncorrected_pvalues = global_uncorrected_pvalue_count.cast<default_type>() / default_type(shuffler.size());
+        uncorrected_pvalues = global_uncorrected_pvalue_count.cast<default_type>() / default_type(num_shuffles);
       }
 
 
@@ -0,0 +1,186 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#include "command.h"
+#include "header.h"
+#include "image.h"
+#include "algo/loop.h"
+#include "interp/linear.h"
+#include "interp/masked.h"
+#include "dwi/tractography/ACT/tissue_lookup.h"
+
+using namespace MR;
+using namespace App;
+using namespace MR::DWI::Tractography::ACT;
+
+void usage ()
+{
+  AUTHOR = "Robert E. Smith (robert.smith@florey.edu.au)";
+  SYNOPSIS = "Verify that the ACT tissue lookup matches masked linear interpolation of the 5TT image";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+inline float clamp01 (const float x) { return std::min (1.0f, std::max (0.0f, x)); }
+
+// Summation order may differ from that of Interp::Linear
+inline bool matches (const float a, const float b) { return std::abs (a - b) <= 1e-6f; }
+
+
+
+// Spherical head phantom, in voxel coordinates: a WM core containing a
+//   subcortical GM nucleus and a small lesion, surrounded by cortical GM and
+//   CSF, with partial volume at each boundary, and empty background beyond
+class Phantom
+{ NOMEMALIGN
+  public:
+    Phantom () : centre (11.5, 11.5, 9.5), nucleus (centre + Eigen::Vector3d (3.0, 0.0, 0.0)), lesion (8, 12, 9) { }
+
+    // false if the voxel contains no tissue
+    bool tissues (const Eigen::Vector3d& voxel, float* t) const
+    {
+      const float r = (voxel - centre).norm();
+      if (r > 11.0f)
+        return false;
+      t[2] = clamp01 ((7.5f - r) / 2.0f);
+      t[3] = clamp01 ((r - 8.5f) / 1.5f);
+      t[0] = 1.0f - t[2] - t[3];
+      t[4] = 0.0f;
+      const float sgm = 0.8f * clamp01 (2.5f - (voxel - nucleus).norm());
+      t[1] = sgm * t[2];
+      t[2] -= t[1];
+      if (voxel.cast<int>() == lesion) {
+        t[4] = 0.6f;
+        t[2] -= 0.6f;
+      }
+      return true;
+    }
+
+    // whether the voxel is pure WM
+    bool pure_wm (const Eigen::Vector3d& voxel) const
+    {
+      float t[5];
+      return tissues (voxel, t) && t[2] == 1.0f;
+    }
+
+    const Eigen::Vector3d centre, nucleus;
+    const Eigen::Vector3i lesion;
+};
+
+
+
+void run ()
+{
+  vector<std::string> failed_tests;
+  auto test = [&] (const bool result, const std::string msg) {
+    if (!result)
+      failed_tests.push_back (msg);
+  };
+
+  const Phantom phantom;
+  Header H;
+  H.ndim() = 4;
+  H.size(0) = H.size(1) = 24; H.size(2) = 20; H.size(3) = 5;
+  H.spacing(0) = H.spacing(1) = 1.0; H.spacing(2) = 1.2; H.spacing(3) = NaN;
+  H.transform().setIdentity();
+  H.transform().translation() = Eigen::Vector3d (-12.0, -14.0, 2.0);
+  H.datatype() = DataType::Float32;
+  auto image = Image<float>::scratch (H, "5TT phantom");
+
+  size_t nonempty = 0;
+  for (auto l = Loop (image, 0, 3) (image); l; ++l) {
+    float t[5];
+    if (!phantom.tissues (Eigen::Vector3d (image.index(0), image.index(1), image.index(2)), t))
+      continue;
+    ++nonempty;
+    for (image.index(3) = 0; image.index(3) != 5; ++image.index(3))
+      image.value() = t[image.index(3)];
+  }
+
+  TissueLookup lookup (image);
+  test (lookup.num_voxels() == nonempty, "Tissue lookup holds " + str(lookup.num_voxels()) + " voxels; expected " + str(nonempty));
+
+  // Interpolation cells whose corners are all pure WM must be flagged as WM interior;
+  //   cells with any corner that is not predominantly WM must not be
+  const Transform transform (image);
+  size_t pure_cells = 0;
+  for (int z = 0; z + 1 < H.size(2); ++z) {
+    for (int y = 0; y + 1 < H.size(1); ++y) {
+      for (int x = 0; x + 1 < H.size(0); ++x) {
+        bool all_pure = true, any_other = false;
+        for (int c = 0; c != 8; ++c) {
+          const Eigen::Vector3d corner (x + (c & 1), y + ((c >> 1) & 1), z + (c >> 2));
+          float t[5];
+          const bool has_tissue = phantom.tissues (corner, t);
+          all_pure = all_pure && phantom.pure_wm (corner);
+          any_other = any_other || !has_tissue || t[2] <= t[0] + t[1] || t[2] <= t[3] || t[2] <= t[4];
+        }
+        const Eigen::Vector3f centre ((transform.voxel2scanner * Eigen::Vector3d (x + 0.5, y + 0.5, z + 0.5)).cast<float>());
+        const bool flagged = lookup.in_wm_interior (centre);
+        if (all_pure) {
+          ++pure_cells;
+          test (flagged, "Cell [ " + str(x) + " " + str(y) + " " + str(z) + " ] with pure WM corners not flagged as WM interior");
+        }
+        if (any_other)
+          test (!flagged, "Cell [ " + str(x) + " " + str(y) + " " + str(z) + " ] with non-WM corners flagged as WM interior");
+      }
+    }
+  }
+  test (pure_cells && lookup.num_wm_interior() >= pure_cells,
+        str(lookup.num_wm_interior()) + " cells flagged as WM interior; expected at least " + str(pure_cells));
+
+  // Rays from the centre of the phantom, through each tissue boundary and out of the image
+  Interp::Masked<Interp::Linear<Image<float>>> interp (image);
+  Tissues reference, result;
+  size_t mismatches = 0, interior_errors = 0, num_wm = 0, num_gm = 0, num_csf = 0, num_outside = 0;
+  for (int d = 0; d != 27; ++d) {
+    const Eigen::Vector3d direction = Eigen::Vector3d (d % 3 - 1.0, (d / 3) % 3 - 1.0, d / 9 - 1.0).normalized();
+    if (!direction.allFinite())
+      continue;
+    for (default_type distance = 0.0; distance < 16.0; distance += 0.037) {
+      const Eigen::Vector3f position ((transform.voxel2scanner * (phantom.centre + distance * direction)).cast<float>());
+      const bool expected = interp.scanner (position) ? reference.set (interp) : (reference.reset(), false);
+      const bool valid = lookup.interpolate (position, result);
+      if (valid != expected || !matches (result.get_cgm(), reference.get_cgm()) || !matches (result.get_sgm(), reference.get_sgm())
+          || !matches (result.get_wm(), reference.get_wm()) || !matches (result.get_csf(), reference.get_csf())
+          || !matches (result.get_path(), reference.get_path()))
+        ++mismatches;
+      if (lookup.in_wm_interior (position) && (!expected || !reference.is_wm()))
+        ++interior_errors;
+      if (!expected)
+        ++num_outside;
+      else if (reference.is_wm())
+        ++num_wm;
+      else if (reference.is_gm())
+        ++num_gm;
+      else if (reference.is_csf())
+        ++num_csf;
+    }
+  }
+  test (!mismatches, "Tissue lookup differs from masked interpolation at " + str(mismatches) + " positions");
+  test (!interior_errors, str(interior_errors) + " positions within WM interior cells are not valid WM");
+  test (num_wm && num_gm && num_csf && num_outside, "Rays did not traverse every tissue boundary (WM " + str(num_wm) + ", GM " + str(num_gm)
+        + ", CSF " + str(num_csf) + ", invalid " + str(num_outside) + ")");
+
+  if (failed_tests.size()) {
+    Exception e (str(failed_tests.size()) + " tests of ACT::TissueLookup failed:");
+    for (auto s : failed_tests)
+      e.push_back (s);
+    throw e;
+  }
+}
@@ -0,0 +1,164 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include <chrono>
+#include <future>
+
+#include "command.h"
+#include "header.h"
+#include "thread.h"
+#include "dwi/tractography/GT/particlegrid.h"
+#include "dwi/tractography/GT/blockscheduler.h"
+
+using namespace MR;
+using namespace App;
+using namespace MR::DWI::Tractography::GT;
+
+void usage ()
+{
+  AUTHOR = "Daan Christiaens (daan.christiaens@kcl.ac.uk)";
+  SYNOPSIS = "Verify that global tractography block scheduling terminates, both on completion and on failure of a sampler thread";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+const size_t num_threads = 4;
+
+
+
+// Mimics the block loop of MHSampler::execute(); the thread whose index
+//   matches fail_thread throws once it has passed fail_after synchronisation
+//   points, and the first to exhaust the block budget finishes sampling
+class Worker
+{ MEMALIGN(Worker)
+  public:
+    Worker (BlockScheduler& scheduler, const ParticleGrid& grid, std::atomic<size_t>& counter,
+            std::atomic<size_t>& blocks, const size_t budget, const size_t fail_thread, const size_t fail_after) :
+        scheduler (scheduler),
+        grid (grid),
+        counter (counter),
+        blocks (blocks),
+        budget (budget),
+        fail_thread (fail_thread),
+        fail_after (fail_after) { }
+
+    void execute ()
+    {
+      const size_t index = counter++;
+      BlockScheduler::Block blk (grid);
+      size_t syncs = 0;
+      try {
+        while (scheduler.sync()) {
+          if (index == fail_thread && ++syncs > fail_after)
+            throw Exception ("simulated sampler failure");
+          while (scheduler.next_block (blk)) {
+            if (++blocks >= budget)
+              scheduler.finish();
+          }
+        }
+      } catch (...) {
+        scheduler.abort();
+        throw;
+      }
+    }
+
+  private:
+    BlockScheduler& scheduler;
+    const ParticleGrid& grid;
+    std::atomic<size_t>& counter;
+    std::atomic<size_t>& blocks;
+    const size_t budget, fail_thread, fail_after;
+};
+
+
+
+// Run the workers, returning false if they fail to terminate within a
+//   generous time limit (in which case the test cannot proceed)
+bool run_workers (const Header& H, Image<bool>& mask, const size_t budget, const size_t fail_thread, const size_t fail_after,
+                  size_t& blocks, bool& threw)
+{
+  auto task = std::make_shared<std::packaged_task<std::pair<size_t,bool>()>> ([=, &mask] {
+    ParticleGrid grid (H);
+    BlockScheduler scheduler (grid, H, mask, num_threads);
+    std::atomic<size_t> counter (0), nblocks (0);
+    Worker worker (scheduler, grid, counter, nblocks, budget, fail_thread, fail_after);
+    bool caught = false;
+    try {
+      Thread::run (Thread::multi (worker, num_threads), "block scheduler test").wait();
+    } catch (Exception&) {
+      caught = true;
+    }
+    return std::make_pair (size_t (nblocks), caught);
+  });
+  auto result = task->get_future();
+  std::thread thread ([task] { (*task)(); });
+  if (result.wait_for (std::chrono::seconds (30)) != std::future_status::ready) {
+    thread.detach();
+    return false;
+  }
+  thread.join();
+  const auto value = result.get();
+  blocks = value.first;
+  threw = value.second;
+  return true;
+}
+
+
+
+void run ()
+{
+  vector<std::string> failed_tests;
+  auto test = [&] (const bool result, const std::string msg) {
+    if (!result)
+      failed_tests.push_back (msg);
+  };
+
+  Header H;
+  H.ndim() = 3;
+  for (size_t axis = 0; axis != 3; ++axis) {
+    H.size(axis) = 24;
+    H.spacing(axis) = 2.0;
+  }
+  H.transform().setIdentity();
+  Image<bool> mask;
+
+  size_t blocks = 0;
+  bool threw = false;
+
+  // Normal termination once the budget is exhausted
+  if (!run_workers (H, mask, 500, num_threads, 0, blocks, threw))
+    throw Exception ("Block scheduler failed to terminate after exhausting the block budget");
+  test (!threw, "Exception thrown by block scheduler in the absence of any failure");
+  test (blocks >= 500, "Block scheduler terminated after " + str(blocks) + " blocks; expected at least 500");
+
+  // A failing thread must release the others from the barrier, whether it
+  //   fails before the first colour or after several
+  for (const size_t fail_after : { size_t(0), size_t(1), size_t(5) }) {
+    for (const size_t fail_thread : { size_t(0), num_threads-1 }) {
+      if (!run_workers (H, mask, std::numeric_limits<size_t>::max(), fail_thread, fail_after, blocks, threw))
+        throw Exception ("Block scheduler failed to terminate when thread " + str(fail_thread) + " failed after " + str(fail_after) + " colours");
+      test (threw, "Exception not propagated when thread " + str(fail_thread) + " failed after " + str(fail_after) + " colours");
+    }
+  }
+
+  if (failed_tests.size()) {
+    Exception e (str(failed_tests.size()) + " tests of BlockScheduler failed:");
+    for (auto s : failed_tests)
+      e.push_back (s);
+    throw e;
+  }
+}
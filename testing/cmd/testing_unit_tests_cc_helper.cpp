@@ -0,0 +1,181 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#include "command.h"
+#include "header.h"
+#include "image.h"
+#include "algo/loop.h"
+#include "math/rng.h"
+#include "registration/metric/cc_helper.h"
+
+using namespace MR;
+using namespace App;
+
+void usage ()
+{
+  AUTHOR = "Max Pietsch (maximilian.pietsch@kcl.ac.uk)";
+  SYNOPSIS = "Verify that the box-sum local cross-correlation terms match a direct neighbourhood computation";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+const ssize_t dims[3] = { 13, 9, 7 };
+
+
+
+// Direct evaluation of the cross-correlation terms of one voxel, over all
+//   voxels within the (truncated) neighbourhood that lie within both masks
+//   and have finite intensities in both images
+Eigen::Matrix<default_type, 5, 1> naive_cc (Image<default_type>& im1, Image<default_type>& im2, Image<bool>& mask,
+                                            const vector<size_t>& extent)
+{
+  const ssize_t centre[3] = { im1.index(0), im1.index(1), im1.index(2) };
+  const default_type v1 = im1.value(), v2 = im2.value();
+  default_type n = 0.0, s1 = 0.0, s2 = 0.0, s11 = 0.0, s22 = 0.0, s12 = 0.0;
+  ssize_t lo[3], hi[3];
+  for (size_t axis = 0; axis != 3; ++axis) {
+    const ssize_t radius = (extent[axis] - 1) / 2;
+    lo[axis] = std::max (centre[axis] - radius, ssize_t(0));
+    hi[axis] = std::min (centre[axis] + radius, dims[axis] - 1);
+  }
+  for (ssize_t z = lo[2]; z <= hi[2]; ++z) {
+    for (ssize_t y = lo[1]; y <= hi[1]; ++y) {
+      for (ssize_t x = lo[0]; x <= hi[0]; ++x) {
+        im1.index(0) = im2.index(0) = x; im1.index(1) = im2.index(1) = y; im1.index(2) = im2.index(2) = z;
+        if (mask.valid()) {
+          assign_pos_of (im1, 0, 3).to (mask);
+          if (!mask.value())
+            continue;
+        }
+        const default_type a = im1.value(), b = im2.value();
+        if (std::isnan (a) || std::isnan (b))
+          continue;
+        n += 1.0; s1 += a; s2 += b; s11 += a*a; s22 += b*b; s12 += a*b;
+      }
+    }
+  }
+  for (size_t axis = 0; axis != 3; ++axis)
+    im1.index(axis) = im2.index(axis) = centre[axis];
+  Eigen::Matrix<default_type, 5, 1> result;
+  if (!n) {
+    result.fill (NaN);
+    return result;
+  }
+  result << s12 - s1*s2/n, s11 - s1*s1/n, s22 - s2*s2/n, v1 - s1/n, v2 - s2/n;
+  return result;
+}
+
+
+
+void run ()
+{
+  vector<std::string> failed_tests;
+  auto test = [&] (const bool result, const std::string msg) {
+    if (!result)
+      failed_tests.push_back (msg);
+  };
+
+  Header H;
+  H.ndim() = 3;
+  for (size_t axis = 0; axis != 3; ++axis) {
+    H.size(axis) = dims[axis];
+    H.spacing(axis) = 1.0;
+  }
+  H.transform().setIdentity();
+  H.datatype() = DataType::Float64;
+
+  // Correlated random images, with a few NaNs, and a mask containing holes
+  Math::RNG::Normal<default_type> rng;
+  auto im1 = Image<default_type>::scratch (H, "image 1");
+  auto im2 = Image<default_type>::scratch (H, "image 2");
+  auto mask = Image<bool>::scratch (H, "mask");
+  size_t count = 0;
+  for (auto l = Loop (im1) (im1, im2, mask); l; ++l, ++count) {
+    const default_type value = 100.0 + 10.0 * rng();
+    im1.value() = value;
+    im2.value() = 0.5 * value + 5.0 * rng();
+    if (count % 37 == 5)
+      im1.value() = NaN;
+    if (count % 41 == 7)
+      im2.value() = NaN;
+    mask.value() = (count % 11) != 3 && im1.index(0) < 11;
+  }
+
+  Image<bool> no_mask;
+  Image<default_type> sums;
+  for (const auto& extent : vector<vector<size_t>> { { 3, 3, 3 }, { 5, 3, 1 }, { 9, 9, 9 } }) {
+    for (const bool masked : { false, true }) {
+      const std::string config = "extent " + str(extent) + (masked ? " with mask" : " without mask");
+      Image<bool>& m (masked ? mask : no_mask);
+
+      auto A = Image<default_type>::scratch (H, "A");
+      auto B = Image<default_type>::scratch (H, "B");
+      auto C = Image<default_type>::scratch (H, "C");
+      auto ms1 = Image<default_type>::scratch (H, "image 1 mean subtracted");
+      auto ms2 = Image<default_type>::scratch (H, "image 2 mean subtracted");
+      // The sums image is allocated on first use, then reused
+      Registration::Metric::cc_precompute (im1, im2, m, m, A, B, C, ms1, ms2, sums, extent);
+
+      size_t mismatches = 0, negative = 0;
+      default_type max_error = 0.0;
+      for (auto l = Loop (im1) (im1, im2, A, B, C, ms1, ms2); l; ++l) {
+        const auto expected = naive_cc (im1, im2, m, extent);
+        const Eigen::Matrix<default_type, 5, 1> result (A.value(), B.value(), C.value(), ms1.value(), ms2.value());
+        if (B.value() < 0.0 || C.value() < 0.0)
+          ++negative;
+        for (size_t i = 0; i != 5; ++i) {
+          if (std::isnan (expected[i]) || std::isnan (result[i])) {
+            if (std::isnan (expected[i]) != std::isnan (result[i]))
+              ++mismatches;
+            continue;
+          }
+          const default_type error = std::abs (result[i] - std::max (expected[i], i == 1 || i == 2 ? 0.0 : -Inf));
+          max_error = std::max (max_error, error / std::max (1.0, std::abs (expected[i])));
+        }
+      }
+      test (!mismatches, str(mismatches) + " box-sum cross-correlation terms differ in validity from direct computation for " + config);
+      test (max_error < 1e-9, "Maximal relative error of box-sum cross-correlation terms " + str(max_error) + " for " + config);
+      test (!negative, str(negative) + " negative neighbourhood variances for " + config);
+    }
+  }
+
+  // Constant images: variances are zero up to round-off, and must not be negative
+  for (auto l = Loop (im1) (im1, im2); l; ++l) {
+    im1.value() = 0.1;
+    im2.value() = 1.0e4 / 3.0;
+  }
+  auto A = Image<default_type>::scratch (H, "A");
+  auto B = Image<default_type>::scratch (H, "B");
+  auto C = Image<default_type>::scratch (H, "C");
+  auto ms1 = Image<default_type>::scratch (H, "image 1 mean subtracted");
+  auto ms2 = Image<default_type>::scratch (H, "image 2 mean subtracted");
+  Registration::Metric::cc_precompute (im1, im2, no_mask, no_mask, A, B, C, ms1, ms2, sums, vector<size_t> { 5, 5, 5 });
+  size_t negative = 0;
+  for (auto l = Loop (B) (B, C); l; ++l) {
+    if (B.value() < 0.0 || C.value() < 0.0)
+      ++negative;
+  }
+  test (!negative, str(negative) + " negative neighbourhood variances for constant images");
+
+  if (failed_tests.size()) {
+    Exception e (str(failed_tests.size()) + " tests of local cross-correlation precomputation failed:");
+    for (auto s : failed_tests)
+      e.push_back (s);
+    throw e;
+  }
+}
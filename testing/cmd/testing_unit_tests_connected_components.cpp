@@ -0,0 +1,183 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+#include <deque>
+
+#include "command.h"
+#include "filter/connected_components.h"
+
+using namespace MR;
+using namespace App;
+using namespace MR::Filter;
+
+void usage ()
+{
+  AUTHOR = "Robert E. Smith (robert.smith@florey.edu.au)";
+  SYNOPSIS = "Verify grid-based connected components labelling against structures of known topology";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+const vector<size_t> dims { 19, 13, 29, 2 };
+
+
+
+// Mask composed of structures whose connectivity is known:
+// - a comb, whose teeth span most of the third axis and are joined only at
+//   their far end, so that labels from every slab must be merged;
+// - a chain of voxels touching only at their corners;
+// - a pair of voxels touching only along an edge;
+// - two identical blocks in successive volumes;
+// - a 3D checkerboard, all of whose voxels touch only along edges or corners
+bool in_mask (const vector<size_t>& p)
+{
+  const size_t x = p[0], y = p[1], z = p[2], v = p[3];
+  if (v == 0) {
+    if (y == 2 && ((x % 4 == 0 && z < 25) || (z == 24 && x < 17)))
+      return true;
+    for (size_t i = 0; i != 7; ++i) {
+      if (x == 4+i && y == 5+i && z == 3+i)
+        return true;
+    }
+    if ((x == 14 && y == 8 && z == 12) || (x == 15 && y == 9 && z == 12))
+      return true;
+  }
+  if (x >= 12 && x < 15 && y >= 10 && y < 13 && z >= 20 && z < 23)
+    return true;
+  if (v == 1 && x < 4 && y >= 8 && y < 12 && z >= 10 && z < 14)
+    return !((x + y + z) % 2);
+  return false;
+}
+
+
+
+// Position of voxel with linear index i, where axis order[0] varies fastest
+vector<size_t> position (size_t i, const vector<size_t>& order)
+{
+  vector<size_t> p (dims.size());
+  for (const auto axis : order) {
+    p[axis] = i % dims[axis];
+    i /= dims[axis];
+  }
+  return p;
+}
+
+size_t linear_index (const vector<size_t>& p, const vector<size_t>& order)
+{
+  size_t i = 0;
+  for (auto axis = order.rbegin(); axis != order.rend(); ++axis)
+    i = i * dims[*axis] + p[*axis];
+  return i;
+}
+
+
+
+// Straightforward breadth-first flood fill, labelling clusters in order of
+//   their first voxel in linear order
+size_t flood_fill (const vector<uint8_t>& mask, const vector<size_t>& order, const vector<vector<int>>& offsets,
+                   vector<uint32_t>& labels, vector<uint32_t>& sizes)
+{
+  labels.assign (mask.size(), 0);
+  sizes.clear();
+  for (size_t seed = 0; seed != mask.size(); ++seed) {
+    if (!mask[seed] || labels[seed])
+      continue;
+    sizes.push_back (0);
+    labels[seed] = sizes.size();
+    std::deque<size_t> queue (1, seed);
+    while (queue.size()) {
+      const vector<size_t> p = position (queue.front(), order);
+      queue.pop_front();
+      ++sizes.back();
+      for (const auto& o : offsets) {
+        vector<size_t> n (p);
+        bool inside = true;
+        for (size_t axis = 0; axis != dims.size(); ++axis) {
+          const ssize_t value = ssize_t(p[axis]) + o[axis];
+          inside = inside && value >= 0 && value < ssize_t(dims[axis]);
+          n[axis] = value;
+        }
+        if (!inside)
+          continue;
+        const size_t j = linear_index (n, order);
+        if (mask[j] && !labels[j]) {
+          labels[j] = sizes.size();
+          queue.push_back (j);
+        }
+      }
+    }
+  }
+  return sizes.size();
+}
+
+
+
+void run ()
+{
+  vector<std::string> failed_tests;
+  auto test = [&] (const bool result, const std::string msg) {
+    if (!result)
+      failed_tests.push_back (msg);
+  };
+
+  // Expected number of clusters with (6 / 26)-connectivity, for adjacency
+  //   within volumes only, and additionally across volumes
+  const vector<bool> spatial { true, true, true, false }, all { true, true, true, true };
+  const size_t expected_spatial[2] = { 1 + 7 + 2 + 2 + 32, 1 + 1 + 1 + 2 + 1 };
+  const size_t expected_all[2] = { 1 + 7 + 2 + 1 + 32, 1 + 1 + 1 + 1 + 1 };
+
+  for (const auto& order : vector<vector<size_t>> { { 0, 1, 2, 3 }, { 3, 0, 1, 2 }, { 2, 1, 0, 3 }, { 1, 3, 2, 0 } }) {
+    const size_t num_voxels = dims[0] * dims[1] * dims[2] * dims[3];
+    vector<uint8_t> mask (num_voxels);
+    for (size_t i = 0; i != num_voxels; ++i)
+      mask[i] = in_mask (position (i, order));
+
+    for (const auto& axes : vector<vector<bool>> { spatial, all, { true, false, true, true } }) {
+      for (const bool use_26 : { false, true }) {
+        const std::string config = "loop order " + str(order) + ", axes " + str(axes) + ", " + (use_26 ? "26" : "6") + "-connectivity";
+
+        GridConnector grid (dims, order, axes, use_26);
+        vector<Connector::Cluster> clusters;
+        vector<uint32_t> labels;
+        grid.run (mask, clusters, labels);
+
+        vector<uint32_t> ref_labels, ref_sizes;
+        flood_fill (mask, order, Connector::neighbour_offsets (dims.size(), axes, use_26), ref_labels, ref_sizes);
+
+        if (axes == spatial)
+          test (clusters.size() == expected_spatial[use_26], str(clusters.size()) + " clusters for " + config + "; expected " + str(expected_spatial[use_26]));
+        if (axes == all)
+          test (clusters.size() == expected_all[use_26], str(clusters.size()) + " clusters for " + config + "; expected " + str(expected_all[use_26]));
+        if (clusters.size() != ref_sizes.size()) {
+          test (false, str(clusters.size()) + " clusters for " + config + "; flood fill yields " + str(ref_sizes.size()));
+          continue;
+        }
+        bool clusters_match = true;
+        for (size_t c = 0; c != clusters.size(); ++c)
+          clusters_match = clusters_match && clusters[c].label == c+1 && clusters[c].size == ref_sizes[c];
+        test (clusters_match, "Cluster labels or sizes differ from flood fill for " + config);
+        test (labels == ref_labels, "Voxel labels differ from flood fill for " + config);
+      }
+    }
+  }
+
+  if (failed_tests.size()) {
+    Exception e (str(failed_tests.size()) + " tests of GridConnector failed:");
+    for (auto s : failed_tests)
+      e.push_back (s);
+    throw e;
+  }
+}
@@ -0,0 +1,151 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#include <random>
+
+#include "command.h"
+#include "math/math.h"
+#include "file/utils.h"
+#include "dwi/tractography/connectome/connectome.h"
+#include "dwi/tractography/connectome/mapped_track.h"
+#include "dwi/tractography/connectome/matrix.h"
+
+using namespace MR;
+using namespace App;
+using namespace MR::DWI::Tractography::Connectome;
+
+void usage ()
+{
+  AUTHOR = "Robert E. Smith (robert.smith@florey.edu.au)";
+  SYNOPSIS = "Verify that connectomes accumulated within dense and sparse per-thread partial connectomes "
+             "match those accumulated directly";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+const node_t max_node_index = 50;
+const size_t num_tracks = 5000;
+const size_t num_partials = 3;
+
+
+
+// Accumulate the mapped streamlines into a connectome, either directly
+//   (partials == 0) or distributed over a number of partial connectomes,
+//   and return the result as written to file
+template <class TrackType>
+Eigen::MatrixXd accumulate (const vector<TrackType>& tracks, const stat_edge stat, const bool vector_output,
+                            const size_t partials, const bool sparse)
+{
+  Matrix<double> matrix (max_node_index, stat, vector_output);
+  if (partials) {
+    vector<std::unique_ptr<Matrix<double>::Partial>> partial;
+    for (size_t i = 0; i != partials; ++i)
+      partial.emplace_back (new Matrix<double>::Partial (matrix, sparse));
+    for (size_t i = 0; i != tracks.size(); ++i)
+      (*partial[i % partials]) (tracks[i]);
+    for (auto& p : partial)
+      matrix.merge (std::move (*p));
+  } else {
+    for (const auto& track : tracks)
+      matrix (track);
+  }
+  matrix.finalize();
+  const std::string path = File::create_tempfile (0, "csv");
+  matrix.save (path, true, !vector_output, false);
+  const Eigen::MatrixXd result = load_matrix (path);
+  File::remove (path);
+  return result;
+}
+
+
+
+template <class TrackType>
+void compare (const vector<TrackType>& tracks, const std::string& type, vector<std::string>& failed_tests)
+{
+  for (const auto stat : { stat_edge::SUM, stat_edge::MEAN, stat_edge::MIN, stat_edge::MAX }) {
+    for (const bool vector_output : { false, true }) {
+      const std::string config = type + ", statistic " + statistics[stat] + (vector_output ? ", vector output" : ", matrix output");
+      const Eigen::MatrixXd reference = accumulate (tracks, stat, vector_output, 0, false);
+      for (const bool sparse : { false, true }) {
+        const Eigen::MatrixXd result = accumulate (tracks, stat, vector_output, num_partials, sparse);
+        const std::string name = std::string (sparse ? "sparse" : "dense") + " partial connectomes";
+        if (result.rows() != reference.rows() || result.cols() != reference.cols()) {
+          failed_tests.push_back ("Dimensions of connectome from " + name + " differ from direct accumulation for " + config);
+          continue;
+        }
+        // Edges to which no streamline is assigned are NaN for the min & max statistics
+        size_t mismatches = 0;
+        double max_error = 0.0;
+        for (ssize_t r = 0; r != reference.rows(); ++r) {
+          for (ssize_t c = 0; c != reference.cols(); ++c) {
+            if (std::isfinite (reference (r, c)) != std::isfinite (result (r, c)))
+              ++mismatches;
+            else if (std::isfinite (reference (r, c)))
+              max_error = std::max (max_error, std::abs (result (r, c) - reference (r, c)) / std::max (1.0, std::abs (reference (r, c))));
+          }
+        }
+        if (mismatches)
+          failed_tests.push_back (str(mismatches) + " edges differ in validity between " + name + " and direct accumulation for " + config);
+        if (max_error > 1e-12)
+          failed_tests.push_back ("Maximal relative error of " + name + " of " + str(max_error) + " for " + config);
+      }
+    }
+  }
+}
+
+
+
+void run ()
+{
+  vector<std::string> failed_tests;
+
+  // Random streamline assignments; some streamlines are unassigned at one or
+  //   both endpoints, and many node pairs receive no streamlines at all
+  std::mt19937 rng (1);
+  std::uniform_int_distribution<node_t> node (0, max_node_index);
+  std::uniform_int_distribution<size_t> list_length (0, 4);
+  std::uniform_real_distribution<float> factor (-1.0f, 5.0f), weight (0.1f, 2.0f);
+  vector<Mapped_track_nodepair> pairs (num_tracks);
+  vector<Mapped_track_nodelist> lists (num_tracks);
+  for (size_t i = 0; i != num_tracks; ++i) {
+    const node_t first = node (rng);
+    pairs[i].set_nodes (std::make_pair (first, first < max_node_index / 2 ? node (rng) / 5 : node (rng)));
+    pairs[i].set_factor (factor (rng));
+    pairs[i].set_weight (weight (rng));
+    const size_t length = list_length (rng);
+    vector<node_t> nodes;
+    while (nodes.size() != length) {
+      const node_t n = 1 + node (rng) % max_node_index;
+      if (std::find (nodes.begin(), nodes.end(), n) == nodes.end())
+        nodes.push_back (n);
+    }
+    lists[i].set_nodes (std::move (nodes));
+    lists[i].set_factor (factor (rng));
+    lists[i].set_weight (weight (rng));
+  }
+
+  compare (pairs, "node pairs", failed_tests);
+  compare (lists, "node lists", failed_tests);
+
+  if (failed_tests.size()) {
+    Exception e (str(failed_tests.size()) + " tests of partial connectome accumulation failed:");
+    for (auto s : failed_tests)
+      e.push_back (s);
+    throw e;
+  }
+}
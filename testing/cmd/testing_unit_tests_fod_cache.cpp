@@ -0,0 +1,165 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#include "command.h"
+#include "header.h"
+#include "image.h"
+#include "algo/loop.h"
+#include "interp/linear.h"
+#include "interp/masked.h"
+#include "math/SH.h"
+#include "dwi/tractography/tracking/fod_cache.h"
+
+using namespace MR;
+using namespace App;
+using namespace MR::DWI::Tractography::Tracking;
+
+void usage ()
+{
+  AUTHOR = "Robert E. Smith (robert.smith@florey.edu.au)";
+  SYNOPSIS = "Verify that the tracking FOD cache matches masked linear interpolation of the source image";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+const int lmax = 8;
+const ssize_t dims[3] = { 11, 9, 7 };
+
+
+
+// Synthetic FOD field: a single fibre whose orientation rotates smoothly
+//   along the x axis, and whose density varies along z; voxels within a
+//   spherical region are left empty, and one voxel contains invalid data
+Image<float> fibre_field ()
+{
+  Header H;
+  H.ndim() = 4;
+  for (size_t axis = 0; axis != 3; ++axis) {
+    H.size(axis) = dims[axis];
+    H.spacing(axis) = 1.5 + 0.5 * axis;
+  }
+  H.size(3) = Math::SH::NforL (lmax);
+  H.spacing(3) = NaN;
+  // Oblique grid, so that the scanner-to-voxel transform is exercised
+  H.transform().linear() = Eigen::AngleAxisd (0.3, Eigen::Vector3d (1.0, 2.0, 3.0).normalized()).matrix();
+  H.transform().translation() = Eigen::Vector3d (-12.0, 4.0, 7.5);
+  H.datatype() = DataType::Float32;
+  auto image = Image<float>::scratch (H, "synthetic FOD field");
+
+  Eigen::VectorXf coefs;
+  for (auto l = Loop (image, 0, 3) (image); l; ++l) {
+    const Eigen::Vector3f centre (image.index(0) - 5.0f, image.index(1) - 4.0f, image.index(2) - 3.0f);
+    if (centre.squaredNorm() < 5.0f)
+      continue;
+    const float angle = 0.25f * image.index(0);
+    Math::SH::delta (coefs, Eigen::Vector3f (std::cos (angle), std::sin (angle), 0.2f).normalized(), lmax);
+    coefs *= 0.2f + 0.1f * image.index(2);
+    if (image.index(0) == 9 && image.index(1) == 1 && image.index(2) == 5)
+      coefs.fill (NaN);
+    for (auto v = Loop (image, 3) (image); v; ++v)
+      image.value() = coefs[image.index(3)];
+  }
+  return image;
+}
+
+
+
+void run ()
+{
+  vector<std::string> failed_tests;
+  auto test = [&] (const bool result, const std::string msg) {
+    if (!result)
+      failed_tests.push_back (msg);
+  };
+
+  test (FODCache::parse_format ("float32") == FODCache::format_t::FLOAT32 &&
+        FODCache::parse_format ("Float16") == FODCache::format_t::FLOAT16 &&
+        FODCache::parse_format ("INT16") == FODCache::format_t::INT16,
+        "FOD cache format names not parsed");
+  try {
+    FODCache::parse_format ("int8");
+    test (false, "Invalid FOD cache format name accepted");
+  } catch (Exception&) { }
+
+  auto image = fibre_field();
+  size_t nonempty = 0;
+  for (auto l = Loop (image, 0, 3) (image); l; ++l) {
+    image.index(3) = 0;
+    if (image.value())
+      ++nonempty;
+  }
+
+  Interp::Masked<Interp::Linear<Image<float>>> interp (image);
+  const Transform transform (image);
+  Eigen::VectorXf reference (image.size(3)), values;
+
+  const FODCache::format_t formats[] = { FODCache::format_t::FLOAT32, FODCache::format_t::FLOAT16, FODCache::format_t::INT16 };
+  const char* names[] = { "float32", "float16", "int16" };
+  // Maximal interpolation error relative to the largest coefficient
+  const float tolerances[] = { 1e-6f, 1e-3f, 1e-4f };
+  size_t float32_bytes = 0;
+
+  for (size_t f = 0; f != 3; ++f) {
+    const std::string name (names[f]);
+    FODCache cache (image, formats[f]);
+    test (cache.num_voxels() == nonempty, name + " cache holds " + str(cache.num_voxels()) + " voxels; expected " + str(nonempty));
+    test (cache.num_coefs() == size_t(image.size(3)), name + " cache holds " + str(cache.num_coefs()) + " coefficients per voxel");
+    if (!f)
+      float32_bytes = cache.bytes();
+    else
+      test (cache.bytes() < float32_bytes, name + " cache is no smaller than float32 cache");
+
+    // Regular lattice of voxel positions with a spacing of one third of a
+    //   voxel, extending one voxel beyond the image on each side; this is
+    //   offset from the voxel centres, since Interp::Linear yields NaN if
+    //   an invalid voxel is encountered even with zero weight
+    size_t accepted = 0, mismatches = 0;
+    float max_error = 0.0f;
+    for (int z = -3; z <= 3 * dims[2]; ++z) {
+      for (int y = -3; y <= 3 * dims[1]; ++y) {
+        for (int x = -3; x <= 3 * dims[0]; ++x) {
+          const Eigen::Vector3d voxel ((x + 0.1) / 3.0, (y + 0.2) / 3.0, (z + 0.3) / 3.0);
+          const Eigen::Vector3f position ((transform.voxel2scanner * voxel).cast<float>());
+          bool expected = interp.scanner (position);
+          if (expected) {
+            for (auto l = Loop (3) (interp); l; ++l)
+              reference[interp.index(3)] = interp.value();
+            expected = reference.allFinite();
+          }
+          const bool result = cache.get (position, values);
+          if (result != expected) {
+            ++mismatches;
+          } else if (result) {
+            ++accepted;
+            max_error = std::max (max_error, (values - reference).cwiseAbs().maxCoeff() / reference.cwiseAbs().maxCoeff());
+          }
+        }
+      }
+    }
+    test (!mismatches, name + " cache differs from masked interpolation in acceptance of " + str(mismatches) + " positions");
+    test (accepted > 1000, "Only " + str(accepted) + " positions accepted by " + name + " cache");
+    test (max_error <= tolerances[f], name + " cache interpolation error " + str(max_error) + " exceeds tolerance " + str(tolerances[f]));
+  }
+
+  if (failed_tests.size()) {
+    Exception e (str(failed_tests.size()) + " tests of FODCache failed:");
+    for (auto s : failed_tests)
+      e.push_back (s);
+    throw e;
+  }
+}
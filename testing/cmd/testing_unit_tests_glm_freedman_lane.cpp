@@ -0,0 +1,178 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#include <random>
+
+#include "command.h"
+#include "header.h"
+#include "image.h"
+#include "algo/loop.h"
+#include "math/least_squares.h"
+#include "math/stats/glm.h"
+#include "math/stats/measurements.h"
+#include "math/stats/typedefs.h"
+
+using namespace MR;
+using namespace App;
+using namespace MR::Math::Stats;
+
+void usage ()
+{
+  AUTHOR = "Robert E. Smith (robert.smith@florey.edu.au)";
+  SYNOPSIS = "Verify that statistics of the fixed-design GLM test match an explicit "
+             "Freedman-Lane computation using the residual-forming matrices";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+// More elements than are processed in a single chunk
+const ssize_t num_inputs = 30, num_elements = 1500;
+
+
+
+// Freedman-Lane statistics computed directly: the data are regressed against
+//   the nuisance regressors using the residual-forming matrix Rz, shuffled,
+//   and the residuals of the full model are computed using the residual-forming
+//   matrix Rm
+matrix_type explicit_stats (const matrix_type& data, const matrix_type& design, const vector<GLM::Hypothesis>& hypotheses,
+                            const matrix_type& shuffling_matrix)
+{
+  const matrix_type pinvM = Math::pinv (design);
+  const matrix_type Rm = matrix_type::Identity (num_inputs, num_inputs) - design * pinvM;
+  matrix_type stats (num_elements, hypotheses.size());
+  for (size_t ih = 0; ih != hypotheses.size(); ++ih) {
+    const auto partition = hypotheses[ih].partition (design);
+    const matrix_type XtX = partition.X.transpose() * partition.X;
+    const default_type dof = num_inputs - partition.rank_x - partition.rank_z;
+    const matrix_type Sy = shuffling_matrix * (partition.Rz * data);
+    const matrix_type lambdas = pinvM * Sy;
+    const vector_type sse = (Rm * Sy).colwise().squaredNorm();
+    for (ssize_t ie = 0; ie != num_elements; ++ie) {
+      const matrix_type beta = hypotheses[ih].matrix() * lambdas.col (ie);
+      const default_type F = ((beta.transpose() * XtX * beta) (0,0) / hypotheses[ih].rank()) / (sse[ie] / dof);
+      stats (ie, ih) = hypotheses[ih].is_F() ? F : std::sqrt (F) * (beta.sum() > 0.0 ? 1.0 : -1.0);
+    }
+  }
+  return stats;
+}
+
+
+
+void run ()
+{
+  vector<std::string> failed_tests;
+  auto test = [&] (const bool result, const std::string msg) {
+    if (!result)
+      failed_tests.push_back (msg);
+  };
+
+  std::mt19937 rng (1);
+  std::normal_distribution<default_type> normal;
+
+  // Design: intercept, group membership, and a continuous covariate
+  matrix_type design (num_inputs, 3);
+  for (ssize_t i = 0; i != num_inputs; ++i) {
+    design (i, 0) = 1.0;
+    design (i, 1) = i % 2 ? 1.0 : 0.0;
+    design (i, 2) = normal (rng);
+  }
+
+  // t-test of group membership, with nuisance regressors; F-test of group
+  //   membership and covariate, with the intercept as nuisance regressor;
+  //   and an F-test of all factors, without any nuisance regressors
+  matrix_type contrast_t (1, 3), contrast_f (2, 3), contrast_all (matrix_type::Identity (3, 3));
+  contrast_t << 0.0, 1.0, 0.0;
+  contrast_f << 0.0, 1.0, 0.0,
+                0.0, 0.0, 1.0;
+  const matrix_type& t_rows (contrast_t);
+  const vector<GLM::Hypothesis> hypotheses { GLM::Hypothesis (t_rows.row (0), 0),
+                                             GLM::Hypothesis (contrast_f, 1),
+                                             GLM::Hypothesis (contrast_all, 2) };
+
+  // Data with a group effect and a covariate effect that varies between elements
+  matrix_type data (num_inputs, num_elements);
+  for (ssize_t ie = 0; ie != num_elements; ++ie) {
+    const default_type group_effect = 0.5 * normal (rng), covariate_effect = 0.5 * normal (rng);
+    for (ssize_t i = 0; i != num_inputs; ++i)
+      data (i, ie) = 10.0 + group_effect * design (i, 1) + covariate_effect * design (i, 2) + normal (rng);
+  }
+
+  Header H;
+  H.ndim() = 3;
+  H.size(0) = num_elements;
+  H.size(1) = num_inputs;
+  H.size(2) = 1;
+  H.spacing(0) = H.spacing(1) = H.spacing(2) = 1.0;
+  H.transform().setIdentity();
+  H.datatype() = DataType::Float32;
+  auto store = Image<float>::scratch (H, "test measurements");
+  for (auto l = Loop (store, 0, 2) (store); l; ++l)
+    store.value() = data (ssize_t (store.index(1)), ssize_t (store.index(0)));
+  Measurements measurements (num_inputs, num_elements);
+  measurements.load (store, "Loading test measurements");
+  // Reference computation must use the data exactly as stored
+  data = data.cast<float>().cast<default_type>();
+
+  const GLM::TestFixedHomoscedastic glm_test (measurements, design, hypotheses);
+
+  // Shuffling matrices: identity; permutation; sign-flipping; permutation
+  //   with sign-flipping; and a matrix that is not a signed permutation,
+  //   which must be applied as a dense matrix product
+  vector<std::pair<std::string, matrix_type>> shuffles;
+  shuffles.emplace_back ("identity", matrix_type::Identity (num_inputs, num_inputs));
+  vector<ssize_t> order (num_inputs);
+  std::iota (order.begin(), order.end(), 0);
+  std::shuffle (order.begin(), order.end(), rng);
+  matrix_type permutation (matrix_type::Zero (num_inputs, num_inputs)), signflip (matrix_type::Zero (num_inputs, num_inputs));
+  for (ssize_t i = 0; i != num_inputs; ++i) {
+    permutation (i, order[i]) = 1.0;
+    signflip (i, i) = rng() % 2 ? 1.0 : -1.0;
+  }
+  shuffles.emplace_back ("permutation", permutation);
+  shuffles.emplace_back ("sign-flip", signflip);
+  shuffles.emplace_back ("permutation with sign-flip", signflip * permutation);
+  matrix_type dense (num_inputs, num_inputs);
+  for (ssize_t i = 0; i != dense.size(); ++i)
+    dense.data()[i] = normal (rng) / std::sqrt (default_type (num_inputs));
+  shuffles.emplace_back ("dense", dense);
+
+  for (const auto& shuffle : shuffles) {
+    matrix_type stats, zstats;
+    glm_test (shuffle.second, stats, zstats);
+    const matrix_type expected = explicit_stats (data, design, hypotheses, shuffle.second);
+    test (stats.rows() == num_elements && stats.cols() == ssize_t(hypotheses.size()),
+          "Statistic matrix of incorrect dimensions for " + shuffle.first + " shuffling");
+    if (stats.rows() != expected.rows() || stats.cols() != expected.cols())
+      continue;
+    for (size_t ih = 0; ih != hypotheses.size(); ++ih) {
+      default_type max_error = 0.0;
+      for (ssize_t ie = 0; ie != num_elements; ++ie)
+        max_error = std::max (max_error, std::abs (stats (ie, ih) - expected (ie, ih)) / std::max (1.0, std::abs (expected (ie, ih))));
+      test (max_error < 1e-9, "Maximal relative error of " + hypotheses[ih].name() + " statistic of "
+                              + str(max_error) + " for " + shuffle.first + " shuffling");
+    }
+    test (zstats.allFinite(), "Non-finite Z-statistics for " + shuffle.first + " shuffling");
+  }
+
+  if (failed_tests.size()) {
+    Exception e (str(failed_tests.size()) + " tests of fixed-design GLM failed:");
+    for (auto s : failed_tests)
+      e.push_back (s);
+    throw e;
+  }
+}
@@ -130,6 +130,40 @@ void run ()
       throw Exception ("ICLS solver test failed at test 4");
   }
 
+  // block solver: a series of similar problem vectors, as would be
+  // encountered for neighbouring voxels; solutions must match those of
+  // the single-vector solver, with or without warm starts:
+  const size_t num_vec = 20;
+  matrix_type problem_vectors (num_sig, num_vec);
+  for (size_t n = 0; n < num_vec; ++n)
+    for (size_t i = 0; i < num_sig; ++i)
+      problem_vectors(i,n) = problem_vector[i] * (1.0 + 0.01*n) + 0.05 * std::sin (0.3*i*n);
+
+  size_t test_num = 6;
+  for (const bool with_eq : { true, false }) {
+    Math::ICLS::Problem<double> problem = with_eq ?
+      Math::ICLS::Problem<double> (problem_matrix, constraint_matrix, constraint_vector, equality_constraint_vector.size()) :
+      Math::ICLS::Problem<double> (problem_matrix, inequality_constraint_matrix, inequality_constraint_vector);
+    for (const bool warm_start : { true, false }) {
+      matrix_type X;
+      vector<size_t> niter;
+      Math::ICLS::Solver<double> solve_block (problem);
+      solve_block (X, problem_vectors, niter, warm_start);
+      if (size_t (X.cols()) != num_vec || niter.size() != num_vec)
+        throw Exception ("ICLS solver test failed at test " + str(test_num));
+      if (!X.col(0).isApprox (with_eq ? solution : solution_no_eq, 1.0e-6))
+        throw Exception ("ICLS solver test failed at test " + str(test_num));
+      Math::ICLS::Solver<double> solve (problem);
+      for (size_t n = 0; n < num_vec; ++n) {
+        vector_type x;
+        solve (x, problem_vectors.col(n));
+        if (!X.col(n).isApprox (x, 1.0e-6))
+          throw Exception ("ICLS solver test failed at test " + str(test_num) + " (problem vector " + str(n) + ")");
+      }
+      ++test_num;
+    }
+  }
+
 
 
 
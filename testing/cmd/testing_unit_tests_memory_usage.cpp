@@ -0,0 +1,131 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include "command.h"
+#include "memory_usage.h"
+
+using namespace MR;
+using namespace App;
+
+void usage ()
+{
+  AUTHOR = "J-Donald Tournier (jdtournier@gmail.com)";
+  SYNOPSIS = "Verify parsing of memory sizes, and accounting of allocations against the memory limit";
+  DESCRIPTION
+  + "If the -memory_limit option is provided, allocations are additionally "
+    "checked against that limit; it must be no smaller than 1kB.";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+void run ()
+{
+  vector<std::string> failed_tests;
+  auto test = [&] (const bool result, const std::string msg) {
+    if (!result)
+      failed_tests.push_back (msg);
+  };
+
+  // Valid sizes
+  const size_t k = 1024;
+  const vector<std::pair<std::string, size_t>> valid {
+    { "1", 1 }, { "100", 100 }, { "100b", 100 }, { "100B", 100 },
+    { "4k", 4*k }, { "4K", 4*k }, { "4kB", 4*k }, { "4kb", 4*k },
+    { "512M", 512*k*k }, { "512MB", 512*k*k }, { " 16G ", 16*k*k*k }, { "16 g", 16*k*k*k },
+    { "1.5G", 3*k*k*k/2 }, { "0.5k", 512 }, { "2T", 2*k*k*k*k }, { ".5M", k*k/2 } };
+  for (const auto& v : valid) {
+    try {
+      const size_t result = Memory::parse_size (v.first);
+      test (result == v.second, "Memory size \"" + v.first + "\" parsed as " + str(result) + "; expected " + str(v.second));
+    } catch (Exception&) {
+      test (false, "Valid memory size \"" + v.first + "\" rejected");
+    }
+  }
+
+  // Invalid sizes: empty, non-numeric, unknown or malformed suffix, zero or
+  //   less than one byte, and too large to represent
+  for (const std::string s : { "", "G", "abc", "-1G", "16Q", "16GiB", "16kk", "1.2.3M", ".", "0", "0G", "0.1", "99999999T", "1e30" }) {
+    try {
+      const size_t result = Memory::parse_size (s);
+      test (false, "Invalid memory size \"" + s + "\" accepted (parsed as " + str(result) + ")");
+    } catch (Exception&) { }
+  }
+
+  // Formatting
+  test (Memory::format_size (0) == "0 B", "Zero size formatted as \"" + Memory::format_size (0) + "\"");
+  test (Memory::format_size (1000) == "1000 B", "1000 bytes formatted as \"" + Memory::format_size (1000) + "\"");
+  test (Memory::format_size (3*k*k*k/2) == "1.5 GB", "1.5G formatted as \"" + Memory::format_size (3*k*k*k/2) + "\"");
+  for (const size_t bytes : { size_t(1), 4*k, 123*k*k, 16*k*k*k, 3*k*k*k*k }) {
+    const size_t reparsed = Memory::parse_size (Memory::format_size (bytes));
+    test (std::abs (default_type(reparsed) - default_type(bytes)) <= 1e-3 * bytes,
+          "Size " + str(bytes) + " formatted as \"" + Memory::format_size (bytes) + "\", which is parsed as " + str(reparsed));
+  }
+
+  // Accounting of allocations
+  const size_t initial = Memory::current();
+  {
+    Memory::Allocation a (1000, "first test allocation");
+    test (Memory::current() == initial + 1000, "Current use not incremented by allocation");
+    Memory::Allocation b (std::move (a));
+    test (!a.size() && b.size() == 1000 && Memory::current() == initial + 1000, "Allocation not transferred by move construction");
+    a = Memory::Allocation (500, "second test allocation");
+    test (Memory::current() == initial + 1500, "Current use not incremented by second allocation");
+    b = std::move (a);
+    test (b.size() == 500 && Memory::current() == initial + 500, "Allocation not released by move assignment");
+    test (Memory::peak() >= initial + 1500, "Peak use not updated");
+    b.release();
+    b.release();
+    test (Memory::current() == initial, "Current use not restored by release");
+  }
+  test (Memory::current() == initial, "Current use not restored on destruction of allocations");
+
+  // Checks against the memory limit
+  auto opt = get_options ("memory_limit");
+  if (opt.size()) {
+    const size_t limit = Memory::limit();
+    test (limit == Memory::parse_size (opt[0][0]), "Memory limit " + str(limit) + " does not match -memory_limit option");
+    if (limit >= k) {
+      test (Memory::fits (limit - initial), "Allocation of remaining budget does not fit");
+      test (!Memory::fits (limit - initial + 1), "Allocation exceeding budget fits");
+      test (!Memory::fits (std::numeric_limits<size_t>::max()), "Maximal allocation fits");
+      Memory::Allocation half (limit / 2, "test allocation of half of budget");
+      test (Memory::fits (limit - initial - half.size()), "Allocation of remaining budget does not fit alongside existing allocation");
+      test (!Memory::fits (limit - initial - half.size() + 1), "Allocation exceeding remaining budget fits alongside existing allocation");
+      try {
+        Memory::check (limit, "test allocation of entire budget");
+        test (false, "No exception thrown when checking allocation that exceeds remaining budget");
+      } catch (Exception&) { }
+      half.release();
+      try {
+        Memory::check (limit - initial, "test allocation of entire budget");
+      } catch (Exception&) {
+        test (false, "Exception thrown when checking allocation that fits within budget");
+      }
+    } else {
+      test (false, "Memory limit of " + str(limit) + " bytes too small for testing");
+    }
+  } else if (!Memory::limit()) {
+    test (Memory::fits (std::numeric_limits<size_t>::max()), "Allocation does not fit in the absence of a memory limit");
+  }
+
+  if (failed_tests.size()) {
+    Exception e (str(failed_tests.size()) + " tests of memory accounting failed:");
+    for (auto s : failed_tests)
+      e.push_back (s);
+    throw e;
+  }
+}
@@ -0,0 +1,155 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+#include <set>
+
+#include "command.h"
+#include "thread.h"
+#include "dwi/tractography/GT/particlepool.h"
+
+using namespace MR;
+using namespace App;
+using namespace MR::DWI::Tractography::GT;
+
+void usage ()
+{
+  AUTHOR = "Daan Christiaens (daan.christiaens@kcl.ac.uk)";
+  SYNOPSIS = "Verify creation, destruction and sampling of particles in the global tractography particle pool";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+class Churn
+{ MEMALIGN(Churn)
+  public:
+    Churn (ParticlePool& pool, std::atomic<size_t>& draws) :
+        pool (pool),
+        draws (draws) { }
+
+    void execute ()
+    {
+      vector<Particle*> owned;
+      for (size_t iter = 0; iter != 20000; ++iter) {
+        if (owned.size() < 50 || (iter % 3 && owned.size() < 200)) {
+          owned.push_back (pool.create (Point_t (iter, 0.0f, 0.0f), Point_t (0.0f, 0.0f, 1.0f)));
+        } else {
+          pool.destroy (owned.back());
+          owned.pop_back();
+        }
+        if (pool.random())
+          ++draws;
+      }
+      for (auto p : owned)
+        pool.destroy (p);
+    }
+
+  private:
+    ParticlePool& pool;
+    std::atomic<size_t>& draws;
+};
+
+
+
+void run ()
+{
+  vector<std::string> failed_tests;
+  auto test = [&] (const bool result, const std::string msg) {
+    if (!result)
+      failed_tests.push_back (msg);
+  };
+
+  const size_t N = 1000;
+  const Point_t dir (0.0f, 0.0f, 1.0f);
+  ParticlePool pool;
+  test (!pool.size(), "New pool is not empty");
+  test (!pool.random(), "Random particle drawn from empty pool");
+
+  vector<Particle*> particles;
+  for (size_t i = 0; i != N; ++i)
+    particles.push_back (pool.create (Point_t (i, 0.0f, 0.0f), dir));
+  test (pool.size() == N, "Pool size " + str(pool.size()) + " after creating " + str(N) + " particles");
+
+  // With every slot occupied, each draw must succeed, and the draws must cover the pool
+  std::set<Particle*> drawn;
+  for (size_t i = 0; i != 20*N; ++i) {
+    Particle* p = pool.random();
+    if (!p) {
+      test (false, "No particle drawn from fully occupied pool");
+      break;
+    }
+    drawn.insert (p);
+  }
+  test (drawn.size() > 0.99 * N, "Only " + str(drawn.size()) + " of " + str(N) + " particles drawn from fully occupied pool");
+  for (size_t i = 0; i != N; ++i)
+    test (particles[i]->getPosition()[0] == float(i), "Particle " + str(i) + " not stored at a stable address");
+
+  // Destroy every second particle: draws must only ever return the survivors
+  std::set<Particle*> destroyed;
+  for (size_t i = 0; i < N; i += 2) {
+    pool.destroy (particles[i]);
+    destroyed.insert (particles[i]);
+  }
+  test (pool.size() == N/2, "Pool size " + str(pool.size()) + " after destroying half of the particles");
+  size_t null_draws = 0;
+  for (size_t i = 0; i != 10*N; ++i) {
+    Particle* p = pool.random();
+    if (!p)
+      ++null_draws;
+    else if (destroyed.count (p) || !p->isAlive())
+      test (false, "Destroyed particle drawn from pool");
+  }
+  test (null_draws < N, str(null_draws) + " unsuccessful draws from half-occupied pool");
+
+  // Destroyed slots must be recycled before the pool grows
+  for (size_t i = 0; i < N; i += 2) {
+    Particle* p = pool.create (Point_t (-1.0f, 0.0f, 0.0f), dir);
+    test (destroyed.count (p), "New particle not created in a recycled slot");
+  }
+  test (pool.size() == N, "Pool size " + str(pool.size()) + " after recycling");
+
+  // A single surviving particle must still be found
+  for (size_t i = 1; i < N; i += 2)
+    pool.destroy (particles[i]);
+  for (auto p : destroyed) {
+    if (p != particles[0])
+      pool.destroy (p);
+  }
+  test (pool.size() == 1, "Pool size " + str(pool.size()) + " with a single surviving particle");
+  Particle* survivor = nullptr;
+  for (size_t i = 0; i != 100*N && !survivor; ++i)
+    survivor = pool.random();
+  test (survivor == particles[0], "Single surviving particle not drawn from pool");
+  pool.destroy (particles[0]);
+  test (!pool.size() && !pool.random(), "Particle drawn from pool after all particles destroyed");
+
+  // Concurrent creation, destruction and sampling
+  pool.clear();
+  std::atomic<size_t> draws (0);
+  {
+    Churn churn (pool, draws);
+    auto threads = Thread::run (Thread::multi (churn, 4), "particle pool churn");
+  }
+  test (!pool.size(), "Pool size " + str(pool.size()) + " after concurrent churn");
+  test (draws > 4 * 20000 / 2, "Only " + str(draws) + " successful draws during concurrent churn");
+
+  if (failed_tests.size()) {
+    Exception e (str(failed_tests.size()) + " tests of ParticlePool failed:");
+    for (auto s : failed_tests)
+      e.push_back (s);
+    throw e;
+  }
+}
@@ -0,0 +1,196 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#include <random>
+
+#include "command.h"
+#include "header.h"
+#include "image.h"
+#include "algo/loop.h"
+#include "math/stats/fwe.h"
+#include "math/stats/glm.h"
+#include "math/stats/measurements.h"
+#include "math/stats/shuffle.h"
+#include "math/stats/typedefs.h"
+#include "stats/enhance.h"
+#include "stats/permtest.h"
+
+using namespace MR;
+using namespace App;
+using namespace MR::Math::Stats;
+
+void usage ()
+{
+  AUTHOR = "Robert E. Smith (robert.smith@florey.edu.au)";
+  SYNOPSIS = "Verify the generalised Pareto tail approximation of family-wise error p-values, "
+             "and early termination of adaptive permutation testing";
+  DESCRIPTION
+  + "The -adaptive option must be provided; the number of shuffles must be "
+    "no smaller than its default value.";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+  OPTIONS
+  + shuffle_options (false);
+}
+
+
+
+// Generalised Pareto distribution with threshold zero, using the
+//   convention of Hosking & Wallis (1987) for the shape parameter k
+const default_type gpd_k = -0.2, gpd_sigma = 1.0;
+
+default_type gpd_survival (const default_type x)
+{
+  return std::pow (1.0 - gpd_k * x / gpd_sigma, 1.0 / gpd_k);
+}
+
+default_type gpd_quantile (const default_type survival)
+{
+  return gpd_sigma * (1.0 - std::pow (survival, gpd_k)) / gpd_k;
+}
+
+
+
+// Run permutation testing of a two-group comparison of the given measurements
+void run_test (const matrix_type& data, matrix_type& null_dist, matrix_type& fwe_pvalues)
+{
+  const ssize_t num_inputs = data.rows(), num_elements = data.cols();
+  Header H;
+  H.ndim() = 3;
+  H.size(0) = num_elements;
+  H.size(1) = num_inputs;
+  H.size(2) = 1;
+  H.spacing(0) = H.spacing(1) = H.spacing(2) = 1.0;
+  H.transform().setIdentity();
+  H.datatype() = DataType::Float32;
+  auto store = Image<float>::scratch (H, "test measurements");
+  for (auto l = Loop (store, 0, 2) (store); l; ++l)
+    store.value() = data (ssize_t (store.index(1)), ssize_t (store.index(0)));
+  Measurements measurements (num_inputs, num_elements);
+  measurements.load (store, "Loading test measurements");
+
+  matrix_type design (num_inputs, 2);
+  for (ssize_t i = 0; i != num_inputs; ++i) {
+    design (i, 0) = 1.0;
+    design (i, 1) = i < num_inputs / 2 ? 1.0 : 0.0;
+  }
+  matrix_type contrast (1, 2);
+  contrast << 0.0, 1.0;
+  const vector<GLM::Hypothesis> hypotheses { GLM::Hypothesis (contrast.row (0), 0) };
+  std::shared_ptr<GLM::TestBase> glm_test (new GLM::TestFixedHomoscedastic (measurements, design, hypotheses));
+
+  matrix_type default_statistic, default_zstat;
+  (*glm_test) (matrix_type::Identity (num_inputs, num_inputs), default_statistic, default_zstat);
+
+  std::shared_ptr<Stats::EnhancerBase> enhancer;
+  matrix_type empirical_distribution, uncorrected_pvalues;
+  Stats::PermTest::count_matrix_type null_contributions;
+  Stats::PermTest::run_permutations (glm_test, enhancer, empirical_distribution, default_zstat, false,
+                                     null_dist, null_contributions, uncorrected_pvalues);
+  fwe_pvalues = fwe_pvalue (null_dist, default_zstat);
+}
+
+
+
+void run ()
+{
+  vector<std::string> failed_tests;
+  auto test = [&] (const bool result, const std::string msg) {
+    if (!result)
+      failed_tests.push_back (msg);
+  };
+
+  if (!get_options ("adaptive").size())
+    throw Exception ("Option -adaptive must be provided for testing of adaptive permutation testing");
+
+  std::mt19937 rng (42);
+
+  // Tail approximation: for a null distribution drawn from a generalised
+  //   Pareto distribution, the tail fitted to its largest values must
+  //   reproduce the known survival function
+  {
+    const size_t num_shuffles = 20000;
+    std::uniform_real_distribution<default_type> uniform (0.0, 1.0);
+    matrix_type null_dist (num_shuffles, 1);
+    for (size_t i = 0; i != num_shuffles; ++i)
+      null_dist (i, 0) = gpd_quantile (1.0 - uniform (rng));
+    const vector<default_type> survivals { 5e-2, 1e-2, 1e-3, 1e-4, 1e-5 };
+    matrix_type stats (survivals.size() + 1, 1);
+    for (size_t i = 0; i != survivals.size(); ++i)
+      stats (i, 0) = gpd_quantile (survivals[i]);
+    // Beyond the largest value in the null distribution
+    stats (survivals.size(), 0) = 2.0 * null_dist.maxCoeff();
+
+    const matrix_type empirical = fwe_pvalue (null_dist, stats, false);
+    const matrix_type tail = fwe_pvalue (null_dist, stats, true);
+    for (size_t i = 0; i != survivals.size(); ++i) {
+      const default_type p = 1.0 - tail (i, 0);
+      test (std::abs (p - survivals[i]) < 0.25 * survivals[i],
+            "Tail approximation yields p = " + str(p) + " for statistic " + str(stats (i, 0)) + "; expected " + str(survivals[i]));
+    }
+    const default_type expected = gpd_survival (stats (survivals.size(), 0));
+    const default_type p = 1.0 - tail (survivals.size(), 0);
+    test (empirical (survivals.size(), 0) == 1.0, "Empirical null distribution yields non-zero p-value for statistic beyond its maximum");
+    test (p > 0.0 && p < 1.0 / num_shuffles && std::abs (p - expected) < 0.5 * expected,
+          "Tail approximation yields p = " + str(p) + " for statistic beyond maximum of null distribution; expected " + str(expected));
+
+    // Too few shuffles for the tail to be fitted: no different from the empirical distribution
+    const matrix_type short_null_dist (null_dist.topRows (100));
+    test (fwe_pvalue (short_null_dist, stats, true) == fwe_pvalue (short_null_dist, stats, false),
+          "Tail approximation applied to null distribution of only 100 shuffles");
+  }
+
+  // Adaptive permutation testing: early termination both where no effect
+  //   is present, and where the effect is overwhelming
+  {
+    const ssize_t num_inputs = 40, num_elements = 5;
+    std::normal_distribution<default_type> normal;
+    matrix_type null_data (num_inputs, num_elements), effect_data (num_inputs, num_elements);
+    for (ssize_t i = 0; i != num_inputs; ++i) {
+      for (ssize_t e = 0; e != num_elements; ++e) {
+        null_data (i, e) = normal (rng);
+        effect_data (i, e) = normal (rng) + (i < num_inputs / 2 ? 5.0 : 0.0);
+      }
+    }
+
+    Shuffler shuffler (num_inputs, false);
+    const size_t max_shuffles = shuffler.size();
+    if (max_shuffles < DEFAULT_NUMBER_SHUFFLES)
+      throw Exception ("Number of shuffles must be at least " + str(DEFAULT_NUMBER_SHUFFLES) + " for testing of adaptive permutation testing");
+
+    for (const bool effect : { false, true }) {
+      const std::string config = effect ? "overwhelming effect" : "no effect";
+      matrix_type null_dist, fwe_pvalues;
+      run_test (effect ? effect_data : null_data, null_dist, fwe_pvalues);
+      test (null_dist.rows() < ssize_t(max_shuffles),
+            "Adaptive permutation testing used all " + str(max_shuffles) + " shuffles for " + config);
+      test (null_dist.allFinite(), "Non-finite values in truncated null distribution for " + config);
+      if (effect)
+        test (fwe_pvalues.minCoeff() > 1.0 - DEFAULT_ADAPTIVE_ALPHA,
+              "Family-wise error p-values not all significant for " + config + ": " + str(1.0 - fwe_pvalues.minCoeff()));
+      else
+        test (fwe_pvalues.maxCoeff() < 1.0 - DEFAULT_ADAPTIVE_ALPHA,
+              "Family-wise error p-values not all non-significant for " + config + ": " + str(1.0 - fwe_pvalues.maxCoeff()));
+    }
+  }
+
+  if (failed_tests.size()) {
+    Exception e (str(failed_tests.size()) + " tests of permutation testing failed:");
+    for (auto s : failed_tests)
+      e.push_back (s);
+    throw e;
+  }
+}
@@ -147,8 +147,8 @@ void run ()
           duplicate_index = true;
         if (temp.data == previous.data)
           duplicate_data = true;
-        matrices.push_back (temp);
       }
+      matrices.push_back (temp);
     }
     if (duplicate_index)
       failed_tests.push_back (msg + " (duplicate shuffle index)");
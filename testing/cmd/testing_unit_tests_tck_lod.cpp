@@ -0,0 +1,130 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#include <algorithm>
+
+#include "command.h"
+#include "math/math.h"
+#include "dwi/tractography/lod.h"
+
+using namespace MR;
+using namespace App;
+using namespace MR::DWI::Tractography;
+
+void usage ()
+{
+  AUTHOR = "Robert E. Smith (robert.smith@florey.edu.au)";
+  SYNOPSIS = "Verify correct operation of the streamline level-of-detail functions";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+// Maximal distance of any original vertex from the polyline through the retained vertices
+float max_deviation (const vector<Eigen::Vector3f>& vertices, const vector<size_t>& retained)
+{
+  float result = 0.0f;
+  for (size_t s = 0; s + 1 < retained.size(); ++s) {
+    const Eigen::Vector3f& p0 (vertices[retained[s]]);
+    const Eigen::Vector3f chord (vertices[retained[s+1]] - p0);
+    for (size_t i = retained[s]; i <= retained[s+1]; ++i) {
+      const Eigen::Vector3f offset (vertices[i] - p0);
+      const float t = std::min (1.0f, std::max (0.0f, offset.dot (chord) / chord.squaredNorm()));
+      result = std::max (result, (offset - t * chord).norm());
+    }
+  }
+  return result;
+}
+
+
+
+void run ()
+{
+  vector<size_t> retained;
+
+  // Collinear vertices reduce to the two endpoints
+  vector<Eigen::Vector3f> line;
+  for (size_t i = 0; i != 100; ++i)
+    line.push_back (Eigen::Vector3f (0.5f * i, 0.2f * i, -0.1f * i));
+  LOD::decimate (line, 0.01f, retained);
+  if (retained.size() != 2 || retained[0] != 0 || retained[1] != 99)
+    throw Exception ("Collinear streamline not decimated to endpoints (" + str(retained.size()) + " vertices retained)");
+
+  // A finely sampled arc must be reduced, but within tolerance
+  vector<Eigen::Vector3f> arc;
+  for (size_t i = 0; i != 1000; ++i) {
+    const float theta = Math::pi * i / 999.0f;
+    arc.push_back (Eigen::Vector3f (10.0f * std::cos (theta), 10.0f * std::sin (theta), 0.01f * i));
+  }
+  for (float tolerance : { 0.001f, 0.01f, 0.1f, 1.0f }) {
+    LOD::decimate (arc, tolerance, retained);
+    if (retained.front() != 0 || retained.back() != arc.size() - 1)
+      throw Exception ("Streamline endpoints not retained for tolerance " + str(tolerance));
+    if (!std::is_sorted (retained.begin(), retained.end()))
+      throw Exception ("Retained vertex indices not in ascending order for tolerance " + str(tolerance));
+    const float deviation = max_deviation (arc, retained);
+    if (deviation > tolerance)
+      throw Exception ("Decimation exceeds tolerance " + str(tolerance) + " (maximal deviation " + str(deviation) + ")");
+    if (tolerance >= 0.01f && retained.size() > arc.size() / 4)
+      throw Exception ("Insufficient decimation for tolerance " + str(tolerance) + " (" + str(retained.size()) + " vertices retained)");
+  }
+
+  // Zero tolerance retains every non-collinear vertex
+  vector<Eigen::Vector3f> zigzag;
+  for (size_t i = 0; i != 50; ++i)
+    zigzag.push_back (Eigen::Vector3f (float(i), float(i % 2), 0.0f));
+  LOD::decimate (zigzag, 0.0f, retained);
+  if (retained.size() != zigzag.size())
+    throw Exception ("Zero-tolerance decimation removed vertices");
+
+  // Subsampling: determine membership of each subset from in_subset() alone
+  const size_t num_streamlines = 1000000;
+  const size_t num_levels = 6;
+  vector<vector<size_t>> subsets (num_levels);
+  for (size_t i = 0; i != num_streamlines; ++i) {
+    for (size_t l = 0; l != num_levels; ++l) {
+      if (LOD::in_subset (i, l))
+        subsets[l].push_back (i);
+    }
+  }
+  if (subsets[0].size() != num_streamlines)
+    throw Exception ("Subsampling level 0 does not retain every streamline (" + str(subsets[0].size()) + " of " + str(num_streamlines) + ")");
+  // Every streamline selected at a coarse level must be selected at every finer level
+  for (size_t coarse = 1; coarse != num_levels; ++coarse) {
+    for (size_t fine = 0; fine != coarse; ++fine) {
+      if (!std::includes (subsets[fine].begin(), subsets[fine].end(), subsets[coarse].begin(), subsets[coarse].end()))
+        throw Exception ("Streamlines selected at subsampling level " + str(coarse) + " not all selected at level " + str(fine));
+    }
+  }
+  // Each level retains approximately 1 in 2^L streamlines
+  for (size_t l = 0; l != num_levels; ++l) {
+    const default_type expected = num_streamlines / default_type(size_t(1) << l);
+    if (std::abs (subsets[l].size() - expected) > 0.02 * expected)
+      throw Exception ("Subsampling level " + str(l) + " retained " + str(subsets[l].size()) + " streamlines; expected " + str(expected));
+  }
+  // Selection must not depend on the order in which streamlines are queried
+  for (size_t i = num_streamlines; i-- > num_streamlines - 1000;) {
+    const size_t l = LOD::subsample_level (i);
+    if (l + 1 < num_levels && std::binary_search (subsets[l+1].begin(), subsets[l+1].end(), i))
+      throw Exception ("Subsampling level of streamline " + str(i) + " not reproducible");
+    if (l < num_levels && !std::binary_search (subsets[l].begin(), subsets[l].end(), i))
+      throw Exception ("Subsampling level of streamline " + str(i) + " not reproducible");
+  }
+
+  if (LOD::level_for_count (num_streamlines, num_streamlines) != 0 || LOD::level_for_count (num_streamlines, 100000) != 4)
+    throw Exception ("Incorrect subsampling level selected for streamline count");
+}
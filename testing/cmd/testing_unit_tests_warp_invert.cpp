@@ -0,0 +1,178 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#include "command.h"
+#include "header.h"
+#include "image.h"
+#include "transform.h"
+#include "algo/loop.h"
+#include "interp/linear.h"
+#include "registration/warp/convert.h"
+#include "registration/warp/invert.h"
+
+using namespace MR;
+using namespace App;
+using namespace MR::Registration;
+
+void usage ()
+{
+  AUTHOR = "Robert E. Smith (robert.smith@florey.edu.au)";
+  SYNOPSIS = "Verify that coarse-to-fine inversion of warp fields matches inversion "
+             "on the full-resolution grid alone";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+// Voxels within this distance of the edge of the field may be mapped outside
+//   of it, and are excluded from comparisons
+const ssize_t margin = 4;
+
+// Maximal discrepancy in mm between inverses
+const default_type tolerance = 1e-3;
+
+// Convergence tolerance, tight enough for the inverse to be independent of
+//   its initialisation to well within the tolerance above
+const default_type error_tolerance = 1e-10;
+const size_t max_iter = 500;
+
+
+
+// Smooth, invertible displacement field of maximal amplitude 1.5 voxels
+void fill (Image<float>& field)
+{
+  for (auto l = Loop (field, 0, 3) (field); l; ++l) {
+    const Eigen::Vector3d p (field.index(0), field.index(1), field.index(2));
+    field.index(3) = 0; field.value() = 3.0 * std::sin (0.21 * p[1]) * std::cos (0.13 * p[2]);
+    field.index(3) = 1; field.value() = 3.0 * std::sin (0.17 * p[2]) * std::cos (0.19 * p[0]);
+    field.index(3) = 2; field.value() = 3.0 * std::sin (0.11 * p[0]) * std::cos (0.23 * p[1]);
+  }
+}
+
+
+
+bool interior (const Image<float>& field)
+{
+  for (size_t axis = 0; axis != 3; ++axis) {
+    if (field.index (axis) < margin || field.index (axis) >= field.size (axis) - margin)
+      return false;
+  }
+  return true;
+}
+
+
+
+default_type max_difference (Image<float>& a, Image<float>& b)
+{
+  default_type result = 0.0;
+  for (auto l = Loop (a, 0, 3) (a, b); l; ++l) {
+    if (interior (a))
+      result = std::max (result, (Eigen::Vector3f (a.row(3)) - Eigen::Vector3f (b.row(3))).cast<default_type>().norm());
+  }
+  return result;
+}
+
+
+
+// Maximal discrepancy between the identity and the composition of the
+//   inverse displacement field with the forward displacement field
+default_type max_residual (Image<float>& disp, Image<float>& inverse)
+{
+  const MR::Transform transform (inverse);
+  Interp::Linear<Image<float>> interp (disp);
+  default_type result = 0.0;
+  for (auto l = Loop (inverse, 0, 3) (inverse); l; ++l) {
+    if (!interior (inverse))
+      continue;
+    const Eigen::Vector3d position = transform.voxel2scanner * Eigen::Vector3d (inverse.index(0), inverse.index(1), inverse.index(2));
+    const Eigen::Vector3d mapped = position + Eigen::Vector3f (inverse.row(3)).cast<default_type>();
+    interp.scanner (mapped);
+    result = std::max (result, (mapped + Eigen::Vector3f (interp.row(3)).cast<default_type>() - position).norm());
+  }
+  return result;
+}
+
+
+
+void run ()
+{
+  vector<std::string> failed_tests;
+  auto test = [&] (const bool result, const std::string msg) {
+    if (!result)
+      failed_tests.push_back (msg);
+  };
+
+  Header H;
+  H.ndim() = 4;
+  H.size(0) = 48; H.size(1) = 40; H.size(2) = 36; H.size(3) = 3;
+  H.spacing(0) = H.spacing(1) = H.spacing(2) = 2.0;
+  H.spacing(3) = 1.0;
+  H.transform() = Eigen::AngleAxisd (0.2, Eigen::Vector3d (3.0, 1.0, 2.0).normalized());
+  H.transform().translation() = Eigen::Vector3d (-40.0, 30.0, 20.0);
+
+  auto disp = Image<float>::scratch (H, "displacement");
+  fill (disp);
+  auto deform = Image<float>::scratch (H, "deformation");
+  Warp::displacement2deformation (disp, deform);
+
+  // Reference: inversion on the full-resolution grid alone, initialised with the identity
+  auto reference = Image<float>::scratch (H, "reference inverse displacement");
+  const auto reference_stats = Warp::invert_displacement (disp, reference, max_iter, error_tolerance);
+  test (max_residual (disp, reference) < tolerance, "Reference inverse displacement field does not invert forward field");
+
+  // Coarse-to-fine inversion of the displacement field, with one coarse
+  //   level (default minimum size) and with several
+  for (const size_t min_size : { size_t(16), size_t(4) }) {
+    const std::string config = "minimum grid size " + str(min_size);
+    auto inverse = Image<float>::scratch (H, "inverse displacement");
+    // The initial contents must be ignored
+    for (auto l = Loop (inverse) (inverse); l; ++l)
+      inverse.value() = NaN;
+    const auto stats = Warp::invert_displacement_coarse_to_fine (disp, inverse, max_iter, error_tolerance, min_size);
+    const default_type difference = max_difference (inverse, reference);
+    test (difference < tolerance, "Coarse-to-fine inverse displacement differs from reference by " + str(difference) + "mm for " + config);
+    const default_type residual = max_residual (disp, inverse);
+    test (residual < tolerance, "Coarse-to-fine inverse displacement does not invert forward field (residual " + str(residual) + "mm) for " + config);
+    test (stats.voxels > reference_stats.voxels, "No coarse levels used in inversion for " + config);
+    test (stats.unconverged <= reference_stats.unconverged,
+          str(stats.unconverged) + " voxels not converged in coarse-to-fine inversion, compared to "
+          + str(reference_stats.unconverged) + " in reference, for " + config);
+  }
+
+  // Coarse-to-fine inversion of the deformation field, compared to
+  //   inversion on the full-resolution grid alone
+  auto inverse_deform = Image<float>::scratch (H, "inverse deformation");
+  Warp::invert_deformation (deform, inverse_deform, false, max_iter, error_tolerance);
+  auto inverse = Image<float>::scratch (H, "inverse displacement");
+  Warp::deformation2displacement (inverse_deform, inverse);
+  default_type difference = max_difference (inverse, reference);
+  test (difference < tolerance, "Coarse-to-fine inverse deformation differs from reference by " + str(difference) + "mm");
+
+  auto identity = Image<float>::scratch (H, "identity deformation");
+  Warp::displacement2deformation (identity, identity);
+  Warp::invert_deformation (deform, identity, true, max_iter, error_tolerance);
+  Warp::deformation2displacement (identity, inverse);
+  difference = max_difference (inverse, reference);
+  test (difference < tolerance, "Initialised inverse deformation differs from reference by " + str(difference) + "mm");
+
+  if (failed_tests.size()) {
+    Exception e (str(failed_tests.size()) + " tests of warp inversion failed:");
+    for (auto s : failed_tests)
+      e.push_back (s);
+    throw e;
+  }
+}
@@ -0,0 +1,169 @@
+/* Copyright (c) 2008-2022 the MRtrix3 contributors.
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * Covered Software is provided under this License on an "as is"
+ * basis, without warranty of any kind, either expressed, implied, or
+ * statutory, including, without limitation, warranties that the
+ * Covered Software is free of defects, merchantable, fit for a
+ * particular purpose or non-infringing.
+ * See the Mozilla Public License v. 2.0 for more details.
+ *
+ * For more details, see http://www.mrtrix.org/.
+ */
+
+
+#include "command.h"
+#include "header.h"
+#include "image.h"
+#include "transform.h"
+#include "algo/loop.h"
+#include "registration/warp/compose.h"
+#include "registration/warp/convert.h"
+#include "registration/warp/invert.h"
+
+using namespace MR;
+using namespace App;
+using namespace MR::Registration;
+
+void usage ()
+{
+  AUTHOR = "Max Pietsch (maximilian.pietsch@kcl.ac.uk)";
+  SYNOPSIS = "Verify that composition, conversion and inversion of single-precision "
+             "warp fields match those performed in double precision";
+  REQUIRES_AT_LEAST_ONE_ARGUMENT = false;
+}
+
+
+
+// Maximal discrepancy in mm between single- and double-precision results
+const default_type tolerance = 1e-3;
+
+
+
+Header field_header ()
+{
+  Header H;
+  H.ndim() = 4;
+  H.size(0) = 20; H.size(1) = 18; H.size(2) = 16; H.size(3) = 3;
+  H.spacing(0) = H.spacing(1) = H.spacing(2) = 2.0;
+  H.spacing(3) = 1.0;
+  // Oblique grid, far from the origin, such that positions in scanner space
+  //   are poorly represented in single precision
+  H.transform() = Eigen::AngleAxisd (0.3, Eigen::Vector3d (1.0, 2.0, 3.0).normalized());
+  H.transform().translation() = Eigen::Vector3d (-120.0, 80.0, 150.0);
+  return H;
+}
+
+
+
+// Smooth displacement field, of the given maximal amplitude in mm along each axis
+template <class FieldType>
+void fill (FieldType& field, const default_type amplitude, const default_type phase)
+{
+  for (auto l = Loop (field, 0, 3) (field); l; ++l) {
+    const Eigen::Vector3d p (field.index(0), field.index(1), field.index(2));
+    field.index(3) = 0; field.value() = amplitude * std::sin (0.31 * p[1] + phase) * std::cos (0.17 * p[2]);
+    field.index(3) = 1; field.value() = amplitude * std::sin (0.23 * p[2] + phase) * std::cos (0.29 * p[0]);
+    field.index(3) = 2; field.value() = amplitude * std::sin (0.19 * p[0] + phase) * std::cos (0.37 * p[1]);
+  }
+}
+
+
+
+class Fields
+{ MEMALIGN(Fields)
+  public:
+    Image<double> d;
+    Image<float> f;
+
+    Fields (const Header& H, const std::string& name) :
+        d (Image<double>::scratch (H, name + " (double)")),
+        f (Image<float>::scratch (H, name + " (float)")) { }
+
+    void fill (const default_type amplitude, const default_type phase)
+    {
+      ::fill (d, amplitude, phase);
+      ::fill (f, amplitude, phase);
+    }
+
+    // maximal discrepancy between single- and double-precision fields
+    default_type max_difference ()
+    {
+      default_type result = 0.0;
+      for (auto l = Loop (d, 0, 3) (d, f); l; ++l) {
+        const Eigen::Vector3d a (d.row(3)), b (Eigen::Vector3f (f.row(3)).cast<default_type>());
+        if (a.allFinite() || b.allFinite())
+          result = std::max (result, (a - b).norm());
+      }
+      return result;
+    }
+};
+
+
+
+void run ()
+{
+  vector<std::string> failed_tests;
+  auto test = [&] (const default_type difference, const std::string msg) {
+    if (!(difference < tolerance))
+      failed_tests.push_back (msg + ": maximal difference of " + str(difference) + "mm between single and double precision");
+  };
+
+  const Header H (field_header());
+  Fields disp (H, "displacement"), update (H, "update"), output (H, "output");
+  disp.fill (3.0, 0.0);
+
+  // Composition with a small update, and with an update large enough for
+  //   scaling and squaring to be applied
+  for (const default_type amplitude : { 0.5, 6.0 }) {
+    update.fill (amplitude, 0.7);
+    Warp::update_displacement (disp.d, update.d, output.d, 0.5);
+    Warp::update_displacement (disp.f, update.f, output.f, 0.5);
+    test (output.max_difference(), "Composition of displacement fields with update of amplitude " + str(amplitude));
+    Warp::update_displacement_scaling_and_squaring (disp.d, update.d, output.d, 0.5);
+    Warp::update_displacement_scaling_and_squaring (disp.f, update.f, output.f, 0.5);
+    test (output.max_difference(), "Scaling and squaring composition with update of amplitude " + str(amplitude));
+  }
+
+  // Conversion between displacement and deformation fields
+  Fields deform (H, "deformation");
+  Warp::displacement2deformation (disp.d, deform.d);
+  Warp::displacement2deformation (disp.f, deform.f);
+  test (deform.max_difference(), "Conversion of displacement to deformation");
+  Warp::deformation2displacement (deform.d, output.d);
+  Warp::deformation2displacement (deform.f, output.f);
+  test (output.max_difference(), "Conversion of deformation to displacement");
+
+  // Linear composition
+  transform_type linear;
+  linear = Eigen::AngleAxisd (0.05, Eigen::Vector3d::UnitZ());
+  linear.translation() = Eigen::Vector3d (1.5, -2.0, 0.5);
+  Warp::compose_linear_deformation (linear, deform.d, output.d);
+  Warp::compose_linear_deformation (linear, deform.f, output.f);
+  test (output.max_difference(), "Composition of deformation with linear transform");
+
+  // Inversion, with tight convergence tolerance, such that any difference
+  //   arises from the precision of the fields
+  Fields inverse (H, "inverse");
+  inverse.fill (0.0, 0.0);
+  Warp::invert_displacement (disp.d, inverse.d, 100, 1e-10);
+  Warp::invert_displacement (disp.f, inverse.f, 100, 1e-10);
+  test (inverse.max_difference(), "Inversion of displacement field");
+  Fields inverse_deform (H, "inverse deformation");
+  inverse_deform.fill (0.0, 0.0);
+  Warp::displacement2deformation (inverse_deform.d, inverse_deform.d);
+  Warp::displacement2deformation (inverse_deform.f, inverse_deform.f);
+  Warp::invert_deformation (deform.d, inverse_deform.d, true, 100, 1e-10);
+  Warp::invert_deformation (deform.f, inverse_deform.f, true, 100, 1e-10);
+  test (inverse_deform.max_difference(), "Inversion of deformation field");
+
+  if (failed_tests.size()) {
+    Exception e (str(failed_tests.size()) + " tests of single-precision warp fields failed:");
+    for (auto s : failed_tests)
+      e.push_back (s);
+    throw e;
+  }
+}